@@ -0,0 +1,215 @@
+/*
+ *  Copyright (C) 2026 The v4l-utils authors
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, version 2 of the License.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  async-test checks the asynchronous conversion of libv4lconvert:
+ *  v4lconvert_submit(), v4lconvert_poll_complete() and
+ *  v4lconvert_get_complete_fd().
+ *
+ *  It submits V4LCONVERT_MAX_JOBS yuyv frames with different contents
+ *  using a fake device, checks that one more job gets refused with EAGAIN,
+ *  that the jobs complete in the order they were submitted with the same
+ *  result as v4lconvert_convert(), that the complete fd is only readable
+ *  while there are completed jobs and that the error of a job is reported
+ *  in its completion only.
+ *
+ *  To execute:
+ *             ./async-test
+ */
+
+#include <errno.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "libv4lconvert.h"
+#include "libv4l-plugin.h"
+
+#define WIDTH 64
+#define HEIGHT 48
+#define SRC_SIZE (WIDTH * HEIGHT * 2)
+#define DEST_SIZE (WIDTH * HEIGHT * 3)
+
+static int fake_ioctl(void *dev_ops_priv, int fd, unsigned long cmd, void *arg)
+{
+	struct v4l2_capability *cap = arg;
+
+	if (cmd != VIDIOC_QUERYCAP) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	memset(cap, 0, sizeof(*cap));
+	strcpy((char *)cap->driver, "async-test");
+	strcpy((char *)cap->card, "async-test");
+	strcpy((char *)cap->bus_info, "async-test");
+	cap->capabilities = V4L2_CAP_VIDEO_CAPTURE | V4L2_CAP_STREAMING;
+	return 0;
+}
+
+static struct libv4l_dev_ops fake_dev_ops = {
+	.ioctl = fake_ioctl,
+};
+
+static struct v4l2_format src_fmt, dest_fmt;
+
+static int fail(const char *msg)
+{
+	printf("FAIL: %s\n", msg);
+	return 1;
+}
+
+/* Returns 1 when fd is readable within timeout ms */
+static int readable(int fd, int timeout)
+{
+	struct pollfd pfd;
+
+	pfd.fd = fd;
+	pfd.events = POLLIN;
+	return poll(&pfd, 1, timeout) == 1 && (pfd.revents & POLLIN);
+}
+
+static int test_jobs(struct v4lconvert_data *data)
+{
+	static unsigned char src[V4LCONVERT_MAX_JOBS][SRC_SIZE];
+	static unsigned char dest[V4LCONVERT_MAX_JOBS][DEST_SIZE];
+	static unsigned char ref[V4LCONVERT_MAX_JOBS][DEST_SIZE];
+	struct v4lconvert_completion completion;
+	int i, j, fd, result = 0;
+
+	for (i = 0; i < V4LCONVERT_MAX_JOBS; i++) {
+		for (j = 0; j < SRC_SIZE; j++)
+			src[i][j] = (j * 7 + i * 31) ^ (j >> 5);
+		if (v4lconvert_convert(data, &src_fmt, &dest_fmt, src[i],
+				       SRC_SIZE, ref[i], DEST_SIZE) != DEST_SIZE) {
+			fprintf(stderr, "v4lconvert_convert: %s\n",
+				v4lconvert_get_error_message(data));
+			exit(1);
+		}
+	}
+
+	if (v4lconvert_poll_complete(data, &completion, 0) != 0)
+		result |= fail("completion without jobs");
+
+	fd = v4lconvert_get_complete_fd(data);
+	if (fd == -1) {
+		fprintf(stderr, "v4lconvert_get_complete_fd: %s\n",
+			v4lconvert_get_error_message(data));
+		exit(1);
+	}
+	if (readable(fd, 0))
+		result |= fail("complete fd readable without jobs");
+
+	memset(dest, 0, sizeof(dest));
+	for (i = 0; i < V4LCONVERT_MAX_JOBS; i++)
+		if (v4lconvert_submit(data, &src_fmt, &dest_fmt, src[i],
+				      SRC_SIZE, dest[i], DEST_SIZE, &src[i])) {
+			fprintf(stderr, "v4lconvert_submit: %s\n",
+				v4lconvert_get_error_message(data));
+			exit(1);
+		}
+
+	/* Completed jobs count as pending until they are polled */
+	if (!readable(fd, 5000))
+		result |= fail("complete fd not readable after submit");
+	if (v4lconvert_submit(data, &src_fmt, &dest_fmt, src[0], SRC_SIZE,
+			      dest[0], DEST_SIZE, NULL) != -1 || errno != EAGAIN)
+		result |= fail("job accepted with a full ring");
+
+	for (i = 0; i < V4LCONVERT_MAX_JOBS; i++) {
+		if (v4lconvert_poll_complete(data, &completion, -1) != 1) {
+			result |= fail("job did not complete");
+			break;
+		}
+		if (completion.cookie != &src[i])
+			result |= fail("jobs completed out of order");
+		else if (completion.result != DEST_SIZE)
+			result |= fail("job failed");
+		else if (memcmp(dest[i], ref[i], DEST_SIZE))
+			result |= fail("job result differs from v4lconvert_convert");
+	}
+
+	if (v4lconvert_poll_complete(data, &completion, 0) != 0)
+		result |= fail("completion after all jobs were returned");
+	if (readable(fd, 0))
+		result |= fail("complete fd readable after all jobs were returned");
+
+	printf("%d jobs: %s\n", V4LCONVERT_MAX_JOBS, result ? "FAIL" : "ok");
+
+	return result;
+}
+
+static int test_error(struct v4lconvert_data *data)
+{
+	static unsigned char src[SRC_SIZE], dest[DEST_SIZE];
+	struct v4lconvert_completion completion;
+	char error_msg[V4LCONVERT_ERROR_MSG_SIZE];
+	int result = 0;
+
+	strcpy(error_msg, v4lconvert_get_error_message(data));
+
+	/* A short frame */
+	if (v4lconvert_submit(data, &src_fmt, &dest_fmt, src, SRC_SIZE / 2,
+			      dest, DEST_SIZE, src)) {
+		fprintf(stderr, "v4lconvert_submit: %s\n",
+			v4lconvert_get_error_message(data));
+		exit(1);
+	}
+
+	if (v4lconvert_poll_complete(data, &completion, -1) != 1)
+		result |= fail("job did not complete");
+	else if (completion.result != -1 || completion.error != EPIPE)
+		result |= fail("short frame not reported as EPIPE");
+	else if (!completion.error_msg[0])
+		result |= fail("no error message in the completion");
+
+	if (strcmp(error_msg, v4lconvert_get_error_message(data)))
+		result |= fail("job changed v4lconvert_get_error_message()");
+
+	printf("short frame: %s\n", result ? "FAIL" : "ok");
+
+	return result;
+}
+
+int main(int argc, char *argv[])
+{
+	struct v4lconvert_data *data;
+	int result;
+
+	/* No flipping or other processing */
+	setenv("LIBV4LCONTROL_FLAGS", "0", 1);
+	setenv("LIBV4LCONTROL_CONTROLS", "0", 1);
+
+	data = v4lconvert_create_with_dev_ops(-1, NULL, &fake_dev_ops);
+	if (!data) {
+		fprintf(stderr, "Could not create v4lconvert instance\n");
+		return 1;
+	}
+
+	src_fmt.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+	src_fmt.fmt.pix.width = WIDTH;
+	src_fmt.fmt.pix.height = HEIGHT;
+	src_fmt.fmt.pix.pixelformat = V4L2_PIX_FMT_YUYV;
+	src_fmt.fmt.pix.bytesperline = WIDTH * 2;
+	src_fmt.fmt.pix.sizeimage = SRC_SIZE;
+	dest_fmt = src_fmt;
+	dest_fmt.fmt.pix.pixelformat = V4L2_PIX_FMT_RGB24;
+	dest_fmt.fmt.pix.bytesperline = WIDTH * 3;
+	dest_fmt.fmt.pix.sizeimage = DEST_SIZE;
+
+	result = test_jobs(data);
+	result |= test_error(data);
+
+	v4lconvert_destroy(data);
+
+	return result;
+}
@@ -0,0 +1,745 @@
+/*
+ *  Copyright (C) 2026 The v4l-utils authors
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, version 2 of the License.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  convert-bench measures the throughput of v4lconvert_convert() for every
+ *  src format libv4lconvert supports to every destination format it offers,
+ *  without needing any hardware.
+ *
+ *  The src frames are generated by the test pattern generator also used by
+ *  v4l2-ctl and qv4l2. Src formats it can not generate are made from a frame
+ *  it can generate: the packed and 16 bit bayer and grey formats by packing
+ *  the 8 bit pattern, (M)JPEG by compressing the rgb24 pattern with libjpeg
+ *  and the vendor specific yuv 4:2:0 layouts by taking the planar yuv 4:2:0
+ *  frame as is, which scrambles the picture but does not change the work
+ *  done converting it. The vendor specific compressed formats are excluded,
+ *  these and any other src format which is not benchmarked get printed with
+ *  the reason.
+ *
+ *  Each conversion is done twice: once plain and once with hflip, vflip,
+ *  whitebalance and gamma enabled and the dest 6 pixels narrower than the
+ *  src, so that it gets cropped.
+ *
+ *  For each conversion the time per pixel, the MB of src data converted per
+ *  second and the number of malloc / calloc / realloc calls per frame are
+ *  printed. The allocation count is only available with glibc.
+ *
+ *  To execute:
+ *             ./convert-bench [-f src fourcc] [-d dest fourcc] [-r WxH]
+ *                             [-m min. milliseconds per conversion]
+ *
+ *  Setting the LIBV4LCONVERT_CPU_FLAGS environment variable to 0 allows
+ *  benchmarking the plain C code, see lib/libv4lconvert/cpu.c
+ */
+
+#include <config.h>
+#include <errno.h>
+#include <getopt.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#ifdef HAVE_JPEG
+#include <jpeglib.h>
+#endif
+
+#include "libv4lconvert.h"
+#include "v4l2-tpg.h"
+#include "../../lib/libv4lconvert/control/libv4lcontrol.h"
+
+#define ARRAY_SIZE(x) (sizeof(x) / sizeof((x)[0]))
+
+/* The src formats of lib/libv4lconvert/libv4lconvert.c supported_src_pixfmts,
+   keep this in sync with it */
+static const unsigned int src_pixfmts[] = {
+	V4L2_PIX_FMT_RGB24, V4L2_PIX_FMT_BGR24,
+	V4L2_PIX_FMT_YUV420, V4L2_PIX_FMT_YVU420,
+	V4L2_PIX_FMT_NV12, V4L2_PIX_FMT_YUYV,
+	V4L2_PIX_FMT_XRGB32, V4L2_PIX_FMT_ARGB32,
+	V4L2_PIX_FMT_GREY,
+	V4L2_PIX_FMT_RGB565, V4L2_PIX_FMT_BGR32,
+	V4L2_PIX_FMT_RGB32, V4L2_PIX_FMT_XBGR32,
+	V4L2_PIX_FMT_ABGR32,
+	V4L2_PIX_FMT_YVYU, V4L2_PIX_FMT_UYVY,
+	V4L2_PIX_FMT_NV16, V4L2_PIX_FMT_NV61,
+	V4L2_PIX_FMT_NV21, V4L2_PIX_FMT_SPCA501,
+	V4L2_PIX_FMT_SPCA505, V4L2_PIX_FMT_SPCA508,
+	V4L2_PIX_FMT_CIT_YYVYUY, V4L2_PIX_FMT_KONICA420,
+	V4L2_PIX_FMT_SN9C20X_I420, V4L2_PIX_FMT_M420,
+	V4L2_PIX_FMT_HM12, V4L2_PIX_FMT_CPIA1,
+	V4L2_PIX_FMT_NV24, V4L2_PIX_FMT_NV42,
+	V4L2_PIX_FMT_NV12M, V4L2_PIX_FMT_NV21M,
+	V4L2_PIX_FMT_YUV420M, V4L2_PIX_FMT_YVU420M,
+	V4L2_PIX_FMT_MJPEG, V4L2_PIX_FMT_JPEG,
+	V4L2_PIX_FMT_PJPG, V4L2_PIX_FMT_JPGL,
+	V4L2_PIX_FMT_OV511, V4L2_PIX_FMT_OV518,
+	V4L2_PIX_FMT_SBGGR8, V4L2_PIX_FMT_SGBRG8,
+	V4L2_PIX_FMT_SGRBG8, V4L2_PIX_FMT_SRGGB8,
+	V4L2_PIX_FMT_STV0680,
+	V4L2_PIX_FMT_SBGGR10, V4L2_PIX_FMT_SGBRG10,
+	V4L2_PIX_FMT_SGRBG10, V4L2_PIX_FMT_SRGGB10,
+	V4L2_PIX_FMT_SBGGR10P, V4L2_PIX_FMT_SGBRG10P,
+	V4L2_PIX_FMT_SGRBG10P, V4L2_PIX_FMT_SRGGB10P,
+	V4L2_PIX_FMT_SBGGR12, V4L2_PIX_FMT_SGBRG12,
+	V4L2_PIX_FMT_SGRBG12, V4L2_PIX_FMT_SRGGB12,
+	V4L2_PIX_FMT_SBGGR12P, V4L2_PIX_FMT_SGBRG12P,
+	V4L2_PIX_FMT_SGRBG12P, V4L2_PIX_FMT_SRGGB12P,
+	V4L2_PIX_FMT_SBGGR16, V4L2_PIX_FMT_SGBRG16,
+	V4L2_PIX_FMT_SGRBG16, V4L2_PIX_FMT_SRGGB16,
+	V4L2_PIX_FMT_SPCA561, V4L2_PIX_FMT_SN9C10X,
+	V4L2_PIX_FMT_SN9C2028, V4L2_PIX_FMT_PAC207,
+	V4L2_PIX_FMT_MR97310A, V4L2_PIX_FMT_JL2005BCD,
+	V4L2_PIX_FMT_SQ905C, V4L2_PIX_FMT_SE401,
+	V4L2_PIX_FMT_Y4, V4L2_PIX_FMT_Y6,
+	V4L2_PIX_FMT_Y10BPACK, V4L2_PIX_FMT_Y16,
+	V4L2_PIX_FMT_Y16_BE,
+	V4L2_PIX_FMT_HSV32, V4L2_PIX_FMT_HSV24,
+};
+
+/* Src formats the tpg can not generate, made from a frame in the from
+   format, see derive() */
+static const struct {
+	unsigned int pixfmt;
+	unsigned int from;
+} derived_pixfmts[] = {
+	{ V4L2_PIX_FMT_MJPEG,		V4L2_PIX_FMT_RGB24 },
+	{ V4L2_PIX_FMT_JPEG,		V4L2_PIX_FMT_RGB24 },
+	{ V4L2_PIX_FMT_SPCA501,		V4L2_PIX_FMT_YUV420 },
+	{ V4L2_PIX_FMT_SPCA505,		V4L2_PIX_FMT_YUV420 },
+	{ V4L2_PIX_FMT_SPCA508,		V4L2_PIX_FMT_YUV420 },
+	{ V4L2_PIX_FMT_CIT_YYVYUY,	V4L2_PIX_FMT_YUV420 },
+	{ V4L2_PIX_FMT_KONICA420,	V4L2_PIX_FMT_YUV420 },
+	{ V4L2_PIX_FMT_SN9C20X_I420,	V4L2_PIX_FMT_YUV420 },
+	{ V4L2_PIX_FMT_M420,		V4L2_PIX_FMT_YUV420 },
+	{ V4L2_PIX_FMT_HM12,		V4L2_PIX_FMT_YUV420 },
+	{ V4L2_PIX_FMT_STV0680,		V4L2_PIX_FMT_SRGGB8 },
+	{ V4L2_PIX_FMT_SBGGR10P,	V4L2_PIX_FMT_SBGGR8 },
+	{ V4L2_PIX_FMT_SGBRG10P,	V4L2_PIX_FMT_SGBRG8 },
+	{ V4L2_PIX_FMT_SGRBG10P,	V4L2_PIX_FMT_SGRBG8 },
+	{ V4L2_PIX_FMT_SRGGB10P,	V4L2_PIX_FMT_SRGGB8 },
+	{ V4L2_PIX_FMT_SBGGR12P,	V4L2_PIX_FMT_SBGGR8 },
+	{ V4L2_PIX_FMT_SGBRG12P,	V4L2_PIX_FMT_SGBRG8 },
+	{ V4L2_PIX_FMT_SGRBG12P,	V4L2_PIX_FMT_SGRBG8 },
+	{ V4L2_PIX_FMT_SRGGB12P,	V4L2_PIX_FMT_SRGGB8 },
+	{ V4L2_PIX_FMT_SBGGR16,		V4L2_PIX_FMT_SBGGR8 },
+	{ V4L2_PIX_FMT_SGBRG16,		V4L2_PIX_FMT_SGBRG8 },
+	{ V4L2_PIX_FMT_SGRBG16,		V4L2_PIX_FMT_SGRBG8 },
+	{ V4L2_PIX_FMT_SRGGB16,		V4L2_PIX_FMT_SRGGB8 },
+	{ V4L2_PIX_FMT_Y4,		V4L2_PIX_FMT_GREY },
+	{ V4L2_PIX_FMT_Y6,		V4L2_PIX_FMT_GREY },
+	{ V4L2_PIX_FMT_Y10BPACK,	V4L2_PIX_FMT_GREY },
+};
+
+/* Src formats which are not benchmarked */
+static const struct {
+	unsigned int pixfmt;
+	const char *reason;
+} excluded_pixfmts[] = {
+	{ V4L2_PIX_FMT_CPIA1,	  "vendor specific compression, no encoder" },
+	{ V4L2_PIX_FMT_PJPG,	  "vendor specific jpeg variant, no encoder" },
+	{ V4L2_PIX_FMT_JPGL,	  "vendor specific jpeg variant, no encoder" },
+	{ V4L2_PIX_FMT_OV511,	  "vendor specific compression, no encoder" },
+	{ V4L2_PIX_FMT_OV518,	  "vendor specific compression, no encoder" },
+	{ V4L2_PIX_FMT_SPCA561,	  "vendor specific compression, no encoder" },
+	{ V4L2_PIX_FMT_SN9C10X,	  "vendor specific compression, no encoder" },
+	{ V4L2_PIX_FMT_SN9C2028,  "vendor specific compression, no encoder" },
+	{ V4L2_PIX_FMT_PAC207,	  "vendor specific compression, no encoder" },
+	{ V4L2_PIX_FMT_MR97310A,  "vendor specific compression, no encoder" },
+	{ V4L2_PIX_FMT_JL2005BCD, "vendor specific compression, no encoder" },
+	{ V4L2_PIX_FMT_SQ905C,	  "vendor specific compression, no encoder" },
+	{ V4L2_PIX_FMT_SE401,	  "vendor specific compression, no encoder" },
+};
+
+/* SUPPORTED_DST_PIXFMTS of lib/libv4lconvert/libv4lconvert.c */
+static const struct {
+	unsigned int pixfmt;
+	int bpp;
+	int planar;
+} dest_pixfmts[] = {
+	{ V4L2_PIX_FMT_RGB24,	24, 0 },
+	{ V4L2_PIX_FMT_BGR24,	24, 0 },
+	{ V4L2_PIX_FMT_YUV420,	12, 1 },
+	{ V4L2_PIX_FMT_YVU420,	12, 1 },
+	{ V4L2_PIX_FMT_NV12,	12, 1 },
+	{ V4L2_PIX_FMT_YUYV,	16, 0 },
+	{ V4L2_PIX_FMT_XRGB32,	32, 0 },
+	{ V4L2_PIX_FMT_ARGB32,	32, 0 },
+	{ V4L2_PIX_FMT_GREY,	 8, 1 },
+};
+
+static const int default_sizes[][2] = {
+	{ 640, 480 }, { 1280, 720 }, { 1920, 1080 }
+};
+
+#if defined(__GLIBC__) && !defined(__SANITIZE_ADDRESS__)
+/* Count the allocations done by libv4lconvert, by interposing the glibc
+   malloc functions. This does not work together with AddressSanitizer,
+   which brings its own malloc */
+extern void *__libc_malloc(size_t size);
+extern void *__libc_calloc(size_t nmemb, size_t size);
+extern void *__libc_realloc(void *ptr, size_t size);
+
+static unsigned long allocations;
+
+void *malloc(size_t size)
+{
+	__sync_fetch_and_add(&allocations, 1);
+	return __libc_malloc(size);
+}
+
+void *calloc(size_t nmemb, size_t size)
+{
+	__sync_fetch_and_add(&allocations, 1);
+	return __libc_calloc(nmemb, size);
+}
+
+void *realloc(void *ptr, size_t size)
+{
+	__sync_fetch_and_add(&allocations, 1);
+	return __libc_realloc(ptr, size);
+}
+#define HAVE_ALLOCATION_COUNT 1
+#else
+static unsigned long allocations;
+#define HAVE_ALLOCATION_COUNT 0
+#endif
+
+static int fake_ioctl(void *dev_ops_priv, int fd, unsigned long cmd, void *arg)
+{
+	struct v4l2_capability *cap = arg;
+
+	if (cmd != VIDIOC_QUERYCAP) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	memset(cap, 0, sizeof(*cap));
+	strcpy((char *)cap->driver, "convert-bench");
+	strcpy((char *)cap->card, "convert-bench");
+	strcpy((char *)cap->bus_info, "convert-bench");
+	cap->capabilities = V4L2_CAP_VIDEO_CAPTURE | V4L2_CAP_STREAMING;
+	return 0;
+}
+
+static struct libv4l_dev_ops fake_dev_ops = {
+	.ioctl = fake_ioctl,
+};
+
+static void fcc2s(unsigned int fcc, char *buf)
+{
+	int i;
+
+	for (i = 0; i < 4; i++)
+		buf[i] = (fcc >> (8 * i)) & 0x7f;
+	strcpy(buf + 4, (fcc & (1U << 31)) ? "-BE" : "");
+}
+
+static unsigned int s2fcc(const char *s)
+{
+	char buf[4] = { ' ', ' ', ' ', ' ' };
+
+	memcpy(buf, s, strnlen(s, 4));
+	return v4l2_fourcc(buf[0], buf[1], buf[2], buf[3]);
+}
+
+static struct v4lconvert_data *create(int process)
+{
+	struct v4lconvert_data *data;
+	struct v4l2_control ctrl;
+	char buf[32];
+
+	setenv("LIBV4LCONTROL_FLAGS", "0", 1);
+	snprintf(buf, sizeof(buf), "%d", process ?
+		 (1 << V4LCONTROL_WHITEBALANCE) | (1 << V4LCONTROL_HFLIP) |
+		 (1 << V4LCONTROL_VFLIP) | (1 << V4LCONTROL_GAMMA) : 0);
+	setenv("LIBV4LCONTROL_CONTROLS", buf, 1);
+
+	data = v4lconvert_create_with_dev_ops(-1, NULL, &fake_dev_ops);
+	if (!data) {
+		fprintf(stderr, "Could not create v4lconvert instance\n");
+		exit(1);
+	}
+
+	if (process) {
+		ctrl.id = V4L2_CID_HFLIP;
+		ctrl.value = 1;
+		v4lconvert_vidioc_s_ctrl(data, &ctrl);
+		ctrl.id = V4L2_CID_VFLIP;
+		v4lconvert_vidioc_s_ctrl(data, &ctrl);
+		ctrl.id = V4L2_CID_AUTO_WHITE_BALANCE;
+		v4lconvert_vidioc_s_ctrl(data, &ctrl);
+		ctrl.id = V4L2_CID_GAMMA;
+		ctrl.value = 1500;
+		v4lconvert_vidioc_s_ctrl(data, &ctrl);
+	}
+
+	return data;
+}
+
+static double now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000.0 + ts.tv_nsec / 1000000.0;
+}
+
+/* Generate a width x height frame in pixfmt, with all planes in a single
+   buffer. Returns NULL if the tpg can not generate pixfmt */
+static unsigned char *generate(unsigned int pixfmt, int width, int height,
+		struct v4l2_format *fmt)
+{
+	struct tpg_data tpg;
+	unsigned char *buf;
+	unsigned int p, size = 0;
+
+	tpg_init(&tpg, width, height);
+	if (tpg_alloc(&tpg, width)) {
+		fprintf(stderr, "Out of memory\n");
+		exit(1);
+	}
+
+	if (!tpg_s_fourcc(&tpg, pixfmt)) {
+		tpg_free(&tpg);
+		return NULL;
+	}
+	tpg_reset_source(&tpg, width, height, V4L2_FIELD_NONE);
+	tpg_s_colorspace(&tpg, V4L2_COLORSPACE_SRGB);
+
+	for (p = 0; p < tpg_g_planes(&tpg); p++)
+		size += tpg_calc_plane_size(&tpg, p);
+
+	buf = malloc(size);
+	if (!buf) {
+		fprintf(stderr, "Out of memory\n");
+		exit(1);
+	}
+
+	size = 0;
+	for (p = 0; p < tpg_g_planes(&tpg); p++) {
+		tpg_fill_plane_buffer(&tpg, 0, p, buf + size);
+		size += tpg_calc_plane_size(&tpg, p);
+	}
+
+	memset(fmt, 0, sizeof(*fmt));
+	fmt->type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+	fmt->fmt.pix.width = width;
+	fmt->fmt.pix.height = height;
+	fmt->fmt.pix.pixelformat = pixfmt;
+	fmt->fmt.pix.field = V4L2_FIELD_NONE;
+	fmt->fmt.pix.bytesperline = tpg_g_bytesperline(&tpg, 0);
+	fmt->fmt.pix.sizeimage = size;
+
+	tpg_free(&tpg);
+	return buf;
+}
+
+static unsigned char *alloc_frame(int size)
+{
+	unsigned char *buf = calloc(1, size);
+
+	if (!buf) {
+		fprintf(stderr, "Out of memory\n");
+		exit(1);
+	}
+	return buf;
+}
+
+/* Pack an 8 bit bayer frame as 10 or 12 bit MIPI packed or 16 bit little
+   endian bayer, the added low bits are the top bits of the 8 bit pixel so
+   that the full range gets used */
+static unsigned char *pack_bayer(const unsigned char *src, int width,
+		int height, int bits, int *line_size)
+{
+	unsigned char *buf, *d;
+	int x, y, i;
+
+	switch (bits) {
+	case 10:
+		*line_size = (width + 3) / 4 * 5;
+		break;
+	case 12:
+		*line_size = (width + 1) / 2 * 3;
+		break;
+	default:
+		*line_size = width * 2;
+	}
+	buf = alloc_frame(*line_size * height);
+
+	for (y = 0; y < height; y++) {
+		d = buf + y * *line_size;
+		switch (bits) {
+		case 10:
+			for (x = 0; x < width; x += 4, d += 5)
+				for (i = 0; i < 4 && x + i < width; i++) {
+					d[i] = src[x + i];
+					d[4] |= (src[x + i] >> 6) << (2 * i);
+				}
+			break;
+		case 12:
+			for (x = 0; x < width; x += 2, d += 3)
+				for (i = 0; i < 2 && x + i < width; i++) {
+					d[i] = src[x + i];
+					d[2] |= (src[x + i] >> 4) << (4 * i);
+				}
+			break;
+		default:
+			for (x = 0; x < width; x++) {
+				d[2 * x] = src[x];
+				d[2 * x + 1] = src[x];
+			}
+		}
+		src += width;
+	}
+
+	return buf;
+}
+
+/* Pack an 8 bit grey frame as 10 bit big endian bit stream */
+static unsigned char *pack_y10b(const unsigned char *src, int pixels,
+		int *size)
+{
+	unsigned char *buf, *d;
+	unsigned int bits = 0;
+	int i, n = 0;
+
+	*size = (pixels * 10 + 7) / 8;
+	buf = d = alloc_frame(*size);
+
+	for (i = 0; i < pixels; i++) {
+		bits = (bits << 10) | (src[i] << 2) | (src[i] >> 6);
+		n += 10;
+		while (n >= 8) {
+			n -= 8;
+			*d++ = bits >> n;
+		}
+	}
+	if (n)
+		*d = bits << (8 - n);
+
+	return buf;
+}
+
+#ifdef HAVE_JPEG
+static unsigned char *compress_jpeg(const unsigned char *src, int width,
+		int height, int *size)
+{
+	struct jpeg_compress_struct cinfo;
+	struct jpeg_error_mgr jerr;
+	unsigned char *buf = NULL;
+	unsigned long buf_size = 0;
+	JSAMPROW row;
+
+	cinfo.err = jpeg_std_error(&jerr);
+	jpeg_create_compress(&cinfo);
+	jpeg_mem_dest(&cinfo, &buf, &buf_size);
+
+	cinfo.image_width = width;
+	cinfo.image_height = height;
+	cinfo.input_components = 3;
+	cinfo.in_color_space = JCS_RGB;
+	jpeg_set_defaults(&cinfo);
+	jpeg_set_quality(&cinfo, 85, TRUE);
+	/* yuv 4:2:2 like webcams send */
+	cinfo.comp_info[0].v_samp_factor = 1;
+
+	jpeg_start_compress(&cinfo, TRUE);
+	while (cinfo.next_scanline < cinfo.image_height) {
+		row = (JSAMPROW)(src + cinfo.next_scanline * width * 3);
+		jpeg_write_scanlines(&cinfo, &row, 1);
+	}
+	jpeg_finish_compress(&cinfo);
+	jpeg_destroy_compress(&cinfo);
+
+	*size = buf_size;
+	return buf;
+}
+#endif
+
+/* Make a width x height frame in pixfmt from one in from generated by the
+   tpg. Returns NULL with the reason in *reason if it can not be made */
+static unsigned char *derive(unsigned int pixfmt, unsigned int from,
+		int width, int height, struct v4l2_format *fmt,
+		const char **reason)
+{
+	unsigned char *src, *buf;
+	int i, size, line_size = 0;
+
+	switch (pixfmt) {
+	case V4L2_PIX_FMT_MJPEG:
+	case V4L2_PIX_FMT_JPEG:
+#ifndef HAVE_JPEG
+		*reason = "generating it needs libjpeg";
+		return NULL;
+#endif
+		/* fall through */
+	case V4L2_PIX_FMT_SPCA501:
+	case V4L2_PIX_FMT_SPCA505:
+	case V4L2_PIX_FMT_SPCA508:
+	case V4L2_PIX_FMT_CIT_YYVYUY:
+	case V4L2_PIX_FMT_KONICA420:
+	case V4L2_PIX_FMT_SN9C20X_I420:
+	case V4L2_PIX_FMT_M420:
+		/* These come in blocks of up to 16x8 pixels, jpeg in 4:2:2
+		   mcus of 16x8 pixels */
+		if (width % 16 || height % 8) {
+			*reason = "needs a multiple of 16 as width and of 8 as height";
+			return NULL;
+		}
+		break;
+	case V4L2_PIX_FMT_HM12:
+		/* The decoder uses the fixed line stride of the cx2341x */
+		if (width > 720) {
+			*reason = "hm12 frames are at most 720 pixels wide";
+			return NULL;
+		}
+		if (width % 16 || height % 16) {
+			*reason = "needs a multiple of 16 as width and height";
+			return NULL;
+		}
+		break;
+	}
+
+	src = generate(from, width, height, fmt);
+	if (!src) {
+		*reason = "can not be generated";
+		return NULL;
+	}
+	size = fmt->fmt.pix.sizeimage;
+
+	switch (pixfmt) {
+#ifdef HAVE_JPEG
+	case V4L2_PIX_FMT_MJPEG:
+	case V4L2_PIX_FMT_JPEG:
+		buf = compress_jpeg(src, width, height, &size);
+		break;
+#endif
+	case V4L2_PIX_FMT_HM12:
+		/* Planar yuv 4:2:0 padded to the cx2341x line stride */
+		size = 720 * height * 3 / 2;
+		buf = alloc_frame(size);
+		memcpy(buf, src, fmt->fmt.pix.sizeimage);
+		line_size = 720;
+		break;
+	case V4L2_PIX_FMT_SBGGR10P:
+	case V4L2_PIX_FMT_SGBRG10P:
+	case V4L2_PIX_FMT_SGRBG10P:
+	case V4L2_PIX_FMT_SRGGB10P:
+		buf = pack_bayer(src, width, height, 10, &line_size);
+		size = line_size * height;
+		break;
+	case V4L2_PIX_FMT_SBGGR12P:
+	case V4L2_PIX_FMT_SGBRG12P:
+	case V4L2_PIX_FMT_SGRBG12P:
+	case V4L2_PIX_FMT_SRGGB12P:
+		buf = pack_bayer(src, width, height, 12, &line_size);
+		size = line_size * height;
+		break;
+	case V4L2_PIX_FMT_SBGGR16:
+	case V4L2_PIX_FMT_SGBRG16:
+	case V4L2_PIX_FMT_SGRBG16:
+	case V4L2_PIX_FMT_SRGGB16:
+		buf = pack_bayer(src, width, height, 16, &line_size);
+		size = line_size * height;
+		break;
+	case V4L2_PIX_FMT_Y10BPACK:
+		buf = pack_y10b(src, width * height, &size);
+		line_size = width * 10 / 8;
+		break;
+	case V4L2_PIX_FMT_Y4:
+	case V4L2_PIX_FMT_Y6:
+		/* The pixels are in the top bits of a byte each */
+		for (i = 0; i < size; i++)
+			src[i] &= pixfmt == V4L2_PIX_FMT_Y4 ? 0xf0 : 0xfc;
+		/* fall through */
+	default:
+		/* The vendor specific yuv 4:2:0 layouts and stv0680 bayer
+		   take the frame as is */
+		fmt->fmt.pix.pixelformat = pixfmt;
+		return src;
+	}
+
+	free(src);
+	fmt->fmt.pix.pixelformat = pixfmt;
+	fmt->fmt.pix.bytesperline = line_size;
+	fmt->fmt.pix.sizeimage = size;
+	return buf;
+}
+
+/* Convert src to dest_pixfmt for at least min_time ms, returns 0 when the
+   conversion is not supported */
+static int bench(struct v4lconvert_data *data, const struct v4l2_format *src_fmt,
+		unsigned char *src, int dest_idx, int process, double min_time)
+{
+	struct v4l2_format dest_fmt = *src_fmt;
+	int bpp = dest_pixfmts[dest_idx].bpp;
+	int width = src_fmt->fmt.pix.width - (process ? 6 : 0);
+	int height = src_fmt->fmt.pix.height;
+	int size = width * height * bpp / 8;
+	unsigned char *dest = malloc(size);
+	char src_s[8], dest_s[8], res_s[16];
+	double start, elapsed;
+	unsigned long allocs;
+	int frames = 0;
+
+	if (!dest) {
+		fprintf(stderr, "Out of memory\n");
+		exit(1);
+	}
+
+	dest_fmt.fmt.pix.pixelformat = dest_pixfmts[dest_idx].pixfmt;
+	dest_fmt.fmt.pix.width = width;
+	dest_fmt.fmt.pix.bytesperline = dest_pixfmts[dest_idx].planar ?
+					width : width * bpp / 8;
+	dest_fmt.fmt.pix.sizeimage = size;
+
+	fcc2s(src_fmt->fmt.pix.pixelformat, src_s);
+	fcc2s(dest_fmt.fmt.pix.pixelformat, dest_s);
+	snprintf(res_s, sizeof(res_s), "%dx%d", src_fmt->fmt.pix.width, height);
+
+	/* Once without timing it, so that libv4lconvert allocates its
+	   buffers and both src and dest are paged in */
+	if (v4lconvert_convert(data, src_fmt, &dest_fmt, src,
+			       src_fmt->fmt.pix.sizeimage, dest, size) < 0) {
+		printf("%-7s -> %-7s %9s %-7s: %s\n", src_s, dest_s, res_s,
+		       process ? "process" : "plain",
+		       v4lconvert_get_error_message(data));
+		free(dest);
+		return 1;
+	}
+
+	allocs = allocations;
+	start = now();
+	do {
+		v4lconvert_convert(data, src_fmt, &dest_fmt, src,
+				   src_fmt->fmt.pix.sizeimage, dest, size);
+		frames++;
+		elapsed = now() - start;
+	} while (elapsed < min_time || frames < 3);
+	allocs = allocations - allocs;
+
+	printf("%-7s -> %-7s %9s %-7s: %7.2f ns/pixel %8.1f MB/s",
+	       src_s, dest_s, res_s, process ? "process" : "plain",
+	       elapsed * 1000000.0 / frames /
+	       (src_fmt->fmt.pix.width * height),
+	       src_fmt->fmt.pix.sizeimage * frames / elapsed / 1000.0);
+	if (HAVE_ALLOCATION_COUNT)
+		printf(" %6.2f allocs/frame", (double)allocs / frames);
+	printf("\n");
+
+	free(dest);
+	return 0;
+}
+
+static void usage(const char *name)
+{
+	fprintf(stderr, "Usage: %s [-f src fourcc] [-d dest fourcc] [-r WxH] "
+		"[-m min. ms per conversion]\n", name);
+	exit(1);
+}
+
+int main(int argc, char *argv[])
+{
+	struct v4lconvert_data *data[2];
+	unsigned int src_filter = 0, dest_filter = 0;
+	int sizes[ARRAY_SIZE(default_sizes)][2];
+	unsigned int i, k, l;
+	int j, process, no_sizes = 0, failures = 0;
+	double min_time = 20;
+	char src_s[8];
+
+	while ((i = getopt(argc, argv, "f:d:r:m:")) != -1) {
+		switch (i) {
+		case 'f':
+			src_filter = s2fcc(optarg);
+			break;
+		case 'd':
+			dest_filter = s2fcc(optarg);
+			break;
+		case 'r':
+			if (sscanf(optarg, "%dx%d", &sizes[0][0],
+				   &sizes[0][1]) != 2 ||
+			    sizes[0][0] < 16 || sizes[0][1] < 16)
+				usage(argv[0]);
+			no_sizes = 1;
+			break;
+		case 'm':
+			min_time = atof(optarg);
+			break;
+		default:
+			usage(argv[0]);
+		}
+	}
+
+	if (!no_sizes) {
+		memcpy(sizes, default_sizes, sizeof(sizes));
+		no_sizes = ARRAY_SIZE(default_sizes);
+	}
+
+	for (process = 0; process < 2; process++)
+		data[process] = create(process);
+
+	for (i = 0; i < ARRAY_SIZE(src_pixfmts); i++) {
+		if (src_filter && src_pixfmts[i] != src_filter)
+			continue;
+
+		fcc2s(src_pixfmts[i], src_s);
+		for (l = 0; l < ARRAY_SIZE(excluded_pixfmts); l++)
+			if (excluded_pixfmts[l].pixfmt == src_pixfmts[i])
+				break;
+		if (l < ARRAY_SIZE(excluded_pixfmts)) {
+			printf("%-7s: excluded, %s\n", src_s,
+			       excluded_pixfmts[l].reason);
+			continue;
+		}
+
+		for (l = 0; l < ARRAY_SIZE(derived_pixfmts); l++)
+			if (derived_pixfmts[l].pixfmt == src_pixfmts[i])
+				break;
+
+		for (j = 0; j < no_sizes; j++) {
+			const char *reason = "can not be generated";
+			struct v4l2_format src_fmt;
+			unsigned char *src;
+
+			if (l < ARRAY_SIZE(derived_pixfmts))
+				src = derive(src_pixfmts[i],
+					     derived_pixfmts[l].from,
+					     sizes[j][0], sizes[j][1],
+					     &src_fmt, &reason);
+			else
+				src = generate(src_pixfmts[i], sizes[j][0],
+					       sizes[j][1], &src_fmt);
+			if (!src) {
+				printf("%-7s %4dx%-4d: excluded, %s\n", src_s,
+				       sizes[j][0], sizes[j][1], reason);
+				continue;
+			}
+
+			for (k = 0; k < ARRAY_SIZE(dest_pixfmts); k++) {
+				if (dest_filter &&
+				    dest_pixfmts[k].pixfmt != dest_filter)
+					continue;
+				for (process = 0; process < 2; process++)
+					failures += bench(data[process],
+							  &src_fmt, src, k,
+							  process, min_time);
+			}
+
+			free(src);
+		}
+	}
+
+	for (process = 0; process < 2; process++)
+		v4lconvert_destroy(data[process]);
+
+	return failures ? 1 : 0;
+}
@@ -0,0 +1,216 @@
+/*
+ *  Copyright (C) 2026 The v4l-utils authors
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, version 2 of the License.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  idct-test compares the integer IDCT used by tinyjpeg (plain C and
+ *  SIMD versions) with the floating point IDCT it used before.
+ *
+ *  Random 8x8 blocks of pixels get transformed with an exact forward DCT
+ *  and quantized with a number of quantization tables, after which the
+ *  different IDCTs must give:
+ *  - the exact same result for the plain C and the SIMD integer IDCT
+ *  - the exact same result for the dc only shortcut and the full IDCT
+ *  - results within 1 of the floating point IDCT
+ *
+ *  After that blocks with random, out of spec, coefficients and quantization
+ *  values, as found in corrupt frames, go through the reduced size IDCTs,
+ *  blocks with a huge DC coefficient must saturate. Build with
+ *  -fsanitize=undefined to also check these for overflows.
+ *
+ *  To execute:
+ *             ./idct-test [number of blocks]
+ *
+ *  Setting the LIBV4LCONVERT_CPU_FLAGS environment variable allows
+ *  selecting which SIMD version gets tested, see lib/libv4lconvert/cpu.c
+ */
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "../../lib/libv4lconvert/libv4lconvert-priv.h"
+#include "../../lib/libv4lconvert/tinyjpeg-internal.h"
+
+/* Example luminance table from the JPEG spec, in natural order */
+static const int16_t std_luminance[64] = {
+	16, 11, 10, 16,  24,  40,  51,  61,
+	12, 12, 14, 19,  26,  58,  60,  55,
+	14, 13, 16, 24,  40,  57,  69,  56,
+	14, 17, 22, 29,  51,  87,  80,  62,
+	18, 22, 37, 56,  68, 109, 103,  77,
+	24, 35, 55, 64,  81, 104, 113,  92,
+	49, 64, 78, 87, 103, 121, 120, 101,
+	72, 92, 95, 98, 112, 100, 103,  99
+};
+
+static void fdct(const int *pixels, double *coefs)
+{
+	int u, v, x, y;
+
+	for (v = 0; v < 8; v++)
+		for (u = 0; u < 8; u++) {
+			double sum = 0;
+
+			for (y = 0; y < 8; y++)
+				for (x = 0; x < 8; x++)
+					sum += pixels[y * 8 + x] *
+						cos((2 * x + 1) * u * M_PI / 16) *
+						cos((2 * y + 1) * v * M_PI / 16);
+			sum /= 4;
+			if (u == 0)
+				sum *= M_SQRT1_2;
+			if (v == 0)
+				sum *= M_SQRT1_2;
+			coefs[v * 8 + u] = sum;
+		}
+}
+
+/* Pixels in the range [-range, range - 1], smoothed with the previous pixel
+   smooth times, to get something looking a bit more like real image data */
+static void random_block(int *pixels, int range, int smooth)
+{
+	int i, j;
+
+	for (i = 0; i < 64; i++)
+		pixels[i] = rand() % (2 * range) - range;
+
+	for (j = 0; j < smooth; j++)
+		for (i = 1; i < 64; i++)
+			pixels[i] = (pixels[i] + pixels[i - 1]) / 2;
+}
+
+/* Blocks of a corrupt frame, returns the number of blocks with a huge DC
+   coefficient, which did not saturate */
+static int corrupt_blocks(int blocks)
+{
+	static const int scales[] = { 2, 4, 8 };
+	int16_t qtable[64];
+	struct component comp;
+	uint8_t out[64];
+	int i, j, s, size, errors = 0;
+
+	for (i = 0; i < blocks; i++) {
+		memset(&comp, 0, sizeof(comp));
+		comp.Q_table = qtable;
+		for (j = 0; j < 64; j++) {
+			comp.DCT[j] = (int16_t)rand();
+			qtable[j] = rand() % 32767 + 1;
+		}
+		/* Every other block has a huge DC coefficient, with AC
+		   coefficients which are too small to matter */
+		if (i & 1) {
+			comp.DCT[0] = (i & 2) ? 32767 : -32768;
+			qtable[0] = 32767;
+			for (j = 1; j < 64; j++)
+				comp.DCT[j] = comp.DCT[j] % 16;
+		}
+
+		for (s = 0; s < 3; s++) {
+			size = 8 / scales[s];
+			tinyjpeg_idct_int_scaled(&comp, out, size, scales[s]);
+			if (!(i & 1))
+				continue;
+			for (j = 0; j < size * size; j++)
+				if (out[j] != ((i & 2) ? 255 : 0))
+					break;
+			if (j != size * size)
+				errors++;
+		}
+	}
+
+	return errors;
+}
+
+int main(int argc, char *argv[])
+{
+	int blocks = argc > 1 ? atoi(argv[1]) : 100000;
+	int cpu_flags = v4lconvert_get_cpu_flags();
+	int i, j, t, dc_only, diff, max_diff = 0, off_by_1 = 0;
+	int dc_only_blocks = 0, simd_errors = 0, dc_only_errors = 0;
+	int float_errors = 0, corrupt_errors;
+	int16_t qtables[4][64];
+	float fqtable[64];
+	struct component comp;
+	uint8_t out_float[64], out_c[64], out_simd[64], out_dc[64];
+	int pixels[64];
+	double coefs[64];
+
+	for (i = 0; i < 64; i++) {
+		qtables[0][i] = 1;
+		qtables[1][i] = (std_luminance[i] + 1) / 2;
+		qtables[2][i] = std_luminance[i];
+		qtables[3][i] = std_luminance[i] * 3;
+	}
+
+	srand(1);
+	for (i = 0; i < blocks; i++) {
+		t = i % 4;
+		random_block(pixels, (i & 4) ? 128 : 8, (i >> 3) % 4);
+		fdct(pixels, coefs);
+
+		memset(&comp, 0, sizeof(comp));
+		comp.Q_table = qtables[t];
+		dc_only = 1;
+		for (j = 0; j < 64; j++) {
+			comp.DCT[j] = lrint(coefs[j] / qtables[t][j]);
+			if (j && comp.DCT[j])
+				dc_only = 0;
+		}
+
+		tinyjpeg_idct_float_qtable(fqtable, qtables[t]);
+		tinyjpeg_idct_float(comp.DCT, fqtable, out_float, 8);
+		tinyjpeg_idct_int(&comp, out_c, 8, 0);
+		tinyjpeg_idct_int(&comp, out_simd, 8, cpu_flags);
+
+		if (dc_only) {
+			comp.dc_only = 1;
+			tinyjpeg_idct_int(&comp, out_dc, 8, cpu_flags);
+			if (memcmp(out_c, out_dc, 64))
+				dc_only_errors++;
+			dc_only_blocks++;
+		}
+
+		if (memcmp(out_c, out_simd, 64))
+			simd_errors++;
+
+		for (j = 0; j < 64; j++) {
+			diff = abs(out_c[j] - out_float[j]);
+			if (diff > max_diff)
+				max_diff = diff;
+			if (diff == 1)
+				off_by_1++;
+			if (diff > 1)
+				float_errors++;
+		}
+	}
+
+	corrupt_errors = corrupt_blocks(blocks / 10);
+
+	printf("blocks: %d, of which dc only: %d, cpu flags: 0x%02x\n",
+	       blocks, dc_only_blocks, cpu_flags);
+	printf("SIMD IDCT mismatches: %d\n", simd_errors);
+	printf("DC only IDCT mismatches: %d\n", dc_only_errors);
+	printf("pixels off by 1 from the floating point IDCT: %d (%.3f%%)\n",
+	       off_by_1, 100.0 * off_by_1 / (blocks * 64.0));
+	printf("pixels off by more then 1: %d, max difference: %d\n",
+	       float_errors, max_diff);
+	printf("corrupt blocks: %d, reduced size IDCTs not saturating: %d\n",
+	       blocks / 10, corrupt_errors);
+
+	if (simd_errors || dc_only_errors || float_errors || corrupt_errors) {
+		printf("FAIL\n");
+		return 1;
+	}
+	printf("PASS\n");
+	return 0;
+}
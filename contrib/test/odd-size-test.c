@@ -0,0 +1,268 @@
+/*
+ *  Copyright (C) 2026 The v4l-utils authors
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, version 2 of the License.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  odd-size-test converts single colour rgb24, yuyv and yuv420 frames with
+ *  an odd height to every destination format libv4lconvert offers, both at
+ *  the same size and scaled down from 640x480, using a fake device. The
+ *  result must have a single colour too, a wrong chroma line for the last
+ *  line shows up as a different colour.
+ *
+ *  The src and dest buffers are allocated with the exact frame size, run it
+ *  built with -fsanitize=address to catch reads and writes past them.
+ *
+ *  To execute:
+ *             ./odd-size-test
+ *
+ *  Setting the LIBV4LCONVERT_CPU_FLAGS environment variable to 0 allows
+ *  testing the plain C code, see lib/libv4lconvert/cpu.c
+ */
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "libv4lconvert.h"
+#include "libv4l-plugin.h"
+
+#define ARRAY_SIZE(x) (sizeof(x) / sizeof((x)[0]))
+
+static int fake_ioctl(void *dev_ops_priv, int fd, unsigned long cmd, void *arg)
+{
+	struct v4l2_capability *cap = arg;
+
+	if (cmd != VIDIOC_QUERYCAP) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	memset(cap, 0, sizeof(*cap));
+	strcpy((char *)cap->driver, "odd-size-test");
+	strcpy((char *)cap->card, "odd-size-test");
+	strcpy((char *)cap->bus_info, "odd-size-test");
+	cap->capabilities = V4L2_CAP_VIDEO_CAPTURE | V4L2_CAP_STREAMING;
+	return 0;
+}
+
+static struct libv4l_dev_ops fake_dev_ops = {
+	.ioctl = fake_ioctl,
+};
+
+/* SUPPORTED_DST_PIXFMTS of lib/libv4lconvert/libv4lconvert.c */
+static const struct {
+	unsigned int pixfmt;
+	int bpp;
+} dest_pixfmts[] = {
+	{ V4L2_PIX_FMT_RGB24,	24 },
+	{ V4L2_PIX_FMT_BGR24,	24 },
+	{ V4L2_PIX_FMT_YUV420,	12 },
+	{ V4L2_PIX_FMT_YVU420,	12 },
+	{ V4L2_PIX_FMT_NV12,	12 },
+	{ V4L2_PIX_FMT_YUYV,	16 },
+	{ V4L2_PIX_FMT_XRGB32,	32 },
+	{ V4L2_PIX_FMT_ARGB32,	32 },
+	{ V4L2_PIX_FMT_GREY,	 8 },
+};
+
+static const unsigned int src_pixfmts[] = {
+	V4L2_PIX_FMT_RGB24, V4L2_PIX_FMT_YUYV, V4L2_PIX_FMT_YUV420,
+};
+
+static const int sizes[][2] = {
+	{ 100, 77 }, { 64, 35 }, { 160, 119 },
+};
+
+static void fcc2s(unsigned int fcc, char *buf)
+{
+	int i;
+
+	for (i = 0; i < 4; i++)
+		buf[i] = (fcc >> (8 * i)) & 0x7f;
+	buf[4] = 0;
+}
+
+/* Returns 1 if all step byte units of buf are the same */
+static int uniform(const unsigned char *buf, int size, int step)
+{
+	int i;
+
+	for (i = step; i < size; i++)
+		if (buf[i] != buf[i - step])
+			return 0;
+	return 1;
+}
+
+/* A single colour frame in exactly sized buffer */
+static unsigned char *make_src(unsigned int pixfmt, int width, int height,
+		struct v4l2_format *fmt)
+{
+	unsigned char *buf;
+	int i, size;
+
+	memset(fmt, 0, sizeof(*fmt));
+	fmt->type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+	fmt->fmt.pix.width = width;
+	fmt->fmt.pix.height = height;
+	fmt->fmt.pix.pixelformat = pixfmt;
+	fmt->fmt.pix.field = V4L2_FIELD_NONE;
+
+	switch (pixfmt) {
+	case V4L2_PIX_FMT_RGB24:
+		fmt->fmt.pix.bytesperline = width * 3;
+		size = width * height * 3;
+		buf = malloc(size);
+		for (i = 0; buf && i < size; i += 3) {
+			buf[i] = 200;
+			buf[i + 1] = 120;
+			buf[i + 2] = 40;
+		}
+		break;
+	case V4L2_PIX_FMT_YUYV:
+		fmt->fmt.pix.bytesperline = width * 2;
+		size = width * height * 2;
+		buf = malloc(size);
+		for (i = 0; buf && i < size; i += 4) {
+			buf[i] = buf[i + 2] = 140;
+			buf[i + 1] = 70;
+			buf[i + 3] = 180;
+		}
+		break;
+	default:
+		fmt->fmt.pix.bytesperline = width;
+		size = width * height * 3 / 2;
+		buf = malloc(size);
+		if (buf) {
+			memset(buf, 140, width * height);
+			memset(buf + width * height, 70, width * height / 4);
+			memset(buf + width * height + width * height / 4, 180,
+			       size - width * height - width * height / 4);
+		}
+	}
+	if (!buf) {
+		fprintf(stderr, "Out of memory\n");
+		exit(1);
+	}
+	fmt->fmt.pix.sizeimage = size;
+
+	return buf;
+}
+
+static int check(unsigned int pixfmt, const unsigned char *buf, int width,
+		int height)
+{
+	int pixels = width * height, uv = (width / 2) * (height / 2);
+
+	/* Like libv4lconvert, the planes of yuv 4:2:0 start at width * height
+	   and 5 / 4 of that, with height / 2 chroma lines */
+	switch (pixfmt) {
+	case V4L2_PIX_FMT_RGB24:
+	case V4L2_PIX_FMT_BGR24:
+		return uniform(buf, pixels * 3, 3);
+	case V4L2_PIX_FMT_XRGB32:
+	case V4L2_PIX_FMT_ARGB32:
+		return uniform(buf, pixels * 4, 4);
+	case V4L2_PIX_FMT_YUYV:
+		return uniform(buf, pixels * 2, 4);
+	case V4L2_PIX_FMT_GREY:
+		return uniform(buf, pixels, 1);
+	case V4L2_PIX_FMT_NV12:
+		return uniform(buf, pixels, 1) &&
+		       uniform(buf + pixels, 2 * uv, 2);
+	default:
+		return uniform(buf, pixels, 1) &&
+		       uniform(buf + pixels, uv, 1) &&
+		       uniform(buf + pixels + pixels / 4, uv, 1);
+	}
+}
+
+static int test(struct v4lconvert_data *data, unsigned int src_pixfmt,
+		int src_width, int src_height, int width, int height)
+{
+	struct v4l2_format src_fmt, dest_fmt;
+	unsigned char *src, *dest;
+	char src_s[8], dest_s[8];
+	unsigned int i;
+	int size, result = 0;
+
+	src = make_src(src_pixfmt, src_width, src_height, &src_fmt);
+	fcc2s(src_pixfmt, src_s);
+
+	for (i = 0; i < ARRAY_SIZE(dest_pixfmts); i++) {
+		size = width * height * dest_pixfmts[i].bpp / 8;
+		dest = malloc(size);
+		if (!dest) {
+			fprintf(stderr, "Out of memory\n");
+			exit(1);
+		}
+
+		dest_fmt = src_fmt;
+		dest_fmt.fmt.pix.pixelformat = dest_pixfmts[i].pixfmt;
+		dest_fmt.fmt.pix.width = width;
+		dest_fmt.fmt.pix.height = height;
+		dest_fmt.fmt.pix.bytesperline = dest_pixfmts[i].bpp == 12 ?
+			width : width * dest_pixfmts[i].bpp / 8;
+		dest_fmt.fmt.pix.sizeimage = size;
+
+		fcc2s(dest_pixfmts[i].pixfmt, dest_s);
+		if (v4lconvert_convert(data, &src_fmt, &dest_fmt, src,
+				       src_fmt.fmt.pix.sizeimage, dest,
+				       size) < 0) {
+			printf("FAIL: %s %dx%d -> %s %dx%d: %s\n", src_s,
+			       src_width, src_height, dest_s, width, height,
+			       v4lconvert_get_error_message(data));
+			result = 1;
+		} else if (!check(dest_pixfmts[i].pixfmt, dest, width,
+				  height)) {
+			printf("FAIL: %s %dx%d -> %s %dx%d: not a single "
+			       "colour\n", src_s, src_width, src_height,
+			       dest_s, width, height);
+			result = 1;
+		}
+
+		free(dest);
+	}
+
+	free(src);
+
+	return result;
+}
+
+int main(int argc, char *argv[])
+{
+	struct v4lconvert_data *data;
+	unsigned int i, j;
+	int result = 0;
+
+	/* No flipping or other processing */
+	setenv("LIBV4LCONTROL_FLAGS", "0", 1);
+	setenv("LIBV4LCONTROL_CONTROLS", "0", 1);
+
+	data = v4lconvert_create_with_dev_ops(-1, NULL, &fake_dev_ops);
+	if (!data) {
+		fprintf(stderr, "Could not create v4lconvert instance\n");
+		return 1;
+	}
+
+	for (i = 0; i < ARRAY_SIZE(src_pixfmts); i++)
+		for (j = 0; j < ARRAY_SIZE(sizes); j++) {
+			result |= test(data, src_pixfmts[i], sizes[j][0],
+				       sizes[j][1], sizes[j][0], sizes[j][1]);
+			result |= test(data, src_pixfmts[i], 640, 480,
+				       sizes[j][0], sizes[j][1]);
+		}
+
+	v4lconvert_destroy(data);
+
+	printf("%s\n", result ? "FAIL" : "PASS");
+
+	return result;
+}
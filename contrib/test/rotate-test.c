@@ -0,0 +1,249 @@
+/*
+ *  Copyright (C) 2026 The v4l-utils authors
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, version 2 of the License.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  rotate-test checks and benchmarks the 90 and 180 degree rotation of
+ *  libv4lconvert, for rgb24 and yuv420 frames of 1920x1080 and 2592x1944
+ *  (5 MP) pixels.
+ *
+ *  The frames get rotated through v4lconvert_convert() using a fake device,
+ *  and by the straightforward pixel by pixel rotation libv4lconvert used
+ *  before it rotated in tiles. The results must be the same, the time per
+ *  frame of both is printed.
+ *
+ *  To execute:
+ *             ./rotate-test [number of frames]
+ *
+ *  Setting the LIBV4LCONVERT_CPU_FLAGS environment variable to 0 allows
+ *  benchmarking the plain C code, see lib/libv4lconvert/cpu.c
+ */
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "libv4lconvert.h"
+#include "../../lib/libv4lconvert/control/libv4lcontrol.h"
+
+static int fake_ioctl(void *dev_ops_priv, int fd, unsigned long cmd, void *arg)
+{
+	struct v4l2_capability *cap = arg;
+
+	if (cmd != VIDIOC_QUERYCAP) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	memset(cap, 0, sizeof(*cap));
+	strcpy((char *)cap->driver, "rotate-test");
+	strcpy((char *)cap->card, "rotate-test");
+	strcpy((char *)cap->bus_info, "rotate-test");
+	cap->capabilities = V4L2_CAP_VIDEO_CAPTURE | V4L2_CAP_STREAMING;
+	return 0;
+}
+
+static struct libv4l_dev_ops fake_dev_ops = {
+	.ioctl = fake_ioctl,
+};
+
+static void ref_rotate90_plane(const unsigned char *src, unsigned char *dst,
+		int destwidth, int destheight, int bpp)
+{
+	int x, y, i;
+
+	for (y = 0; y < destheight; y++)
+		for (x = 0; x < destwidth; x++) {
+			int offset = ((destwidth - x - 1) * destheight + y) * bpp;
+
+			for (i = 0; i < bpp; i++)
+				*dst++ = src[offset + i];
+		}
+}
+
+static void ref_rotate180_plane(const unsigned char *src, unsigned char *dst,
+		int pixels, int bpp)
+{
+	int i, j;
+
+	src += (pixels - 1) * bpp;
+	for (i = 0; i < pixels; i++) {
+		for (j = 0; j < bpp; j++)
+			dst[j] = src[j];
+		dst += bpp;
+		src -= bpp;
+	}
+}
+
+/* The frame in src is width x height, for rotate90 the result is
+   height x width */
+static void ref_rotate(const unsigned char *src, unsigned char *dst,
+		int width, int height, int yuv, int rotate90)
+{
+	int i, pixels = width * height;
+
+	if (!yuv) {
+		if (rotate90)
+			ref_rotate90_plane(src, dst, height, width, 3);
+		else
+			ref_rotate180_plane(src, dst, pixels, 3);
+		return;
+	}
+
+	for (i = 0; i < 3; i++) {
+		if (rotate90)
+			ref_rotate90_plane(src, dst, height, width, 1);
+		else
+			ref_rotate180_plane(src, dst, pixels, 1);
+		src += pixels;
+		dst += pixels;
+		if (i == 0) {
+			width /= 2;
+			height /= 2;
+			pixels /= 4;
+		}
+	}
+}
+
+static struct v4lconvert_data *create(int rotate90)
+{
+	struct v4lconvert_data *data;
+	struct v4l2_control ctrl;
+	char buf[32];
+
+	/* Rotating 90 degrees is a device flag, rotating 180 degrees is
+	   done by setting both the hflip and vflip controls */
+	snprintf(buf, sizeof(buf), "%d",
+		 rotate90 ? V4LCONTROL_ROTATED_90_JPEG : 0);
+	setenv("LIBV4LCONTROL_FLAGS", buf, 1);
+	snprintf(buf, sizeof(buf), "%d",
+		 rotate90 ? 0 : (1 << V4LCONTROL_HFLIP) | (1 << V4LCONTROL_VFLIP));
+	setenv("LIBV4LCONTROL_CONTROLS", buf, 1);
+
+	data = v4lconvert_create_with_dev_ops(-1, NULL, &fake_dev_ops);
+	if (!data) {
+		fprintf(stderr, "Could not create v4lconvert instance\n");
+		exit(1);
+	}
+
+	if (!rotate90) {
+		ctrl.id = V4L2_CID_HFLIP;
+		ctrl.value = 1;
+		v4lconvert_vidioc_s_ctrl(data, &ctrl);
+		ctrl.id = V4L2_CID_VFLIP;
+		v4lconvert_vidioc_s_ctrl(data, &ctrl);
+	}
+
+	return data;
+}
+
+static double now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000.0 + ts.tv_nsec / 1000000.0;
+}
+
+static int test(struct v4lconvert_data *data, int width, int height,
+		unsigned int pixfmt, int rotate90, int frames)
+{
+	int i, yuv = pixfmt == V4L2_PIX_FMT_YUV420;
+	int size = yuv ? width * height * 3 / 2 : width * height * 3;
+	unsigned char *src = malloc(size);
+	unsigned char *dest = malloc(size);
+	unsigned char *ref = malloc(size);
+	struct v4l2_format src_fmt, dest_fmt;
+	double start = 0, lib_time, ref_time;
+	int result = 0;
+
+	if (!src || !dest || !ref) {
+		fprintf(stderr, "Out of memory\n");
+		exit(1);
+	}
+
+	for (i = 0; i < size; i++)
+		src[i] = rand();
+
+	memset(&src_fmt, 0, sizeof(src_fmt));
+	src_fmt.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+	src_fmt.fmt.pix.width = width;
+	src_fmt.fmt.pix.height = height;
+	src_fmt.fmt.pix.pixelformat = pixfmt;
+	src_fmt.fmt.pix.bytesperline = yuv ? width : width * 3;
+	src_fmt.fmt.pix.sizeimage = size;
+	/* Normally the dest would be height x width when rotating 90
+	   degrees, which makes libv4lconvert crop (copy) the rotated frame
+	   to dest. Keeping the src size avoids this extra copy. */
+	dest_fmt = src_fmt;
+
+	/* Once without timing it, so that libv4lconvert allocates its
+	   buffers and both src and dest are paged in */
+	for (i = -1; i < frames; i++) {
+		if (i == 0)
+			start = now();
+		if (v4lconvert_convert(data, &src_fmt, &dest_fmt, src, size,
+				       dest, size) != size) {
+			fprintf(stderr, "v4lconvert_convert: %s\n",
+				v4lconvert_get_error_message(data));
+			exit(1);
+		}
+	}
+	lib_time = (now() - start) / frames;
+
+	ref_rotate(src, ref, width, height, yuv, rotate90);
+	start = now();
+	for (i = 0; i < frames; i++)
+		ref_rotate(src, ref, width, height, yuv, rotate90);
+	ref_time = (now() - start) / frames;
+
+	if (memcmp(dest, ref, size)) {
+		printf("FAIL: ");
+		result = 1;
+	}
+
+	printf("%s %-6s %4dx%-4d: %6.2f ms per frame, before %6.2f ms\n",
+	       rotate90 ? "rotate90 " : "rotate180", yuv ? "yuv420" : "rgb24",
+	       width, height, lib_time, ref_time);
+
+	free(src);
+	free(dest);
+	free(ref);
+
+	return result;
+}
+
+int main(int argc, char *argv[])
+{
+	static const int sizes[][2] = { { 1920, 1080 }, { 2592, 1944 } };
+	static const unsigned int pixfmts[] = {
+		V4L2_PIX_FMT_RGB24, V4L2_PIX_FMT_YUV420
+	};
+	int frames = argc > 1 ? atoi(argv[1]) : 20;
+	int rotate90, i, j, result = 0;
+
+	if (frames < 1)
+		frames = 1;
+
+	for (rotate90 = 1; rotate90 >= 0; rotate90--) {
+		struct v4lconvert_data *data = create(rotate90);
+
+		for (i = 0; i < 2; i++)
+			for (j = 0; j < 2; j++)
+				result |= test(data, sizes[i][0], sizes[i][1],
+					       pixfmts[j], rotate90, frames);
+
+		v4lconvert_destroy(data);
+	}
+
+	return result;
+}
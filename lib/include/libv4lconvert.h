@@ -57,6 +57,12 @@ struct v4lconvert_data;
 
 LIBV4L_PUBLIC const struct libv4l_dev_ops *v4lconvert_get_default_dev_ops();
 
+/* When the LIBV4LCONVERT_CACHE_DIR environment variable points to a directory,
+   the results of enumerating the formats, framesizes and frameintervals of
+   the device get stored there and are used instead of asking the device
+   again on the next create for the same device. The cache is only used when
+   the driver, card, bus info, driver version, capabilities and (for USB
+   devices) the vendor id, product id and firmware version all match. */
 LIBV4L_PUBLIC struct v4lconvert_data *v4lconvert_create(int fd);
 LIBV4L_PUBLIC struct v4lconvert_data *v4lconvert_create_with_dev_ops(int fd,
 		void *dev_ops_priv, const struct libv4l_dev_ops *dev_ops);
@@ -77,7 +83,15 @@ LIBV4L_PUBLIC int v4lconvert_supported_dst_fmt_only(
    Note that just like the real VIDIOC_TRY_FMT this function will change the
    dest_fmt when not supported. This includes changing it to a supported
    destination format when trying a native format of the camera and
-   v4lconvert_supported_dst_fmt_only() returns true. */
+   v4lconvert_supported_dst_fmt_only() returns true.
+   dest_fmt may be smaller than src_fmt, for (M)JPEG cams this includes 1/2,
+   1/4 and 1/8 of the src_fmt size, which v4lconvert_convert decodes directly
+   at the reduced size. Resolutions the camera does not have are made by
+   scaling down the next larger resolution it has, keeping the aspect ratio
+   of dest_fmt by cropping the sides or the top and bottom of the frame.
+   For devices which only support the multi-planar api, src_fmt is a
+   V4L2_BUF_TYPE_VIDEO_CAPTURE_MPLANE format, and dest_fmt may be one too, in
+   which case the converted frames are in a single plane. */
 LIBV4L_PUBLIC int v4lconvert_try_format(struct v4lconvert_data *data,
 		struct v4l2_format *dest_fmt, /* in / out */
 		struct v4l2_format *src_fmt); /* out */
@@ -116,6 +130,70 @@ LIBV4L_PUBLIC int v4lconvert_convert(struct v4lconvert_data *data,
 		const struct v4l2_format *dest_fmt, /* in */
 		unsigned char *src, int src_size, unsigned char *dest, int dest_size);
 
+/* Same as v4lconvert_convert(), for a V4L2_BUF_TYPE_VIDEO_CAPTURE_MPLANE
+   src_fmt, src and src_size hold the start and bytesused of each plane of
+   the frame. Multi-planar yuv formats get converted straight from their
+   planes, without copying them into one buffer first. dest_fmt may be a
+   single-planar format or a multi-planar format with 1 plane. */
+LIBV4L_PUBLIC int v4lconvert_convert_mplane(struct v4lconvert_data *data,
+		const struct v4l2_format *src_fmt,  /* in */
+		const struct v4l2_format *dest_fmt, /* in */
+		unsigned char *src[], const int src_size[],
+		unsigned char *dest, int dest_size);
+
+/* Asynchronous version of v4lconvert_convert(), the frame gets converted by a
+   worker thread, so that the application can requeue the buffer of the
+   previous frame and capture the next frame while this one is converted.
+   src and dest must stay valid until the job completes. Jobs get converted
+   in the order they are submitted, one at a time, conversion of a single
+   frame still uses multiple threads, see v4lconvert_set_threads().
+   Only single-planar src formats are supported.
+
+   The worker converts with the scratch buffers and the decoder and
+   processing state of data, so conversions on one instance never overlap:
+   a v4lconvert_convert() call waits for the job being converted and the
+   other way around. Use a v4lconvert instance per stream to convert
+   multiple streams in parallel.
+
+   Returns 0 on success and -1 on error, with errno set to EAGAIN when
+   V4LCONVERT_MAX_JOBS jobs are pending already (completed jobs count as
+   pending until returned by v4lconvert_poll_complete()).
+
+   While jobs are pending v4lconvert_convert() and the control functions may
+   be called as usual, but the format may not be changed, so do not call
+   v4lconvert_try_format() until all jobs are complete. */
+#define V4LCONVERT_MAX_JOBS 32
+
+LIBV4L_PUBLIC int v4lconvert_submit(struct v4lconvert_data *data,
+		const struct v4l2_format *src_fmt,  /* in */
+		const struct v4l2_format *dest_fmt, /* in */
+		unsigned char *src, int src_size, unsigned char *dest, int dest_size,
+		void *cookie);
+
+#define V4LCONVERT_ERROR_MSG_SIZE 256
+
+/* The error of a job is only reported here, v4lconvert_get_error_message()
+   is not changed by the worker thread */
+struct v4lconvert_completion {
+	void *cookie;	/* as passed to v4lconvert_submit() */
+	int result;	/* what v4lconvert_convert() would have returned */
+	int error;	/* errno value when result is -1 */
+	char error_msg[V4LCONVERT_ERROR_MSG_SIZE]; /* when result is -1 */
+};
+
+/* Get the oldest completed job, waiting at most timeout ms for it to
+   complete, -1 waits until it does. Returns 1 when a job has been
+   returned in completion, 0 on timeout or if there are no pending jobs and
+   -1 on error. */
+LIBV4L_PUBLIC int v4lconvert_poll_complete(struct v4lconvert_data *data,
+		struct v4lconvert_completion *completion, int timeout);
+
+/* A file descriptor which is readable (POLLIN) when there is a completed job,
+   to add to the poll() / select() loop of the application, use
+   v4lconvert_poll_complete() with a timeout of 0 to get the job. Do not read
+   from it. Returns -1 on error. */
+LIBV4L_PUBLIC int v4lconvert_get_complete_fd(struct v4lconvert_data *data);
+
 /* get a string describing the last error */
 LIBV4L_PUBLIC const char *v4lconvert_get_error_message(struct v4lconvert_data *data);
 
@@ -151,9 +229,66 @@ LIBV4L_PUBLIC int v4lconvert_supported_dst_format(unsigned int pixelformat);
 LIBV4L_PUBLIC int v4lconvert_get_fps(struct v4lconvert_data *data);
 LIBV4L_PUBLIC void v4lconvert_set_fps(struct v4lconvert_data *data, int fps);
 
+/* Get/set the no threads libv4lconvert uses to convert a frame, frames get
+   split up in bands of rows which are converted in parallel. The default is 1
+   (convert on the calling thread only), or the value of the
+   LIBV4LCONVERT_THREADS environment variable. Passing 0 uses 1 thread per
+   cpu. Returns 0 on success and -1 on error. */
+LIBV4L_PUBLIC int v4lconvert_get_threads(struct v4lconvert_data *data);
+LIBV4L_PUBLIC int v4lconvert_set_threads(struct v4lconvert_data *data,
+		int threads);
+
+/* Statistics of the v4lconvert_convert() calls of a v4lconvert instance,
+   to find out which step of the conversion takes how much of the time per
+   frame. The counters are always kept, the time spent in each stage only
+   once enabled with v4lconvert_set_stats_timing() or by setting the
+   LIBV4LCONVERT_STATS environment variable to 1. libv4l2 enables this and
+   periodically writes the statistics to its log file, when logging. */
+enum v4lconvert_stage {
+	V4LCONVERT_STAGE_DECODE,	/* decoding JPEG and other compressed formats */
+	V4LCONVERT_STAGE_CONVERT,	/* converting uncompressed formats */
+	V4LCONVERT_STAGE_PROCESSING,	/* whitebalance, autogain, gamma */
+	V4LCONVERT_STAGE_ROTATE,	/* 90 degree rotation */
+	V4LCONVERT_STAGE_FLIP,		/* horizontal / vertical flipping */
+	V4LCONVERT_STAGE_CROP,		/* cropping or scaling to the dest size */
+	V4LCONVERT_STAGE_PACK,		/* converting to the final dest format */
+	V4LCONVERT_STAGE_COUNT
+};
+
+struct v4lconvert_stats {
+	unsigned long long frames;		/* v4lconvert_convert() calls */
+	unsigned long long decode_errors;	/* frames failing to decode */
+	unsigned long long short_frames;	/* frames with too little data */
+	unsigned long long buffer_reallocs;	/* scratch buffers newly allocated */
+	unsigned long long total_ns;		/* time in v4lconvert_convert() */
+	/* Frames which went through a stage and the time spent in it, note
+	   that processing and flipping may get done while converting, this
+	   then counts as time spent converting */
+	unsigned long long stage_frames[V4LCONVERT_STAGE_COUNT];
+	unsigned long long stage_ns[V4LCONVERT_STAGE_COUNT];
+};
+
+/* Get / reset the statistics, the conversion of frames (by another thread)
+   is not stopped for this so the values may be off by 1 frame */
+LIBV4L_PUBLIC void v4lconvert_get_stats(struct v4lconvert_data *data,
+		struct v4lconvert_stats *stats);
+LIBV4L_PUBLIC void v4lconvert_reset_stats(struct v4lconvert_data *data);
+/* Enable / disable timing the stages, this costs a clock_gettime() call per
+   stage per frame */
+LIBV4L_PUBLIC void v4lconvert_set_stats_timing(struct v4lconvert_data *data,
+		int enable);
+
 /* Fixup bytesperline and sizeimage for supported destination formats */
 LIBV4L_PUBLIC void v4lconvert_fixup_fmt(struct v4l2_format *fmt);
 
+/* Convert between single and multi-planar formats, the single-planar version
+   of a multi-planar format has the bytesperline of the first plane and the
+   sizeimage of all planes together. fmt and mp_fmt may be the same. */
+LIBV4L_PUBLIC void v4lconvert_mplane_to_pix(const struct v4l2_format *mp_fmt,
+		struct v4l2_format *fmt);
+LIBV4L_PUBLIC void v4lconvert_pix_to_mplane(const struct v4l2_format *fmt,
+		struct v4l2_format *mp_fmt);
+
 #ifdef __cplusplus
 }
 #endif /* __cplusplus */
@@ -99,8 +99,12 @@ static void *plugin_init(int fd)
 	    (cap.capabilities & V4L2_CAP_VIDEO_OUTPUT_MPLANE))
 		plugin.mplane_output = 1;
 
-	/* Device doesn't need it. return NULL to disable the plugin */
-	if (!plugin.mplane)
+	/*
+	 * Device doesn't need it. return NULL to disable the plugin. Note that
+	 * capture only devices are handled by libv4l2 itself, which converts
+	 * straight from the driver's planes.
+	 */
+	if (!plugin.mplane_output)
 		return NULL;
 
 	/* Allocate and initialize private data */
@@ -33,6 +33,8 @@
 #define V4L2_DEFAULT_NREADBUFFERS 4
 #define V4L2_IGNORE_FIRST_FRAME_ERRORS 3
 #define V4L2_DEFAULT_FPS 30
+/* When logging, the conversion statistics get logged every this many frames */
+#define V4L2_LOG_STATS_FRAMES 300
 
 #define V4L2_LOG_ERR(...) 			\
 	do { 					\
@@ -90,9 +92,10 @@ struct v4l2_dev_info {
 	unsigned char *convert_mmap_buf;
 	size_t convert_mmap_buf_size;
 	size_t convert_mmap_frame_size;
-	/* Frame bookkeeping is only done when in read or mmap-conversion mode */
-	unsigned char *frame_pointers[V4L2_MAX_NO_FRAMES];
-	int frame_sizes[V4L2_MAX_NO_FRAMES];
+	/* Frame bookkeeping is only done when in read or mmap-conversion mode,
+	   for multi-planar devices there is a pointer and size per plane */
+	unsigned char *frame_pointers[V4L2_MAX_NO_FRAMES][VIDEO_MAX_PLANES];
+	int frame_sizes[V4L2_MAX_NO_FRAMES][VIDEO_MAX_PLANES];
 	int frame_queued; /* 1 status bit per frame */
 	int frame_info_generation;
 	/* mapping tracking of our fake (converting mmap) frame buffers */
@@ -129,5 +132,6 @@ static inline void v4l2_plugin_cleanup(void *plugin_lib, void *plugin_priv,
 /* From log.c */
 extern const char *v4l2_ioctls[];
 void v4l2_log_ioctl(unsigned long int request, void *arg, int result);
+void v4l2_log_convert_stats(int fd, struct v4lconvert_data *convert);
 
 #endif
@@ -84,6 +84,7 @@
 #define V4L2_STREAM_TOUCHED		0x1000
 #define V4L2_USE_READ_FOR_READ		0x2000
 #define V4L2_SUPPORTS_TIMEPERFRAME	0x4000
+#define V4L2_IS_MPLANE			0x8000
 
 #define V4L2_MMAP_OFFSET_MAGIC      0xABCDEF00u
 
@@ -100,6 +101,66 @@ static struct v4l2_dev_info devices[V4L2_MAX_DEVICES] = {
 };
 static int devices_used;
 
+/* The buffer type to use when talking to the device, apps always use the
+   single-planar api, for multi-planar devices we translate */
+static enum v4l2_buf_type v4l2_buf_type(int index)
+{
+	return (devices[index].flags & V4L2_IS_MPLANE) ?
+		V4L2_BUF_TYPE_VIDEO_CAPTURE_MPLANE : V4L2_BUF_TYPE_VIDEO_CAPTURE;
+}
+
+static unsigned int v4l2_no_planes(int index)
+{
+	if (!(devices[index].flags & V4L2_IS_MPLANE))
+		return 1;
+
+	return MIN(devices[index].src_fmt.fmt.pix_mp.num_planes,
+		   VIDEO_MAX_PLANES);
+}
+
+/* Do a QUERYBUF, QBUF or DQBUF on the device. For multi-planar devices buf
+   gets translated to and from a multi-planar buffer, with the length and
+   bytesused of all planes added up, planes (if not NULL) receives the
+   per-plane info filled in by the driver. */
+static int v4l2_buffer_ioctl(int index, unsigned long int request,
+		struct v4l2_buffer *buf, struct v4l2_plane *planes)
+{
+	struct v4l2_plane my_planes[VIDEO_MAX_PLANES];
+	struct v4l2_buffer mp_buf;
+	unsigned int i;
+	int result, saved_err;
+
+	if (!(devices[index].flags & V4L2_IS_MPLANE))
+		return devices[index].dev_ops->ioctl(
+				devices[index].dev_ops_priv,
+				devices[index].fd, request, buf);
+
+	if (!planes)
+		planes = my_planes;
+	memset(planes, 0, VIDEO_MAX_PLANES * sizeof(*planes));
+
+	mp_buf = *buf;
+	mp_buf.type = V4L2_BUF_TYPE_VIDEO_CAPTURE_MPLANE;
+	mp_buf.m.planes = planes;
+	mp_buf.length = VIDEO_MAX_PLANES;
+	result = devices[index].dev_ops->ioctl(devices[index].dev_ops_priv,
+			devices[index].fd, request, &mp_buf);
+	saved_err = errno;
+
+	*buf = mp_buf;
+	buf->type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+	buf->m.offset = planes[0].m.mem_offset;
+	buf->length = 0;
+	buf->bytesused = 0;
+	for (i = 0; i < v4l2_no_planes(index); i++) {
+		buf->length += planes[i].length;
+		buf->bytesused += planes[i].bytesused;
+	}
+
+	errno = saved_err;
+	return result;
+}
+
 static int v4l2_ensure_convert_mmap_buf(int index)
 {
 	if (devices[index].convert_mmap_buf != MAP_FAILED) {
@@ -136,7 +197,7 @@ static int v4l2_request_read_buffers(int index)
 	   and thus the needed buffer size may have changed. */
 	req.count = (devices[index].no_frames) ? devices[index].no_frames :
 		devices[index].nreadbuffers;
-	req.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+	req.type = v4l2_buf_type(index);
 	req.memory = V4L2_MEMORY_MMAP;
 	result = devices[index].dev_ops->ioctl(devices[index].dev_ops_priv,
 			devices[index].fd, VIDIOC_REQBUFS, &req);
@@ -166,7 +227,7 @@ static void v4l2_unrequest_read_buffers(int index)
 	/* (Un)Request buffers, note not all driver support this, and those
 	   who do not support it don't need it. */
 	req.count = 0;
-	req.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+	req.type = v4l2_buf_type(index);
 	req.memory = V4L2_MEMORY_MMAP;
 	if (devices[index].dev_ops->ioctl(devices[index].dev_ops_priv,
 			devices[index].fd, VIDIOC_REQBUFS, &req) < 0)
@@ -180,20 +241,19 @@ static void v4l2_unrequest_read_buffers(int index)
 static int v4l2_map_buffers(int index)
 {
 	int result = 0;
-	unsigned int i;
+	unsigned int i, p;
 	struct v4l2_buffer buf;
+	struct v4l2_plane planes[VIDEO_MAX_PLANES];
 
 	for (i = 0; i < devices[index].no_frames; i++) {
-		if (devices[index].frame_pointers[i] != MAP_FAILED)
+		if (devices[index].frame_pointers[i][0] != MAP_FAILED)
 			continue;
 
+		memset(&buf, 0, sizeof(buf));
 		buf.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
 		buf.memory = V4L2_MEMORY_MMAP;
 		buf.index = i;
-		buf.reserved = buf.reserved2 = 0;
-		result = devices[index].dev_ops->ioctl(
-				devices[index].dev_ops_priv,
-				devices[index].fd, VIDIOC_QUERYBUF, &buf);
+		result = v4l2_buffer_ioctl(index, VIDIOC_QUERYBUF, &buf, planes);
 		if (result) {
 			int saved_err = errno;
 
@@ -202,21 +262,31 @@ static int v4l2_map_buffers(int index)
 			break;
 		}
 
-		devices[index].frame_pointers[i] = (void *)SYS_MMAP(NULL,
-				(size_t)buf.length, PROT_READ | PROT_WRITE, MAP_SHARED, devices[index].fd,
-				buf.m.offset);
-		if (devices[index].frame_pointers[i] == MAP_FAILED) {
-			int saved_err = errno;
-
-			V4L2_PERROR("mmapping buffer %u", i);
-			errno = saved_err;
-			result = -1;
-			break;
+		if (!(devices[index].flags & V4L2_IS_MPLANE)) {
+			planes[0].length = buf.length;
+			planes[0].m.mem_offset = buf.m.offset;
 		}
-		V4L2_LOG("mapped buffer %u at %p\n", i,
-				devices[index].frame_pointers[i]);
 
-		devices[index].frame_sizes[i] = buf.length;
+		for (p = 0; p < v4l2_no_planes(index); p++) {
+			devices[index].frame_pointers[i][p] = (void *)SYS_MMAP(NULL,
+					(size_t)planes[p].length, PROT_READ | PROT_WRITE,
+					MAP_SHARED, devices[index].fd,
+					planes[p].m.mem_offset);
+			if (devices[index].frame_pointers[i][p] == MAP_FAILED) {
+				int saved_err = errno;
+
+				V4L2_PERROR("mmapping buffer %u plane %u", i, p);
+				errno = saved_err;
+				result = -1;
+				break;
+			}
+			V4L2_LOG("mapped buffer %u plane %u at %p\n", i, p,
+					devices[index].frame_pointers[i][p]);
+
+			devices[index].frame_sizes[i][p] = planes[p].length;
+		}
+		if (result)
+			break;
 	}
 
 	return result;
@@ -224,15 +294,18 @@ static int v4l2_map_buffers(int index)
 
 static void v4l2_unmap_buffers(int index)
 {
-	unsigned int i;
+	unsigned int i, p;
 
 	/* unmap the buffers */
 	for (i = 0; i < devices[index].no_frames; i++) {
-		if (devices[index].frame_pointers[i] != MAP_FAILED) {
-			SYS_MUNMAP(devices[index].frame_pointers[i],
-					devices[index].frame_sizes[i]);
-			devices[index].frame_pointers[i] = MAP_FAILED;
-			V4L2_LOG("unmapped buffer %u\n", i);
+		for (p = 0; p < VIDEO_MAX_PLANES; p++) {
+			if (devices[index].frame_pointers[i][p] == MAP_FAILED)
+				continue;
+
+			SYS_MUNMAP(devices[index].frame_pointers[i][p],
+					devices[index].frame_sizes[i][p]);
+			devices[index].frame_pointers[i][p] = MAP_FAILED;
+			V4L2_LOG("unmapped buffer %u plane %u\n", i, p);
 		}
 	}
 }
@@ -240,7 +313,7 @@ static void v4l2_unmap_buffers(int index)
 static int v4l2_streamon(int index)
 {
 	int result;
-	enum v4l2_buf_type type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+	enum v4l2_buf_type type = v4l2_buf_type(index);
 
 	if (!(devices[index].flags & V4L2_STREAMON)) {
 		result = devices[index].dev_ops->ioctl(
@@ -263,7 +336,7 @@ static int v4l2_streamon(int index)
 static int v4l2_streamoff(int index)
 {
 	int result;
-	enum v4l2_buf_type type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+	enum v4l2_buf_type type = v4l2_buf_type(index);
 
 	if (devices[index].flags & V4L2_STREAMON) {
 		result = devices[index].dev_ops->ioctl(
@@ -280,6 +353,9 @@ static int v4l2_streamoff(int index)
 
 		/* Stream off also dequeues all our buffers! */
 		devices[index].frame_queued = 0;
+
+		v4l2_log_convert_stats(devices[index].fd,
+				       devices[index].convert);
 	}
 
 	return 0;
@@ -297,8 +373,7 @@ static int v4l2_queue_read_buffer(int index, int buffer_index)
 	buf.type   = V4L2_BUF_TYPE_VIDEO_CAPTURE;
 	buf.memory = V4L2_MEMORY_MMAP;
 	buf.index  = buffer_index;
-	result = devices[index].dev_ops->ioctl(devices[index].dev_ops_priv,
-			devices[index].fd, VIDIOC_QBUF, &buf);
+	result = v4l2_buffer_ioctl(index, VIDIOC_QBUF, &buf, NULL);
 	if (result) {
 		int saved_err = errno;
 
@@ -311,11 +386,55 @@ static int v4l2_queue_read_buffer(int index, int buffer_index)
 	return 0;
 }
 
+/* Convert a dequeued buffer, multi-planar buffers get converted straight from
+   their planes */
+static int v4l2_convert_buffer(int index, struct v4l2_buffer *buf,
+		struct v4l2_plane *planes, unsigned char *dest, int dest_size)
+{
+	unsigned char *src[VIDEO_MAX_PLANES];
+	int src_size[VIDEO_MAX_PLANES];
+	unsigned int p;
+
+	if (!(devices[index].flags & V4L2_IS_MPLANE))
+		return v4lconvert_convert(devices[index].convert,
+				&devices[index].src_fmt, &devices[index].dest_fmt,
+				devices[index].frame_pointers[buf->index][0],
+				buf->bytesused, dest, dest_size);
+
+	for (p = 0; p < v4l2_no_planes(index); p++) {
+		unsigned int offset = MIN(planes[p].data_offset,
+					  planes[p].bytesused);
+
+		src[p] = devices[index].frame_pointers[buf->index][p] + offset;
+		src_size[p] = planes[p].bytesused - offset;
+	}
+
+	return v4lconvert_convert_mplane(devices[index].convert,
+			&devices[index].src_fmt, &devices[index].dest_fmt,
+			src, src_size, dest, dest_size);
+}
+
+/* When logging, log the conversion statistics every V4L2_LOG_STATS_FRAMES
+   frames */
+static void v4l2_log_periodic_stats(int index)
+{
+	struct v4lconvert_stats stats;
+
+	if (!v4l2_log_file)
+		return;
+
+	v4lconvert_get_stats(devices[index].convert, &stats);
+	if (stats.frames % V4L2_LOG_STATS_FRAMES == 0)
+		v4l2_log_convert_stats(devices[index].fd,
+				       devices[index].convert);
+}
+
 static int v4l2_dequeue_and_convert(int index, struct v4l2_buffer *buf,
 		unsigned char *dest, int dest_size)
 {
 	const int max_tries = V4L2_IGNORE_FIRST_FRAME_ERRORS + 1;
 	int result, tries = max_tries, frame_info_gen;
+	struct v4l2_plane planes[VIDEO_MAX_PLANES];
 
 	/* Make sure we have the real v4l2 buffers mapped */
 	result = v4l2_map_buffers(index);
@@ -325,9 +444,7 @@ static int v4l2_dequeue_and_convert(int index, struct v4l2_buffer *buf,
 	do {
 		frame_info_gen = devices[index].frame_info_generation;
 		pthread_mutex_unlock(&devices[index].stream_lock);
-		result = devices[index].dev_ops->ioctl(
-				devices[index].dev_ops_priv,
-				devices[index].fd, VIDIOC_DQBUF, buf);
+		result = v4l2_buffer_ioctl(index, VIDIOC_DQBUF, buf, planes);
 		pthread_mutex_lock(&devices[index].stream_lock);
 		if (result) {
 			if (errno != EAGAIN) {
@@ -346,12 +463,11 @@ static int v4l2_dequeue_and_convert(int index, struct v4l2_buffer *buf,
 			return -1;
 		}
 
-		result = v4lconvert_convert(devices[index].convert,
-				&devices[index].src_fmt, &devices[index].dest_fmt,
-				devices[index].frame_pointers[buf->index],
-				buf->bytesused, dest ? dest : (devices[index].convert_mmap_buf +
+		result = v4l2_convert_buffer(index, buf, planes,
+				dest ? dest : (devices[index].convert_mmap_buf +
 					buf->index * devices[index].convert_mmap_frame_size),
 				dest_size);
+		v4l2_log_periodic_stats(index);
 
 		if (devices[index].first_frame) {
 			/* Always treat convert errors as EAGAIN during the first few frames, as
@@ -436,6 +552,7 @@ static int v4l2_read_and_convert(int index, unsigned char *dest, int dest_size)
 		result = v4lconvert_convert(devices[index].convert,
 				&devices[index].src_fmt, &devices[index].dest_fmt,
 				devices[index].readbuf, result, dest, dest_size);
+		v4l2_log_periodic_stats(index);
 
 		if (devices[index].first_frame) {
 			/* Always treat convert errors as EAGAIN during the first few frames, as
@@ -484,7 +601,7 @@ static int v4l2_queue_read_buffers(int index)
 
 	for (i = 0; i < devices[index].no_frames; i++) {
 		/* Don't queue unmapped buffers (should never happen) */
-		if (devices[index].frame_pointers[i] != MAP_FAILED) {
+		if (devices[index].frame_pointers[i][0] != MAP_FAILED) {
 			if (v4l2_queue_read_buffer(index, i)) {
 				last_error = errno;
 				continue;
@@ -546,6 +663,10 @@ static int v4l2_needs_conversion(int index)
 	if (devices[index].convert == NULL)
 		return 0;
 
+	/* The app always gets single-planar buffers, filled by us */
+	if (devices[index].flags & V4L2_IS_MPLANE)
+		return 1;
+
 	return v4lconvert_needs_conversion(devices[index].convert,
 			&devices[index].src_fmt, &devices[index].dest_fmt);
 }
@@ -576,14 +697,12 @@ static int v4l2_buffers_mapped(int index)
 		struct v4l2_buffer buf;
 
 		for (i = 0; i < devices[index].no_frames; i++) {
+			memset(&buf, 0, sizeof(buf));
 			buf.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
 			buf.memory = V4L2_MEMORY_MMAP;
 			buf.index = i;
-			buf.reserved = buf.reserved2 = 0;
-			if (devices[index].dev_ops->ioctl(
-					devices[index].dev_ops_priv,
-					devices[index].fd, VIDIOC_QUERYBUF,
-					&buf)) {
+			if (v4l2_buffer_ioctl(index, VIDIOC_QUERYBUF, &buf,
+					      NULL)) {
 				int saved_err = errno;
 
 				V4L2_PERROR("querying buffer %u", i);
@@ -654,7 +773,7 @@ int v4l2_open(const char *file, int oflag, ...)
 
 int v4l2_fd_open(int fd, int v4l2_flags)
 {
-	int i, index;
+	int i, j, index;
 	char *lfname;
 	struct v4l2_capability cap;
 	struct v4l2_format fmt = { 0, };
@@ -664,6 +783,7 @@ int v4l2_fd_open(int fd, int v4l2_flags)
 	void *dev_ops_priv;
 	const struct libv4l_dev_ops *dev_ops;
 	long page_size;
+	int mplane = 0;
 
 	v4l2_plugin_init(fd, &plugin_library, &dev_ops_priv, &dev_ops);
 
@@ -697,12 +817,19 @@ int v4l2_fd_open(int fd, int v4l2_flags)
 
 	if (cap.capabilities & V4L2_CAP_DEVICE_CAPS)
 		cap.capabilities = cap.device_caps;
-	if (!(cap.capabilities & V4L2_CAP_VIDEO_CAPTURE) ||
+	/* Multi-planar only devices get used through the multi-planar api,
+	   we only do streaming io with those */
+	if (!(cap.capabilities & V4L2_CAP_VIDEO_CAPTURE) &&
+	    (cap.capabilities & V4L2_CAP_VIDEO_CAPTURE_MPLANE) &&
+	    (cap.capabilities & V4L2_CAP_STREAMING))
+		mplane = 1;
+	else if (!(cap.capabilities & V4L2_CAP_VIDEO_CAPTURE) ||
 	    !(cap.capabilities & (V4L2_CAP_STREAMING | V4L2_CAP_READWRITE)))
 		goto no_capture;
 
 	/* Get current cam format */
-	fmt.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+	fmt.type = mplane ? V4L2_BUF_TYPE_VIDEO_CAPTURE_MPLANE :
+			    V4L2_BUF_TYPE_VIDEO_CAPTURE;
 	if (dev_ops->ioctl(dev_ops_priv, fd, VIDIOC_G_FMT, &fmt)) {
 		int saved_err = errno;
 		V4L2_LOG_ERR("getting pixformat: %s\n", strerror(errno));
@@ -712,7 +839,7 @@ int v4l2_fd_open(int fd, int v4l2_flags)
 	}
 
 	/* Check for frame rate setting support */
-	parm.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+	parm.type = fmt.type;
 	if (dev_ops->ioctl(dev_ops_priv, fd, VIDIOC_G_PARM, &parm))
 		parm.type = 0;
 
@@ -751,6 +878,8 @@ no_capture:
 	}
 
 	devices[index].flags = v4l2_flags;
+	if (mplane)
+		devices[index].flags |= V4L2_IS_MPLANE;
 	if (cap.capabilities & V4L2_CAP_READWRITE)
 		devices[index].flags |= V4L2_SUPPORTS_READ;
 	if (!(cap.capabilities & V4L2_CAP_STREAMING)) {
@@ -759,8 +888,7 @@ no_capture:
 		   driver on the first read */
 		devices[index].first_frame = V4L2_IGNORE_FIRST_FRAME_ERRORS;
 	}
-	if ((parm.type == V4L2_BUF_TYPE_VIDEO_CAPTURE) &&
-	    (parm.parm.capture.capability & V4L2_CAP_TIMEPERFRAME))
+	if (parm.type && (parm.parm.capture.capability & V4L2_CAP_TIMEPERFRAME))
 		devices[index].flags |= V4L2_SUPPORTS_TIMEPERFRAME;
 	devices[index].open_count = 1;
 	devices[index].page_size = page_size;
@@ -777,7 +905,8 @@ no_capture:
 	devices[index].convert_mmap_buf = MAP_FAILED;
 	devices[index].convert_mmap_buf_size = 0;
 	for (i = 0; i < V4L2_MAX_NO_FRAMES; i++) {
-		devices[index].frame_pointers[i] = MAP_FAILED;
+		for (j = 0; j < VIDEO_MAX_PLANES; j++)
+			devices[index].frame_pointers[i][j] = MAP_FAILED;
 		devices[index].frame_map_count[i] = 0;
 	}
 	devices[index].frame_queued = 0;
@@ -792,6 +921,9 @@ no_capture:
 	   a frame rate using the S_PARM ioctl after a S_FMT */
 	if (devices[index].convert)
 		v4lconvert_set_fps(devices[index].convert, V4L2_DEFAULT_FPS);
+	/* Time the conversion stages, for the statistics in the log */
+	if (devices[index].convert && v4l2_log_file)
+		v4lconvert_set_stats_timing(devices[index].convert, 1);
 	v4l2_update_fps(index, &parm);
 
 	V4L2_LOG("open: %d\n", fd);
@@ -854,6 +986,7 @@ int v4l2_close(int fd)
 		devices[index].convert_mmap_buf = MAP_FAILED;
 		devices[index].convert_mmap_buf_size = 0;
 	}
+	v4l2_log_convert_stats(devices[index].fd, devices[index].convert);
 	v4lconvert_destroy(devices[index].convert);
 	free(devices[index].readbuf);
 	devices[index].readbuf = NULL;
@@ -942,6 +1075,19 @@ static int v4l2_pix_fmt_identical(struct v4l2_format *a, struct v4l2_format *b)
 static void v4l2_set_src_and_dest_format(int index,
 		struct v4l2_format *src_fmt, struct v4l2_format *dest_fmt)
 {
+	struct v4l2_format src_pix_fmt;
+
+	/* The app always sees the single-planar version of a multi-planar
+	   format, src_fmt gets stored as is */
+	if (src_fmt->type == V4L2_BUF_TYPE_VIDEO_CAPTURE_MPLANE) {
+		v4lconvert_mplane_to_pix(src_fmt, &src_pix_fmt);
+		devices[index].src_fmt = *src_fmt;
+		src_fmt = &src_pix_fmt;
+	} else
+		devices[index].src_fmt = *src_fmt;
+	if (dest_fmt->type == V4L2_BUF_TYPE_VIDEO_CAPTURE_MPLANE)
+		v4lconvert_mplane_to_pix(dest_fmt, dest_fmt);
+
 	/*
 	 * When a user does a try_fmt with the current dest_fmt and the
 	 * dest_fmt is a supported one we will align the resolution (see
@@ -970,7 +1116,6 @@ static void v4l2_set_src_and_dest_format(int index,
 	} else
 		v4lconvert_fixup_fmt(dest_fmt);
 
-	devices[index].src_fmt = *src_fmt;
 	devices[index].dest_fmt = *dest_fmt;
 	/* round up to full page size */
 	devices[index].convert_mmap_frame_size =
@@ -1044,7 +1189,7 @@ static int v4l2_s_fmt(int index, struct v4l2_format *dest_fmt)
 
 	if (devices[index].flags & V4L2_SUPPORTS_TIMEPERFRAME) {
 		struct v4l2_streamparm parm = {
-			.type = V4L2_BUF_TYPE_VIDEO_CAPTURE,
+			.type = v4l2_buf_type(index),
 		};
 		if (devices[index].dev_ops->ioctl(devices[index].dev_ops_priv,
 						  devices[index].fd,
@@ -1142,6 +1287,12 @@ int v4l2_ioctl(int fd, unsigned long int request, ...)
 				stream_needs_locking = 1;
 		}
 		break;
+	case VIDIOC_G_PARM:
+		if (((struct v4l2_streamparm *)arg)->type ==
+				V4L2_BUF_TYPE_VIDEO_CAPTURE &&
+				(devices[index].flags & V4L2_IS_MPLANE))
+			is_capture_request = 1;
+		break;
 	case VIDIOC_S_STD:
 	case VIDIOC_S_INPUT:
 	case VIDIOC_S_DV_TIMINGS:
@@ -1217,6 +1368,11 @@ no_capture_request:
 			/* We always support read() as we fake it using mmap mode */
 			cap->capabilities |= V4L2_CAP_READWRITE;
 			cap->device_caps |= V4L2_CAP_READWRITE;
+			/* And the single-planar api for multi-planar devices */
+			if (devices[index].flags & V4L2_IS_MPLANE) {
+				cap->capabilities |= V4L2_CAP_VIDEO_CAPTURE;
+				cap->device_caps |= V4L2_CAP_VIDEO_CAPTURE;
+			}
 		}
 		break;
 	}
@@ -1267,7 +1423,7 @@ no_capture_request:
 			break;
 
 		/* These ioctls may have changed the device's fmt */
-		src_fmt.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+		src_fmt.type = v4l2_buf_type(index);
 		result = devices[index].dev_ops->ioctl(
 				devices[index].dev_ops_priv,
 				fd, VIDIOC_G_FMT, &src_fmt);
@@ -1290,6 +1446,8 @@ no_capture_request:
 		v4l2_set_src_and_dest_format(index, &devices[index].src_fmt,
 					     &devices[index].dest_fmt);
 		/* and try to restore the last set destination pixelformat. */
+		if (src_fmt.type == V4L2_BUF_TYPE_VIDEO_CAPTURE_MPLANE)
+			v4lconvert_mplane_to_pix(&src_fmt, &src_fmt);
 		src_fmt.fmt.pix.pixelformat = orig_dest_pixelformat;
 		result = v4l2_s_fmt(index, &src_fmt);
 		if (result) {
@@ -1319,9 +1477,11 @@ no_capture_request:
 		if (req->count > V4L2_MAX_NO_FRAMES)
 			req->count = V4L2_MAX_NO_FRAMES;
 
+		req->type = v4l2_buf_type(index);
 		result = devices[index].dev_ops->ioctl(
 				devices[index].dev_ops_priv,
 				fd, VIDIOC_REQBUFS, req);
+		req->type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
 		if (result < 0)
 			break;
 		result = 0; /* some drivers return the number of buffers on success */
@@ -1342,9 +1502,7 @@ no_capture_request:
 
 		/* Do a real query even when converting to let the driver fill in
 		   things like buf->field */
-		result = devices[index].dev_ops->ioctl(
-				devices[index].dev_ops_priv,
-				fd, VIDIOC_QUERYBUF, buf);
+		result = v4l2_buffer_ioctl(index, VIDIOC_QUERYBUF, buf, NULL);
 
 		v4l2_set_conversion_buf_params(index, buf);
 		break;
@@ -1366,9 +1524,7 @@ no_capture_request:
 				break;
 		}
 
-		result = devices[index].dev_ops->ioctl(
-				devices[index].dev_ops_priv,
-				fd, VIDIOC_QBUF, arg);
+		result = v4l2_buffer_ioctl(index, VIDIOC_QBUF, buf, NULL);
 
 		v4l2_set_conversion_buf_params(index, buf);
 		break;
@@ -1385,9 +1541,8 @@ no_capture_request:
 
 		if (!v4l2_needs_conversion(index)) {
 			pthread_mutex_unlock(&devices[index].stream_lock);
-			result = devices[index].dev_ops->ioctl(
-					devices[index].dev_ops_priv,
-					fd, VIDIOC_DQBUF, buf);
+			result = v4l2_buffer_ioctl(index, VIDIOC_DQBUF, buf,
+						   NULL);
 			pthread_mutex_lock(&devices[index].stream_lock);
 			if (result) {
 				saved_err = errno;
@@ -1442,9 +1597,11 @@ no_capture_request:
 			v4l2_adjust_src_fmt_to_fps(index, fps);
 		}
 
+		parm->type = v4l2_buf_type(index);
 		result = devices[index].dev_ops->ioctl(
 						devices[index].dev_ops_priv,
 						fd, VIDIOC_S_PARM, parm);
+		parm->type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
 		if (result)
 			break;
 
@@ -1452,6 +1609,17 @@ no_capture_request:
 		break;
 	}
 
+	case VIDIOC_G_PARM: {
+		struct v4l2_streamparm *parm = arg;
+
+		parm->type = V4L2_BUF_TYPE_VIDEO_CAPTURE_MPLANE;
+		result = devices[index].dev_ops->ioctl(
+				devices[index].dev_ops_priv,
+				fd, VIDIOC_G_PARM, parm);
+		parm->type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+		break;
+	}
+
 	default:
 		result = devices[index].dev_ops->ioctl(
 				devices[index].dev_ops_priv,
@@ -1574,6 +1742,9 @@ ssize_t v4l2_read(int fd, void *dest, size_t n)
 	if (!(devices[index].flags & V4L2_STREAM_CONTROLLED_BY_READ) &&
 			!(devices[index].flags & V4L2_USE_READ_FOR_READ)) {
 		result = v4l2_activate_read_stream(index);
+		/* Multi-planar devices cannot fall back to read() */
+		if (result && (devices[index].flags & V4L2_IS_MPLANE))
+			goto leave;
 		if (result) {
 			/* Activating mmap mode failed, use read() instead */
 			devices[index].flags |= V4L2_USE_READ_FOR_READ;
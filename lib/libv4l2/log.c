@@ -262,3 +262,42 @@ void v4l2_log_ioctl(unsigned long int request, void *arg, int result)
 
 	fflush(v4l2_log_file);
 }
+
+void v4l2_log_convert_stats(int fd, struct v4lconvert_data *convert)
+{
+	static const char *stage_names[V4LCONVERT_STAGE_COUNT] = {
+		[V4LCONVERT_STAGE_DECODE]     = "decode",
+		[V4LCONVERT_STAGE_CONVERT]    = "convert",
+		[V4LCONVERT_STAGE_PROCESSING] = "processing",
+		[V4LCONVERT_STAGE_ROTATE]     = "rotate",
+		[V4LCONVERT_STAGE_FLIP]       = "flip",
+		[V4LCONVERT_STAGE_CROP]       = "crop",
+		[V4LCONVERT_STAGE_PACK]       = "pack",
+	};
+	struct v4lconvert_stats stats;
+	int i;
+
+	if (!v4l2_log_file || !convert)
+		return;
+
+	v4lconvert_get_stats(convert, &stats);
+	if (!stats.frames)
+		return;
+
+	fprintf(v4l2_log_file, "libv4l2: conversion stats fd %d: %llu frames, "
+		"%llu decode errors, %llu short frames, %llu buffer reallocs, "
+		"%.3f ms per frame\n", fd, stats.frames, stats.decode_errors,
+		stats.short_frames, stats.buffer_reallocs,
+		stats.total_ns / 1000000.0 / stats.frames);
+	for (i = 0; i < V4LCONVERT_STAGE_COUNT; i++) {
+		if (!stats.stage_frames[i])
+			continue;
+
+		fprintf(v4l2_log_file, "libv4l2:   %-10s: %llu frames, "
+			"%.3f ms per frame\n", stage_names[i],
+			stats.stage_frames[i],
+			stats.stage_ns[i] / 1000000.0 / stats.stage_frames[i]);
+	}
+
+	fflush(v4l2_log_file);
+}
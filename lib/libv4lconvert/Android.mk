@@ -4,12 +4,18 @@ include $(CLEAR_VARS)
 
 LOCAL_SRC_FILES := \
     bayer.c \
+    bayer-simd.c \
+    async.c \
+    capcache.c \
     cpia1.c \
+    cpu.c \
     crop.c \
     flip.c \
+    flip-simd.c \
     helper.c \
     hm12.c \
-    jidctflt.c \
+    jidctint.c \
+    jidctint-simd.c \
     jl2005bcd.c \
     jpeg.c \
     jpeg_memsrcdest.c \
@@ -18,6 +24,11 @@ LOCAL_SRC_FILES := \
     mr97310a.c \
     pac207.c \
     rgbyuv.c \
+    rgbyuv-simd.c \
+    pack-simd.c \
+    pool.c \
+    scale.c \
+    scale-simd.c \
     se401.c \
     sn9c10x.c \
     sn9c2028-decomp.c \
@@ -26,6 +37,7 @@ LOCAL_SRC_FILES := \
     spca561-decompress.c \
     sq905c.c \
     stv0680.c \
+    threads.c \
     tinyjpeg.c \
     control/libv4lcontrol.c \
     processing/autogain.c  \
@@ -0,0 +1,310 @@
+/*
+
+# Asynchronous conversion, frames submitted with v4lconvert_submit() get
+# converted by a worker thread and are handed back by
+# v4lconvert_poll_complete()
+
+# This program is free software; you can redistribute it and/or modify
+# it under the terms of the GNU Lesser General Public License as published by
+# the Free Software Foundation; either version 2.1 of the License, or
+# (at your option) any later version.
+#
+# This program is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU Lesser General Public License for more details.
+#
+# You should have received a copy of the GNU Lesser General Public License
+# along with this program; if not, write to the Free Software
+# Foundation, Inc., 51 Franklin Street, Suite 500, Boston, MA  02110-1335  USA
+
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include "libv4lconvert-priv.h"
+#ifdef HAVE_SYS_EVENTFD_H
+#include <sys/eventfd.h>
+#endif
+
+struct v4lconvert_job {
+	struct v4l2_format src_fmt;
+	struct v4l2_format dest_fmt;
+	unsigned char *src;
+	unsigned char *dest;
+	int src_size;
+	int dest_size;
+	void *cookie;
+	int result;
+	int error;
+	char error_msg[V4LCONVERT_ERROR_MSG_SIZE];
+};
+
+struct v4lconvert_async {
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+	pthread_t worker;
+	int exit;
+	/* Error message of the job being converted, only used by the worker */
+	char *error_buf;
+	/* Holds 1 count (eventfd) or byte (pipe) per completed job not yet
+	   returned, so it is readable when there are completed jobs. With an
+	   eventfd both fds are the same. */
+	int fds[2];
+	/* Ring of jobs, the indices only ever increase. Jobs first - next are
+	   completed, next - last are waiting for the worker. The job at next
+	   is owned by the worker while it converts it. */
+	struct v4lconvert_job jobs[V4LCONVERT_MAX_JOBS];
+	unsigned int first;
+	unsigned int next;
+	unsigned int last;
+};
+
+static void v4lconvert_async_notify(struct v4lconvert_async *async)
+{
+#ifdef HAVE_SYS_EVENTFD_H
+	uint64_t count = 1;
+#else
+	char count = 0;
+#endif
+
+	while (write(async->fds[1], &count, sizeof(count)) == -1 &&
+			errno == EINTR)
+		;
+}
+
+/* Returns 0 when a completion was consumed, -1 when there was none */
+static int v4lconvert_async_consume(struct v4lconvert_async *async)
+{
+#ifdef HAVE_SYS_EVENTFD_H
+	uint64_t count;
+#else
+	char count;
+#endif
+	int res;
+
+	do {
+		res = read(async->fds[0], &count, sizeof(count));
+	} while (res == -1 && errno == EINTR);
+
+	return res == sizeof(count) ? 0 : -1;
+}
+
+static void *v4lconvert_async_worker(void *arg)
+{
+	struct v4lconvert_data *data = arg;
+	struct v4lconvert_async *async = data->async;
+	struct v4lconvert_job *job;
+
+	pthread_mutex_lock(&async->lock);
+	while (1) {
+		while (!async->exit && async->next == async->last)
+			pthread_cond_wait(&async->cond, &async->lock);
+		if (async->exit)
+			break;
+
+		job = &async->jobs[async->next % V4LCONVERT_MAX_JOBS];
+		pthread_mutex_unlock(&async->lock);
+
+		job->error_msg[0] = 0;
+		async->error_buf = job->error_msg;
+		job->result = v4lconvert_convert(data, &job->src_fmt,
+				&job->dest_fmt, job->src, job->src_size,
+				job->dest, job->dest_size);
+		job->error = job->result == -1 ? errno : 0;
+
+		pthread_mutex_lock(&async->lock);
+		async->next++;
+		v4lconvert_async_notify(async);
+	}
+	pthread_mutex_unlock(&async->lock);
+
+	return NULL;
+}
+
+static void v4lconvert_async_free(struct v4lconvert_async *async)
+{
+	close(async->fds[0]);
+	if (async->fds[1] != async->fds[0])
+		close(async->fds[1]);
+	pthread_cond_destroy(&async->cond);
+	pthread_mutex_destroy(&async->lock);
+	free(async);
+}
+
+/* The worker thread only gets started when it is needed, most users of
+   libv4lconvert never submit a job */
+static int v4lconvert_async_create(struct v4lconvert_data *data)
+{
+	struct v4lconvert_async *async;
+	int res;
+
+	async = calloc(1, sizeof(*async));
+	if (!async)
+		goto error;
+
+#ifdef HAVE_SYS_EVENTFD_H
+	async->fds[0] = eventfd(0, EFD_SEMAPHORE | EFD_NONBLOCK | EFD_CLOEXEC);
+	if (async->fds[0] == -1) {
+		free(async);
+		goto error;
+	}
+	async->fds[1] = async->fds[0];
+#else
+	if (pipe(async->fds)) {
+		free(async);
+		goto error;
+	}
+	fcntl(async->fds[0], F_SETFL, O_NONBLOCK);
+	fcntl(async->fds[0], F_SETFD, FD_CLOEXEC);
+	fcntl(async->fds[1], F_SETFD, FD_CLOEXEC);
+#endif
+
+	pthread_mutex_init(&async->lock, NULL);
+	pthread_cond_init(&async->cond, NULL);
+
+	/* Held until async->worker is set, v4lconvert_error_buf() compares
+	   it against the thread it gets called from */
+	pthread_mutex_lock(&async->lock);
+	data->async = async;
+	res = pthread_create(&async->worker, NULL, v4lconvert_async_worker,
+			     data);
+	pthread_mutex_unlock(&async->lock);
+	if (res) {
+		data->async = NULL;
+		errno = res;
+		v4lconvert_async_free(async);
+		goto error;
+	}
+
+	return 0;
+
+error:
+	V4LCONVERT_ERR("creating conversion worker thread: %s\n",
+		       strerror(errno));
+	return -1;
+}
+
+int v4lconvert_submit(struct v4lconvert_data *data,
+		const struct v4l2_format *src_fmt,  /* in */
+		const struct v4l2_format *dest_fmt, /* in */
+		unsigned char *src, int src_size, unsigned char *dest, int dest_size,
+		void *cookie)
+{
+	struct v4lconvert_async *async;
+	struct v4lconvert_job *job;
+
+	if (src_fmt->type != V4L2_BUF_TYPE_VIDEO_CAPTURE) {
+		V4LCONVERT_ERR("async conversion needs a single-planar format\n");
+		errno = EINVAL;
+		return -1;
+	}
+
+	if (!data->async && v4lconvert_async_create(data))
+		return -1;
+	async = data->async;
+
+	pthread_mutex_lock(&async->lock);
+	if (async->last - async->first == V4LCONVERT_MAX_JOBS) {
+		pthread_mutex_unlock(&async->lock);
+		V4LCONVERT_ERR("too many pending conversion jobs\n");
+		errno = EAGAIN;
+		return -1;
+	}
+
+	job = &async->jobs[async->last % V4LCONVERT_MAX_JOBS];
+	job->src_fmt = *src_fmt;
+	job->dest_fmt = *dest_fmt;
+	job->src = src;
+	job->src_size = src_size;
+	job->dest = dest;
+	job->dest_size = dest_size;
+	job->cookie = cookie;
+	async->last++;
+	pthread_cond_signal(&async->cond);
+	pthread_mutex_unlock(&async->lock);
+
+	return 0;
+}
+
+int v4lconvert_poll_complete(struct v4lconvert_data *data,
+		struct v4lconvert_completion *completion, int timeout)
+{
+	struct v4lconvert_async *async = data->async;
+	struct v4lconvert_job *job;
+	struct pollfd pfd;
+	int res;
+
+	if (!async)
+		return 0;
+
+	pthread_mutex_lock(&async->lock);
+	res = async->first != async->last;
+	pthread_mutex_unlock(&async->lock);
+	if (!res)
+		return 0;
+
+	pfd.fd = async->fds[0];
+	pfd.events = POLLIN;
+	do {
+		res = poll(&pfd, 1, timeout);
+	} while (res == -1 && errno == EINTR && timeout < 0);
+	if (res <= 0)
+		return res;
+
+	/* Another thread may have taken the completion in the mean time */
+	if (v4lconvert_async_consume(async))
+		return 0;
+
+	pthread_mutex_lock(&async->lock);
+	job = &async->jobs[async->first % V4LCONVERT_MAX_JOBS];
+	completion->cookie = job->cookie;
+	completion->result = job->result;
+	completion->error = job->error;
+	strcpy(completion->error_msg, job->error_msg);
+	async->first++;
+	pthread_mutex_unlock(&async->lock);
+
+	return 1;
+}
+
+char *v4lconvert_error_buf(struct v4lconvert_data *data)
+{
+	struct v4lconvert_async *async = data->async;
+
+	if (async && pthread_equal(pthread_self(), async->worker))
+		return async->error_buf;
+
+	return data->error_msg;
+}
+
+int v4lconvert_get_complete_fd(struct v4lconvert_data *data)
+{
+	if (!data->async && v4lconvert_async_create(data))
+		return -1;
+
+	return data->async->fds[0];
+}
+
+void v4lconvert_async_destroy(struct v4lconvert_data *data)
+{
+	struct v4lconvert_async *async = data->async;
+
+	if (!async)
+		return;
+
+	pthread_mutex_lock(&async->lock);
+	async->exit = 1;
+	pthread_cond_signal(&async->cond);
+	pthread_mutex_unlock(&async->lock);
+	pthread_join(async->worker, NULL);
+
+	data->async = NULL;
+	v4lconvert_async_free(async);
+}
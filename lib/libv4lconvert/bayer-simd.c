@@ -0,0 +1,644 @@
+/*
+
+# SIMD versions of the inner loops of the bayer demosaicing routines, and of
+# converting high bit depth bayer to 8 bit
+
+# These produce the exact same output as the plain C code in bayer.c, which
+# stays the reference implementation and handles the borders and the
+# left-over pixels at the end of each line.
+
+# This program is free software; you can redistribute it and/or modify
+# it under the terms of the GNU Lesser General Public License as published by
+# the Free Software Foundation; either version 2.1 of the License, or
+# (at your option) any later version.
+#
+# This program is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU Lesser General Public License for more details.
+#
+# You should have received a copy of the GNU Lesser General Public License
+# along with this program; if not, write to the Free Software
+# Foundation, Inc., 51 Franklin Street, Suite 500, Boston, MA  02110-1335  USA
+
+ */
+
+#include "libv4lconvert-priv.h"
+#include "simd-priv.h"
+
+/*
+ * The line kernels work on pixel pairs, for a pair starting at bayer[x]:
+ * a is the non green pixel at bayer[stride + x + 1], which gets its missing
+ * colors from its 4 diagonal (t0) and 4 horizontal / vertical (t1)
+ * neighbours, and b is the green pixel at bayer[stride + x + 2], which gets
+ * its missing colors from its 2 vertical (t0) and 2 horizontal (t1)
+ * neighbours. Which of t0 and the center pixel is red and which is blue
+ * depends on blue_line.
+ *
+ * In the 16 bit lanes used below "even" holds the bytes at bayer[x + 2k]
+ * and "odd" the bytes at bayer[x + 2k + 1].
+ */
+
+/* Luma weights from bayer.c, 8453 / 16594 / 3223 scaled for the number of
+   neighbours summed */
+#define Y_BLUE_A_C    8453
+#define Y_BLUE_A_T1   4148
+#define Y_BLUE_A_T0    806
+#define Y_BLUE_B_C   16594
+#define Y_BLUE_B_T1   4226
+#define Y_BLUE_B_T0   1611
+#define Y_RED_A_C     3223
+#define Y_RED_A_T1    4148
+#define Y_RED_A_T0    2113
+#define Y_RED_B_C    16594
+#define Y_RED_B_T1    1611
+#define Y_RED_B_T0    4226
+
+#ifdef HAVE_V4LCONVERT_X86_SIMD
+
+static inline V4LCONVERT_TARGET("ssse3") void load_even_odd_ssse3(
+		const unsigned char *src, __m128i *even, __m128i *odd)
+{
+	__m128i v = _mm_loadu_si128((const __m128i *)src);
+
+	*even = _mm_and_si128(v, _mm_set1_epi16(0x00ff));
+	*odd = _mm_srli_epi16(v, 8);
+}
+
+/* (ka * a + kb * b + kc * c + round) >> 15 for 16 bit signed a, b and c */
+static inline V4LCONVERT_TARGET("ssse3") __m128i weigh3_ssse3(
+		__m128i a, int ka, __m128i b, int kb, __m128i c, int kc, int round)
+{
+	const __m128i kab = _mm_set1_epi32(V4LCONVERT_COEF_PAIR(ka, kb));
+	const __m128i kc0 = _mm_set1_epi32(V4LCONVERT_COEF_PAIR(kc, 0));
+	const __m128i r = _mm_set1_epi32(round);
+	const __m128i zero = _mm_setzero_si128();
+	__m128i lo, hi;
+
+	lo = _mm_add_epi32(_mm_madd_epi16(_mm_unpacklo_epi16(a, b), kab),
+			   _mm_madd_epi16(_mm_unpacklo_epi16(c, zero), kc0));
+	hi = _mm_add_epi32(_mm_madd_epi16(_mm_unpackhi_epi16(a, b), kab),
+			   _mm_madd_epi16(_mm_unpackhi_epi16(c, zero), kc0));
+	lo = _mm_srai_epi32(_mm_add_epi32(lo, r), 15);
+	hi = _mm_srai_epi32(_mm_add_epi32(hi, r), 15);
+
+	return _mm_packs_epi32(lo, hi);
+}
+
+/* Interleave 8 16 bit a pixel values with 8 b pixel values to 16 bytes */
+static inline V4LCONVERT_TARGET("ssse3") __m128i pairs_ssse3(__m128i a,
+		__m128i b)
+{
+	return _mm_or_si128(a, _mm_slli_epi16(b, 8));
+}
+
+static V4LCONVERT_TARGET("ssse3") int bayer_line_to_rgb24_ssse3(
+		const unsigned char *bayer, int stride, unsigned char *dest,
+		int len, int blue_line)
+{
+	const __m128i two = _mm_set1_epi16(2);
+	int x;
+
+	for (x = 0; x + 18 <= len; x += 16) {
+		const unsigned char *b = bayer + x;
+		__m128i e0, o0, e0n, e1, o1, e1n, o1n, e2, o2, e2n, dummy;
+		__m128i t0a, t1a, t0b, t1b, c0, c1, c2;
+
+		load_even_odd_ssse3(b, &e0, &o0);
+		load_even_odd_ssse3(b + 2, &e0n, &dummy);
+		load_even_odd_ssse3(b + stride, &e1, &o1);
+		load_even_odd_ssse3(b + stride + 2, &e1n, &o1n);
+		load_even_odd_ssse3(b + stride * 2, &e2, &o2);
+		load_even_odd_ssse3(b + stride * 2 + 2, &e2n, &dummy);
+
+		t0a = _mm_srli_epi16(_mm_add_epi16(_mm_add_epi16(e0, e0n),
+				_mm_add_epi16(_mm_add_epi16(e2, e2n), two)), 2);
+		t1a = _mm_srli_epi16(_mm_add_epi16(_mm_add_epi16(o0, e1),
+				_mm_add_epi16(_mm_add_epi16(e1n, o2), two)), 2);
+		t0b = _mm_avg_epu16(e0n, e2n);
+		t1b = _mm_avg_epu16(o1, o1n);
+
+		c1 = pairs_ssse3(t1a, e1n);
+		if (blue_line) {
+			c0 = pairs_ssse3(t0a, t0b);
+			c2 = pairs_ssse3(o1, t1b);
+		} else {
+			c0 = pairs_ssse3(o1, t1b);
+			c2 = pairs_ssse3(t0a, t0b);
+		}
+		store_rgb24_ssse3(dest + x * 3, c0, c1, c2);
+	}
+
+	return x;
+}
+
+static V4LCONVERT_TARGET("ssse3") int bayer_line_to_y_ssse3(
+		const unsigned char *bayer, int stride, unsigned char *ydst,
+		int len, int blue_line)
+{
+	int x;
+
+	for (x = 0; x + 18 <= len; x += 16) {
+		const unsigned char *b = bayer + x;
+		__m128i e0, o0, e0n, e1, o1, e1n, o1n, e2, o2, e2n, dummy;
+		__m128i t0a, t1a, t0b, t1b, ya, yb;
+
+		load_even_odd_ssse3(b, &e0, &o0);
+		load_even_odd_ssse3(b + 2, &e0n, &dummy);
+		load_even_odd_ssse3(b + stride, &e1, &o1);
+		load_even_odd_ssse3(b + stride + 2, &e1n, &o1n);
+		load_even_odd_ssse3(b + stride * 2, &e2, &o2);
+		load_even_odd_ssse3(b + stride * 2 + 2, &e2n, &dummy);
+
+		t0a = _mm_add_epi16(_mm_add_epi16(e0, e0n), _mm_add_epi16(e2, e2n));
+		t1a = _mm_add_epi16(_mm_add_epi16(o0, e1), _mm_add_epi16(e1n, o2));
+		t0b = _mm_add_epi16(e0n, e2n);
+		t1b = _mm_add_epi16(o1, o1n);
+
+		if (blue_line) {
+			ya = weigh3_ssse3(t0a, Y_BLUE_A_T0, t1a, Y_BLUE_A_T1,
+					  o1, Y_BLUE_A_C, 524288);
+			yb = weigh3_ssse3(t0b, Y_BLUE_B_T0, t1b, Y_BLUE_B_T1,
+					  e1n, Y_BLUE_B_C, 524288);
+		} else {
+			ya = weigh3_ssse3(t0a, Y_RED_A_T0, t1a, Y_RED_A_T1,
+					  o1, Y_RED_A_C, 524288);
+			yb = weigh3_ssse3(t0b, Y_RED_B_T0, t1b, Y_RED_B_T1,
+					  e1n, Y_RED_B_C, 524288);
+		}
+		_mm_storeu_si128((__m128i *)(ydst + x), pairs_ssse3(ya, yb));
+	}
+
+	return x;
+}
+
+static V4LCONVERT_TARGET("ssse3") int bayer_to_uv_ssse3(
+		const unsigned char *bayer, int stride, unsigned char *udst,
+		unsigned char *vdst, int width, unsigned int pixfmt)
+{
+	int x;
+
+	for (x = 0; x + 16 <= width; x += 16) {
+		__m128i e0, o0, e1, o1, r, g, b, u, v;
+
+		load_even_odd_ssse3(bayer + x, &e0, &o0);
+		load_even_odd_ssse3(bayer + stride + x, &e1, &o1);
+
+		switch (pixfmt) {
+		case V4L2_PIX_FMT_SBGGR8:
+			b = e0;
+			g = _mm_add_epi16(o0, e1);
+			r = o1;
+			break;
+		case V4L2_PIX_FMT_SRGGB8:
+			r = e0;
+			g = _mm_add_epi16(o0, e1);
+			b = o1;
+			break;
+		case V4L2_PIX_FMT_SGBRG8:
+			g = _mm_add_epi16(e0, o1);
+			b = o0;
+			r = e1;
+			break;
+		default: /* V4L2_PIX_FMT_SGRBG8 */
+			g = _mm_add_epi16(e0, o1);
+			r = o0;
+			b = e1;
+			break;
+		}
+
+		u = weigh3_ssse3(r, -4878, g, -4789, b, 14456, 4210688);
+		v = weigh3_ssse3(r, 14456, g, -6052, b, -2351, 4210688);
+		_mm_storel_epi64((__m128i *)(udst + x / 2), _mm_packus_epi16(u, u));
+		_mm_storel_epi64((__m128i *)(vdst + x / 2), _mm_packus_epi16(v, v));
+	}
+
+	return x;
+}
+
+static inline V4LCONVERT_TARGET("avx2") void load_even_odd_avx2(
+		const unsigned char *src, __m256i *even, __m256i *odd)
+{
+	__m256i v = _mm256_loadu_si256((const __m256i *)src);
+
+	*even = _mm256_and_si256(v, _mm256_set1_epi16(0x00ff));
+	*odd = _mm256_srli_epi16(v, 8);
+}
+
+static inline V4LCONVERT_TARGET("avx2") __m256i weigh3_avx2(
+		__m256i a, int ka, __m256i b, int kb, __m256i c, int kc, int round)
+{
+	const __m256i kab = _mm256_set1_epi32(V4LCONVERT_COEF_PAIR(ka, kb));
+	const __m256i kc0 = _mm256_set1_epi32(V4LCONVERT_COEF_PAIR(kc, 0));
+	const __m256i r = _mm256_set1_epi32(round);
+	const __m256i zero = _mm256_setzero_si256();
+	__m256i lo, hi;
+
+	/* unpack and pack both work per 128 bit lane, so the element order
+	   is preserved */
+	lo = _mm256_add_epi32(_mm256_madd_epi16(_mm256_unpacklo_epi16(a, b), kab),
+			      _mm256_madd_epi16(_mm256_unpacklo_epi16(c, zero), kc0));
+	hi = _mm256_add_epi32(_mm256_madd_epi16(_mm256_unpackhi_epi16(a, b), kab),
+			      _mm256_madd_epi16(_mm256_unpackhi_epi16(c, zero), kc0));
+	lo = _mm256_srai_epi32(_mm256_add_epi32(lo, r), 15);
+	hi = _mm256_srai_epi32(_mm256_add_epi32(hi, r), 15);
+
+	return _mm256_packs_epi32(lo, hi);
+}
+
+static inline V4LCONVERT_TARGET("avx2") __m256i pairs_avx2(__m256i a,
+		__m256i b)
+{
+	return _mm256_or_si256(a, _mm256_slli_epi16(b, 8));
+}
+
+static V4LCONVERT_TARGET("avx2") int bayer_line_to_rgb24_avx2(
+		const unsigned char *bayer, int stride, unsigned char *dest,
+		int len, int blue_line)
+{
+	const __m256i two = _mm256_set1_epi16(2);
+	int x;
+
+	for (x = 0; x + 34 <= len; x += 32) {
+		const unsigned char *b = bayer + x;
+		__m256i e0, o0, e0n, e1, o1, e1n, o1n, e2, o2, e2n, dummy;
+		__m256i t0a, t1a, t0b, t1b, c0, c1, c2;
+
+		load_even_odd_avx2(b, &e0, &o0);
+		load_even_odd_avx2(b + 2, &e0n, &dummy);
+		load_even_odd_avx2(b + stride, &e1, &o1);
+		load_even_odd_avx2(b + stride + 2, &e1n, &o1n);
+		load_even_odd_avx2(b + stride * 2, &e2, &o2);
+		load_even_odd_avx2(b + stride * 2 + 2, &e2n, &dummy);
+
+		t0a = _mm256_srli_epi16(_mm256_add_epi16(_mm256_add_epi16(e0, e0n),
+				_mm256_add_epi16(_mm256_add_epi16(e2, e2n), two)), 2);
+		t1a = _mm256_srli_epi16(_mm256_add_epi16(_mm256_add_epi16(o0, e1),
+				_mm256_add_epi16(_mm256_add_epi16(e1n, o2), two)), 2);
+		t0b = _mm256_avg_epu16(e0n, e2n);
+		t1b = _mm256_avg_epu16(o1, o1n);
+
+		c1 = pairs_avx2(t1a, e1n);
+		if (blue_line) {
+			c0 = pairs_avx2(t0a, t0b);
+			c2 = pairs_avx2(o1, t1b);
+		} else {
+			c0 = pairs_avx2(o1, t1b);
+			c2 = pairs_avx2(t0a, t0b);
+		}
+		store_rgb24_ssse3(dest + x * 3, _mm256_castsi256_si128(c0),
+				  _mm256_castsi256_si128(c1),
+				  _mm256_castsi256_si128(c2));
+		store_rgb24_ssse3(dest + x * 3 + 48,
+				  _mm256_extracti128_si256(c0, 1),
+				  _mm256_extracti128_si256(c1, 1),
+				  _mm256_extracti128_si256(c2, 1));
+	}
+
+	return x;
+}
+
+static V4LCONVERT_TARGET("avx2") int bayer_line_to_y_avx2(
+		const unsigned char *bayer, int stride, unsigned char *ydst,
+		int len, int blue_line)
+{
+	int x;
+
+	for (x = 0; x + 34 <= len; x += 32) {
+		const unsigned char *b = bayer + x;
+		__m256i e0, o0, e0n, e1, o1, e1n, o1n, e2, o2, e2n, dummy;
+		__m256i t0a, t1a, t0b, t1b, ya, yb;
+
+		load_even_odd_avx2(b, &e0, &o0);
+		load_even_odd_avx2(b + 2, &e0n, &dummy);
+		load_even_odd_avx2(b + stride, &e1, &o1);
+		load_even_odd_avx2(b + stride + 2, &e1n, &o1n);
+		load_even_odd_avx2(b + stride * 2, &e2, &o2);
+		load_even_odd_avx2(b + stride * 2 + 2, &e2n, &dummy);
+
+		t0a = _mm256_add_epi16(_mm256_add_epi16(e0, e0n),
+				       _mm256_add_epi16(e2, e2n));
+		t1a = _mm256_add_epi16(_mm256_add_epi16(o0, e1),
+				       _mm256_add_epi16(e1n, o2));
+		t0b = _mm256_add_epi16(e0n, e2n);
+		t1b = _mm256_add_epi16(o1, o1n);
+
+		if (blue_line) {
+			ya = weigh3_avx2(t0a, Y_BLUE_A_T0, t1a, Y_BLUE_A_T1,
+					 o1, Y_BLUE_A_C, 524288);
+			yb = weigh3_avx2(t0b, Y_BLUE_B_T0, t1b, Y_BLUE_B_T1,
+					 e1n, Y_BLUE_B_C, 524288);
+		} else {
+			ya = weigh3_avx2(t0a, Y_RED_A_T0, t1a, Y_RED_A_T1,
+					 o1, Y_RED_A_C, 524288);
+			yb = weigh3_avx2(t0b, Y_RED_B_T0, t1b, Y_RED_B_T1,
+					 e1n, Y_RED_B_C, 524288);
+		}
+		_mm256_storeu_si256((__m256i *)(ydst + x), pairs_avx2(ya, yb));
+	}
+
+	return x;
+}
+
+/* The msb bytes of packed raw10 / raw12 are the first 4 of each 5 resp. the
+   first 2 of each 3 bytes, 8 samples take 10 resp. 12 bytes */
+static V4LCONVERT_TARGET("ssse3") int bayer_unpack_packed_ssse3(
+		const unsigned char *src, int src_len, unsigned char *dest,
+		int width, int packing)
+{
+	const int group = packing == V4LCONVERT_BAYER_PACKED10 ? 10 : 12;
+	const __m128i shuf = packing == V4LCONVERT_BAYER_PACKED10 ?
+		_mm_setr_epi8(0, 1, 2, 3, 5, 6, 7, 8, -1, -1, -1, -1, -1, -1, -1, -1) :
+		_mm_setr_epi8(0, 1, 3, 4, 6, 7, 9, 10, -1, -1, -1, -1, -1, -1, -1, -1);
+	int x;
+
+	for (x = 0; x + 16 <= width && (x / 8 + 1) * group + 16 <= src_len;
+	     x += 16) {
+		const unsigned char *s = src + x / 8 * group;
+		__m128i lo = _mm_shuffle_epi8(
+			_mm_loadu_si128((const __m128i *)s), shuf);
+		__m128i hi = _mm_shuffle_epi8(
+			_mm_loadu_si128((const __m128i *)(s + group)), shuf);
+
+		_mm_storeu_si128((__m128i *)(dest + x),
+				 _mm_unpacklo_epi64(lo, hi));
+	}
+
+	return x;
+}
+
+/* Masking before packing truncates the same way the C code does */
+static V4LCONVERT_TARGET("sse2") int bayer_unpack_16bit_sse2(
+		const unsigned char *src, unsigned char *dest, int width,
+		int shift)
+{
+	const __m128i count = _mm_cvtsi32_si128(shift);
+	const __m128i mask = _mm_set1_epi16(0x00ff);
+	int x;
+
+	for (x = 0; x + 16 <= width; x += 16) {
+		__m128i a = _mm_loadu_si128((const __m128i *)(src + 2 * x));
+		__m128i b = _mm_loadu_si128((const __m128i *)(src + 2 * x + 16));
+
+		a = _mm_and_si128(_mm_srl_epi16(a, count), mask);
+		b = _mm_and_si128(_mm_srl_epi16(b, count), mask);
+		_mm_storeu_si128((__m128i *)(dest + x), _mm_packus_epi16(a, b));
+	}
+
+	return x;
+}
+
+#endif /* HAVE_V4LCONVERT_X86_SIMD */
+
+#ifdef HAVE_V4LCONVERT_NEON
+
+/* (ka * a + kb * b + kc * c + 524288) >> 15 for 8 unsigned a, b and c */
+static inline uint8x8_t weigh3_neon(uint16x8_t a, int ka, uint16x8_t b,
+		int kb, uint16x8_t c, int kc)
+{
+	const uint32x4_t r = vdupq_n_u32(524288);
+	uint32x4_t lo, hi;
+
+	lo = vmlal_n_u16(vmlal_n_u16(vmlal_n_u16(r, vget_low_u16(a), ka),
+			vget_low_u16(b), kb), vget_low_u16(c), kc);
+	hi = vmlal_n_u16(vmlal_n_u16(vmlal_n_u16(r, vget_high_u16(a), ka),
+			vget_high_u16(b), kb), vget_high_u16(c), kc);
+
+	return vmovn_u16(vcombine_u16(vshrn_n_u32(lo, 15), vshrn_n_u32(hi, 15)));
+}
+
+static inline uint16x8_t add4_lo_neon(uint8x16_t a, uint8x16_t b,
+		uint8x16_t c, uint8x16_t d)
+{
+	return vaddq_u16(vaddl_u8(vget_low_u8(a), vget_low_u8(b)),
+			 vaddl_u8(vget_low_u8(c), vget_low_u8(d)));
+}
+
+static inline uint16x8_t add4_hi_neon(uint8x16_t a, uint8x16_t b,
+		uint8x16_t c, uint8x16_t d)
+{
+	return vaddq_u16(vaddl_u8(vget_high_u8(a), vget_high_u8(b)),
+			 vaddl_u8(vget_high_u8(c), vget_high_u8(d)));
+}
+
+static int bayer_line_to_rgb24_neon(const unsigned char *bayer, int stride,
+		unsigned char *dest, int len, int blue_line)
+{
+	int x;
+
+	for (x = 0; x + 34 <= len; x += 32) {
+		const unsigned char *b = bayer + x;
+		uint8x16x2_t r0 = vld2q_u8(b), r0n = vld2q_u8(b + 2);
+		uint8x16x2_t r1 = vld2q_u8(b + stride), r1n = vld2q_u8(b + stride + 2);
+		uint8x16x2_t r2 = vld2q_u8(b + stride * 2);
+		uint8x16x2_t r2n = vld2q_u8(b + stride * 2 + 2);
+		uint8x16_t t0a, t1a, t0b, t1b;
+		uint8x16x2_t c0, c1, c2;
+		uint8x16x3_t out;
+
+		/* vrshrn does the + 2 rounding, vrhadd the + 1 */
+		t0a = vcombine_u8(
+			vrshrn_n_u16(add4_lo_neon(r0.val[0], r0n.val[0],
+						  r2.val[0], r2n.val[0]), 2),
+			vrshrn_n_u16(add4_hi_neon(r0.val[0], r0n.val[0],
+						  r2.val[0], r2n.val[0]), 2));
+		t1a = vcombine_u8(
+			vrshrn_n_u16(add4_lo_neon(r0.val[1], r1.val[0],
+						  r1n.val[0], r2.val[1]), 2),
+			vrshrn_n_u16(add4_hi_neon(r0.val[1], r1.val[0],
+						  r1n.val[0], r2.val[1]), 2));
+		t0b = vrhaddq_u8(r0n.val[0], r2n.val[0]);
+		t1b = vrhaddq_u8(r1.val[1], r1n.val[1]);
+
+		c1 = vzipq_u8(t1a, r1n.val[0]);
+		if (blue_line) {
+			c0 = vzipq_u8(t0a, t0b);
+			c2 = vzipq_u8(r1.val[1], t1b);
+		} else {
+			c0 = vzipq_u8(r1.val[1], t1b);
+			c2 = vzipq_u8(t0a, t0b);
+		}
+		out.val[0] = c0.val[0];
+		out.val[1] = c1.val[0];
+		out.val[2] = c2.val[0];
+		vst3q_u8(dest + x * 3, out);
+		out.val[0] = c0.val[1];
+		out.val[1] = c1.val[1];
+		out.val[2] = c2.val[1];
+		vst3q_u8(dest + x * 3 + 48, out);
+	}
+
+	return x;
+}
+
+static int bayer_line_to_y_neon(const unsigned char *bayer, int stride,
+		unsigned char *ydst, int len, int blue_line)
+{
+	const int a_t0 = blue_line ? Y_BLUE_A_T0 : Y_RED_A_T0;
+	const int a_t1 = blue_line ? Y_BLUE_A_T1 : Y_RED_A_T1;
+	const int a_c  = blue_line ? Y_BLUE_A_C  : Y_RED_A_C;
+	const int b_t0 = blue_line ? Y_BLUE_B_T0 : Y_RED_B_T0;
+	const int b_t1 = blue_line ? Y_BLUE_B_T1 : Y_RED_B_T1;
+	const int b_c  = blue_line ? Y_BLUE_B_C  : Y_RED_B_C;
+	int x;
+
+	for (x = 0; x + 34 <= len; x += 32) {
+		const unsigned char *b = bayer + x;
+		uint8x16x2_t r0 = vld2q_u8(b), r0n = vld2q_u8(b + 2);
+		uint8x16x2_t r1 = vld2q_u8(b + stride), r1n = vld2q_u8(b + stride + 2);
+		uint8x16x2_t r2 = vld2q_u8(b + stride * 2);
+		uint8x16x2_t r2n = vld2q_u8(b + stride * 2 + 2);
+		uint8x16x2_t y;
+
+		y.val[0] = vcombine_u8(
+			weigh3_neon(add4_lo_neon(r0.val[0], r0n.val[0],
+						 r2.val[0], r2n.val[0]), a_t0,
+				    add4_lo_neon(r0.val[1], r1.val[0],
+						 r1n.val[0], r2.val[1]), a_t1,
+				    vmovl_u8(vget_low_u8(r1.val[1])), a_c),
+			weigh3_neon(add4_hi_neon(r0.val[0], r0n.val[0],
+						 r2.val[0], r2n.val[0]), a_t0,
+				    add4_hi_neon(r0.val[1], r1.val[0],
+						 r1n.val[0], r2.val[1]), a_t1,
+				    vmovl_u8(vget_high_u8(r1.val[1])), a_c));
+		y.val[1] = vcombine_u8(
+			weigh3_neon(vaddl_u8(vget_low_u8(r0n.val[0]),
+					     vget_low_u8(r2n.val[0])), b_t0,
+				    vaddl_u8(vget_low_u8(r1.val[1]),
+					     vget_low_u8(r1n.val[1])), b_t1,
+				    vmovl_u8(vget_low_u8(r1n.val[0])), b_c),
+			weigh3_neon(vaddl_u8(vget_high_u8(r0n.val[0]),
+					     vget_high_u8(r2n.val[0])), b_t0,
+				    vaddl_u8(vget_high_u8(r1.val[1]),
+					     vget_high_u8(r1n.val[1])), b_t1,
+				    vmovl_u8(vget_high_u8(r1n.val[0])), b_c));
+		vst2q_u8(ydst + x, y);
+	}
+
+	return x;
+}
+
+static int bayer_unpack_line_neon(const unsigned char *src, int src_len,
+		unsigned char *dest, int width, int packing, int shift)
+{
+	const uint8x8_t idx10 = { 0, 1, 2, 3, 5, 6, 7, 8 };
+	const int16x8_t count = vdupq_n_s16(-shift);
+	int x = 0;
+
+	switch (packing) {
+	case V4LCONVERT_BAYER_16BIT:
+		for (; x + 16 <= width; x += 16) {
+			uint16x8_t a = vreinterpretq_u16_u8(vld1q_u8(src + 2 * x));
+			uint16x8_t b = vreinterpretq_u16_u8(vld1q_u8(src + 2 * x + 16));
+
+			vst1q_u8(dest + x,
+				 vcombine_u8(vmovn_u16(vshlq_u16(a, count)),
+					     vmovn_u16(vshlq_u16(b, count))));
+		}
+		break;
+	case V4LCONVERT_BAYER_PACKED10:
+		for (; x + 16 <= width && (x / 8 + 1) * 10 + 16 <= src_len;
+		     x += 16) {
+			uint8x16_t a = vld1q_u8(src + x / 8 * 10);
+			uint8x16_t b = vld1q_u8(src + x / 8 * 10 + 10);
+			uint8x8x2_t ta = { { vget_low_u8(a), vget_high_u8(a) } };
+			uint8x8x2_t tb = { { vget_low_u8(b), vget_high_u8(b) } };
+
+			vst1q_u8(dest + x, vcombine_u8(vtbl2_u8(ta, idx10),
+						       vtbl2_u8(tb, idx10)));
+		}
+		break;
+	case V4LCONVERT_BAYER_PACKED12:
+		for (; x + 16 <= width; x += 16) {
+			uint8x8x3_t v = vld3_u8(src + x / 2 * 3);
+			uint8x8x2_t msb = { { v.val[0], v.val[1] } };
+
+			vst2_u8(dest + x, msb);
+		}
+		break;
+	}
+
+	return x;
+}
+
+#endif /* HAVE_V4LCONVERT_NEON */
+
+int v4lconvert_simd_bayer_line_to_rgb24(int cpu_flags,
+		const unsigned char *bayer, int stride, unsigned char *dest,
+		int len, int blue_line)
+{
+	int x = 0;
+
+#ifdef HAVE_V4LCONVERT_X86_SIMD
+	if (cpu_flags & V4LCONVERT_CPU_AVX2)
+		x = bayer_line_to_rgb24_avx2(bayer, stride, dest, len, blue_line);
+	if (cpu_flags & V4LCONVERT_CPU_SSSE3)
+		x += bayer_line_to_rgb24_ssse3(bayer + x, stride, dest + x * 3,
+					       len - x, blue_line);
+#endif
+#ifdef HAVE_V4LCONVERT_NEON
+	if (cpu_flags & V4LCONVERT_CPU_NEON)
+		x = bayer_line_to_rgb24_neon(bayer, stride, dest, len, blue_line);
+#endif
+
+	return x;
+}
+
+int v4lconvert_simd_bayer_line_to_y(int cpu_flags, const unsigned char *bayer,
+		int stride, unsigned char *ydst, int len, int blue_line)
+{
+	int x = 0;
+
+#ifdef HAVE_V4LCONVERT_X86_SIMD
+	if (cpu_flags & V4LCONVERT_CPU_AVX2)
+		x = bayer_line_to_y_avx2(bayer, stride, ydst, len, blue_line);
+	if (cpu_flags & V4LCONVERT_CPU_SSSE3)
+		x += bayer_line_to_y_ssse3(bayer + x, stride, ydst + x,
+					   len - x, blue_line);
+#endif
+#ifdef HAVE_V4LCONVERT_NEON
+	if (cpu_flags & V4LCONVERT_CPU_NEON)
+		x = bayer_line_to_y_neon(bayer, stride, ydst, len, blue_line);
+#endif
+
+	return x;
+}
+
+int v4lconvert_simd_bayer_to_uv(int cpu_flags, const unsigned char *bayer,
+		int stride, unsigned char *udst, unsigned char *vdst, int width,
+		unsigned int pixfmt)
+{
+	int x = 0;
+
+#ifdef HAVE_V4LCONVERT_X86_SIMD
+	if (cpu_flags & V4LCONVERT_CPU_SSSE3)
+		x = bayer_to_uv_ssse3(bayer, stride, udst, vdst, width, pixfmt);
+#endif
+
+	return x;
+}
+
+int v4lconvert_simd_bayer_unpack_line(int cpu_flags, const unsigned char *src,
+		int src_len, unsigned char *dest, int width, int packing,
+		int shift)
+{
+	int x = 0;
+
+#ifdef HAVE_V4LCONVERT_X86_SIMD
+	if (packing == V4LCONVERT_BAYER_16BIT) {
+		if (cpu_flags & V4LCONVERT_CPU_SSE2)
+			x = bayer_unpack_16bit_sse2(src, dest, width, shift);
+	} else if (packing != V4LCONVERT_BAYER_8BIT) {
+		if (cpu_flags & V4LCONVERT_CPU_SSSE3)
+			x = bayer_unpack_packed_ssse3(src, src_len, dest, width,
+						      packing);
+	}
+#endif
+#ifdef HAVE_V4LCONVERT_NEON
+	if (cpu_flags & V4LCONVERT_CPU_NEON)
+		x = bayer_unpack_line_neon(src, src_len, dest, width, packing,
+					   shift);
+#endif
+
+	return x;
+}
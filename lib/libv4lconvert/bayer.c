@@ -29,9 +29,116 @@
  * see bayer.c from libdc1394 for all supported algorithms
  */
 
+#include <errno.h>
+#include <stdlib.h>
 #include <string.h>
 #include "libv4lconvert-priv.h"
 
+static const struct {
+	unsigned int pixfmt;
+	unsigned int pixfmt8; /* 8 bit format with the same pattern */
+	int packing;
+	int shift;
+} bayer_formats[] = {
+	{ V4L2_PIX_FMT_SBGGR8,   V4L2_PIX_FMT_SBGGR8, V4LCONVERT_BAYER_8BIT,     0 },
+	{ V4L2_PIX_FMT_SGBRG8,   V4L2_PIX_FMT_SGBRG8, V4LCONVERT_BAYER_8BIT,     0 },
+	{ V4L2_PIX_FMT_SGRBG8,   V4L2_PIX_FMT_SGRBG8, V4LCONVERT_BAYER_8BIT,     0 },
+	{ V4L2_PIX_FMT_SRGGB8,   V4L2_PIX_FMT_SRGGB8, V4LCONVERT_BAYER_8BIT,     0 },
+	{ V4L2_PIX_FMT_SBGGR10,  V4L2_PIX_FMT_SBGGR8, V4LCONVERT_BAYER_16BIT,    2 },
+	{ V4L2_PIX_FMT_SGBRG10,  V4L2_PIX_FMT_SGBRG8, V4LCONVERT_BAYER_16BIT,    2 },
+	{ V4L2_PIX_FMT_SGRBG10,  V4L2_PIX_FMT_SGRBG8, V4LCONVERT_BAYER_16BIT,    2 },
+	{ V4L2_PIX_FMT_SRGGB10,  V4L2_PIX_FMT_SRGGB8, V4LCONVERT_BAYER_16BIT,    2 },
+	{ V4L2_PIX_FMT_SBGGR10P, V4L2_PIX_FMT_SBGGR8, V4LCONVERT_BAYER_PACKED10, 0 },
+	{ V4L2_PIX_FMT_SGBRG10P, V4L2_PIX_FMT_SGBRG8, V4LCONVERT_BAYER_PACKED10, 0 },
+	{ V4L2_PIX_FMT_SGRBG10P, V4L2_PIX_FMT_SGRBG8, V4LCONVERT_BAYER_PACKED10, 0 },
+	{ V4L2_PIX_FMT_SRGGB10P, V4L2_PIX_FMT_SRGGB8, V4LCONVERT_BAYER_PACKED10, 0 },
+	{ V4L2_PIX_FMT_SBGGR12,  V4L2_PIX_FMT_SBGGR8, V4LCONVERT_BAYER_16BIT,    4 },
+	{ V4L2_PIX_FMT_SGBRG12,  V4L2_PIX_FMT_SGBRG8, V4LCONVERT_BAYER_16BIT,    4 },
+	{ V4L2_PIX_FMT_SGRBG12,  V4L2_PIX_FMT_SGRBG8, V4LCONVERT_BAYER_16BIT,    4 },
+	{ V4L2_PIX_FMT_SRGGB12,  V4L2_PIX_FMT_SRGGB8, V4LCONVERT_BAYER_16BIT,    4 },
+	{ V4L2_PIX_FMT_SBGGR12P, V4L2_PIX_FMT_SBGGR8, V4LCONVERT_BAYER_PACKED12, 0 },
+	{ V4L2_PIX_FMT_SGBRG12P, V4L2_PIX_FMT_SGBRG8, V4LCONVERT_BAYER_PACKED12, 0 },
+	{ V4L2_PIX_FMT_SGRBG12P, V4L2_PIX_FMT_SGRBG8, V4LCONVERT_BAYER_PACKED12, 0 },
+	{ V4L2_PIX_FMT_SRGGB12P, V4L2_PIX_FMT_SRGGB8, V4LCONVERT_BAYER_PACKED12, 0 },
+	{ V4L2_PIX_FMT_SBGGR16,  V4L2_PIX_FMT_SBGGR8, V4LCONVERT_BAYER_16BIT,    8 },
+	{ V4L2_PIX_FMT_SGBRG16,  V4L2_PIX_FMT_SGBRG8, V4LCONVERT_BAYER_16BIT,    8 },
+	{ V4L2_PIX_FMT_SGRBG16,  V4L2_PIX_FMT_SGRBG8, V4LCONVERT_BAYER_16BIT,    8 },
+	{ V4L2_PIX_FMT_SRGGB16,  V4L2_PIX_FMT_SRGGB8, V4LCONVERT_BAYER_16BIT,    8 },
+};
+
+unsigned int v4lconvert_bayer_unpacking(unsigned int pixfmt, int *packing,
+		int *shift)
+{
+	int i;
+
+	for (i = 0; i < ARRAY_SIZE(bayer_formats); i++)
+		if (bayer_formats[i].pixfmt == pixfmt)
+			break;
+
+	if (i == ARRAY_SIZE(bayer_formats)) {
+		if (packing)
+			*packing = V4LCONVERT_BAYER_8BIT;
+		if (shift)
+			*shift = 0;
+		return 0;
+	}
+
+	if (packing)
+		*packing = bayer_formats[i].packing;
+	if (shift)
+		*shift = bayer_formats[i].shift;
+	return bayer_formats[i].pixfmt8;
+}
+
+static int bayer_packed_line_size(int packing, int width)
+{
+	switch (packing) {
+	case V4LCONVERT_BAYER_16BIT:
+		return width * 2;
+	case V4LCONVERT_BAYER_PACKED10:
+		return (width + 3) / 4 * 5;
+	case V4LCONVERT_BAYER_PACKED12:
+		return (width + 1) / 2 * 3;
+	}
+	return width;
+}
+
+int v4lconvert_bayer_line_size(unsigned int pixfmt, int width)
+{
+	int packing;
+
+	v4lconvert_bayer_unpacking(pixfmt, &packing, NULL);
+	return bayer_packed_line_size(packing, width);
+}
+
+void v4lconvert_bayer_unpack_line(struct v4lconvert_data *data,
+		const unsigned char *src, unsigned char *dest, int width,
+		int packing, int shift)
+{
+	int x;
+
+	x = v4lconvert_simd_bayer_unpack_line(data->cpu_flags, src,
+			bayer_packed_line_size(packing, width), dest, width,
+			packing, shift);
+
+	switch (packing) {
+	case V4LCONVERT_BAYER_16BIT:
+		for (; x < width; x++)
+			dest[x] = (src[2 * x] | (src[2 * x + 1] << 8)) >> shift;
+		break;
+	case V4LCONVERT_BAYER_PACKED10:
+		for (; x < width; x++)
+			dest[x] = src[x / 4 * 5 + x % 4];
+		break;
+	case V4LCONVERT_BAYER_PACKED12:
+		for (; x < width; x++)
+			dest[x] = src[x / 2 * 3 + x % 2];
+		break;
+	default:
+		memcpy(dest + x, src + x, width - x);
+	}
+}
+
 /**************************************************************
  *     Color conversion functions for cameras that can        *
  * output raw-Bayer pattern images, such as some Basler and   *
@@ -162,168 +269,602 @@ static void v4lconvert_border_bayer_line_to_bgr24(
 	}
 }
 
-/* From libdc1394, which on turn was based on OpenCV's Bayer decoding */
-static void bayer_to_rgbbgr24(const unsigned char *bayer,
-		unsigned char *bgr, int width, int height, const unsigned int stride, unsigned int pixfmt,
-		int start_with_green, int blue_line)
+/* From libdc1394, which on turn was based on OpenCV's Bayer decoding,
+   renders the line below the one bayer points to, start_with_green and
+   blue_line describe the line bayer points to */
+static void bayer_line_to_rgbbgr24(struct v4lconvert_data *data,
+		const unsigned char *bayer, unsigned char *bgr, int width,
+		const unsigned int stride, int start_with_green, int blue_line)
 {
-	/* render the first line */
-	v4lconvert_border_bayer_line_to_bgr24(bayer, bayer + stride, bgr, width,
-			start_with_green, blue_line);
-	bgr += width * 3;
-
-	/* reduce height by 2 because of the special case top/bottom line */
-	for (height -= 2; height; height--) {
-		int t0, t1;
-		/* (width - 2) because of the border */
-		const unsigned char *bayer_end = bayer + (width - 2);
-
-		if (start_with_green) {
-
-			t0 = (bayer[1] + bayer[stride * 2 + 1] + 1) >> 1;
-			/* Write first pixel */
-			t1 = (bayer[0] + bayer[stride * 2] + bayer[stride + 1] + 1) / 3;
-			if (blue_line) {
-				*bgr++ = t0;
-				*bgr++ = t1;
-				*bgr++ = bayer[stride];
-			} else {
-				*bgr++ = bayer[stride];
-				*bgr++ = t1;
-				*bgr++ = t0;
-			}
+	int t0, t1, x;
+	/* (width - 2) because of the border */
+	const unsigned char *bayer_end = bayer + (width - 2);
 
-			/* Write second pixel */
-			t1 = (bayer[stride] + bayer[stride + 2] + 1) >> 1;
-			if (blue_line) {
-				*bgr++ = t0;
-				*bgr++ = bayer[stride + 1];
-				*bgr++ = t1;
-			} else {
-				*bgr++ = t1;
-				*bgr++ = bayer[stride + 1];
-				*bgr++ = t0;
-			}
-			bayer++;
+	if (start_with_green) {
+
+		t0 = (bayer[1] + bayer[stride * 2 + 1] + 1) >> 1;
+		/* Write first pixel */
+		t1 = (bayer[0] + bayer[stride * 2] + bayer[stride + 1] + 1) / 3;
+		if (blue_line) {
+			*bgr++ = t0;
+			*bgr++ = t1;
+			*bgr++ = bayer[stride];
 		} else {
-			/* Write first pixel */
-			t0 = (bayer[0] + bayer[stride * 2] + 1) >> 1;
-			if (blue_line) {
-				*bgr++ = t0;
-				*bgr++ = bayer[stride];
-				*bgr++ = bayer[stride + 1];
-			} else {
-				*bgr++ = bayer[stride + 1];
-				*bgr++ = bayer[stride];
-				*bgr++ = t0;
-			}
+			*bgr++ = bayer[stride];
+			*bgr++ = t1;
+			*bgr++ = t0;
 		}
 
+		/* Write second pixel */
+		t1 = (bayer[stride] + bayer[stride + 2] + 1) >> 1;
 		if (blue_line) {
-			for (; bayer <= bayer_end - 2; bayer += 2) {
-				t0 = (bayer[0] + bayer[2] + bayer[stride * 2] +
-					bayer[stride * 2 + 2] + 2) >> 2;
-				t1 = (bayer[1] + bayer[stride] + bayer[stride + 2] +
-					bayer[stride * 2 + 1] + 2) >> 2;
-				*bgr++ = t0;
-				*bgr++ = t1;
-				*bgr++ = bayer[stride + 1];
-
-				t0 = (bayer[2] + bayer[stride * 2 + 2] + 1) >> 1;
-				t1 = (bayer[stride + 1] + bayer[stride + 3] + 1) >> 1;
-				*bgr++ = t0;
-				*bgr++ = bayer[stride + 2];
-				*bgr++ = t1;
-			}
+			*bgr++ = t0;
+			*bgr++ = bayer[stride + 1];
+			*bgr++ = t1;
 		} else {
-			for (; bayer <= bayer_end - 2; bayer += 2) {
-				t0 = (bayer[0] + bayer[2] + bayer[stride * 2] +
-					bayer[stride * 2 + 2] + 2) >> 2;
-				t1 = (bayer[1] + bayer[stride] + bayer[stride + 2] +
-					bayer[stride * 2 + 1] + 2) >> 2;
-				*bgr++ = bayer[stride + 1];
-				*bgr++ = t1;
-				*bgr++ = t0;
-
-				t0 = (bayer[2] + bayer[stride * 2 + 2] + 1) >> 1;
-				t1 = (bayer[stride + 1] + bayer[stride + 3] + 1) >> 1;
-				*bgr++ = t1;
-				*bgr++ = bayer[stride + 2];
-				*bgr++ = t0;
-			}
+			*bgr++ = t1;
+			*bgr++ = bayer[stride + 1];
+			*bgr++ = t0;
+		}
+		bayer++;
+	} else {
+		/* Write first pixel */
+		t0 = (bayer[0] + bayer[stride * 2] + 1) >> 1;
+		if (blue_line) {
+			*bgr++ = t0;
+			*bgr++ = bayer[stride];
+			*bgr++ = bayer[stride + 1];
+		} else {
+			*bgr++ = bayer[stride + 1];
+			*bgr++ = bayer[stride];
+			*bgr++ = t0;
 		}
+	}
 
-		if (bayer < bayer_end) {
-			/* write second to last pixel */
+	x = v4lconvert_simd_bayer_line_to_rgb24(data->cpu_flags, bayer,
+			stride, bgr, bayer_end + 2 - bayer, blue_line);
+	bayer += x;
+	bgr += x * 3;
+
+	if (blue_line) {
+		for (; bayer <= bayer_end - 2; bayer += 2) {
 			t0 = (bayer[0] + bayer[2] + bayer[stride * 2] +
 				bayer[stride * 2 + 2] + 2) >> 2;
 			t1 = (bayer[1] + bayer[stride] + bayer[stride + 2] +
 				bayer[stride * 2 + 1] + 2) >> 2;
-			if (blue_line) {
-				*bgr++ = t0;
-				*bgr++ = t1;
-				*bgr++ = bayer[stride + 1];
-			} else {
-				*bgr++ = bayer[stride + 1];
-				*bgr++ = t1;
-				*bgr++ = t0;
-			}
-			/* write last pixel */
+			*bgr++ = t0;
+			*bgr++ = t1;
+			*bgr++ = bayer[stride + 1];
+
 			t0 = (bayer[2] + bayer[stride * 2 + 2] + 1) >> 1;
-			if (blue_line) {
-				*bgr++ = t0;
-				*bgr++ = bayer[stride + 2];
-				*bgr++ = bayer[stride + 1];
-			} else {
-				*bgr++ = bayer[stride + 1];
-				*bgr++ = bayer[stride + 2];
-				*bgr++ = t0;
-			}
+			t1 = (bayer[stride + 1] + bayer[stride + 3] + 1) >> 1;
+			*bgr++ = t0;
+			*bgr++ = bayer[stride + 2];
+			*bgr++ = t1;
+		}
+	} else {
+		for (; bayer <= bayer_end - 2; bayer += 2) {
+			t0 = (bayer[0] + bayer[2] + bayer[stride * 2] +
+				bayer[stride * 2 + 2] + 2) >> 2;
+			t1 = (bayer[1] + bayer[stride] + bayer[stride + 2] +
+				bayer[stride * 2 + 1] + 2) >> 2;
+			*bgr++ = bayer[stride + 1];
+			*bgr++ = t1;
+			*bgr++ = t0;
 
-			bayer++;
+			t0 = (bayer[2] + bayer[stride * 2 + 2] + 1) >> 1;
+			t1 = (bayer[stride + 1] + bayer[stride + 3] + 1) >> 1;
+			*bgr++ = t1;
+			*bgr++ = bayer[stride + 2];
+			*bgr++ = t0;
+		}
+	}
+
+	if (bayer < bayer_end) {
+		/* write second to last pixel */
+		t0 = (bayer[0] + bayer[2] + bayer[stride * 2] +
+			bayer[stride * 2 + 2] + 2) >> 2;
+		t1 = (bayer[1] + bayer[stride] + bayer[stride + 2] +
+			bayer[stride * 2 + 1] + 2) >> 2;
+		if (blue_line) {
+			*bgr++ = t0;
+			*bgr++ = t1;
+			*bgr++ = bayer[stride + 1];
+		} else {
+			*bgr++ = bayer[stride + 1];
+			*bgr++ = t1;
+			*bgr++ = t0;
+		}
+		/* write last pixel */
+		t0 = (bayer[2] + bayer[stride * 2 + 2] + 1) >> 1;
+		if (blue_line) {
+			*bgr++ = t0;
+			*bgr++ = bayer[stride + 2];
+			*bgr++ = bayer[stride + 1];
+		} else {
+			*bgr++ = bayer[stride + 1];
+			*bgr++ = bayer[stride + 2];
+			*bgr++ = t0;
+		}
+
+		bayer++;
 
+	} else {
+		/* write last pixel */
+		t0 = (bayer[0] + bayer[stride * 2] + 1) >> 1;
+		t1 = (bayer[1] + bayer[stride * 2 + 1] + bayer[stride] + 1) / 3;
+		if (blue_line) {
+			*bgr++ = t0;
+			*bgr++ = t1;
+			*bgr++ = bayer[stride + 1];
 		} else {
-			/* write last pixel */
-			t0 = (bayer[0] + bayer[stride * 2] + 1) >> 1;
-			t1 = (bayer[1] + bayer[stride * 2 + 1] + bayer[stride] + 1) / 3;
-			if (blue_line) {
-				*bgr++ = t0;
-				*bgr++ = t1;
-				*bgr++ = bayer[stride + 1];
-			} else {
-				*bgr++ = bayer[stride + 1];
-				*bgr++ = t1;
-				*bgr++ = t0;
+			*bgr++ = bayer[stride + 1];
+			*bgr++ = t1;
+			*bgr++ = t0;
+		}
+
+	}
+}
+
+struct bayer_band_args {
+	struct v4lconvert_data *data;
+	const unsigned char *bayer;
+	unsigned char *dest;
+	unsigned char *udest;
+	unsigned char *vdest;
+	int width;
+	int height;
+	unsigned int stride;
+	unsigned int pixfmt;
+	/* These are for the first line, the pattern flips every line */
+	int start_with_green;
+	int blue_line;
+	/* V4LCONTROL_DEMOSAIC_*, and the number of lines above and below the
+	   line being rendered which the demosaicing reads */
+	int mode;
+	int margin;
+	/* The row of the frame bayer points to */
+	int bayer_row;
+	/* High bit depth src frame, see bayer_unpack_band() */
+	const unsigned char *src;
+	unsigned int src_stride;
+	int packing;
+	int shift;
+	v4lconvert_band_func band_func;
+	/* scratch_size bytes of scratch for each band of band_rows rows, see
+	   bayer_run_bands() */
+	unsigned char *scratch;
+	int scratch_size;
+	int band_rows;
+};
+
+/* High bit depth bayer gets converted to 8 bit BAYER_UNPACK_ROWS lines at a
+   time, plus the lines above and below those which the demosaicing reads,
+   which then get demosaiced by band_func while still in the cache */
+#define BAYER_UNPACK_ROWS 16
+
+static unsigned char *bayer_band_scratch(const struct bayer_band_args *args,
+		int first_row)
+{
+	return args->scratch + first_row / args->band_rows * args->scratch_size;
+}
+
+static void bayer_unpack_band(void *arg, int first_row, int rows)
+{
+	struct bayer_band_args *args = arg;
+	struct bayer_band_args chunk = *args;
+	unsigned char *lines = bayer_band_scratch(args, first_row);
+	int y, i, n, top, bottom;
+
+	chunk.bayer = lines;
+	chunk.stride = args->width;
+	/* The chunks of this band get the rest of its scratch */
+	chunk.scratch = lines + (BAYER_UNPACK_ROWS + 2 * args->margin) *
+			args->width;
+	chunk.band_rows = args->height;
+
+	for (y = first_row; y < first_row + rows; y += n) {
+		n = first_row + rows - y;
+		if (n > BAYER_UNPACK_ROWS)
+			n = BAYER_UNPACK_ROWS;
+		top = y > args->margin ? y - args->margin : 0;
+		bottom = y + n + args->margin < args->height ?
+			 y + n + args->margin : args->height;
+
+		for (i = top; i < bottom; i++)
+			v4lconvert_bayer_unpack_line(args->data,
+					args->src + i * args->src_stride,
+					lines + (i - top) * args->width,
+					args->width, args->packing, args->shift);
+
+		chunk.bayer_row = top;
+		args->band_func(&chunk, y, n);
+	}
+}
+
+/* Nearest neighbour demosaicing, renders the line bayer points to, other points
+   to the other line of its 2x2 blocks */
+static void bayer_nearest_line_to_rgbbgr24(const unsigned char *bayer,
+		const unsigned char *other, unsigned char *bgr, int width,
+		int start_with_green, int blue_line)
+{
+	/* Offset of green and the other color within a pair of pixels, the
+	   other line has its non green pixel below our green one */
+	const int g = start_with_green ? 0 : 1;
+	const int c = 1 - g;
+	/* Where the color of this line goes in bgr */
+	const int ci = blue_line ? 0 : 2;
+	int x;
+
+	for (x = 0; x + 1 < width; x += 2) {
+		bgr[ci] = bgr[ci + 3] = bayer[x + c];
+		bgr[2 - ci] = bgr[5 - ci] = other[x + g];
+		bgr[1] = bgr[4] = bayer[x + g];
+		bgr += 6;
+	}
+
+	/* Odd width, repeat the last pixel */
+	if (x < width) {
+		bgr[0] = bgr[-3];
+		bgr[1] = bgr[-2];
+		bgr[2] = bgr[-1];
+	}
+}
+
+/* Edge aware demosaicing (Hamilton-Adams). First green gets interpolated for
+   all lines of a band, plus the line above and below it, in the direction
+   with the smallest gradient, corrected with the second order derivative of
+   the red / blue samples. Then red and blue get interpolated from their
+   difference to green. The frame gets mirrored at its borders, which keeps
+   the bayer pattern intact. */
+#define BAYER_EDGE_BORDER 3
+
+struct bayer_edge_buf {
+	unsigned char *raw;	/* lines first_row - 3 ... first_row + rows + 2 */
+	unsigned char *green;	/* lines first_row - 1 ... first_row + rows */
+	int first_row;
+	int pitch;		/* width + 2 * BAYER_EDGE_BORDER */
+};
+
+static int bayer_mirror(int i, int n)
+{
+	if (i < 0)
+		return -i;
+	if (i >= n)
+		return 2 * (n - 1) - i;
+	return i;
+}
+
+/* Edge aware demosaicing to yuv420 renders 2 lines to bgr at a time, the
+   scratch of a band starts with those, followed by the bayer_edge_buf */
+static int bayer_edge_scratch_size(int width, int rows)
+{
+	return 2 * width * 3 + (2 * rows + 8) * (width + 2 * BAYER_EDGE_BORDER);
+}
+
+static void bayer_edge_prepare(struct bayer_band_args *args,
+		struct bayer_edge_buf *buf, int first_row, int rows)
+{
+	const int width = args->width;
+	const int pitch = width + 2 * BAYER_EDGE_BORDER;
+	/* Green pixels are those where x + y + green_odd is even */
+	const int green_odd = !args->start_with_green;
+	const unsigned char *line, *p;
+	unsigned char *dst, *g;
+	int i, x, y, t, lh, lv, dh, dv;
+
+	buf->raw = bayer_band_scratch(args, first_row) + 2 * width * 3;
+	buf->green = buf->raw + (rows + 6) * pitch;
+	buf->first_row = first_row;
+	buf->pitch = pitch;
+
+	for (i = 0; i < rows + 6; i++) {
+		y = bayer_mirror(first_row - BAYER_EDGE_BORDER + i, args->height);
+		line = args->bayer + (y - args->bayer_row) * args->stride;
+		dst = buf->raw + i * pitch + BAYER_EDGE_BORDER;
+		memcpy(dst, line, width);
+		for (x = 1; x <= BAYER_EDGE_BORDER; x++) {
+			dst[-x] = line[x];
+			dst[width - 1 + x] = line[width - 1 - x];
+		}
+	}
+
+	for (i = 0; i < rows + 2; i++) {
+		y = first_row - 1 + i;
+		p = buf->raw + (i + 2) * pitch + BAYER_EDGE_BORDER;
+		g = buf->green + i * pitch + BAYER_EDGE_BORDER;
+		for (x = -1; x <= width; x++) {
+			if (((x + y + green_odd) & 1) == 0) {
+				g[x] = p[x];
+				continue;
 			}
+			lh = 2 * p[x] - p[x - 2] - p[x + 2];
+			lv = 2 * p[x] - p[x - 2 * pitch] - p[x + 2 * pitch];
+			dh = abs(p[x - 1] - p[x + 1]) + abs(lh);
+			dv = abs(p[x - pitch] - p[x + pitch]) + abs(lv);
+			/* t is 8 times green */
+			if (dh < dv)
+				t = 4 * (p[x - 1] + p[x + 1]) + 2 * lh;
+			else if (dv < dh)
+				t = 4 * (p[x - pitch] + p[x + pitch]) + 2 * lv;
+			else
+				t = 2 * (p[x - 1] + p[x + 1] + p[x - pitch] +
+					 p[x + pitch]) + lh + lv;
+			g[x] = t < 0 ? 0 : t >= 2040 ? 255 : (t + 4) >> 3;
+		}
+	}
+}
+
+/* Run func over the frame in bands, unpacking high bit depth bayer on the
+   fly. The scratch the bands need gets allocated up front, for all bands at
+   once, so that they cannot fail */
+static int bayer_run_bands(struct bayer_band_args *args,
+		v4lconvert_band_func func, int align)
+{
+	struct v4lconvert_data *data = args->data;
+	int rows, no_bands;
+
+	args->band_rows = v4lconvert_band_rows(data->threads, args->height,
+					       align);
+	no_bands = (args->height + args->band_rows - 1) / args->band_rows;
+	rows = args->band_rows;
+	args->scratch_size = 0;
+	if (args->packing != V4LCONVERT_BAYER_8BIT) {
+		args->scratch_size = (BAYER_UNPACK_ROWS + 2 * args->margin) *
+				     args->width;
+		if (rows > BAYER_UNPACK_ROWS)
+			rows = BAYER_UNPACK_ROWS;
+	}
+	if (args->mode == V4LCONTROL_DEMOSAIC_EDGE)
+		args->scratch_size += bayer_edge_scratch_size(args->width, rows);
 
+	if (args->scratch_size) {
+		args->scratch = v4lconvert_alloc_buffer(data,
+				no_bands * args->scratch_size, &data->bayer_buf,
+				&data->bayer_buf_size);
+		if (!args->scratch)
+			return v4lconvert_oom_error(data);
+	}
+
+	if (args->packing == V4LCONVERT_BAYER_8BIT) {
+		v4lconvert_run_bands(data->threads, func, args, args->height,
+				     align);
+	} else {
+		args->src = args->bayer;
+		args->src_stride = args->stride;
+		args->band_func = func;
+		v4lconvert_run_bands(data->threads, bayer_unpack_band, args,
+				     args->height, align);
+	}
+	return 0;
+}
+
+static void bayer_edge_line_to_rgbbgr24(struct bayer_band_args *args,
+		const struct bayer_edge_buf *buf, int y, unsigned char *bgr)
+{
+	const int pitch = buf->pitch;
+	const int i = y - buf->first_row;
+	const unsigned char *p = buf->raw + (i + 3) * pitch + BAYER_EDGE_BORDER;
+	const unsigned char *g = buf->green + (i + 1) * pitch + BAYER_EDGE_BORDER;
+	const int green_odd = !args->start_with_green;
+	const int blue_line = args->blue_line ^ (y & 1);
+	int x, c, o, t;
+
+	for (x = 0; x < args->width; x++) {
+		if (((x + y + green_odd) & 1) == 0) {
+			/* The color of this line is left and right of us,
+			   the other color above and below us */
+			t = 2 * g[x] + p[x - 1] - g[x - 1] + p[x + 1] - g[x + 1];
+			c = t < 0 ? 0 : t >= 510 ? 255 : (t + 1) >> 1;
+			t = 2 * g[x] + p[x - pitch] - g[x - pitch] +
+				p[x + pitch] - g[x + pitch];
+			o = t < 0 ? 0 : t >= 510 ? 255 : (t + 1) >> 1;
+		} else {
+			/* The other color is in the 4 corners */
+			c = p[x];
+			t = 4 * g[x] +
+				p[x - pitch - 1] - g[x - pitch - 1] +
+				p[x - pitch + 1] - g[x - pitch + 1] +
+				p[x + pitch - 1] - g[x + pitch - 1] +
+				p[x + pitch + 1] - g[x + pitch + 1];
+			o = t < 0 ? 0 : t >= 1020 ? 255 : (t + 2) >> 2;
+		}
+		if (blue_line) {
+			bgr[0] = c;
+			bgr[2] = o;
+		} else {
+			bgr[0] = o;
+			bgr[2] = c;
+		}
+		bgr[1] = g[x];
+		bgr += 3;
+	}
+}
+
+/* Renders line y of the frame, edge is only used for
+   V4LCONTROL_DEMOSAIC_EDGE */
+static void bayer_render_line(struct bayer_band_args *args,
+		const struct bayer_edge_buf *edge, int y, unsigned char *bgr)
+{
+	const unsigned int stride = args->stride;
+	const unsigned char *bayer =
+		args->bayer + (y - args->bayer_row) * stride;
+	int odd = y & 1;
+
+	switch (args->mode) {
+	case V4LCONTROL_DEMOSAIC_NEAREST:
+		bayer_nearest_line_to_rgbbgr24(bayer,
+				(odd || y == args->height - 1) ?
+					bayer - stride : bayer + stride,
+				bgr, args->width, args->start_with_green ^ odd,
+				args->blue_line ^ odd);
+		break;
+	case V4LCONTROL_DEMOSAIC_EDGE:
+		bayer_edge_line_to_rgbbgr24(args, edge, y, bgr);
+		break;
+	default:
+		if (y == 0) {
+			/* render the first line */
+			v4lconvert_border_bayer_line_to_bgr24(bayer, bayer + stride,
+					bgr, args->width, args->start_with_green,
+					args->blue_line);
+		} else if (y == args->height - 1) {
+			/* render the last line */
+			v4lconvert_border_bayer_line_to_bgr24(bayer, bayer - stride,
+					bgr, args->width, args->start_with_green ^ odd,
+					args->blue_line ^ odd);
+		} else {
+			bayer_line_to_rgbbgr24(args->data, bayer - stride, bgr,
+					args->width, stride,
+					args->start_with_green ^ !odd,
+					args->blue_line ^ !odd);
+		}
+	}
+}
+
+static void bayer_to_rgbbgr24_band(void *arg, int first_row, int rows)
+{
+	struct bayer_band_args *args = arg;
+	struct bayer_edge_buf edge = { NULL };
+	unsigned char *bgr;
+	int y;
+
+	if (args->mode == V4LCONTROL_DEMOSAIC_EDGE)
+		bayer_edge_prepare(args, &edge, first_row, rows);
+
+	for (y = first_row; y < first_row + rows; y++) {
+		bgr = v4lconvert_fused_line(args->data, args->dest, y,
+					    args->width, args->height);
+		bayer_render_line(args, &edge, y, bgr);
+		v4lconvert_fused_finish_line(args->data, bgr, args->width);
+	}
+}
+
+/* Offsets of red, the green on the first and second line, and blue within the
+   2x2 blocks starting at the even lines of the frame */
+struct bayer_block {
+	int r, g0, g1, b;
+};
+
+static struct bayer_block bayer_block_offsets(
+		const struct bayer_band_args *args)
+{
+	const unsigned int stride = args->stride;
+	/* The color of the first line, and the other one */
+	int c = args->start_with_green ? 1 : 0;
+	int o = args->start_with_green ? stride : stride + 1;
+	struct bayer_block block = {
+		.r = args->blue_line ? o : c,
+		.g0 = args->start_with_green ? 0 : 1,
+		.g1 = args->start_with_green ? stride + 1 : stride,
+		.b = args->blue_line ? c : o,
+	};
+
+	return block;
+}
+
+/* 2x2 binning, renders a half width line for every 2 lines of the band */
+static void bayer_bin_to_rgbbgr24_band(void *arg, int first_row, int rows)
+{
+	struct bayer_band_args *args = arg;
+	const int width = args->width / 2;
+	const unsigned char *bayer;
+	unsigned char *bgr, *d;
+	const struct bayer_block blk = bayer_block_offsets(args);
+	int x, y;
+
+	for (y = first_row; y + 1 < first_row + rows; y += 2) {
+		bayer = args->bayer + (y - args->bayer_row) * args->stride;
+		bgr = d = v4lconvert_fused_line(args->data, args->dest, y / 2,
+						width, args->height / 2);
+		for (x = 0; x < width; x++) {
+			*d++ = bayer[blk.b];
+			*d++ = (bayer[blk.g0] + bayer[blk.g1] + 1) >> 1;
+			*d++ = bayer[blk.r];
+			bayer += 2;
 		}
+		v4lconvert_fused_finish_line(args->data, bgr, width);
+	}
+}
 
-		/* skip 2 border pixels and padding */
-		bayer += (stride - width) + 2;
+/* Sets args->mode and args->margin from the demosaic control. Binning is only
+   done when v4lconvert_convert() asks for a half size frame, otherwise it is
+   done as nearest neighbour. The other modes need at least 4x4 pixels. */
+static void bayer_set_mode(struct bayer_band_args *args)
+{
+	struct v4lconvert_data *data = args->data;
 
-		blue_line = !blue_line;
-		start_with_green = !start_with_green;
+	args->mode = v4lcontrol_get_ctrl(data->control, V4LCONTROL_DEMOSAIC);
+	if (data->src_scale == 2)
+		args->mode = V4LCONTROL_DEMOSAIC_BIN;
+	else if (args->mode == V4LCONTROL_DEMOSAIC_BIN)
+		args->mode = V4LCONTROL_DEMOSAIC_NEAREST;
+
+	if (args->width < 4 || args->height < 4)
+		args->mode = V4LCONTROL_DEMOSAIC_BILINEAR;
+
+	switch (args->mode) {
+	case V4LCONTROL_DEMOSAIC_BIN:
+		args->margin = 0;
+		break;
+	case V4LCONTROL_DEMOSAIC_EDGE:
+		args->margin = BAYER_EDGE_BORDER;
+		break;
+	default:
+		args->margin = 1;
 	}
+}
+
+static int bayer_to_rgbbgr24(struct v4lconvert_data *data,
+		const unsigned char *bayer,
+		unsigned char *bgr, int width, int height, const unsigned int stride, unsigned int pixfmt,
+		int packing, int shift, int start_with_green, int blue_line)
+{
+	struct bayer_band_args args = {
+		.data = data,
+		.bayer = bayer,
+		.dest = bgr,
+		.width = width,
+		.height = height,
+		.stride = stride,
+		.pixfmt = pixfmt,
+		.start_with_green = start_with_green,
+		.blue_line = blue_line,
+		.packing = packing,
+		.shift = shift,
+	};
+
+	bayer_set_mode(&args);
+	if (args.mode == V4LCONTROL_DEMOSAIC_BIN)
+		return bayer_run_bands(&args, bayer_bin_to_rgbbgr24_band, 2);
 
-	/* render the last line */
-	v4lconvert_border_bayer_line_to_bgr24(bayer + stride, bayer, bgr, width,
-			!start_with_green, !blue_line);
+	return bayer_run_bands(&args, bayer_to_rgbbgr24_band, 1);
 }
 
-void v4lconvert_bayer_to_rgb24(const unsigned char *bayer,
+int v4lconvert_bayer_to_rgb24(struct v4lconvert_data *data,
+		const unsigned char *bayer,
 		unsigned char *bgr, int width, int height, const unsigned int stride, unsigned int pixfmt)
 {
-	bayer_to_rgbbgr24(bayer, bgr, width, height, stride, pixfmt,
+	int packing, shift;
+
+	pixfmt = v4lconvert_bayer_unpacking(pixfmt, &packing, &shift);
+	return bayer_to_rgbbgr24(data, bayer, bgr, width, height, stride,
+			pixfmt, packing, shift,
 			pixfmt == V4L2_PIX_FMT_SGBRG8		/* start with green */
 			|| pixfmt == V4L2_PIX_FMT_SGRBG8,
 			pixfmt != V4L2_PIX_FMT_SBGGR8		/* blue line */
 			&& pixfmt != V4L2_PIX_FMT_SGBRG8);
 }
 
-void v4lconvert_bayer_to_bgr24(const unsigned char *bayer,
+int v4lconvert_bayer_to_bgr24(struct v4lconvert_data *data,
+		const unsigned char *bayer,
 		unsigned char *bgr, int width, int height, const unsigned int stride, unsigned int pixfmt)
 {
-	bayer_to_rgbbgr24(bayer, bgr, width, height, stride, pixfmt,
+	int packing, shift;
+
+	pixfmt = v4lconvert_bayer_unpacking(pixfmt, &packing, &shift);
+	return bayer_to_rgbbgr24(data, bayer, bgr, width, height, stride,
+			pixfmt, packing, shift,
 			pixfmt == V4L2_PIX_FMT_SGBRG8		/* start with green */
 			|| pixfmt == V4L2_PIX_FMT_SGRBG8,
 			pixfmt == V4L2_PIX_FMT_SBGGR8		/* blue line */
@@ -429,26 +970,21 @@ static void v4lconvert_border_bayer_line_to_y(
 	}
 }
 
-void v4lconvert_bayer_to_yuv420(const unsigned char *bayer, unsigned char *yuv,
-		int width, int height, const unsigned int stride, unsigned int src_pixfmt, int yvu)
+/* Calculate the u and v planes 2x2 pixels at a time */
+static void bayer_to_uv(struct v4lconvert_data *data,
+		const unsigned char *bayer, unsigned char *udst, unsigned char *vdst,
+		int width, int height, const unsigned int stride, unsigned int src_pixfmt)
 {
-	int blue_line = 0, start_with_green = 0, x, y;
-	unsigned char *ydst = yuv;
-	unsigned char *udst, *vdst;
-
-	if (yvu) {
-		vdst = yuv + width * height;
-		udst = vdst + width * height / 4;
-	} else {
-		udst = yuv + width * height;
-		vdst = udst + width * height / 4;
-	}
+	int x, y;
 
-	/* First calculate the u and v planes 2x2 pixels at a time */
 	switch (src_pixfmt) {
 	case V4L2_PIX_FMT_SBGGR8:
 		for (y = 0; y < height; y += 2) {
-			for (x = 0; x < width; x += 2) {
+			x = v4lconvert_simd_bayer_to_uv(data->cpu_flags, bayer,
+					stride, udst, vdst, width, src_pixfmt);
+			udst += x / 2;
+			vdst += x / 2;
+			for (; x < width; x += 2) {
 				int b, g, r;
 
 				b  = bayer[x];
@@ -460,12 +996,15 @@ void v4lconvert_bayer_to_yuv420(const unsigned char *bayer, unsigned char *yuv,
 			}
 			bayer += 2 * stride;
 		}
-		blue_line = 1;
 		break;
 
 	case V4L2_PIX_FMT_SRGGB8:
 		for (y = 0; y < height; y += 2) {
-			for (x = 0; x < width; x += 2) {
+			x = v4lconvert_simd_bayer_to_uv(data->cpu_flags, bayer,
+					stride, udst, vdst, width, src_pixfmt);
+			udst += x / 2;
+			vdst += x / 2;
+			for (; x < width; x += 2) {
 				int b, g, r;
 
 				r  = bayer[x];
@@ -481,7 +1020,11 @@ void v4lconvert_bayer_to_yuv420(const unsigned char *bayer, unsigned char *yuv,
 
 	case V4L2_PIX_FMT_SGBRG8:
 		for (y = 0; y < height; y += 2) {
-			for (x = 0; x < width; x += 2) {
+			x = v4lconvert_simd_bayer_to_uv(data->cpu_flags, bayer,
+					stride, udst, vdst, width, src_pixfmt);
+			udst += x / 2;
+			vdst += x / 2;
+			for (; x < width; x += 2) {
 				int b, g, r;
 
 				g  = bayer[x];
@@ -493,13 +1036,15 @@ void v4lconvert_bayer_to_yuv420(const unsigned char *bayer, unsigned char *yuv,
 			}
 			bayer += 2 * stride;
 		}
-		blue_line = 1;
-		start_with_green = 1;
 		break;
 
 	case V4L2_PIX_FMT_SGRBG8:
 		for (y = 0; y < height; y += 2) {
-			for (x = 0; x < width; x += 2) {
+			x = v4lconvert_simd_bayer_to_uv(data->cpu_flags, bayer,
+					stride, udst, vdst, width, src_pixfmt);
+			udst += x / 2;
+			vdst += x / 2;
+			for (; x < width; x += 2) {
 				int b, g, r;
 
 				g  = bayer[x];
@@ -511,123 +1056,308 @@ void v4lconvert_bayer_to_yuv420(const unsigned char *bayer, unsigned char *yuv,
 			}
 			bayer += 2 * stride;
 		}
-		start_with_green = 1;
 		break;
 	}
+}
 
-	/* Point bayer back to start of frame */
-	bayer -= stride * height;
-
-	/* render the first line */
-	v4lconvert_border_bayer_line_to_y(bayer, bayer + stride, ydst, width,
-			start_with_green, blue_line);
-	ydst += width;
-
-	/* reduce height by 2 because of the border */
-	for (height -= 2; height; height--) {
-		int t0, t1;
-		/* (width - 2) because of the border */
-		const unsigned char *bayer_end = bayer + (width - 2);
+/* Renders the line below the one bayer points to, see bayer_line_to_rgbbgr24 */
+static void bayer_line_to_y(struct v4lconvert_data *data,
+		const unsigned char *bayer, unsigned char *ydst, int width,
+		const unsigned int stride, int start_with_green, int blue_line)
+{
+	int t0, t1, x;
+	/* (width - 2) because of the border */
+	const unsigned char *bayer_end = bayer + (width - 2);
 
-		if (start_with_green) {
-			t0 = bayer[1] + bayer[stride * 2 + 1];
-			/* Write first pixel */
-			t1 = bayer[0] + bayer[stride * 2] + bayer[stride + 1];
-			if (blue_line)
-				*ydst++ = (8453 * bayer[stride] + 5516 * t1 +
-						1661 * t0 + 524288) >> 15;
-			else
-				*ydst++ = (4226 * t0 + 5516 * t1 +
-						3223 * bayer[stride] + 524288) >> 15;
-
-			/* Write second pixel */
-			t1 = bayer[stride] + bayer[stride + 2];
-			if (blue_line)
-				*ydst++ = (4226 * t1 + 16594 * bayer[stride + 1] +
-						1611 * t0 + 524288) >> 15;
-			else
-				*ydst++ = (4226 * t0 + 16594 * bayer[stride + 1] +
-						1611 * t1 + 524288) >> 15;
-			bayer++;
-		} else {
-			/* Write first pixel */
-			t0 = bayer[0] + bayer[stride * 2];
-			if (blue_line) {
-				*ydst++ = (8453 * bayer[stride + 1] + 16594 * bayer[stride] +
-						1661 * t0 + 524288) >> 15;
-			} else {
-				*ydst++ = (4226 * t0 + 16594 * bayer[stride] +
-						3223 * bayer[stride + 1] + 524288) >> 15;
-			}
-		}
+	if (start_with_green) {
+		t0 = bayer[1] + bayer[stride * 2 + 1];
+		/* Write first pixel */
+		t1 = bayer[0] + bayer[stride * 2] + bayer[stride + 1];
+		if (blue_line)
+			*ydst++ = (8453 * bayer[stride] + 5516 * t1 +
+					1661 * t0 + 524288) >> 15;
+		else
+			*ydst++ = (4226 * t0 + 5516 * t1 +
+					3223 * bayer[stride] + 524288) >> 15;
 
+		/* Write second pixel */
+		t1 = bayer[stride] + bayer[stride + 2];
+		if (blue_line)
+			*ydst++ = (4226 * t1 + 16594 * bayer[stride + 1] +
+					1611 * t0 + 524288) >> 15;
+		else
+			*ydst++ = (4226 * t0 + 16594 * bayer[stride + 1] +
+					1611 * t1 + 524288) >> 15;
+		bayer++;
+	} else {
+		/* Write first pixel */
+		t0 = bayer[0] + bayer[stride * 2];
 		if (blue_line) {
-			for (; bayer <= bayer_end - 2; bayer += 2) {
-				t0 = bayer[0] + bayer[2] + bayer[stride * 2] + bayer[stride * 2 + 2];
-				t1 = bayer[1] + bayer[stride] + bayer[stride + 2] + bayer[stride * 2 + 1];
-				*ydst++ = (8453 * bayer[stride + 1] + 4148 * t1 +
-						806 * t0 + 524288) >> 15;
-
-				t0 = bayer[2] + bayer[stride * 2 + 2];
-				t1 = bayer[stride + 1] + bayer[stride + 3];
-				*ydst++ = (4226 * t1 + 16594 * bayer[stride + 2] +
-						1611 * t0 + 524288) >> 15;
-			}
+			*ydst++ = (8453 * bayer[stride + 1] + 16594 * bayer[stride] +
+					1661 * t0 + 524288) >> 15;
 		} else {
-			for (; bayer <= bayer_end - 2; bayer += 2) {
-				t0 = bayer[0] + bayer[2] + bayer[stride * 2] + bayer[stride * 2 + 2];
-				t1 = bayer[1] + bayer[stride] + bayer[stride + 2] + bayer[stride * 2 + 1];
-				*ydst++ = (2113 * t0 + 4148 * t1 +
-						3223 * bayer[stride + 1] + 524288) >> 15;
-
-				t0 = bayer[2] + bayer[stride * 2 + 2];
-				t1 = bayer[stride + 1] + bayer[stride + 3];
-				*ydst++ = (4226 * t0 + 16594 * bayer[stride + 2] +
-						1611 * t1 + 524288) >> 15;
-			}
+			*ydst++ = (4226 * t0 + 16594 * bayer[stride] +
+					3223 * bayer[stride + 1] + 524288) >> 15;
 		}
+	}
+
+	x = v4lconvert_simd_bayer_line_to_y(data->cpu_flags, bayer, stride,
+			ydst, bayer_end + 2 - bayer, blue_line);
+	bayer += x;
+	ydst += x;
 
-		if (bayer < bayer_end) {
-			/* Write second to last pixel */
+	if (blue_line) {
+		for (; bayer <= bayer_end - 2; bayer += 2) {
 			t0 = bayer[0] + bayer[2] + bayer[stride * 2] + bayer[stride * 2 + 2];
 			t1 = bayer[1] + bayer[stride] + bayer[stride + 2] + bayer[stride * 2 + 1];
-			if (blue_line)
-				*ydst++ = (8453 * bayer[stride + 1] + 4148 * t1 +
-						806 * t0 + 524288) >> 15;
-			else
-				*ydst++ = (2113 * t0 + 4148 * t1 +
-						3223 * bayer[stride + 1] + 524288) >> 15;
+			*ydst++ = (8453 * bayer[stride + 1] + 4148 * t1 +
+					806 * t0 + 524288) >> 15;
 
-			/* write last pixel */
 			t0 = bayer[2] + bayer[stride * 2 + 2];
-			if (blue_line) {
-				*ydst++ = (8453 * bayer[stride + 1] + 16594 * bayer[stride + 2] +
-						1661 * t0 + 524288) >> 15;
-			} else {
-				*ydst++ = (4226 * t0 + 16594 * bayer[stride + 2] +
-						3223 * bayer[stride + 1] + 524288) >> 15;
-			}
-			bayer++;
+			t1 = bayer[stride + 1] + bayer[stride + 3];
+			*ydst++ = (4226 * t1 + 16594 * bayer[stride + 2] +
+					1611 * t0 + 524288) >> 15;
+		}
+	} else {
+		for (; bayer <= bayer_end - 2; bayer += 2) {
+			t0 = bayer[0] + bayer[2] + bayer[stride * 2] + bayer[stride * 2 + 2];
+			t1 = bayer[1] + bayer[stride] + bayer[stride + 2] + bayer[stride * 2 + 1];
+			*ydst++ = (2113 * t0 + 4148 * t1 +
+					3223 * bayer[stride + 1] + 524288) >> 15;
+
+			t0 = bayer[2] + bayer[stride * 2 + 2];
+			t1 = bayer[stride + 1] + bayer[stride + 3];
+			*ydst++ = (4226 * t0 + 16594 * bayer[stride + 2] +
+					1611 * t1 + 524288) >> 15;
+		}
+	}
+
+	if (bayer < bayer_end) {
+		/* Write second to last pixel */
+		t0 = bayer[0] + bayer[2] + bayer[stride * 2] + bayer[stride * 2 + 2];
+		t1 = bayer[1] + bayer[stride] + bayer[stride + 2] + bayer[stride * 2 + 1];
+		if (blue_line)
+			*ydst++ = (8453 * bayer[stride + 1] + 4148 * t1 +
+					806 * t0 + 524288) >> 15;
+		else
+			*ydst++ = (2113 * t0 + 4148 * t1 +
+					3223 * bayer[stride + 1] + 524288) >> 15;
+
+		/* write last pixel */
+		t0 = bayer[2] + bayer[stride * 2 + 2];
+		if (blue_line) {
+			*ydst++ = (8453 * bayer[stride + 1] + 16594 * bayer[stride + 2] +
+					1661 * t0 + 524288) >> 15;
 		} else {
-			/* write last pixel */
-			t0 = bayer[0] + bayer[stride * 2];
-			t1 = bayer[1] + bayer[stride * 2 + 1] + bayer[stride];
-			if (blue_line)
-				*ydst++ = (8453 * bayer[stride + 1] + 5516 * t1 +
-						1661 * t0 + 524288) >> 15;
-			else
-				*ydst++ = (4226 * t0 + 5516 * t1 +
-						3223 * bayer[stride + 1] + 524288) >> 15;
+			*ydst++ = (4226 * t0 + 16594 * bayer[stride + 2] +
+					3223 * bayer[stride + 1] + 524288) >> 15;
 		}
+		bayer++;
+	} else {
+		/* write last pixel */
+		t0 = bayer[0] + bayer[stride * 2];
+		t1 = bayer[1] + bayer[stride * 2 + 1] + bayer[stride];
+		if (blue_line)
+			*ydst++ = (8453 * bayer[stride + 1] + 5516 * t1 +
+					1661 * t0 + 524288) >> 15;
+		else
+			*ydst++ = (4226 * t0 + 5516 * t1 +
+					3223 * bayer[stride + 1] + 524288) >> 15;
+	}
+}
 
-		/* skip 2 border pixels and padding */
-		bayer += (stride - width) + 2;
+static void bayer_to_yuv420_band(void *arg, int first_row, int rows)
+{
+	struct bayer_band_args *args = arg;
+	const unsigned int stride = args->stride;
+	const unsigned char *bayer =
+		args->bayer + (first_row - args->bayer_row) * stride;
+	unsigned char *ydst = args->dest + first_row * args->width;
+	int y, odd;
+
+	bayer_to_uv(args->data, bayer,
+			args->udest + first_row / 2 * (args->width / 2),
+			args->vdest + first_row / 2 * (args->width / 2),
+			args->width, rows, stride, args->pixfmt);
 
-		blue_line = !blue_line;
-		start_with_green = !start_with_green;
+	for (y = first_row; y < first_row + rows; y++) {
+		odd = y & 1;
+		if (y == 0) {
+			/* render the first line */
+			v4lconvert_border_bayer_line_to_y(bayer, bayer + stride,
+					ydst, args->width, args->start_with_green,
+					args->blue_line);
+		} else if (y == args->height - 1) {
+			/* render the last line */
+			v4lconvert_border_bayer_line_to_y(bayer, bayer - stride,
+					ydst, args->width, args->start_with_green ^ odd,
+					args->blue_line ^ odd);
+		} else {
+			bayer_line_to_y(args->data, bayer - stride, ydst,
+					args->width, stride,
+					args->start_with_green ^ !odd,
+					args->blue_line ^ !odd);
+		}
+		bayer += stride;
+		ydst += args->width;
 	}
+}
+
+/* For edge aware demosaicing, render 2 lines to bgr at a time and convert
+   those */
+static void bayer_to_yuv420_bgr_band(void *arg, int first_row, int rows)
+{
+	struct bayer_band_args *args = arg;
+	const int width = args->width;
+	struct bayer_edge_buf edge = { NULL };
+	unsigned char *bgr, *ydst, *udst, *vdst;
+	const unsigned char *s;
+	int x, y;
+
+	bgr = bayer_band_scratch(args, first_row);
+	if (args->mode == V4LCONTROL_DEMOSAIC_EDGE)
+		bayer_edge_prepare(args, &edge, first_row, rows);
+
+	for (y = first_row; y + 1 < first_row + rows; y += 2) {
+		bayer_render_line(args, &edge, y, bgr);
+		bayer_render_line(args, &edge, y + 1, bgr + width * 3);
+
+		ydst = args->dest + y * width;
+		for (x = 0, s = bgr; x < 2 * width; x++, s += 3)
+			RGB2Y(s[2], s[1], s[0], ydst[x]);
+
+		udst = args->udest + y / 2 * (width / 2);
+		vdst = args->vdest + y / 2 * (width / 2);
+		for (x = 0, s = bgr; x < width / 2; x++, s += 6) {
+			int b = (s[0] + s[3] + s[width * 3] + s[width * 3 + 3]) / 4;
+			int g = (s[1] + s[4] + s[width * 3 + 1] + s[width * 3 + 4]) / 4;
+			int r = (s[2] + s[5] + s[width * 3 + 2] + s[width * 3 + 5]) / 4;
+
+			RGB2UV(r, g, b, udst[x], vdst[x]);
+		}
+	}
+}
+
+/* Nearest neighbour, the 2 pixels of a line within a 2x2 block get the same
+   color, so only 1 Y per 2 pixels needs to be calculated */
+static void bayer_nearest_to_yuv420_band(void *arg, int first_row, int rows)
+{
+	struct bayer_band_args *args = arg;
+	const int width = args->width;
+	const unsigned char *bayer;
+	unsigned char *ydst, *udst, *vdst;
+	const struct bayer_block blk = bayer_block_offsets(args);
+	int x, y, r, g0, g1, b;
+
+	for (y = first_row; y + 1 < first_row + rows; y += 2) {
+		bayer = args->bayer + (y - args->bayer_row) * args->stride;
+		ydst = args->dest + y * width;
+		udst = args->udest + y / 2 * (width / 2);
+		vdst = args->vdest + y / 2 * (width / 2);
+		for (x = 0; x + 1 < width; x += 2) {
+			r  = bayer[x + blk.r];
+			g0 = bayer[x + blk.g0];
+			g1 = bayer[x + blk.g1];
+			b  = bayer[x + blk.b];
+			RGB2Y(r, g0, b, ydst[x]);
+			RGB2Y(r, g1, b, ydst[x + width]);
+			ydst[x + 1] = ydst[x];
+			ydst[x + width + 1] = ydst[x + width];
+			RGB2UV(r, (g0 + g1) / 2, b, *udst++, *vdst++);
+		}
+		/* Odd width, repeat the last pixel */
+		if (x < width) {
+			ydst[x] = ydst[x - 1];
+			ydst[x + width] = ydst[x + width - 1];
+		}
+	}
+}
 
-	/* render the last line */
-	v4lconvert_border_bayer_line_to_y(bayer + stride, bayer, ydst, width,
-			!start_with_green, !blue_line);
+/* Averages the 2x2 block p points to into 1 pixel */
+#define BAYER_BIN(p, blk, red, green, blue) \
+	do { \
+		(red) = (p)[(blk).r]; \
+		(green) = ((p)[(blk).g0] + (p)[(blk).g1] + 1) >> 1; \
+		(blue) = (p)[(blk).b]; \
+	} while (0)
+
+/* 2x2 binning, renders 2 half width lines for every 4 lines of the band */
+static void bayer_bin_to_yuv420_band(void *arg, int first_row, int rows)
+{
+	struct bayer_band_args *args = arg;
+	const unsigned int stride = args->stride;
+	const int width = args->width / 2;
+	const struct bayer_block blk = bayer_block_offsets(args);
+	const unsigned char *bayer;
+	unsigned char *ydst, *udst, *vdst;
+	int x, y, r0, g0, b0, r1, g1, b1, r2, g2, b2, r3, g3, b3;
+
+	for (y = first_row; y + 3 < first_row + rows; y += 4) {
+		bayer = args->bayer + (y - args->bayer_row) * stride;
+		ydst = args->dest + y / 2 * width;
+		udst = args->udest + y / 4 * (width / 2);
+		vdst = args->vdest + y / 4 * (width / 2);
+		for (x = 0; x < width; x += 2) {
+			BAYER_BIN(bayer, blk, r0, g0, b0);
+			BAYER_BIN(bayer + 2, blk, r1, g1, b1);
+			BAYER_BIN(bayer + 2 * stride, blk, r2, g2, b2);
+			BAYER_BIN(bayer + 2 * stride + 2, blk, r3, g3, b3);
+			RGB2Y(r0, g0, b0, ydst[x]);
+			RGB2Y(r1, g1, b1, ydst[x + 1]);
+			RGB2Y(r2, g2, b2, ydst[x + width]);
+			RGB2Y(r3, g3, b3, ydst[x + width + 1]);
+			RGB2UV((r0 + r1 + r2 + r3) / 4, (g0 + g1 + g2 + g3) / 4,
+			       (b0 + b1 + b2 + b3) / 4, *udst++, *vdst++);
+			bayer += 4;
+		}
+	}
+}
+
+int v4lconvert_bayer_to_yuv420(struct v4lconvert_data *data,
+		const unsigned char *bayer, unsigned char *yuv,
+		int width, int height, const unsigned int stride, unsigned int src_pixfmt, int yvu)
+{
+	int packing, shift;
+	unsigned int pixfmt8 = v4lconvert_bayer_unpacking(src_pixfmt, &packing,
+							   &shift);
+	struct bayer_band_args args = {
+		.data = data,
+		.bayer = bayer,
+		.dest = yuv,
+		.width = width,
+		.height = height,
+		.stride = stride,
+		.pixfmt = pixfmt8,
+		.start_with_green = pixfmt8 == V4L2_PIX_FMT_SGBRG8 ||
+				    pixfmt8 == V4L2_PIX_FMT_SGRBG8,
+		.blue_line = pixfmt8 == V4L2_PIX_FMT_SBGGR8 ||
+			     pixfmt8 == V4L2_PIX_FMT_SGBRG8,
+		.packing = packing,
+		.shift = shift,
+	};
+
+	bayer_set_mode(&args);
+	if (args.mode == V4LCONTROL_DEMOSAIC_BIN) {
+		width /= 2;
+		height /= 2;
+	}
+
+	if (yvu) {
+		args.vdest = yuv + width * height;
+		args.udest = args.vdest + width * height / 4;
+	} else {
+		args.udest = yuv + width * height;
+		args.vdest = args.udest + width * height / 4;
+	}
+
+	switch (args.mode) {
+	case V4LCONTROL_DEMOSAIC_BILINEAR:
+		return bayer_run_bands(&args, bayer_to_yuv420_band, 2);
+	case V4LCONTROL_DEMOSAIC_NEAREST:
+		return bayer_run_bands(&args, bayer_nearest_to_yuv420_band, 2);
+	case V4LCONTROL_DEMOSAIC_BIN:
+		return bayer_run_bands(&args, bayer_bin_to_yuv420_band, 4);
+	default:
+		return bayer_run_bands(&args, bayer_to_yuv420_bgr_band, 2);
+	}
 }
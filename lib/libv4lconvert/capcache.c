@@ -0,0 +1,372 @@
+/*
+
+# On disk cache of the format, framesize and frameinterval enumeration of a
+# device, to avoid doing all these ioctls (which for UVC cams may mean USB
+# control transfers) on every open
+
+# This program is free software; you can redistribute it and/or modify
+# it under the terms of the GNU Lesser General Public License as published by
+# the Free Software Foundation; either version 2.1 of the License, or
+# (at your option) any later version.
+#
+# This program is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU Lesser General Public License for more details.
+#
+# You should have received a copy of the GNU Lesser General Public License
+# along with this program; if not, write to the Free Software
+# Foundation, Inc., 51 Franklin Street, Suite 500, Boston, MA  02110-1335  USA
+
+ */
+
+#include <errno.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <sys/sysmacros.h>
+#include "libv4lconvert-priv.h"
+
+#define V4LCONVERT_CAPCACHE_MAGIC   0x6363766c /* "lvcc" */
+#define V4LCONVERT_CAPCACHE_VERSION 1
+/* Sanity limit for the number of entries in a cache file */
+#define V4LCONVERT_CAPCACHE_MAX_ENTRIES 65536
+
+/* A cache file is only used when all of this matches the device */
+struct v4lconvert_capcache_key {
+	struct v4l2_capability cap;
+	/* The modalias of the device, for USB devices this contains the
+	   vendor and product id and the bcdDevice (firmware) version */
+	char modalias[128];
+};
+
+struct v4lconvert_capcache_header {
+	uint32_t magic;
+	uint32_t version;
+	uint32_t entry_size;
+	uint32_t no_entries;
+	struct v4lconvert_capcache_key key;
+};
+
+/* The result of one enumeration ioctl, errors which tell the end of the
+   enumeration has been reached get cached too */
+struct v4lconvert_capcache_entry {
+	uint32_t cmd;
+	int32_t error;
+	union {
+		struct v4l2_fmtdesc fmt;
+		struct v4l2_frmsizeenum frmsize;
+		struct v4l2_frmivalenum frmival;
+	} arg;
+};
+
+struct v4lconvert_capcache {
+	pthread_mutex_t lock;
+	char *filename;
+	struct v4lconvert_capcache_key key;
+	struct v4lconvert_capcache_entry *entries;
+	unsigned int no_entries;
+	unsigned int entries_size;
+	int dirty;
+};
+
+static void v4lconvert_capcache_get_modalias(int fd, char *buf, int size)
+{
+	struct stat st;
+	char sysfs_name[64];
+	FILE *f;
+
+	buf[0] = 0;
+
+	if (fstat(fd, &st) || !S_ISCHR(st.st_mode))
+		return;
+
+	snprintf(sysfs_name, sizeof(sysfs_name),
+		 "/sys/dev/char/%u:%u/device/modalias",
+		 major(st.st_rdev), minor(st.st_rdev));
+	f = fopen(sysfs_name, "r");
+	if (!f)
+		return;
+
+	if (!fgets(buf, size, f))
+		buf[0] = 0;
+	fclose(f);
+}
+
+static void v4lconvert_capcache_load(struct v4lconvert_capcache *cache)
+{
+	struct v4lconvert_capcache_header header;
+	struct v4lconvert_capcache_entry *entries;
+	FILE *f;
+
+	f = fopen(cache->filename, "r");
+	if (!f)
+		return;
+
+	if (fread(&header, sizeof(header), 1, f) != 1 ||
+	    header.magic != V4LCONVERT_CAPCACHE_MAGIC ||
+	    header.version != V4LCONVERT_CAPCACHE_VERSION ||
+	    header.entry_size != sizeof(struct v4lconvert_capcache_entry) ||
+	    header.no_entries > V4LCONVERT_CAPCACHE_MAX_ENTRIES ||
+	    memcmp(&header.key, &cache->key, sizeof(cache->key)))
+		goto leave;
+
+	entries = malloc(header.no_entries * sizeof(*entries));
+	if (!entries)
+		goto leave;
+
+	if (fread(entries, sizeof(*entries), header.no_entries, f) !=
+			header.no_entries) {
+		free(entries);
+		goto leave;
+	}
+
+	cache->entries = entries;
+	cache->no_entries = header.no_entries;
+	cache->entries_size = header.no_entries;
+leave:
+	fclose(f);
+}
+
+/* Writes the cache to a temporary file which then gets renamed, so that
+   other processes opening the same device never see a half written file */
+static void v4lconvert_capcache_write(struct v4lconvert_capcache *cache)
+{
+	struct v4lconvert_capcache_header header;
+	char tmp_name[PATH_MAX];
+	FILE *f;
+	int fd;
+
+	memset(&header, 0, sizeof(header));
+	header.magic = V4LCONVERT_CAPCACHE_MAGIC;
+	header.version = V4LCONVERT_CAPCACHE_VERSION;
+	header.entry_size = sizeof(struct v4lconvert_capcache_entry);
+	header.no_entries = cache->no_entries;
+	header.key = cache->key;
+
+	snprintf(tmp_name, sizeof(tmp_name), "%s.XXXXXX", cache->filename);
+	fd = mkstemp(tmp_name);
+	if (fd == -1)
+		goto error;
+
+	f = fdopen(fd, "w");
+	if (!f) {
+		close(fd);
+		unlink(tmp_name);
+		goto error;
+	}
+
+	if (fwrite(&header, sizeof(header), 1, f) != 1 ||
+	    fwrite(cache->entries, sizeof(*cache->entries), cache->no_entries,
+		   f) != cache->no_entries) {
+		fclose(f);
+		unlink(tmp_name);
+		goto error;
+	}
+
+	if (fclose(f) || rename(tmp_name, cache->filename)) {
+		unlink(tmp_name);
+		goto error;
+	}
+
+	cache->dirty = 0;
+	return;
+
+error:
+	fprintf(stderr, "libv4lconvert: warning could not write cache %s: %s\n",
+		cache->filename, strerror(errno));
+	/* Don't try again */
+	cache->dirty = 0;
+}
+
+void v4lconvert_capcache_open(struct v4lconvert_data *data,
+		const struct v4l2_capability *cap)
+{
+	struct v4lconvert_capcache *cache;
+	const char *dir = getenv("LIBV4LCONVERT_CACHE_DIR");
+	char *s;
+	int len;
+
+	if (!dir || !dir[0])
+		return;
+
+	cache = calloc(1, sizeof(*cache));
+	if (!cache)
+		return;
+
+	cache->key.cap = *cap;
+	memset(cache->key.cap.reserved, 0, sizeof(cache->key.cap.reserved));
+	v4lconvert_capcache_get_modalias(data->fd, cache->key.modalias,
+					 sizeof(cache->key.modalias));
+
+	/* One file per driver / bus position, with anything which may not
+	   be in a filename replaced */
+	len = strlen(dir) + sizeof(cap->driver) + sizeof(cap->bus_info) + 16;
+	cache->filename = malloc(len);
+	if (!cache->filename) {
+		free(cache);
+		return;
+	}
+	snprintf(cache->filename, len, "%s/%.16s-%.32s.cache", dir,
+		 (const char *)cap->driver, (const char *)cap->bus_info);
+	for (s = cache->filename + strlen(dir) + 1; *s; s++)
+		if (!((*s >= 'a' && *s <= 'z') || (*s >= 'A' && *s <= 'Z') ||
+		      (*s >= '0' && *s <= '9') || *s == '.' || *s == '-'))
+			*s = '_';
+
+	pthread_mutex_init(&cache->lock, NULL);
+	v4lconvert_capcache_load(cache);
+	data->capcache = cache;
+}
+
+void v4lconvert_capcache_save(struct v4lconvert_data *data)
+{
+	struct v4lconvert_capcache *cache = data->capcache;
+
+	if (!cache)
+		return;
+
+	pthread_mutex_lock(&cache->lock);
+	if (cache->dirty)
+		v4lconvert_capcache_write(cache);
+	pthread_mutex_unlock(&cache->lock);
+}
+
+void v4lconvert_capcache_close(struct v4lconvert_data *data)
+{
+	struct v4lconvert_capcache *cache = data->capcache;
+
+	if (!cache)
+		return;
+
+	v4lconvert_capcache_save(data);
+	pthread_mutex_destroy(&cache->lock);
+	free(cache->entries);
+	free(cache->filename);
+	free(cache);
+	data->capcache = NULL;
+}
+
+/* Does entry hold the answer to cmd with arg? Only the fields the app fills
+   in are compared */
+static int v4lconvert_capcache_match(const struct v4lconvert_capcache_entry *e,
+		unsigned int cmd, const void *arg)
+{
+	if (e->cmd != cmd)
+		return 0;
+
+	switch (cmd) {
+	case VIDIOC_ENUM_FMT: {
+		const struct v4l2_fmtdesc *fmt = arg;
+
+		return e->arg.fmt.index == fmt->index &&
+		       e->arg.fmt.type == fmt->type;
+	}
+	case VIDIOC_ENUM_FRAMESIZES: {
+		const struct v4l2_frmsizeenum *frmsize = arg;
+
+		return e->arg.frmsize.index == frmsize->index &&
+		       e->arg.frmsize.pixel_format == frmsize->pixel_format;
+	}
+	case VIDIOC_ENUM_FRAMEINTERVALS: {
+		const struct v4l2_frmivalenum *frmival = arg;
+
+		return e->arg.frmival.index == frmival->index &&
+		       e->arg.frmival.pixel_format == frmival->pixel_format &&
+		       e->arg.frmival.width == frmival->width &&
+		       e->arg.frmival.height == frmival->height;
+	}
+	}
+	return 0;
+}
+
+static int v4lconvert_capcache_arg_size(unsigned int cmd)
+{
+	switch (cmd) {
+	case VIDIOC_ENUM_FMT:
+		return sizeof(struct v4l2_fmtdesc);
+	case VIDIOC_ENUM_FRAMESIZES:
+		return sizeof(struct v4l2_frmsizeenum);
+	case VIDIOC_ENUM_FRAMEINTERVALS:
+		return sizeof(struct v4l2_frmivalenum);
+	}
+	return 0;
+}
+
+/* Must be called with the cache lock held */
+static void v4lconvert_capcache_add(struct v4lconvert_capcache *cache,
+		unsigned int cmd, const void *arg, int size, int error)
+{
+	struct v4lconvert_capcache_entry *e;
+
+	if (cache->no_entries == V4LCONVERT_CAPCACHE_MAX_ENTRIES)
+		return;
+
+	if (cache->no_entries == cache->entries_size) {
+		unsigned int new_size = cache->entries_size ?
+			cache->entries_size * 2 : 64;
+
+		e = realloc(cache->entries, new_size * sizeof(*e));
+		if (!e)
+			return;
+		cache->entries = e;
+		cache->entries_size = new_size;
+	}
+
+	e = &cache->entries[cache->no_entries++];
+	memset(e, 0, sizeof(*e));
+	e->cmd = cmd;
+	e->error = error;
+	memcpy(&e->arg, arg, size);
+	cache->dirty = 1;
+}
+
+/* Do one of the VIDIOC_ENUM_FMT, VIDIOC_ENUM_FRAMESIZES or
+   VIDIOC_ENUM_FRAMEINTERVALS ioctls, from the cache when we have one */
+int v4lconvert_enum_ioctl(struct v4lconvert_data *data, unsigned long cmd,
+		void *arg)
+{
+	struct v4lconvert_capcache *cache = data->capcache;
+	unsigned int i;
+	int size, result, saved_errno;
+
+	size = v4lconvert_capcache_arg_size(cmd);
+	if (!cache || !size)
+		return data->dev_ops->ioctl(data->dev_ops_priv, data->fd, cmd,
+					    arg);
+
+	pthread_mutex_lock(&cache->lock);
+	for (i = 0; i < cache->no_entries; i++) {
+		const struct v4lconvert_capcache_entry *e = &cache->entries[i];
+
+		if (!v4lconvert_capcache_match(e, cmd, arg))
+			continue;
+
+		if (e->error) {
+			pthread_mutex_unlock(&cache->lock);
+			errno = e->error;
+			return -1;
+		}
+		memcpy(arg, &e->arg, size);
+		pthread_mutex_unlock(&cache->lock);
+		return 0;
+	}
+
+	result = data->dev_ops->ioctl(data->dev_ops_priv, data->fd, cmd, arg);
+	saved_errno = errno;
+	/* Only cache the end of the enumeration and not supported errors,
+	   others may be temporary */
+	if (result == 0)
+		v4lconvert_capcache_add(cache, cmd, arg, size, 0);
+	else if (saved_errno == EINVAL || saved_errno == ENOTTY)
+		v4lconvert_capcache_add(cache, cmd, arg, size, saved_errno);
+	pthread_mutex_unlock(&cache->lock);
+
+	errno = saved_errno;
+	return result;
+}
@@ -567,7 +567,8 @@ static void v4lcontrol_get_flags_from_db(struct v4lcontrol_data *data,
 }
 
 struct v4lcontrol_data *v4lcontrol_create(int fd, void *dev_ops_priv,
-	const struct libv4l_dev_ops *dev_ops, int always_needs_conversion)
+	const struct libv4l_dev_ops *dev_ops, int always_needs_conversion,
+	int bayer_src)
 {
 	int shm_fd;
 	int i, rc, got_usb_info, speed, init = 0;
@@ -678,6 +679,13 @@ struct v4lcontrol_data *v4lcontrol_create(int fd, void *dev_ops_priv,
 		break;
 	}
 
+	if (data->controls & (1 << V4LCONTROL_WHITEBALANCE |
+			      1 << V4LCONTROL_AUTOGAIN))
+		data->controls |= 1 << V4LCONTROL_STATS_STEP;
+
+	if (bayer_src)
+		data->controls |= 1 << V4LCONTROL_DEMOSAIC;
+
 	/* Allow overriding through environment */
 	s = getenv("LIBV4LCONTROL_CONTROLS");
 	if (s)
@@ -841,6 +849,25 @@ static const struct v4l2_queryctrl fake_controls[V4LCONTROL_COUNT] = {
 		.step = 1,
 		.default_value = 100,
 		.flags = V4L2_CTRL_FLAG_SLIDER
+	}, {
+		.id = V4L2_CTRL_CLASS_USER + 0x2001, /* FIXME */
+		.type = V4L2_CTRL_TYPE_INTEGER,
+		.name =  "Auto WB/Gain Sample Step",
+		.minimum = 1,
+		.maximum = 16,
+		.step = 1,
+		.default_value = V4LCONTROL_DEFAULT_STATS_STEP,
+		.flags = V4L2_CTRL_FLAG_SLIDER
+	}, {
+		/* 0: bilinear, 1: nearest, 2: 2x2 binning, 3: edge aware */
+		.id = V4L2_CTRL_CLASS_USER + 0x2002, /* FIXME */
+		.type = V4L2_CTRL_TYPE_INTEGER,
+		.name =  "Bayer Demosaic Mode",
+		.minimum = 0,
+		.maximum = V4LCONTROL_DEMOSAIC_COUNT - 1,
+		.step = 1,
+		.default_value = V4LCONTROL_DEMOSAIC_BILINEAR,
+		.flags = 0
 	},
 };
 
@@ -45,13 +45,39 @@ enum {
 	V4LCONTROL_AUTO_ENABLE_COUNT,
 	V4LCONTROL_AUTOGAIN,
 	V4LCONTROL_AUTOGAIN_TARGET,
+	/* Whitebalance / autogain statistics are gathered from every Nth pixel
+	   (bayer: 2x2 block) of every Nth line */
+	V4LCONTROL_STATS_STEP,
+	/* Bayer demosaicing algorithm, one of the V4LCONTROL_DEMOSAIC_* values */
+	V4LCONTROL_DEMOSAIC,
 	V4LCONTROL_COUNT
 };
 
+#define V4LCONTROL_DEFAULT_STATS_STEP 4
+
+/* Bayer demosaic modes */
+enum {
+	V4LCONTROL_DEMOSAIC_BILINEAR,
+	/* Every 2x2 block gets the red and blue of that block, every pixel
+	   the green of its own line in that block */
+	V4LCONTROL_DEMOSAIC_NEAREST,
+	/* Average every 2x2 block into 1 pixel, producing a half size frame,
+	   when a frame of at most half the size is asked for. Otherwise this
+	   is the same as V4LCONTROL_DEMOSAIC_NEAREST */
+	V4LCONTROL_DEMOSAIC_BIN,
+	/* Interpolate green along edges instead of across them, and red and
+	   blue from their difference to green (Hamilton-Adams) */
+	V4LCONTROL_DEMOSAIC_EDGE,
+	V4LCONTROL_DEMOSAIC_COUNT
+};
+
 struct v4lcontrol_data;
 
+/* bayer_src tells if the device has raw bayer formats, which makes us add
+   the demosaic control */
 struct v4lcontrol_data *v4lcontrol_create(int fd, void *dev_ops_priv,
-	const struct libv4l_dev_ops *dev_ops, int always_needs_conversion);
+	const struct libv4l_dev_ops *dev_ops, int always_needs_conversion,
+	int bayer_src);
 void v4lcontrol_destroy(struct v4lcontrol_data *data);
 
 int v4lcontrol_get_bandwidth(struct v4lcontrol_data *data);
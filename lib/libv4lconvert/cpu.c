@@ -0,0 +1,50 @@
+/*
+
+# CPU feature detection for the SIMD conversion routines
+
+# This program is free software; you can redistribute it and/or modify
+# it under the terms of the GNU Lesser General Public License as published by
+# the Free Software Foundation; either version 2.1 of the License, or
+# (at your option) any later version.
+#
+# This program is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU Lesser General Public License for more details.
+#
+# You should have received a copy of the GNU Lesser General Public License
+# along with this program; if not, write to the Free Software
+# Foundation, Inc., 51 Franklin Street, Suite 500, Boston, MA  02110-1335  USA
+
+ */
+
+#include <stdlib.h>
+#include "libv4lconvert-priv.h"
+
+int v4lconvert_get_cpu_flags(void)
+{
+	int flags = 0;
+	char *s;
+
+#ifdef HAVE_V4LCONVERT_X86_SIMD
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("sse2"))
+		flags |= V4LCONVERT_CPU_SSE2;
+	if (__builtin_cpu_supports("ssse3"))
+		flags |= V4LCONVERT_CPU_SSSE3;
+	if (__builtin_cpu_supports("avx2"))
+		flags |= V4LCONVERT_CPU_AVX2;
+#endif
+#ifdef HAVE_V4LCONVERT_NEON
+	/* NEON is part of the baseline when the compiler targets it */
+	flags |= V4LCONVERT_CPU_NEON;
+#endif
+
+	/* Allow masking out instruction sets through the environment, setting
+	   this to 0 forces the (bit exact) plain C reference code paths */
+	s = getenv("LIBV4LCONVERT_CPU_FLAGS");
+	if (s)
+		flags &= strtol(s, NULL, 0);
+
+	return flags;
+}
@@ -0,0 +1,324 @@
+/*
+
+# SIMD versions of the flip / rotate inner loops
+
+# These produce the exact same output as the plain C code in flip.c, which
+# stays the reference implementation and handles the left-over pixels at the
+# end of each line and the partial tiles at the frame edges.
+
+# This program is free software; you can redistribute it and/or modify
+# it under the terms of the GNU Lesser General Public License as published by
+# the Free Software Foundation; either version 2.1 of the License, or
+# (at your option) any later version.
+#
+# This program is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU Lesser General Public License for more details.
+#
+# You should have received a copy of the GNU Lesser General Public License
+# along with this program; if not, write to the Free Software
+# Foundation, Inc., 51 Franklin Street, Suite 500, Boston, MA  02110-1335  USA
+
+ */
+
+#include <string.h>
+#include "libv4lconvert-priv.h"
+#include "simd-priv.h"
+
+/*
+ * The 16x16 byte transposes below do 4 rounds of interleaving row i with
+ * row i + 8, storing the low half result as row 2i and the high half result
+ * as row 2i + 1. After 4 rounds row j holds column j of the original block.
+ * The rows are kept in named variables (a0 - a15 and b0 - b15) rather then
+ * arrays, so that they stay in registers.
+ */
+
+#define TRANSPOSE_LOAD(load, src, stride) \
+	a0 = load(src); a1 = load(src + stride); \
+	a2 = load(src + 2 * stride); a3 = load(src + 3 * stride); \
+	a4 = load(src + 4 * stride); a5 = load(src + 5 * stride); \
+	a6 = load(src + 6 * stride); a7 = load(src + 7 * stride); \
+	a8 = load(src + 8 * stride); a9 = load(src + 9 * stride); \
+	a10 = load(src + 10 * stride); a11 = load(src + 11 * stride); \
+	a12 = load(src + 12 * stride); a13 = load(src + 13 * stride); \
+	a14 = load(src + 14 * stride); a15 = load(src + 15 * stride)
+
+#define TRANSPOSE_STORE(store, dest, stride) \
+	store(dest, a0); store(dest + stride, a1); \
+	store(dest + 2 * stride, a2); store(dest + 3 * stride, a3); \
+	store(dest + 4 * stride, a4); store(dest + 5 * stride, a5); \
+	store(dest + 6 * stride, a6); store(dest + 7 * stride, a7); \
+	store(dest + 8 * stride, a8); store(dest + 9 * stride, a9); \
+	store(dest + 10 * stride, a10); store(dest + 11 * stride, a11); \
+	store(dest + 12 * stride, a12); store(dest + 13 * stride, a13); \
+	store(dest + 14 * stride, a14); store(dest + 15 * stride, a15)
+
+/* zip(lo, hi, x, y) interleaves rows x and y into rows lo and hi */
+#define TRANSPOSE_ROUND(zip, in, out) \
+	zip(out##0, out##1, in##0, in##8); \
+	zip(out##2, out##3, in##1, in##9); \
+	zip(out##4, out##5, in##2, in##10); \
+	zip(out##6, out##7, in##3, in##11); \
+	zip(out##8, out##9, in##4, in##12); \
+	zip(out##10, out##11, in##5, in##13); \
+	zip(out##12, out##13, in##6, in##14); \
+	zip(out##14, out##15, in##7, in##15)
+
+#define TRANSPOSE(zip) \
+	TRANSPOSE_ROUND(zip, a, b); \
+	TRANSPOSE_ROUND(zip, b, a); \
+	TRANSPOSE_ROUND(zip, a, b); \
+	TRANSPOSE_ROUND(zip, b, a)
+
+#ifdef HAVE_V4LCONVERT_X86_SIMD
+
+static V4LCONVERT_TARGET("ssse3") int reverse_line_ssse3(
+		const unsigned char *src, unsigned char *dest, int width)
+{
+	const __m128i rev = _mm_setr_epi8(15, 14, 13, 12, 11, 10, 9, 8,
+					  7, 6, 5, 4, 3, 2, 1, 0);
+	int x;
+
+	for (x = 0; x + 16 <= width; x += 16) {
+		__m128i v = _mm_loadu_si128(
+			(const __m128i *)(src + width - 16 - x));
+
+		_mm_storeu_si128((__m128i *)(dest + x),
+				 _mm_shuffle_epi8(v, rev));
+	}
+
+	return x;
+}
+
+/* Reverses the order of 16 rgb24 pixels at a time, each output register
+   gets its bytes from 2 or 3 of the input registers */
+static V4LCONVERT_TARGET("ssse3") int reverse_line_rgb24_ssse3(
+		const unsigned char *src, unsigned char *dest, int width)
+{
+	const __m128i m01 = _mm_setr_epi8(-128, -128, -128, -128, -128, -128,
+			-128, -128, -128, -128, -128, -128, -128, -128, -128, 14);
+	const __m128i m02 = _mm_setr_epi8(13, 14, 15, 10, 11, 12, 7, 8,
+			9, 4, 5, 6, 1, 2, 3, -128);
+	const __m128i m10 = _mm_setr_epi8(-128, -128, -128, -128, -128, -128,
+			-128, -128, -128, -128, -128, -128, -128, -128, 15, -128);
+	const __m128i m11 = _mm_setr_epi8(15, -128, 11, 12, 13, 8, 9, 10,
+			5, 6, 7, 2, 3, 4, -128, 0);
+	const __m128i m12 = _mm_setr_epi8(-128, 0, -128, -128, -128, -128,
+			-128, -128, -128, -128, -128, -128, -128, -128, -128, -128);
+	const __m128i m20 = _mm_setr_epi8(-128, 12, 13, 14, 9, 10, 11, 6,
+			7, 8, 3, 4, 5, 0, 1, 2);
+	const __m128i m21 = _mm_setr_epi8(1, -128, -128, -128, -128, -128,
+			-128, -128, -128, -128, -128, -128, -128, -128, -128, -128);
+	int x;
+
+	for (x = 0; x + 16 <= width; x += 16) {
+		const unsigned char *s = src + (width - 16 - x) * 3;
+		__m128i i0 = _mm_loadu_si128((const __m128i *)s);
+		__m128i i1 = _mm_loadu_si128((const __m128i *)(s + 16));
+		__m128i i2 = _mm_loadu_si128((const __m128i *)(s + 32));
+		__m128i o0, o1, o2;
+
+		o0 = _mm_or_si128(_mm_shuffle_epi8(i1, m01),
+				  _mm_shuffle_epi8(i2, m02));
+		o1 = _mm_or_si128(_mm_or_si128(_mm_shuffle_epi8(i0, m10),
+					       _mm_shuffle_epi8(i1, m11)),
+				  _mm_shuffle_epi8(i2, m12));
+		o2 = _mm_or_si128(_mm_shuffle_epi8(i0, m20),
+				  _mm_shuffle_epi8(i1, m21));
+		_mm_storeu_si128((__m128i *)(dest + x * 3), o0);
+		_mm_storeu_si128((__m128i *)(dest + x * 3 + 16), o1);
+		_mm_storeu_si128((__m128i *)(dest + x * 3 + 32), o2);
+	}
+
+	return x;
+}
+
+#define LOAD_SSE2(p) _mm_loadu_si128((const __m128i *)(p))
+#define STORE_SSE2(p, v) _mm_storeu_si128((__m128i *)(p), v)
+#define ZIP_SSE2(lo, hi, x, y) \
+	do { \
+		lo = _mm_unpacklo_epi8(x, y); \
+		hi = _mm_unpackhi_epi8(x, y); \
+	} while (0)
+
+static V4LCONVERT_TARGET("sse2") void transpose_block_sse2(
+		const unsigned char *src, int src_stride, unsigned char *dest,
+		int dest_stride)
+{
+	__m128i a0, a1, a2, a3, a4, a5, a6, a7, a8, a9, a10, a11, a12, a13,
+		a14, a15;
+	__m128i b0, b1, b2, b3, b4, b5, b6, b7, b8, b9, b10, b11, b12, b13,
+		b14, b15;
+
+	TRANSPOSE_LOAD(LOAD_SSE2, src, src_stride);
+	TRANSPOSE(ZIP_SSE2);
+	TRANSPOSE_STORE(STORE_SSE2, dest, dest_stride);
+}
+
+/*
+ * rgb24 blocks get transposed in 4x4 pixel steps: 4 pixels of each of 4 src
+ * lines get expanded to 4 bytes per pixel, transposed as 32 bit elements
+ * and packed back to 12 bytes for each of 4 dest lines. The last 4 pixels of
+ * a 16 pixel src line are loaded from 4 bytes before them, so that we never
+ * read beyond the block.
+ */
+#define STORE_RGB24_SSSE3(d, v) \
+	do { \
+		__m128i p = _mm_shuffle_epi8(v, pack); \
+		int last = _mm_cvtsi128_si32(_mm_srli_si128(p, 8)); \
+		_mm_storel_epi64((__m128i *)(d), p); \
+		memcpy((d) + 8, &last, 4); \
+	} while (0)
+
+#define TRANSPOSE_RGB24_4X4_SSSE3(s, expand, d) \
+	do { \
+		__m128i r0, r1, r2, r3, t0, t1, t2, t3; \
+		r0 = _mm_shuffle_epi8(LOAD_SSE2(s), expand); \
+		r1 = _mm_shuffle_epi8(LOAD_SSE2(s + src_stride), expand); \
+		r2 = _mm_shuffle_epi8(LOAD_SSE2(s + 2 * src_stride), expand); \
+		r3 = _mm_shuffle_epi8(LOAD_SSE2(s + 3 * src_stride), expand); \
+		t0 = _mm_unpacklo_epi32(r0, r1); \
+		t1 = _mm_unpacklo_epi32(r2, r3); \
+		t2 = _mm_unpackhi_epi32(r0, r1); \
+		t3 = _mm_unpackhi_epi32(r2, r3); \
+		STORE_RGB24_SSSE3(d, _mm_unpacklo_epi64(t0, t1)); \
+		STORE_RGB24_SSSE3(d + dest_stride, _mm_unpackhi_epi64(t0, t1)); \
+		STORE_RGB24_SSSE3(d + 2 * dest_stride, \
+				  _mm_unpacklo_epi64(t2, t3)); \
+		STORE_RGB24_SSSE3(d + 3 * dest_stride, \
+				  _mm_unpackhi_epi64(t2, t3)); \
+	} while (0)
+
+static V4LCONVERT_TARGET("ssse3") void transpose_block_rgb24_ssse3(
+		const unsigned char *src, int src_stride, unsigned char *dest,
+		int dest_stride)
+{
+	const __m128i expand = _mm_setr_epi8(0, 1, 2, -128, 3, 4, 5, -128,
+			6, 7, 8, -128, 9, 10, 11, -128);
+	const __m128i expand_last = _mm_setr_epi8(4, 5, 6, -128, 7, 8, 9, -128,
+			10, 11, 12, -128, 13, 14, 15, -128);
+	const __m128i pack = _mm_setr_epi8(0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13,
+			14, -128, -128, -128, -128);
+	int x;
+
+	for (x = 0; x < 16; x += 4) {
+		const unsigned char *s = src + x * src_stride;
+		unsigned char *d = dest + x * 3;
+
+		TRANSPOSE_RGB24_4X4_SSSE3(s, expand, d);
+		TRANSPOSE_RGB24_4X4_SSSE3(s + 12, expand, d + 4 * dest_stride);
+		TRANSPOSE_RGB24_4X4_SSSE3(s + 24, expand, d + 8 * dest_stride);
+		TRANSPOSE_RGB24_4X4_SSSE3(s + 32, expand_last,
+					  d + 12 * dest_stride);
+	}
+}
+
+#endif /* HAVE_V4LCONVERT_X86_SIMD */
+
+#ifdef HAVE_V4LCONVERT_NEON
+
+static inline uint8x16_t reverse_neon(uint8x16_t v)
+{
+	v = vrev64q_u8(v);
+	return vcombine_u8(vget_high_u8(v), vget_low_u8(v));
+}
+
+static int reverse_line_neon(const unsigned char *src, unsigned char *dest,
+		int width)
+{
+	int x;
+
+	for (x = 0; x + 16 <= width; x += 16)
+		vst1q_u8(dest + x, reverse_neon(vld1q_u8(src + width - 16 - x)));
+
+	return x;
+}
+
+static int reverse_line_rgb24_neon(const unsigned char *src,
+		unsigned char *dest, int width)
+{
+	uint8x16x3_t v;
+	int x;
+
+	for (x = 0; x + 16 <= width; x += 16) {
+		v = vld3q_u8(src + (width - 16 - x) * 3);
+		v.val[0] = reverse_neon(v.val[0]);
+		v.val[1] = reverse_neon(v.val[1]);
+		v.val[2] = reverse_neon(v.val[2]);
+		vst3q_u8(dest + x * 3, v);
+	}
+
+	return x;
+}
+
+#define ZIP_NEON(lo, hi, x, y) \
+	do { \
+		uint8x16x2_t z = vzipq_u8(x, y); \
+		lo = z.val[0]; \
+		hi = z.val[1]; \
+	} while (0)
+
+static void transpose_block_neon(const unsigned char *src, int src_stride,
+		unsigned char *dest, int dest_stride)
+{
+	uint8x16_t a0, a1, a2, a3, a4, a5, a6, a7, a8, a9, a10, a11, a12, a13,
+		a14, a15;
+	uint8x16_t b0, b1, b2, b3, b4, b5, b6, b7, b8, b9, b10, b11, b12, b13,
+		b14, b15;
+
+	TRANSPOSE_LOAD(vld1q_u8, src, src_stride);
+	TRANSPOSE(ZIP_NEON);
+	TRANSPOSE_STORE(vst1q_u8, dest, dest_stride);
+}
+
+#endif /* HAVE_V4LCONVERT_NEON */
+
+int v4lconvert_simd_reverse_line(int cpu_flags, const unsigned char *src,
+		unsigned char *dest, int width, int bpp)
+{
+	int x = 0;
+
+#ifdef HAVE_V4LCONVERT_X86_SIMD
+	if (cpu_flags & V4LCONVERT_CPU_SSSE3)
+		x = bpp == 3 ? reverse_line_rgb24_ssse3(src, dest, width) :
+			       reverse_line_ssse3(src, dest, width);
+#endif
+#ifdef HAVE_V4LCONVERT_NEON
+	if (cpu_flags & V4LCONVERT_CPU_NEON)
+		x = bpp == 3 ? reverse_line_rgb24_neon(src, dest, width) :
+			       reverse_line_neon(src, dest, width);
+#endif
+
+	return x;
+}
+
+int v4lconvert_simd_can_transpose(int cpu_flags, int bpp)
+{
+#ifdef HAVE_V4LCONVERT_X86_SIMD
+	if (bpp == 1 && (cpu_flags & V4LCONVERT_CPU_SSE2))
+		return 1;
+	if (bpp == 3 && (cpu_flags & V4LCONVERT_CPU_SSSE3))
+		return 1;
+#endif
+#ifdef HAVE_V4LCONVERT_NEON
+	if (bpp == 1 && (cpu_flags & V4LCONVERT_CPU_NEON))
+		return 1;
+#endif
+
+	return 0;
+}
+
+void v4lconvert_simd_transpose_block(int cpu_flags, const unsigned char *src,
+		int src_stride, unsigned char *dest, int dest_stride, int bpp)
+{
+#ifdef HAVE_V4LCONVERT_X86_SIMD
+	if (bpp == 3)
+		transpose_block_rgb24_ssse3(src, src_stride, dest, dest_stride);
+	else
+		transpose_block_sse2(src, src_stride, dest, dest_stride);
+#endif
+#ifdef HAVE_V4LCONVERT_NEON
+	transpose_block_neon(src, src_stride, dest, dest_stride);
+#endif
+}
@@ -23,6 +23,8 @@
 #include <string.h>
 #include "libv4lconvert-priv.h"
 
+#define MIN(a, b) (((a) < (b)) ? (a) : (b))
+
 static void v4lconvert_vflip_rgbbgr24(unsigned char *src, unsigned char *dest,
 		struct v4l2_format *fmt)
 {
@@ -66,140 +68,223 @@ static void v4lconvert_vflip_yuv420(unsigned char *src, unsigned char *dest,
 	}
 }
 
-static void v4lconvert_hflip_rgbbgr24(unsigned char *src, unsigned char *dest,
-		struct v4l2_format *fmt)
+/* Reverses the order of the width pixels of bpp (1 or 3) bytes of a line */
+static void v4lconvert_reverse_line(struct v4lconvert_data *data,
+		const unsigned char *src, unsigned char *dest, int width, int bpp)
 {
-	int x, y;
+	int x = v4lconvert_simd_reverse_line(data->cpu_flags, src, dest,
+					     width, bpp);
 
-	for (y = 0; y < fmt->fmt.pix.height; y++) {
-		src += fmt->fmt.pix.width * 3;
-		for (x = 0; x < fmt->fmt.pix.width; x++) {
+	src += (width - x) * bpp;
+	dest += x * bpp;
+	if (bpp == 3) {
+		for (; x < width; x++) {
 			src -= 3;
 			dest[0] = src[0];
 			dest[1] = src[1];
 			dest[2] = src[2];
 			dest += 3;
 		}
-		src += fmt->fmt.pix.bytesperline;
+	} else {
+		for (; x < width; x++)
+			*dest++ = *--src;
 	}
 }
 
-static void v4lconvert_hflip_yuv420(unsigned char *src, unsigned char *dest,
-		struct v4l2_format *fmt)
+static void v4lconvert_hflip_rgbbgr24(struct v4lconvert_data *data,
+		unsigned char *src, unsigned char *dest, struct v4l2_format *fmt)
 {
-	int x, y;
+	int y;
 
-	/* First flip the Y plane */
 	for (y = 0; y < fmt->fmt.pix.height; y++) {
-		src += fmt->fmt.pix.width;
-		for (x = 0; x < fmt->fmt.pix.width; x++)
-			*dest++ = *--src;
+		v4lconvert_reverse_line(data, src, dest, fmt->fmt.pix.width, 3);
 		src += fmt->fmt.pix.bytesperline;
+		dest += fmt->fmt.pix.width * 3;
 	}
+}
 
-	/* Now flip the U plane */
-	for (y = 0; y < fmt->fmt.pix.height / 2; y++) {
-		src += fmt->fmt.pix.width / 2;
-		for (x = 0; x < fmt->fmt.pix.width / 2; x++)
-			*dest++ = *--src;
-		src += fmt->fmt.pix.bytesperline / 2;
+static void v4lconvert_hflip_yuv420(struct v4lconvert_data *data,
+		unsigned char *src, unsigned char *dest, struct v4l2_format *fmt)
+{
+	int y;
+
+	/* First flip the Y plane */
+	for (y = 0; y < fmt->fmt.pix.height; y++) {
+		v4lconvert_reverse_line(data, src, dest, fmt->fmt.pix.width, 1);
+		src += fmt->fmt.pix.bytesperline;
+		dest += fmt->fmt.pix.width;
 	}
 
-	/* Last flip the V plane */
-	for (y = 0; y < fmt->fmt.pix.height / 2; y++) {
-		src += fmt->fmt.pix.width / 2;
-		for (x = 0; x < fmt->fmt.pix.width / 2; x++)
-			*dest++ = *--src;
+	/* Now flip the U and V planes */
+	for (y = 0; y < fmt->fmt.pix.height / 2 * 2; y++) {
+		v4lconvert_reverse_line(data, src, dest, fmt->fmt.pix.width / 2,
+					1);
 		src += fmt->fmt.pix.bytesperline / 2;
+		dest += fmt->fmt.pix.width / 2;
 	}
 }
 
-static void v4lconvert_rotate180_rgbbgr24(const unsigned char *src,
-		unsigned char *dst, int width, int height)
+/* Flipping both x and y is reversing the order of all pixels, do this a line
+   at a time, taking the lines from the bottom up */
+static void v4lconvert_rotate180_plane(struct v4lconvert_data *data,
+		const unsigned char *src, unsigned char *dst, int width,
+		int height, int bpp)
 {
-	int i;
-
-	src += 3 * width * height - 3;
+	int y;
 
-	for (i = 0; i < width * height; i++) {
-		dst[0] = src[0];
-		dst[1] = src[1];
-		dst[2] = src[2];
-		dst += 3;
-		src -= 3;
+	src += (height - 1) * width * bpp;
+	for (y = 0; y < height; y++) {
+		v4lconvert_reverse_line(data, src, dst, width, bpp);
+		src -= width * bpp;
+		dst += width * bpp;
 	}
 }
 
-static void v4lconvert_rotate180_yuv420(const unsigned char *src,
-		unsigned char *dst, int width, int height)
+static void v4lconvert_rotate180_rgbbgr24(struct v4lconvert_data *data,
+		const unsigned char *src, unsigned char *dst, int width,
+		int height)
 {
-	int i;
+	v4lconvert_rotate180_plane(data, src, dst, width, height, 3);
+}
 
+static void v4lconvert_rotate180_yuv420(struct v4lconvert_data *data,
+		const unsigned char *src, unsigned char *dst, int width,
+		int height)
+{
 	/* First flip x and y of the Y plane */
-	src += width * height - 1;
-	for (i = 0; i < width * height; i++)
-		*dst++ = *src--;
+	v4lconvert_rotate180_plane(data, src, dst, width, height, 1);
 
 	/* Now flip the U plane */
-	src += width * height * 5 / 4;
-	for (i = 0; i < width * height / 4; i++)
-		*dst++ = *src--;
+	src += width * height;
+	dst += width * height;
+	v4lconvert_rotate180_plane(data, src, dst, width / 2, height / 2, 1);
 
 	/* Last flip the V plane */
-	src += width * height / 2;
-	for (i = 0; i < width * height / 4; i++)
-		*dst++ = *src--;
+	src += width * height / 4;
+	dst += width * height / 4;
+	v4lconvert_rotate180_plane(data, src, dst, width / 2, height / 2, 1);
 }
 
-static void v4lconvert_rotate90_rgbbgr24(const unsigned char *src,
-		unsigned char *dst, int destwidth, int destheight)
+/*
+ * Rotating 90 degrees means reading the src a column at a time. With the
+ * simd transposes the dest gets written in strips of V4LCONVERT_ROTATE_STRIP
+ * columns, which get filled a row of V4LCONVERT_ROTATE_TILE square tiles at
+ * a time, top to bottom. This way each strip reads V4LCONVERT_ROTATE_STRIP
+ * src lines front to back, which the cpu's prefetcher can follow, and writes
+ * V4LCONVERT_ROTATE_STRIP pixels per dest line. Strips of dest rows instead
+ * walk the whole src height for every tile column, which at 5 MP got slower
+ * than not tiling at all. The plain C code is not faster when tiled, the
+ * prefetcher does a better job on long columns, so it does the whole plane
+ * as one tile.
+ */
+#define V4LCONVERT_ROTATE_TILE 16
+#define V4LCONVERT_ROTATE_STRIP 256
+
+/* Rotates a w x h pixels tile, src points to the tile's pixel which ends up
+   in the top left of the dest tile */
+static void v4lconvert_rotate90_tile(const unsigned char *src, int srcstride,
+		unsigned char *dst, int dststride, int w, int h, int bpp)
 {
 	int x, y;
-#define srcwidth destheight
-#define srcheight destwidth
-
-	for (y = 0; y < destheight; y++)
-		for (x = 0; x < destwidth; x++) {
-			int offset = ((srcheight - x - 1) * srcwidth + y) * 3;
-			*dst++ = src[offset++];
-			*dst++ = src[offset++];
-			*dst++ = src[offset];
+
+	if (bpp == 3) {
+		for (y = 0; y < h; y++) {
+			const unsigned char *s = src + y * 3;
+			unsigned char *d = dst + y * dststride;
+
+			for (x = 0; x < w; x++) {
+				d[0] = s[0];
+				d[1] = s[1];
+				d[2] = s[2];
+				d += 3;
+				s -= srcstride;
+			}
+		}
+	} else {
+		for (y = 0; y < h; y++) {
+			const unsigned char *s = src + y;
+			unsigned char *d = dst + y * dststride;
+
+			for (x = 0; x < w; x++) {
+				d[x] = *s;
+				s -= srcstride;
+			}
 		}
+	}
 }
 
-static void v4lconvert_rotate90_yuv420(const unsigned char *src,
-		unsigned char *dst, int destwidth, int destheight)
+static void v4lconvert_rotate90_plane(struct v4lconvert_data *data,
+		const unsigned char *src, unsigned char *dst, int destwidth,
+		int destheight, int bpp)
 {
-	int x, y;
+	const int srcwidth = destheight, srcheight = destwidth;
+	int x, y, strip, strip_end, w, h;
+
+	/* dest pixel (x, y) is src pixel (y, srcheight - x - 1) */
+	if (!v4lconvert_simd_can_transpose(data->cpu_flags, bpp)) {
+		v4lconvert_rotate90_tile(src + (srcheight - 1) * srcwidth * bpp,
+				srcwidth * bpp, dst, destwidth * bpp,
+				destwidth, destheight, bpp);
+		return;
+	}
 
-	/* Y-plane */
-	for (y = 0; y < destheight; y++)
-		for (x = 0; x < destwidth; x++) {
-			int offset = (srcheight - x - 1) * srcwidth + y;
-			*dst++ = src[offset];
+	for (strip = 0; strip < destwidth; strip += V4LCONVERT_ROTATE_STRIP) {
+		strip_end = MIN(strip + V4LCONVERT_ROTATE_STRIP, destwidth);
+		for (y = 0; y < destheight; y += V4LCONVERT_ROTATE_TILE) {
+			h = MIN(V4LCONVERT_ROTATE_TILE, destheight - y);
+			for (x = strip; x < strip_end;
+			     x += V4LCONVERT_ROTATE_TILE) {
+				const unsigned char *s = src +
+					((srcheight - x - 1) * srcwidth + y) *
+					bpp;
+				unsigned char *d = dst +
+					(y * destwidth + x) * bpp;
+
+				w = MIN(V4LCONVERT_ROTATE_TILE, strip_end - x);
+				if (w == V4LCONVERT_ROTATE_TILE &&
+				    h == V4LCONVERT_ROTATE_TILE)
+					v4lconvert_simd_transpose_block(
+						data->cpu_flags, s,
+						-srcwidth * bpp, d,
+						destwidth * bpp, bpp);
+				else
+					v4lconvert_rotate90_tile(s,
+						srcwidth * bpp, d,
+						destwidth * bpp, w, h, bpp);
+			}
 		}
+	}
+}
+
+static void v4lconvert_rotate90_rgbbgr24(struct v4lconvert_data *data,
+		const unsigned char *src, unsigned char *dst, int destwidth,
+		int destheight)
+{
+	v4lconvert_rotate90_plane(data, src, dst, destwidth, destheight, 3);
+}
+
+static void v4lconvert_rotate90_yuv420(struct v4lconvert_data *data,
+		const unsigned char *src, unsigned char *dst, int destwidth,
+		int destheight)
+{
+	/* Y-plane */
+	v4lconvert_rotate90_plane(data, src, dst, destwidth, destheight, 1);
 
 	/* U-plane */
-	src += srcwidth * srcheight;
-	destwidth /= 2;
-	destheight /= 2;
-	for (y = 0; y < destheight; y++)
-		for (x = 0; x < destwidth; x++) {
-			int offset = (srcheight - x - 1) * srcwidth + y;
-			*dst++ = src[offset];
-		}
+	src += destwidth * destheight;
+	dst += destwidth * destheight;
+	v4lconvert_rotate90_plane(data, src, dst, destwidth / 2,
+				  destheight / 2, 1);
 
 	/* V-plane */
-	src += srcwidth * srcheight;
-	for (y = 0; y < destheight; y++)
-		for (x = 0; x < destwidth; x++) {
-			int offset = (srcheight - x - 1) * srcwidth + y;
-			*dst++ = src[offset];
-		}
+	src += destwidth * destheight / 4;
+	dst += destwidth * destheight / 4;
+	v4lconvert_rotate90_plane(data, src, dst, destwidth / 2,
+				  destheight / 2, 1);
 }
 
-void v4lconvert_rotate90(unsigned char *src, unsigned char *dest,
-		struct v4l2_format *fmt)
+void v4lconvert_rotate90(struct v4lconvert_data *data, unsigned char *src,
+		unsigned char *dest, struct v4l2_format *fmt)
 {
 	int tmp;
 
@@ -210,31 +295,85 @@ void v4lconvert_rotate90(unsigned char *src, unsigned char *dest,
 	switch (fmt->fmt.pix.pixelformat) {
 	case V4L2_PIX_FMT_RGB24:
 	case V4L2_PIX_FMT_BGR24:
-		v4lconvert_rotate90_rgbbgr24(src, dest, fmt->fmt.pix.width,
-				fmt->fmt.pix.height);
+		v4lconvert_rotate90_rgbbgr24(data, src, dest,
+				fmt->fmt.pix.width, fmt->fmt.pix.height);
 		break;
 	case V4L2_PIX_FMT_YUV420:
 	case V4L2_PIX_FMT_YVU420:
-		v4lconvert_rotate90_yuv420(src, dest, fmt->fmt.pix.width,
-				fmt->fmt.pix.height);
+		v4lconvert_rotate90_yuv420(data, src, dest,
+				fmt->fmt.pix.width, fmt->fmt.pix.height);
 		break;
 	}
 	v4lconvert_fixup_fmt(fmt);
 }
 
-void v4lconvert_flip(unsigned char *src, unsigned char *dest,
-		struct v4l2_format *fmt, int hflip, int vflip)
+/*
+ * Helpers for flipping rgb24 / bgr24 frames while converting them, and for
+ * directly converting to 32 bpp rgb, instead of converting to a temporary
+ * buffer and doing another pass over the frame. Converters supporting this
+ * ask where to write each rgb24 line, and call v4lconvert_fused_finish_line()
+ * once a line is written, which applies the processing lookup tables to it,
+ * horizontally flips it in place and / or expands it to 32 bpp while it is
+ * still in the cache.
+ */
+unsigned char *v4lconvert_fused_line(struct v4lconvert_data *data,
+		unsigned char *dest, int y, int width, int height)
+{
+	if (data->fused & V4LCONVERT_FUSED_VFLIP)
+		y = height - 1 - y;
+
+	/* For 32 bpp the rgb24 line goes in the last 3/4 of the dest line */
+	if (data->fused & V4LCONVERT_FUSED_RGB32)
+		return dest + y * width * 4 + width;
+
+	return dest + y * width * 3;
+}
+
+void v4lconvert_fused_finish_line(struct v4lconvert_data *data,
+		unsigned char *line, int width)
+{
+	unsigned char *start = line, *end = line + (width - 1) * 3;
+	const unsigned char *lut0 = data->lut[0], *lut1 = data->lut[1];
+	const unsigned char *lut2 = data->lut[2];
+	unsigned char tmp;
+	int i;
+
+	if (data->fused & V4LCONVERT_FUSED_LUT) {
+		for (i = 0; i < width * 3; i += 3) {
+			line[i] = lut0[line[i]];
+			line[i + 1] = lut1[line[i + 1]];
+			line[i + 2] = lut2[line[i + 2]];
+		}
+	}
+
+	if (data->fused & V4LCONVERT_FUSED_HFLIP) {
+		for (; line < end; line += 3, end -= 3) {
+			for (i = 0; i < 3; i++) {
+				tmp = line[i];
+				line[i] = end[i];
+				end[i] = tmp;
+			}
+		}
+	}
+
+	if (data->fused & V4LCONVERT_FUSED_RGB32)
+		v4lconvert_rgb24_to_rgb32_line(data, start, start - width,
+					       width);
+}
+
+void v4lconvert_flip(struct v4lconvert_data *data, unsigned char *src,
+		unsigned char *dest, struct v4l2_format *fmt, int hflip, int vflip)
 {
 	if (vflip && hflip) {
 		switch (fmt->fmt.pix.pixelformat) {
 		case V4L2_PIX_FMT_RGB24:
 		case V4L2_PIX_FMT_BGR24:
-			v4lconvert_rotate180_rgbbgr24(src, dest, fmt->fmt.pix.width,
+			v4lconvert_rotate180_rgbbgr24(data, src, dest, fmt->fmt.pix.width,
 					fmt->fmt.pix.height);
 			break;
 		case V4L2_PIX_FMT_YUV420:
 		case V4L2_PIX_FMT_YVU420:
-			v4lconvert_rotate180_yuv420(src, dest, fmt->fmt.pix.width,
+			v4lconvert_rotate180_yuv420(data, src, dest, fmt->fmt.pix.width,
 					fmt->fmt.pix.height);
 			break;
 		}
@@ -242,11 +381,11 @@ void v4lconvert_flip(unsigned char *src, unsigned char *dest,
 		switch (fmt->fmt.pix.pixelformat) {
 		case V4L2_PIX_FMT_RGB24:
 		case V4L2_PIX_FMT_BGR24:
-			v4lconvert_hflip_rgbbgr24(src, dest, fmt);
+			v4lconvert_hflip_rgbbgr24(data, src, dest, fmt);
 			break;
 		case V4L2_PIX_FMT_YUV420:
 		case V4L2_PIX_FMT_YVU420:
-			v4lconvert_hflip_yuv420(src, dest, fmt);
+			v4lconvert_hflip_yuv420(data, src, dest, fmt);
 			break;
 		}
 	} else if (vflip) {
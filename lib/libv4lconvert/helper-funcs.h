@@ -24,11 +24,20 @@
  * SUCH DAMAGE.
  */
 
+#include <config.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <stdint.h>
 #include <unistd.h>
 #include <errno.h>
+#include <limits.h>
 #include <string.h>
+#include <poll.h>
+#include <sys/mman.h>
+#include "helper-shm.h"
+#ifdef V4LCONVERT_HELPER_HAVE_SHM
+#include <sys/eventfd.h>
+#endif
 
 static int v4lconvert_helper_write(int fd, const void *b, size_t count,
   char *progname)
@@ -77,3 +86,105 @@ static int v4lconvert_helper_read(int fd, void *b, size_t count,
 
   return 0;
 }
+
+typedef int (*v4lconvert_helper_decompress_func)(unsigned char *src,
+  unsigned char *dest, int width, int height, int yvu, int src_size);
+
+/* Called when libv4l asks us to switch to passing frames through shared
+   memory (see helper-shm.h). When we cannot do that we answer -1 and return,
+   so that the caller continues with the pipe protocol, otherwise we handle
+   requests until libv4l closes our stdin. */
+static int v4lconvert_helper_shm(v4lconvert_helper_decompress_func decompress,
+  char *progname)
+{
+  int r = -1;
+#ifdef V4LCONVERT_HELPER_HAVE_SHM
+  struct v4lconvert_helper_shm *shm = MAP_FAILED;
+  struct pollfd pfd[2];
+  int memfd, req_fd, done_fd, size = 0, slot = 0;
+  char *env = getenv(V4LCONVERT_HELPER_SHM_ENV);
+  uint64_t count;
+
+  if (!env || sscanf(env, "%d,%d,%d", &memfd, &req_fd, &done_fd) != 3)
+    goto no_shm;
+
+  r = V4LCONVERT_HELPER_SHM_ACK;
+  if (v4lconvert_helper_write(STDOUT_FILENO, &r, sizeof(int), progname))
+    exit(1);
+
+  pfd[0].fd = req_fd;
+  pfd[0].events = POLLIN;
+  pfd[1].fd = STDIN_FILENO;
+  pfd[1].events = POLLIN;
+  while (1) {
+    if (poll(pfd, 2, -1) == -1) {
+      if (errno == EINTR)
+	continue;
+
+      fprintf(stderr, "%s: error polling: %s\n", progname, strerror(errno));
+      exit(1);
+    }
+    /* Anything on stdin means libv4l closed it, iow is done with us */
+    if (pfd[1].revents)
+      exit(0);
+
+    if (read(req_fd, &count, sizeof(count)) == -1)
+      continue;
+
+    /* libv4l grows the shared memory when it needs more room */
+    if (shm == MAP_FAILED || shm->size != size) {
+      if (shm != MAP_FAILED)
+	munmap(shm, size);
+      if (pread(memfd, &size, sizeof(int), 0) != sizeof(int)) {
+	fprintf(stderr, "%s: error reading shared memory size\n", progname);
+	exit(1);
+      }
+      shm = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, memfd, 0);
+      if (shm == MAP_FAILED) {
+	fprintf(stderr, "%s: error mapping shared memory: %s\n", progname,
+		strerror(errno));
+	exit(1);
+      }
+    }
+
+    while (shm->slot[slot].state == V4LCONVERT_HELPER_SLOT_SUBMITTED) {
+      struct v4lconvert_helper_shm_slot *s = &shm->slot[slot];
+      int width = s->width, height = s->height;
+      int dest_size = width * height * 3 / 2;
+
+      if (width <= 0 || width > SHRT_MAX || height <= 0 || height > SHRT_MAX) {
+	fprintf(stderr, "%s: error: width or height out of bounds\n",
+		progname);
+	dest_size = -1;
+      } else if (dest_size > s->dest_size ||
+		 s->src_size < 0 || s->src_offset < 0 || s->dest_offset < 0 ||
+		 s->src_offset + s->src_size > size ||
+		 s->dest_offset + dest_size > size) {
+	fprintf(stderr, "%s: error: invalid shared memory request\n",
+		progname);
+	dest_size = -1;
+      } else if (decompress((unsigned char *)shm + s->src_offset,
+			    (unsigned char *)shm + s->dest_offset, width, height,
+			    s->flags, s->src_size))
+	dest_size = -1;
+
+      s->dest_size = dest_size;
+      s->state = V4LCONVERT_HELPER_SLOT_DONE;
+      count = 1;
+      if (write(done_fd, &count, sizeof(count)) == -1) {
+	fprintf(stderr, "%s: error signalling: %s\n", progname,
+		strerror(errno));
+	exit(1);
+      }
+      slot = (slot + 1) % V4LCONVERT_HELPER_SHM_SLOTS;
+    }
+  }
+
+no_shm:
+  r = -1;
+#endif
+  if (v4lconvert_helper_write(STDOUT_FILENO, &r, sizeof(int), progname))
+    exit(1);
+
+  return -1;
+}
@@ -0,0 +1,74 @@
+/* Shared memory protocol between libv4lconvert and decompression helpers
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#ifndef __LIBV4LCONVERT_HELPER_SHM_H
+#define __LIBV4LCONVERT_HELPER_SHM_H
+
+#if defined(HAVE_MEMFD_CREATE) && defined(HAVE_SYS_EVENTFD_H)
+#define V4LCONVERT_HELPER_HAVE_SHM 1
+#endif
+
+/* The helper finds the shared memory and eventfd file descriptors in this
+   environment variable, as "<memfd>,<request eventfd>,<done eventfd>" */
+#define V4LCONVERT_HELPER_SHM_ENV "LIBV4LCONVERT_HELPER_SHM"
+
+/* Send as width over the pipe to ask the helper to switch to the shared
+   memory protocol, the helper answers with V4LCONVERT_HELPER_SHM_ACK as data
+   length. Helpers which do not know about it answer -1 (invalid width), in
+   which case we keep using the pipes. */
+#define V4LCONVERT_HELPER_SHM_MAGIC (-0x4d485356)
+#define V4LCONVERT_HELPER_SHM_ACK     0x4d485356
+
+#define V4LCONVERT_HELPER_SHM_SLOTS 2
+
+enum v4lconvert_helper_slot_state {
+	V4LCONVERT_HELPER_SLOT_FREE,
+	V4LCONVERT_HELPER_SLOT_SUBMITTED,
+	V4LCONVERT_HELPER_SLOT_DONE,
+};
+
+/* Offsets are relative to the start of the shared memory */
+struct v4lconvert_helper_shm_slot {
+	volatile int state;
+	int width;
+	int height;
+	int flags;
+	int src_offset;
+	int src_size;
+	int dest_offset;
+	int dest_size; /* room in, decompressed size (-1 on error) out */
+};
+
+/* The shared memory starts with this header, followed by the src and dest
+   area of each slot. Slots get submitted (and must be handled) in order, the
+   request eventfd gets written after each submit, the done eventfd after
+   each completion. */
+struct v4lconvert_helper_shm {
+	/* Size of the shared memory, this may grow between requests, the
+	   helper must remap it when it has become bigger */
+	volatile int size;
+	struct v4lconvert_helper_shm_slot slot[V4LCONVERT_HELPER_SHM_SLOTS];
+};
+
+#endif
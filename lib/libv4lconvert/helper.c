@@ -22,8 +22,16 @@
 #include <errno.h>
 #include <string.h>
 #include <signal.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <stdint.h>
+#include <sys/mman.h>
 #include <sys/wait.h>
 #include "libv4lconvert-priv.h"
+#include "helper-shm.h"
+#ifdef V4LCONVERT_HELPER_HAVE_SHM
+#include <sys/eventfd.h>
+#endif
 
 #define READ_END  0
 #define WRITE_END 1
@@ -46,11 +54,118 @@
    From the helper to libv4l the following is send:
    int			data length (-1 in case of a decompression error)
    unsigned char[]	data (not present when a decompression error happened)
+
+   Pushing every frame through these pipes costs 2 copies and a bunch of
+   syscalls per direction, so when possible we switch to passing the frames
+   through a ring of slots in shared memory (see helper-shm.h) instead. The
+   helper gets asked to switch by sending it V4LCONVERT_HELPER_SHM_MAGIC as
+   width, older helpers simply answer that with -1, and we stay with the
+   pipes.
  */
 
+#ifdef V4LCONVERT_HELPER_HAVE_SHM
+static void v4lconvert_helper_shm_cleanup(struct v4lconvert_data *data)
+{
+	if (data->decompress_shm)
+		munmap(data->decompress_shm, data->decompress_shm->size);
+	if (data->decompress_shm_fd != -1)
+		close(data->decompress_shm_fd);
+	if (data->decompress_req_fd != -1)
+		close(data->decompress_req_fd);
+	if (data->decompress_done_fd != -1)
+		close(data->decompress_done_fd);
+	data->decompress_shm = NULL;
+	data->decompress_shm_fd = -1;
+	data->decompress_req_fd = -1;
+	data->decompress_done_fd = -1;
+}
+
+/* Create the shared memory and eventfds, these get created close on exec,
+   the child clears that for the helper */
+static int v4lconvert_helper_shm_create(struct v4lconvert_data *data)
+{
+	data->decompress_shm_fd = memfd_create("libv4lconvert-helper",
+					       MFD_CLOEXEC);
+	data->decompress_req_fd = eventfd(0, EFD_CLOEXEC);
+	data->decompress_done_fd = eventfd(0, EFD_CLOEXEC);
+	data->decompress_shm_src_room = 0;
+	data->decompress_shm_dest_room = 0;
+	data->decompress_shm_slot = 0;
+	if (data->decompress_shm_fd == -1 || data->decompress_req_fd == -1 ||
+			data->decompress_done_fd == -1) {
+		v4lconvert_helper_shm_cleanup(data);
+		return -1;
+	}
+	return 0;
+}
+
+/* Make the shared memory big enough for src_size bytes of compressed and
+   dest_size bytes of decompressed data per slot */
+static int v4lconvert_helper_shm_resize(struct v4lconvert_data *data,
+		int src_size, int dest_size)
+{
+	struct v4lconvert_helper_shm *shm;
+	long page_size = sysconf(_SC_PAGESIZE);
+	int i, size, src_room, dest_room;
+
+	if (data->decompress_shm && src_size <= data->decompress_shm_src_room &&
+			dest_size <= data->decompress_shm_dest_room)
+		return 0;
+
+	if (page_size <= 0)
+		page_size = 4096;
+	src_room = data->decompress_shm_src_room;
+	if (src_size > src_room)
+		src_room = (src_size + page_size - 1) / page_size * page_size;
+	dest_room = data->decompress_shm_dest_room;
+	if (dest_size > dest_room)
+		dest_room = (dest_size + page_size - 1) / page_size * page_size;
+	size = page_size + V4LCONVERT_HELPER_SHM_SLOTS * (src_room + dest_room);
+
+	if (ftruncate(data->decompress_shm_fd, size)) {
+		V4LCONVERT_ERR("resizing helper shared memory: %s\n",
+			       strerror(errno));
+		return -1;
+	}
+
+	shm = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED,
+		   data->decompress_shm_fd, 0);
+	if (shm == MAP_FAILED) {
+		V4LCONVERT_ERR("mapping helper shared memory: %s\n",
+			       strerror(errno));
+		return -1;
+	}
+	if (data->decompress_shm)
+		munmap(data->decompress_shm, data->decompress_shm->size);
+
+	/* No requests are pending here, so we can freely move the slots */
+	for (i = 0; i < V4LCONVERT_HELPER_SHM_SLOTS; i++) {
+		shm->slot[i].src_offset = page_size +
+					  i * (src_room + dest_room);
+		shm->slot[i].dest_offset = shm->slot[i].src_offset + src_room;
+	}
+	shm->size = size;
+	data->decompress_shm = shm;
+	data->decompress_shm_src_room = src_room;
+	data->decompress_shm_dest_room = dest_room;
+
+	return 0;
+}
+#endif
+
 static int v4lconvert_helper_start(struct v4lconvert_data *data,
 		const char *helper)
 {
+#ifdef V4LCONVERT_HELPER_HAVE_SHM
+	char shm_env[64];
+
+	/* Without these we simply use the pipes */
+	if (v4lconvert_helper_shm_create(data) == 0)
+		snprintf(shm_env, sizeof(shm_env), "%s=%d,%d,%d",
+			 V4LCONVERT_HELPER_SHM_ENV, data->decompress_shm_fd,
+			 data->decompress_req_fd, data->decompress_done_fd);
+#endif
+
 	if (pipe(data->decompress_in_pipe)) {
 		V4LCONVERT_ERR("with helper pipe: %s\n", strerror(errno));
 		goto error;
@@ -84,6 +199,16 @@ static int v4lconvert_helper_start(struct v4lconvert_data *data,
 			exit(1);
 		}
 
+#ifdef V4LCONVERT_HELPER_HAVE_SHM
+		/* Hand the shared memory and eventfds to the helper */
+		if (data->decompress_shm_fd != -1) {
+			fcntl(data->decompress_shm_fd, F_SETFD, 0);
+			fcntl(data->decompress_req_fd, F_SETFD, 0);
+			fcntl(data->decompress_done_fd, F_SETFD, 0);
+			putenv(shm_env);
+		}
+#endif
+
 		/* And execute the helper */
 		execl(helper, helper, NULL);
 
@@ -105,6 +230,9 @@ error_close_in_pipe:
 	close(data->decompress_in_pipe[READ_END]);
 	close(data->decompress_in_pipe[WRITE_END]);
 error:
+#ifdef V4LCONVERT_HELPER_HAVE_SHM
+	v4lconvert_helper_shm_cleanup(data);
+#endif
 	return -1;
 }
 
@@ -165,17 +293,126 @@ static int v4lconvert_helper_read(struct v4lconvert_data *data, void *b,
 	return 0;
 }
 
+/* Ask the helper to switch to the shared memory protocol */
+static void v4lconvert_helper_shm_negotiate(struct v4lconvert_data *data)
+{
+#ifdef V4LCONVERT_HELPER_HAVE_SHM
+	int r, request[4] = { V4LCONVERT_HELPER_SHM_MAGIC, 0, 0, 0 };
+
+	if (data->decompress_shm_fd == -1)
+		return;
+
+	if (v4lconvert_helper_write(data, request, sizeof(request)) ||
+			v4lconvert_helper_read(data, &r, sizeof(int)) ||
+			r != V4LCONVERT_HELPER_SHM_ACK ||
+			v4lconvert_helper_shm_resize(data, 0, 0))
+		v4lconvert_helper_shm_cleanup(data);
+#endif
+}
+
+#ifdef V4LCONVERT_HELPER_HAVE_SHM
+static int v4lconvert_helper_shm_decompress(struct v4lconvert_data *data,
+		const unsigned char *src, int src_size,
+		unsigned char *dest, int dest_size, int width, int height,
+		int flags, unsigned char **frame)
+{
+	struct v4lconvert_helper_shm_slot *slot;
+	struct pollfd pfd[2];
+	uint64_t count = 1;
+	unsigned char *shm;
+	int r;
+
+	/* The helpers output yuv420 */
+	if (v4lconvert_helper_shm_resize(data, src_size,
+					 width * height * 3 / 2))
+		return -1;
+
+	shm = (unsigned char *)data->decompress_shm;
+	slot = &data->decompress_shm->slot[data->decompress_shm_slot];
+	memcpy(shm + slot->src_offset, src, src_size);
+	slot->width = width;
+	slot->height = height;
+	slot->flags = flags;
+	slot->src_size = src_size;
+	slot->dest_size = data->decompress_shm_dest_room;
+	slot->state = V4LCONVERT_HELPER_SLOT_SUBMITTED;
+	if (write(data->decompress_req_fd, &count, sizeof(count)) == -1) {
+		V4LCONVERT_ERR("signalling helper: %s\n", strerror(errno));
+		return -1;
+	}
+
+	/* Wait for the helper, it writing to its stdout means it exited */
+	pfd[0].fd = data->decompress_done_fd;
+	pfd[0].events = POLLIN;
+	pfd[1].fd = data->decompress_in_pipe[READ_END];
+	pfd[1].events = POLLIN;
+	while (slot->state != V4LCONVERT_HELPER_SLOT_DONE) {
+		if (poll(pfd, 2, -1) == -1) {
+			if (errno == EINTR)
+				continue;
+
+			V4LCONVERT_ERR("waiting for helper: %s\n", strerror(errno));
+			return -1;
+		}
+		if (pfd[1].revents) {
+			V4LCONVERT_ERR("waiting for helper: helper exited\n");
+			return -1;
+		}
+		if (pfd[0].revents &&
+				read(data->decompress_done_fd, &count, sizeof(count)) == -1 &&
+				errno != EINTR && errno != EAGAIN) {
+			V4LCONVERT_ERR("waiting for helper: %s\n", strerror(errno));
+			return -1;
+		}
+	}
+	slot->state = V4LCONVERT_HELPER_SLOT_FREE;
+	data->decompress_shm_slot = (data->decompress_shm_slot + 1) %
+				    V4LCONVERT_HELPER_SHM_SLOTS;
+
+	r = slot->dest_size;
+	if (r < 0) {
+		V4LCONVERT_ERR("decompressing frame data\n");
+		return -1;
+	}
+
+	if (dest_size < r) {
+		V4LCONVERT_ERR("destination buffer to small\n");
+		return -1;
+	}
+
+	/* The slot is not touched again until the next request after the
+	   next one, so the caller can use the frame right where it is */
+	if (frame)
+		*frame = shm + slot->dest_offset;
+	else
+		memcpy(dest, shm + slot->dest_offset, r);
+
+	return 0;
+}
+#endif
+
 int v4lconvert_helper_decompress(struct v4lconvert_data *data,
 		const char *helper, const unsigned char *src, int src_size,
-		unsigned char *dest, int dest_size, int width, int height, int flags)
+		unsigned char *dest, int dest_size, int width, int height, int flags,
+		unsigned char **frame)
 {
 	int r;
 
 	if (data->decompress_pid == -1) {
 		if (v4lconvert_helper_start(data, helper))
 			return -1;
+		v4lconvert_helper_shm_negotiate(data);
 	}
 
+#ifdef V4LCONVERT_HELPER_HAVE_SHM
+	if (data->decompress_shm)
+		return v4lconvert_helper_shm_decompress(data, src, src_size,
+				dest, dest_size, width, height, flags, frame);
+#endif
+
+	if (frame)
+		*frame = dest;
+
 	if (v4lconvert_helper_write(data, &width, sizeof(int)))
 		return -1;
 
@@ -216,5 +453,8 @@ void v4lconvert_helper_cleanup(struct v4lconvert_data *data)
 		close(data->decompress_in_pipe[READ_END]);
 		waitpid(data->decompress_pid, &status, 0);
 		data->decompress_pid = -1;
+#ifdef V4LCONVERT_HELPER_HAVE_SHM
+		v4lconvert_helper_shm_cleanup(data);
+#endif
 	}
 }
@@ -35,22 +35,19 @@ Foundation, Inc., 51 Franklin Street, Suite 500, Boston, MA  02110-1335  USA
    which is available for raw video as a 'bonus feature'.
  */
 
-#define CLIP(color) \
-	(unsigned char)(((color) > 0xff) ? 0xff : (((color) < 0) ? 0 : (color)))
-
 static const int stride = 720;
 
-static void v4lconvert_hm12_to_rgb(const unsigned char *src, unsigned char *dest,
-		int width, int height, int rgb)
+static void v4lconvert_hm12_to_rgb(struct v4lconvert_data *data,
+		const unsigned char *src, unsigned char *dest, int width,
+		int height, int bgr)
 {
 	unsigned int y, x, i, j;
 	const unsigned char *y_base = src;
 	const unsigned char *uv_base = src + stride * height;
 	const unsigned char *src_y;
 	const unsigned char *src_uv;
+	const struct v4lconvert_yuv_coefs coefs = *data->yuv_coefs;
 	int mb_size = 256;
-	int r = rgb ? 0 : 2;
-	int b = 2 - r;
 
 	for (y = 0; y < height; y += 16) {
 		int mb_y = (y / 16) * (stride / 16);
@@ -70,17 +67,10 @@ static void v4lconvert_hm12_to_rgb(const unsigned char *src, unsigned char *dest
 				int idx = (x + (y + i) * width) * 3;
 
 				for (j = 0; j < maxx; j++) {
-					int y = src_y[j];
-					int u = src_uv[j & ~1];
-					int v = src_uv[j | 1];
-					int u1 = (((u - 128) << 7) + (u - 128)) >> 6;
-					int rg = (((u - 128) << 1) + (u - 128) +
-						((v - 128) << 2) + ((v - 128) << 1)) >> 3;
-					int v1 = (((v - 128) << 1) + (v - 128)) >> 1;
-
-					dest[idx+r] = CLIP(y + v1);
-					dest[idx+1] = CLIP(y - rg);
-					dest[idx+b] = CLIP(y + u1);
+					v4lconvert_yuv_to_rgb24_pixel(&coefs,
+						dest + idx, src_y[j],
+						src_uv[j & ~1] - 128,
+						src_uv[j | 1] - 128, bgr);
 					idx += 3;
 				}
 				src_y += 16;
@@ -91,16 +81,18 @@ static void v4lconvert_hm12_to_rgb(const unsigned char *src, unsigned char *dest
 	}
 }
 
-void v4lconvert_hm12_to_rgb24(const unsigned char *src, unsigned char *dest,
-		int width, int height)
+void v4lconvert_hm12_to_rgb24(struct v4lconvert_data *data,
+		const unsigned char *src, unsigned char *dest, int width,
+		int height)
 {
-	v4lconvert_hm12_to_rgb(src, dest, width, height, 1);
+	v4lconvert_hm12_to_rgb(data, src, dest, width, height, 0);
 }
 
-void v4lconvert_hm12_to_bgr24(const unsigned char *src, unsigned char *dest,
-		int width, int height)
+void v4lconvert_hm12_to_bgr24(struct v4lconvert_data *data,
+		const unsigned char *src, unsigned char *dest, int width,
+		int height)
 {
-	v4lconvert_hm12_to_rgb(src, dest, width, height, 0);
+	v4lconvert_hm12_to_rgb(data, src, dest, width, height, 1);
 }
 
 static void de_macro_uv(unsigned char *dstu, unsigned char *dstv,
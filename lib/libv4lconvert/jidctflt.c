@@ -114,17 +114,50 @@ static inline unsigned char descale_and_clamp(int x, int shift)
 }
 #endif
 
+/*
+ * Note tinyjpeg now uses the integer IDCT from jidctint.c, this is kept as
+ * the reference to compare it with, see contrib/test/idct-test.c.
+ */
+
+/*
+ * Build the table for tinyjpeg_idct_float() from a (dezigzagged) JPEG
+ * quantization table.
+ */
+
+void tinyjpeg_idct_float_qtable(float *qtable, const int16_t *Q_table)
+{
+	/* Taken from libjpeg. Copyright Independent JPEG Group's LLM idct.
+	 * For float AA&N IDCT method, divisors are equal to quantization
+	 * coefficients scaled by scalefactor[row]*scalefactor[col], where
+	 *   scalefactor[0] = 1
+	 *   scalefactor[k] = cos(k*PI/16) * sqrt(2)    for k=1..7
+	 * We apply a further scale factor of 8.
+	 * What's actually stored is 1/divisor so that the inner loop can
+	 * use a multiplication rather than a division.
+	 */
+	int i, j;
+	static const double aanscalefactor[8] = {
+		1.0, 1.387039845, 1.306562965, 1.175875602,
+		1.0, 0.785694958, 0.541196100, 0.275899379
+	};
+
+	for (i = 0; i < 8; i++)
+		for (j = 0; j < 8; j++)
+			*qtable++ = *Q_table++ * aanscalefactor[i] * aanscalefactor[j];
+}
+
 /*
  * Perform dequantization and inverse DCT on one block of coefficients.
  */
 
-void tinyjpeg_idct_float(struct component *compptr, uint8_t *output_buf, int stride)
+void tinyjpeg_idct_float(const int16_t *DCT, const float *qtable,
+		uint8_t *output_buf, int stride)
 {
 	FAST_FLOAT tmp0, tmp1, tmp2, tmp3, tmp4, tmp5, tmp6, tmp7;
 	FAST_FLOAT tmp10, tmp11, tmp12, tmp13;
 	FAST_FLOAT z5, z10, z11, z12, z13;
-	int16_t *inptr;
-	FAST_FLOAT *quantptr;
+	const int16_t *inptr;
+	const FAST_FLOAT *quantptr;
 	FAST_FLOAT *wsptr;
 	uint8_t *outptr;
 	int ctr;
@@ -132,8 +165,8 @@ void tinyjpeg_idct_float(struct component *compptr, uint8_t *output_buf, int str
 
 	/* Pass 1: process columns from input, store into work array. */
 
-	inptr = compptr->DCT;
-	quantptr = compptr->Q_table;
+	inptr = DCT;
+	quantptr = qtable;
 	wsptr = workspace;
 	for (ctr = DCTSIZE; ctr > 0; ctr--) {
 		/* Due to quantization, we will usually find that many of the input
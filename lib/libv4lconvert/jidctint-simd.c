@@ -0,0 +1,332 @@
+/*
+
+# SIMD versions of the integer IDCT
+
+# These produce the exact same output as the plain C code in jidctint.c, see
+# there for a description of the algorithm. The SIMD versions do both passes
+# on 8 columns resp. rows at a time, so they skip the zero column / row
+# shortcuts, which do not change the result.
+
+# This program is free software; you can redistribute it and/or modify
+# it under the terms of the GNU Lesser General Public License as published by
+# the Free Software Foundation; either version 2.1 of the License, or
+# (at your option) any later version.
+#
+# This program is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU Lesser General Public License for more details.
+#
+# You should have received a copy of the GNU Lesser General Public License
+# along with this program; if not, write to the Free Software
+# Foundation, Inc., 51 Franklin Street, Suite 500, Boston, MA  02110-1335  USA
+
+ */
+
+#include "libv4lconvert-priv.h"
+#include "simd-priv.h"
+
+#define CONST_BITS  13
+#define PASS1_BITS  2
+
+/*
+ * The multiplications of the odd part of jidctint.c, folded into a single
+ * sum of products per output:
+ *   tmp0 = y7 * ODD_07_0 + y1 * ODD_01_0 + y5 * ODD_05_0 + y3 * ODD_03_0
+ * and so on for tmp1 - tmp3. The even part uses:
+ *   tmp3 = y2 * (c0541 + c0765) + y6 * c0541
+ *   tmp2 = y2 * c0541 + y6 * (c0541 - c1847)
+ *   tmp0 = (y0 + y4) << CONST_BITS, tmp1 = (y0 - y4) << CONST_BITS
+ */
+#define EVEN_2_3   10703	/* FIX_0_541196100 + FIX_0_765366865 */
+#define EVEN_6_3    4433	/* FIX_0_541196100 */
+#define EVEN_2_2    4433	/* FIX_0_541196100 */
+#define EVEN_6_2  -10704	/* FIX_0_541196100 - FIX_1_847759065 */
+
+#define ODD_07_0  -11363
+#define ODD_01_0    2260
+#define ODD_05_0    9633
+#define ODD_03_0   -6436
+#define ODD_07_1    9633
+#define ODD_01_1    6437
+#define ODD_05_1    2261
+#define ODD_03_1  -11362
+#define ODD_07_2   -6436
+#define ODD_01_2    9633
+#define ODD_05_2  -11362
+#define ODD_03_2   -2259
+#define ODD_07_3    2260
+#define ODD_01_3   11363
+#define ODD_05_3    6437
+#define ODD_03_3    9633
+
+#ifdef HAVE_V4LCONVERT_X86_SIMD
+
+static inline V4LCONVERT_TARGET("sse2") void transpose_8x8_sse2(__m128i *r)
+{
+	__m128i a0, a1, a2, a3, a4, a5, a6, a7;
+	__m128i b0, b1, b2, b3, b4, b5, b6, b7;
+
+	a0 = _mm_unpacklo_epi16(r[0], r[1]);
+	a1 = _mm_unpackhi_epi16(r[0], r[1]);
+	a2 = _mm_unpacklo_epi16(r[2], r[3]);
+	a3 = _mm_unpackhi_epi16(r[2], r[3]);
+	a4 = _mm_unpacklo_epi16(r[4], r[5]);
+	a5 = _mm_unpackhi_epi16(r[4], r[5]);
+	a6 = _mm_unpacklo_epi16(r[6], r[7]);
+	a7 = _mm_unpackhi_epi16(r[6], r[7]);
+
+	b0 = _mm_unpacklo_epi32(a0, a2);
+	b1 = _mm_unpackhi_epi32(a0, a2);
+	b2 = _mm_unpacklo_epi32(a1, a3);
+	b3 = _mm_unpackhi_epi32(a1, a3);
+	b4 = _mm_unpacklo_epi32(a4, a6);
+	b5 = _mm_unpackhi_epi32(a4, a6);
+	b6 = _mm_unpacklo_epi32(a5, a7);
+	b7 = _mm_unpackhi_epi32(a5, a7);
+
+	r[0] = _mm_unpacklo_epi64(b0, b4);
+	r[1] = _mm_unpackhi_epi64(b0, b4);
+	r[2] = _mm_unpacklo_epi64(b1, b5);
+	r[3] = _mm_unpackhi_epi64(b1, b5);
+	r[4] = _mm_unpacklo_epi64(b2, b6);
+	r[5] = _mm_unpackhi_epi64(b2, b6);
+	r[6] = _mm_unpacklo_epi64(b3, b7);
+	r[7] = _mm_unpackhi_epi64(b3, b7);
+}
+
+/* a * ka + b * kb for the low resp. high 4 elements of a and b */
+#define MADD_LO(a, b, ka, kb) _mm_madd_epi16(_mm_unpacklo_epi16(a, b), \
+		_mm_set1_epi32(V4LCONVERT_COEF_PAIR(ka, kb)))
+#define MADD_HI(a, b, ka, kb) _mm_madd_epi16(_mm_unpackhi_epi16(a, b), \
+		_mm_set1_epi32(V4LCONVERT_COEF_PAIR(ka, kb)))
+
+/*
+ * One pass of the IDCT on 8 columns at once, r[n] holds input n of each
+ * column and gets output n, descaled by shift bits.
+ */
+static inline V4LCONVERT_TARGET("sse2") void idct_pass_sse2(__m128i *r,
+		const int shift)
+{
+	const __m128i round = _mm_set1_epi32(1 << (shift - 1));
+	__m128i even_lo[4], even_hi[4], odd_lo[4], odd_hi[4];
+	__m128i tmp0, tmp1, tmp2, tmp3;
+	int i;
+
+	/* Even part */
+	tmp0 = MADD_LO(r[0], r[4], 1 << CONST_BITS, 1 << CONST_BITS);
+	tmp1 = MADD_LO(r[0], r[4], 1 << CONST_BITS, -(1 << CONST_BITS));
+	tmp2 = MADD_LO(r[2], r[6], EVEN_2_2, EVEN_6_2);
+	tmp3 = MADD_LO(r[2], r[6], EVEN_2_3, EVEN_6_3);
+	even_lo[0] = _mm_add_epi32(tmp0, tmp3);	/* tmp10 */
+	even_lo[1] = _mm_add_epi32(tmp1, tmp2);	/* tmp11 */
+	even_lo[2] = _mm_sub_epi32(tmp1, tmp2);	/* tmp12 */
+	even_lo[3] = _mm_sub_epi32(tmp0, tmp3);	/* tmp13 */
+
+	tmp0 = MADD_HI(r[0], r[4], 1 << CONST_BITS, 1 << CONST_BITS);
+	tmp1 = MADD_HI(r[0], r[4], 1 << CONST_BITS, -(1 << CONST_BITS));
+	tmp2 = MADD_HI(r[2], r[6], EVEN_2_2, EVEN_6_2);
+	tmp3 = MADD_HI(r[2], r[6], EVEN_2_3, EVEN_6_3);
+	even_hi[0] = _mm_add_epi32(tmp0, tmp3);
+	even_hi[1] = _mm_add_epi32(tmp1, tmp2);
+	even_hi[2] = _mm_sub_epi32(tmp1, tmp2);
+	even_hi[3] = _mm_sub_epi32(tmp0, tmp3);
+
+	/* Odd part, odd_xx[n] is tmpn of jidctint.c */
+	odd_lo[0] = _mm_add_epi32(MADD_LO(r[7], r[1], ODD_07_0, ODD_01_0),
+				  MADD_LO(r[5], r[3], ODD_05_0, ODD_03_0));
+	odd_lo[1] = _mm_add_epi32(MADD_LO(r[7], r[1], ODD_07_1, ODD_01_1),
+				  MADD_LO(r[5], r[3], ODD_05_1, ODD_03_1));
+	odd_lo[2] = _mm_add_epi32(MADD_LO(r[7], r[1], ODD_07_2, ODD_01_2),
+				  MADD_LO(r[5], r[3], ODD_05_2, ODD_03_2));
+	odd_lo[3] = _mm_add_epi32(MADD_LO(r[7], r[1], ODD_07_3, ODD_01_3),
+				  MADD_LO(r[5], r[3], ODD_05_3, ODD_03_3));
+	odd_hi[0] = _mm_add_epi32(MADD_HI(r[7], r[1], ODD_07_0, ODD_01_0),
+				  MADD_HI(r[5], r[3], ODD_05_0, ODD_03_0));
+	odd_hi[1] = _mm_add_epi32(MADD_HI(r[7], r[1], ODD_07_1, ODD_01_1),
+				  MADD_HI(r[5], r[3], ODD_05_1, ODD_03_1));
+	odd_hi[2] = _mm_add_epi32(MADD_HI(r[7], r[1], ODD_07_2, ODD_01_2),
+				  MADD_HI(r[5], r[3], ODD_05_2, ODD_03_2));
+	odd_hi[3] = _mm_add_epi32(MADD_HI(r[7], r[1], ODD_07_3, ODD_01_3),
+				  MADD_HI(r[5], r[3], ODD_05_3, ODD_03_3));
+
+	/* Output n and 7 - n are even n +/- odd 3 - n */
+	for (i = 0; i < 4; i++) {
+		__m128i lo, hi;
+
+		lo = _mm_srai_epi32(_mm_add_epi32(_mm_add_epi32(even_lo[i],
+				odd_lo[3 - i]), round), shift);
+		hi = _mm_srai_epi32(_mm_add_epi32(_mm_add_epi32(even_hi[i],
+				odd_hi[3 - i]), round), shift);
+		r[i] = _mm_packs_epi32(lo, hi);
+
+		lo = _mm_srai_epi32(_mm_add_epi32(_mm_sub_epi32(even_lo[i],
+				odd_lo[3 - i]), round), shift);
+		hi = _mm_srai_epi32(_mm_add_epi32(_mm_sub_epi32(even_hi[i],
+				odd_hi[3 - i]), round), shift);
+		r[7 - i] = _mm_packs_epi32(lo, hi);
+	}
+}
+
+static V4LCONVERT_TARGET("sse2") void idct_sse2(const int16_t *coef,
+		const int16_t *qtable, uint8_t *dest, int stride)
+{
+	__m128i r[8];
+	int i;
+
+	for (i = 0; i < 8; i++)
+		r[i] = _mm_mullo_epi16(
+			_mm_loadu_si128((const __m128i *)(coef + 8 * i)),
+			_mm_loadu_si128((const __m128i *)(qtable + 8 * i)));
+
+	idct_pass_sse2(r, CONST_BITS - PASS1_BITS);
+	transpose_8x8_sse2(r);
+	idct_pass_sse2(r, CONST_BITS + PASS1_BITS + 3);
+	transpose_8x8_sse2(r);
+
+	for (i = 0; i < 8; i++) {
+		_mm_storel_epi64((__m128i *)dest, _mm_packus_epi16(
+			_mm_adds_epi16(r[i], _mm_set1_epi16(128)), r[i]));
+		dest += stride;
+	}
+}
+
+#endif /* HAVE_V4LCONVERT_X86_SIMD */
+
+#ifdef HAVE_V4LCONVERT_NEON
+
+static inline void transpose_8x8_neon(int16x8_t *r)
+{
+	int16x8x2_t a0 = vtrnq_s16(r[0], r[1]);
+	int16x8x2_t a1 = vtrnq_s16(r[2], r[3]);
+	int16x8x2_t a2 = vtrnq_s16(r[4], r[5]);
+	int16x8x2_t a3 = vtrnq_s16(r[6], r[7]);
+	int32x4x2_t b0 = vtrnq_s32(vreinterpretq_s32_s16(a0.val[0]),
+				   vreinterpretq_s32_s16(a1.val[0]));
+	int32x4x2_t b1 = vtrnq_s32(vreinterpretq_s32_s16(a0.val[1]),
+				   vreinterpretq_s32_s16(a1.val[1]));
+	int32x4x2_t b2 = vtrnq_s32(vreinterpretq_s32_s16(a2.val[0]),
+				   vreinterpretq_s32_s16(a3.val[0]));
+	int32x4x2_t b3 = vtrnq_s32(vreinterpretq_s32_s16(a2.val[1]),
+				   vreinterpretq_s32_s16(a3.val[1]));
+
+	r[0] = vreinterpretq_s16_s32(vcombine_s32(vget_low_s32(b0.val[0]),
+						  vget_low_s32(b2.val[0])));
+	r[1] = vreinterpretq_s16_s32(vcombine_s32(vget_low_s32(b1.val[0]),
+						  vget_low_s32(b3.val[0])));
+	r[2] = vreinterpretq_s16_s32(vcombine_s32(vget_low_s32(b0.val[1]),
+						  vget_low_s32(b2.val[1])));
+	r[3] = vreinterpretq_s16_s32(vcombine_s32(vget_low_s32(b1.val[1]),
+						  vget_low_s32(b3.val[1])));
+	r[4] = vreinterpretq_s16_s32(vcombine_s32(vget_high_s32(b0.val[0]),
+						  vget_high_s32(b2.val[0])));
+	r[5] = vreinterpretq_s16_s32(vcombine_s32(vget_high_s32(b1.val[0]),
+						  vget_high_s32(b3.val[0])));
+	r[6] = vreinterpretq_s16_s32(vcombine_s32(vget_high_s32(b0.val[1]),
+						  vget_high_s32(b2.val[1])));
+	r[7] = vreinterpretq_s16_s32(vcombine_s32(vget_high_s32(b1.val[1]),
+						  vget_high_s32(b3.val[1])));
+}
+
+/* a * ka + b * kb (+ c * kc + d * kd) for 4 elements */
+static inline int32x4_t madd2_neon(int16x4_t a, int16x4_t b, int ka, int kb)
+{
+	return vmlal_n_s16(vmull_n_s16(a, ka), b, kb);
+}
+
+static inline int32x4_t madd4_neon(int16x4_t a, int16x4_t b, int16x4_t c,
+		int16x4_t d, int ka, int kb, int kc, int kd)
+{
+	return vmlal_n_s16(vmlal_n_s16(madd2_neon(a, b, ka, kb), c, kc), d, kd);
+}
+
+/* One pass of the IDCT on 4 columns at once, see idct_pass_sse2 */
+static inline void idct_pass_half_neon(const int16x4_t *r, int32x4_t *out)
+{
+	int32x4_t tmp0, tmp1, tmp2, tmp3, even[4], odd[4];
+	int i;
+
+	tmp0 = madd2_neon(r[0], r[4], 1 << CONST_BITS, 1 << CONST_BITS);
+	tmp1 = madd2_neon(r[0], r[4], 1 << CONST_BITS, -(1 << CONST_BITS));
+	tmp2 = madd2_neon(r[2], r[6], EVEN_2_2, EVEN_6_2);
+	tmp3 = madd2_neon(r[2], r[6], EVEN_2_3, EVEN_6_3);
+	even[0] = vaddq_s32(tmp0, tmp3);
+	even[1] = vaddq_s32(tmp1, tmp2);
+	even[2] = vsubq_s32(tmp1, tmp2);
+	even[3] = vsubq_s32(tmp0, tmp3);
+
+	odd[0] = madd4_neon(r[7], r[1], r[5], r[3],
+			    ODD_07_0, ODD_01_0, ODD_05_0, ODD_03_0);
+	odd[1] = madd4_neon(r[7], r[1], r[5], r[3],
+			    ODD_07_1, ODD_01_1, ODD_05_1, ODD_03_1);
+	odd[2] = madd4_neon(r[7], r[1], r[5], r[3],
+			    ODD_07_2, ODD_01_2, ODD_05_2, ODD_03_2);
+	odd[3] = madd4_neon(r[7], r[1], r[5], r[3],
+			    ODD_07_3, ODD_01_3, ODD_05_3, ODD_03_3);
+
+	for (i = 0; i < 4; i++) {
+		out[i] = vaddq_s32(even[i], odd[3 - i]);
+		out[7 - i] = vsubq_s32(even[i], odd[3 - i]);
+	}
+}
+
+static void idct_neon(const int16_t *coef, const int16_t *qtable,
+		uint8_t *dest, int stride)
+{
+	int16x8_t r[8];
+	int16x4_t lo[8], hi[8];
+	int32x4_t out_lo[8], out_hi[8];
+	int i;
+
+	for (i = 0; i < 8; i++) {
+		r[i] = vmulq_s16(vld1q_s16(coef + 8 * i), vld1q_s16(qtable + 8 * i));
+		lo[i] = vget_low_s16(r[i]);
+		hi[i] = vget_high_s16(r[i]);
+	}
+
+	idct_pass_half_neon(lo, out_lo);
+	idct_pass_half_neon(hi, out_hi);
+	for (i = 0; i < 8; i++)
+		r[i] = vcombine_s16(
+			vqrshrn_n_s32(out_lo[i], CONST_BITS - PASS1_BITS),
+			vqrshrn_n_s32(out_hi[i], CONST_BITS - PASS1_BITS));
+	transpose_8x8_neon(r);
+
+	for (i = 0; i < 8; i++) {
+		lo[i] = vget_low_s16(r[i]);
+		hi[i] = vget_high_s16(r[i]);
+	}
+	idct_pass_half_neon(lo, out_lo);
+	idct_pass_half_neon(hi, out_hi);
+	for (i = 0; i < 8; i++)
+		r[i] = vcombine_s16(
+			vqmovn_s32(vrshrq_n_s32(out_lo[i], CONST_BITS + PASS1_BITS + 3)),
+			vqmovn_s32(vrshrq_n_s32(out_hi[i], CONST_BITS + PASS1_BITS + 3)));
+	transpose_8x8_neon(r);
+
+	for (i = 0; i < 8; i++) {
+		vst1_u8(dest, vqmovun_s16(vqaddq_s16(r[i], vdupq_n_s16(128))));
+		dest += stride;
+	}
+}
+
+#endif /* HAVE_V4LCONVERT_NEON */
+
+int v4lconvert_simd_idct(int cpu_flags, const int16_t *coef,
+		const int16_t *qtable, uint8_t *dest, int stride)
+{
+#ifdef HAVE_V4LCONVERT_X86_SIMD
+	if (cpu_flags & V4LCONVERT_CPU_SSE2) {
+		idct_sse2(coef, qtable, dest, stride);
+		return 1;
+	}
+#endif
+#ifdef HAVE_V4LCONVERT_NEON
+	if (cpu_flags & V4LCONVERT_CPU_NEON) {
+		idct_neon(coef, qtable, dest, stride);
+		return 1;
+	}
+#endif
+
+	return 0;
+}
@@ -0,0 +1,616 @@
+/*
+ * jidctint.c
+ *
+ * Copyright (C) 1994-1998, Thomas G. Lane.
+ * This file is part of the Independent JPEG Group's software.
+ *
+ * The authors make NO WARRANTY or representation, either express or implied,
+ * with respect to this software, its quality, accuracy, merchantability, or
+ * fitness for a particular purpose.  This software is provided "AS IS", and you,
+ * its user, assume the entire risk as to its quality and accuracy.
+ *
+ * This software is copyright (C) 1991-1998, Thomas G. Lane.
+ * All Rights Reserved except as specified below.
+ *
+ * Permission is hereby granted to use, copy, modify, and distribute this
+ * software (or portions thereof) for any purpose, without fee, subject to these
+ * conditions:
+ * (1) If any part of the source code for this software is distributed, then this
+ * README file must be included, with this copyright and no-warranty notice
+ * unaltered; and any additions, deletions, or changes to the original files
+ * must be clearly indicated in accompanying documentation.
+ * (2) If only executable code is distributed, then the accompanying
+ * documentation must state that "this software is based in part on the work of
+ * the Independent JPEG Group".
+ * (3) Permission for use of this software is granted only if the user accepts
+ * full responsibility for any undesirable consequences; the authors accept
+ * NO LIABILITY for damages of any kind.
+ *
+ * These conditions apply to any software derived from or based on the IJG code,
+ * not just to the unmodified library.  If you use our work, you ought to
+ * acknowledge us.
+ *
+ * Permission is NOT granted for the use of any IJG author's name or company name
+ * in advertising or publicity relating to this software or products derived from
+ * it.  This software may be referred to only as "the Independent JPEG Group's
+ * software".
+ *
+ * We specifically permit and encourage the use of this software as the basis of
+ * commercial products, provided that all warranty or liability claims are
+ * assumed by the product vendor.
+ *
+ *
+ * This file contains a slow-but-accurate integer implementation of the
+ * inverse DCT (Discrete Cosine Transform).  In the IJG code, this routine
+ * must also perform dequantization of the input coefficients.
+ *
+ * A 2-D IDCT can be done by 1-D IDCT on each column followed by 1-D IDCT
+ * on each row (or vice versa, but it's more convenient to emit a row at
+ * a time).  Direct algorithms are also available, but they are much more
+ * complex and seem not to be any faster when reduced to code.
+ *
+ * This implementation is based on an algorithm described in
+ *   C. Loeffler, A. Ligtenberg and G. Moschytz, "Practical Fast 1-D DCT
+ *   Algorithms with 11 Multiplications", Proc. Int'l. Conf. on Acoustics,
+ *   Speech, and Signal Processing 1989 (ICASSP '89), pp. 988-991.
+ * The primary algorithm described there uses 11 multiplies and 29 adds.
+ * We use their alternate method with 12 multiplies and 32 adds.
+ * The advantage of this method is that no data path contains more than one
+ * multiplication; this allows a very simple and accurate implementation in
+ * scaled fixed-point arithmetic, with a minimal number of shifts.
+ *
+ * The constants are scaled by 2^13 and the results of the first pass by
+ * 2^2, which keeps all intermediate values of valid JPEG data within 16 bits
+ * between the passes. This allows the SIMD versions in jidctint-simd.c to
+ * work on 8 16 bit values at a time, they produce the exact same output as
+ * the plain C code below. The output is within 1 of that of the floating
+ * point IDCT from jidctflt.c, which tinyjpeg used before,
+ * see contrib/test/idct-test.c.
+ *
+ * Modified for tinyjpeg: blocks which only have a DC coefficient (a very
+ * common case) are special cased, see the dc_only flag in struct component.
+ *
+ * The reduced size IDCTs at the end of this file, used to decode at 1/2, 1/4
+ * or 1/8 of the image size, come from jidctred.c of the IJG code.
+ */
+
+#include <stdint.h>
+#include <string.h>
+#include "tinyjpeg-internal.h"
+#include "libv4lconvert-priv.h"
+
+/* These may already be defined by jpeglib.h */
+#ifndef DCTSIZE
+#define DCTSIZE	   8
+#define DCTSIZE2   64
+#endif
+
+#define CONST_BITS  13
+#define PASS1_BITS  2
+
+#define FIX_0_298631336  ((int32_t)  2446)	/* FIX(0.298631336) */
+#define FIX_0_390180644  ((int32_t)  3196)	/* FIX(0.390180644) */
+#define FIX_0_541196100  ((int32_t)  4433)	/* FIX(0.541196100) */
+#define FIX_0_765366865  ((int32_t)  6270)	/* FIX(0.765366865) */
+#define FIX_0_899976223  ((int32_t)  7373)	/* FIX(0.899976223) */
+#define FIX_1_175875602  ((int32_t)  9633)	/* FIX(1.175875602) */
+#define FIX_1_501321110  ((int32_t) 12299)	/* FIX(1.501321110) */
+#define FIX_1_847759065  ((int32_t) 15137)	/* FIX(1.847759065) */
+#define FIX_1_961570560  ((int32_t) 16069)	/* FIX(1.961570560) */
+#define FIX_2_053119869  ((int32_t) 16819)	/* FIX(2.053119869) */
+#define FIX_2_562915447  ((int32_t) 20995)	/* FIX(2.562915447) */
+#define FIX_3_072711026  ((int32_t) 25172)	/* FIX(3.072711026) */
+
+/* Extra constants for the reduced size IDCTs */
+#define FIX_0_211164243  ((int32_t)  1730)	/* FIX(0.211164243) */
+#define FIX_0_509795579  ((int32_t)  4176)	/* FIX(0.509795579) */
+#define FIX_0_601344887  ((int32_t)  4926)	/* FIX(0.601344887) */
+#define FIX_0_720959822  ((int32_t)  5906)	/* FIX(0.720959822) */
+#define FIX_0_850430095  ((int32_t)  6967)	/* FIX(0.850430095) */
+#define FIX_1_061594337  ((int32_t)  8697)	/* FIX(1.061594337) */
+#define FIX_1_272758580  ((int32_t) 10426)	/* FIX(1.272758580) */
+#define FIX_1_451774981  ((int32_t) 11893)	/* FIX(1.451774981) */
+#define FIX_2_172734803  ((int32_t) 17799)	/* FIX(2.172734803) */
+#define FIX_3_624509785  ((int32_t) 29692)	/* FIX(3.624509785) */
+
+/* Descale and correctly round an int32_t value that's scaled by N bits */
+#define DESCALE(x, n)  (((x) + (1 << ((n) - 1))) >> (n))
+
+#define DEQUANTIZE(coef, quantval)  (((int32_t) (coef)) * (quantval))
+
+/* Left shifting negative values is undefined, multiply instead, which
+   compiles to the same shift */
+#define LEFT_SHIFT(x, n)  ((x) * (1 << (n)))
+
+static inline uint8_t range_limit(int64_t x)
+{
+	x += 128;
+	if (x < 0)
+		return 0;
+	if (x > 255)
+		return 255;
+	return x;
+}
+
+/*
+ * Perform dequantization and inverse DCT on one block of coefficients.
+ */
+
+void tinyjpeg_idct_int(struct component *compptr, uint8_t *output_buf,
+		int stride, int cpu_flags)
+{
+	int32_t tmp0, tmp1, tmp2, tmp3;
+	int32_t tmp10, tmp11, tmp12, tmp13;
+	int32_t z1, z2, z3, z4, z5;
+	int16_t *inptr;
+	int16_t *quantptr;
+	int32_t *wsptr;
+	uint8_t *outptr;
+	int ctr;
+	int32_t workspace[DCTSIZE2]; /* buffers data between passes */
+
+	/* All AC terms zero, all outputs are equal to the DC coefficient, this
+	 * gives the exact same result as going through both passes. */
+	if (compptr->dc_only) {
+		uint8_t dcval = range_limit(DESCALE(DEQUANTIZE(compptr->DCT[0],
+						compptr->Q_table[0]), 3));
+
+		for (ctr = 0; ctr < DCTSIZE; ctr++) {
+			memset(output_buf, dcval, DCTSIZE);
+			output_buf += stride;
+		}
+		return;
+	}
+
+	if (v4lconvert_simd_idct(cpu_flags, compptr->DCT, compptr->Q_table,
+				 output_buf, stride))
+		return;
+
+	/* Pass 1: process columns from input, store into work array. */
+	/* Note results are scaled up by sqrt(8) compared to a true IDCT; */
+	/* furthermore, we scale the results by 2**PASS1_BITS. */
+
+	inptr = compptr->DCT;
+	quantptr = compptr->Q_table;
+	wsptr = workspace;
+	for (ctr = DCTSIZE; ctr > 0; ctr--) {
+		/* Due to quantization, we will usually find that many of the input
+		 * coefficients are zero, especially the AC terms.  We can exploit this
+		 * by short-circuiting the IDCT calculation for any column in which all
+		 * the AC terms are zero.  In that case each output is equal to the
+		 * DC coefficient (with scale factor as needed).
+		 * With typical images and quantization tables, half or more of the
+		 * column DCT calculations can be simplified this way.
+		 */
+
+		if (inptr[DCTSIZE*1] == 0 && inptr[DCTSIZE*2] == 0 &&
+				inptr[DCTSIZE*3] == 0 && inptr[DCTSIZE*4] == 0 &&
+				inptr[DCTSIZE*5] == 0 && inptr[DCTSIZE*6] == 0 &&
+				inptr[DCTSIZE*7] == 0) {
+			/* AC terms all zero */
+			int32_t dcval = LEFT_SHIFT(DEQUANTIZE(inptr[DCTSIZE*0], quantptr[DCTSIZE*0]), PASS1_BITS);
+
+			wsptr[DCTSIZE*0] = dcval;
+			wsptr[DCTSIZE*1] = dcval;
+			wsptr[DCTSIZE*2] = dcval;
+			wsptr[DCTSIZE*3] = dcval;
+			wsptr[DCTSIZE*4] = dcval;
+			wsptr[DCTSIZE*5] = dcval;
+			wsptr[DCTSIZE*6] = dcval;
+			wsptr[DCTSIZE*7] = dcval;
+
+			inptr++;			/* advance pointers to next column */
+			quantptr++;
+			wsptr++;
+			continue;
+		}
+
+		/* Even part: reverse the even part of the forward DCT. */
+		/* The rotator is sqrt(2)*c(-6). */
+
+		z2 = DEQUANTIZE(inptr[DCTSIZE*2], quantptr[DCTSIZE*2]);
+		z3 = DEQUANTIZE(inptr[DCTSIZE*6], quantptr[DCTSIZE*6]);
+
+		z1 = (z2 + z3) * FIX_0_541196100;
+		tmp2 = z1 + z3 * (-FIX_1_847759065);
+		tmp3 = z1 + z2 * FIX_0_765366865;
+
+		z2 = DEQUANTIZE(inptr[DCTSIZE*0], quantptr[DCTSIZE*0]);
+		z3 = DEQUANTIZE(inptr[DCTSIZE*4], quantptr[DCTSIZE*4]);
+
+		tmp0 = LEFT_SHIFT(z2 + z3, CONST_BITS);
+		tmp1 = LEFT_SHIFT(z2 - z3, CONST_BITS);
+
+		tmp10 = tmp0 + tmp3;
+		tmp13 = tmp0 - tmp3;
+		tmp11 = tmp1 + tmp2;
+		tmp12 = tmp1 - tmp2;
+
+		/* Odd part per figure 8; the matrix is unitary and hence its
+		 * transpose is its inverse.  i0..i3 are y7,y5,y3,y1 respectively.
+		 */
+
+		tmp0 = DEQUANTIZE(inptr[DCTSIZE*7], quantptr[DCTSIZE*7]);
+		tmp1 = DEQUANTIZE(inptr[DCTSIZE*5], quantptr[DCTSIZE*5]);
+		tmp2 = DEQUANTIZE(inptr[DCTSIZE*3], quantptr[DCTSIZE*3]);
+		tmp3 = DEQUANTIZE(inptr[DCTSIZE*1], quantptr[DCTSIZE*1]);
+
+		z1 = tmp0 + tmp3;
+		z2 = tmp1 + tmp2;
+		z3 = tmp0 + tmp2;
+		z4 = tmp1 + tmp3;
+		z5 = (z3 + z4) * FIX_1_175875602; /* sqrt(2) * c3 */
+
+		tmp0 = tmp0 * FIX_0_298631336; /* sqrt(2) * (-c1+c3+c5-c7) */
+		tmp1 = tmp1 * FIX_2_053119869; /* sqrt(2) * ( c1+c3-c5+c7) */
+		tmp2 = tmp2 * FIX_3_072711026; /* sqrt(2) * ( c1+c3+c5-c7) */
+		tmp3 = tmp3 * FIX_1_501321110; /* sqrt(2) * ( c1+c3-c5-c7) */
+		z1 = z1 * (-FIX_0_899976223); /* sqrt(2) * (c7-c3) */
+		z2 = z2 * (-FIX_2_562915447); /* sqrt(2) * (-c1-c3) */
+		z3 = z3 * (-FIX_1_961570560); /* sqrt(2) * (-c3-c5) */
+		z4 = z4 * (-FIX_0_390180644); /* sqrt(2) * (c5-c3) */
+
+		z3 += z5;
+		z4 += z5;
+
+		tmp0 += z1 + z3;
+		tmp1 += z2 + z4;
+		tmp2 += z2 + z3;
+		tmp3 += z1 + z4;
+
+		/* Final output stage: inputs are tmp10..tmp13, tmp0..tmp3 */
+
+		wsptr[DCTSIZE*0] = DESCALE(tmp10 + tmp3, CONST_BITS-PASS1_BITS);
+		wsptr[DCTSIZE*7] = DESCALE(tmp10 - tmp3, CONST_BITS-PASS1_BITS);
+		wsptr[DCTSIZE*1] = DESCALE(tmp11 + tmp2, CONST_BITS-PASS1_BITS);
+		wsptr[DCTSIZE*6] = DESCALE(tmp11 - tmp2, CONST_BITS-PASS1_BITS);
+		wsptr[DCTSIZE*2] = DESCALE(tmp12 + tmp1, CONST_BITS-PASS1_BITS);
+		wsptr[DCTSIZE*5] = DESCALE(tmp12 - tmp1, CONST_BITS-PASS1_BITS);
+		wsptr[DCTSIZE*3] = DESCALE(tmp13 + tmp0, CONST_BITS-PASS1_BITS);
+		wsptr[DCTSIZE*4] = DESCALE(tmp13 - tmp0, CONST_BITS-PASS1_BITS);
+
+		inptr++;			/* advance pointers to next column */
+		quantptr++;
+		wsptr++;
+	}
+
+	/* Pass 2: process rows from work array, store into output array. */
+	/* Note that we must descale the results by a factor of 8 == 2**3, */
+	/* and also undo the PASS1_BITS scaling. */
+
+	wsptr = workspace;
+	outptr = output_buf;
+	for (ctr = 0; ctr < DCTSIZE; ctr++) {
+		/* Rows of zeroes can be exploited in the same way as we did with columns.
+		 * However, the column calculation has created many nonzero AC terms, so
+		 * the simplification applies less often (typically 5% to 10% of the time).
+		 * On machines with very fast multiplication, it's possible that the
+		 * test takes more time than it's worth.  In that case this section
+		 * may be commented out.
+		 */
+
+		if (wsptr[1] == 0 && wsptr[2] == 0 && wsptr[3] == 0 && wsptr[4] == 0 &&
+				wsptr[5] == 0 && wsptr[6] == 0 && wsptr[7] == 0) {
+			/* AC terms all zero */
+			uint8_t dcval = range_limit(DESCALE(wsptr[0], PASS1_BITS+3));
+
+			memset(outptr, dcval, DCTSIZE);
+
+			wsptr += DCTSIZE;		/* advance pointer to next row */
+			outptr += stride;
+			continue;
+		}
+
+		/* Even part: reverse the even part of the forward DCT. */
+		/* The rotator is sqrt(2)*c(-6). */
+
+		z2 = wsptr[2];
+		z3 = wsptr[6];
+
+		z1 = (z2 + z3) * FIX_0_541196100;
+		tmp2 = z1 + z3 * (-FIX_1_847759065);
+		tmp3 = z1 + z2 * FIX_0_765366865;
+
+		tmp0 = LEFT_SHIFT(wsptr[0] + wsptr[4], CONST_BITS);
+		tmp1 = LEFT_SHIFT(wsptr[0] - wsptr[4], CONST_BITS);
+
+		tmp10 = tmp0 + tmp3;
+		tmp13 = tmp0 - tmp3;
+		tmp11 = tmp1 + tmp2;
+		tmp12 = tmp1 - tmp2;
+
+		/* Odd part per figure 8; the matrix is unitary and hence its
+		 * transpose is its inverse.  i0..i3 are y7,y5,y3,y1 respectively.
+		 */
+
+		tmp0 = wsptr[7];
+		tmp1 = wsptr[5];
+		tmp2 = wsptr[3];
+		tmp3 = wsptr[1];
+
+		z1 = tmp0 + tmp3;
+		z2 = tmp1 + tmp2;
+		z3 = tmp0 + tmp2;
+		z4 = tmp1 + tmp3;
+		z5 = (z3 + z4) * FIX_1_175875602; /* sqrt(2) * c3 */
+
+		tmp0 = tmp0 * FIX_0_298631336; /* sqrt(2) * (-c1+c3+c5-c7) */
+		tmp1 = tmp1 * FIX_2_053119869; /* sqrt(2) * ( c1+c3-c5+c7) */
+		tmp2 = tmp2 * FIX_3_072711026; /* sqrt(2) * ( c1+c3+c5-c7) */
+		tmp3 = tmp3 * FIX_1_501321110; /* sqrt(2) * ( c1+c3-c5-c7) */
+		z1 = z1 * (-FIX_0_899976223); /* sqrt(2) * (c7-c3) */
+		z2 = z2 * (-FIX_2_562915447); /* sqrt(2) * (-c1-c3) */
+		z3 = z3 * (-FIX_1_961570560); /* sqrt(2) * (-c3-c5) */
+		z4 = z4 * (-FIX_0_390180644); /* sqrt(2) * (c5-c3) */
+
+		z3 += z5;
+		z4 += z5;
+
+		tmp0 += z1 + z3;
+		tmp1 += z2 + z4;
+		tmp2 += z2 + z3;
+		tmp3 += z1 + z4;
+
+		/* Final output stage: inputs are tmp10..tmp13, tmp0..tmp3 */
+
+		outptr[0] = range_limit(DESCALE(tmp10 + tmp3, CONST_BITS+PASS1_BITS+3));
+		outptr[7] = range_limit(DESCALE(tmp10 - tmp3, CONST_BITS+PASS1_BITS+3));
+		outptr[1] = range_limit(DESCALE(tmp11 + tmp2, CONST_BITS+PASS1_BITS+3));
+		outptr[6] = range_limit(DESCALE(tmp11 - tmp2, CONST_BITS+PASS1_BITS+3));
+		outptr[2] = range_limit(DESCALE(tmp12 + tmp1, CONST_BITS+PASS1_BITS+3));
+		outptr[5] = range_limit(DESCALE(tmp12 - tmp1, CONST_BITS+PASS1_BITS+3));
+		outptr[3] = range_limit(DESCALE(tmp13 + tmp0, CONST_BITS+PASS1_BITS+3));
+		outptr[4] = range_limit(DESCALE(tmp13 - tmp0, CONST_BITS+PASS1_BITS+3));
+
+		wsptr += DCTSIZE;		/* advance pointer to next row */
+		outptr += stride;
+	}
+}
+
+/*
+ * Perform dequantization and inverse DCT on one block of coefficients,
+ * producing a reduced-size 4x4 output block.
+ *
+ * Like in jidctred.c, where INT32 is a long, the reduced size IDCTs work
+ * with 64 bit intermediates, so that the coefficients of a corrupt frame
+ * cannot overflow them.
+ */
+
+static void idct_4x4(struct component *compptr, uint8_t *output_buf,
+		int stride)
+{
+	int64_t tmp0, tmp2, tmp10, tmp12;
+	int64_t z1, z2, z3, z4;
+	int16_t *inptr;
+	int16_t *quantptr;
+	int64_t *wsptr;
+	uint8_t *outptr;
+	int ctr;
+	int64_t workspace[DCTSIZE*4]; /* buffers data between passes */
+
+	/* Pass 1: process columns from input, store into work array. */
+
+	inptr = compptr->DCT;
+	quantptr = compptr->Q_table;
+	wsptr = workspace;
+	for (ctr = DCTSIZE; ctr > 0; inptr++, quantptr++, wsptr++, ctr--) {
+		/* Don't bother to process column 4, because second pass won't use it */
+		if (ctr == DCTSIZE-4)
+			continue;
+		if (inptr[DCTSIZE*1] == 0 && inptr[DCTSIZE*2] == 0 &&
+				inptr[DCTSIZE*3] == 0 && inptr[DCTSIZE*5] == 0 &&
+				inptr[DCTSIZE*6] == 0 && inptr[DCTSIZE*7] == 0) {
+			/* AC terms all zero; we need not examine term 4 for 4x4 output */
+			int64_t dcval = LEFT_SHIFT(DEQUANTIZE(inptr[DCTSIZE*0], quantptr[DCTSIZE*0]), PASS1_BITS);
+
+			wsptr[DCTSIZE*0] = dcval;
+			wsptr[DCTSIZE*1] = dcval;
+			wsptr[DCTSIZE*2] = dcval;
+			wsptr[DCTSIZE*3] = dcval;
+			continue;
+		}
+
+		/* Even part */
+
+		tmp0 = DEQUANTIZE(inptr[DCTSIZE*0], quantptr[DCTSIZE*0]);
+		tmp0 = LEFT_SHIFT(tmp0, CONST_BITS+1);
+
+		z2 = DEQUANTIZE(inptr[DCTSIZE*2], quantptr[DCTSIZE*2]);
+		z3 = DEQUANTIZE(inptr[DCTSIZE*6], quantptr[DCTSIZE*6]);
+
+		tmp2 = z2 * FIX_1_847759065 + z3 * (-FIX_0_765366865);
+
+		tmp10 = tmp0 + tmp2;
+		tmp12 = tmp0 - tmp2;
+
+		/* Odd part */
+
+		z1 = DEQUANTIZE(inptr[DCTSIZE*7], quantptr[DCTSIZE*7]);
+		z2 = DEQUANTIZE(inptr[DCTSIZE*5], quantptr[DCTSIZE*5]);
+		z3 = DEQUANTIZE(inptr[DCTSIZE*3], quantptr[DCTSIZE*3]);
+		z4 = DEQUANTIZE(inptr[DCTSIZE*1], quantptr[DCTSIZE*1]);
+
+		tmp0 = z1 * (-FIX_0_211164243) /* sqrt(2) * (c3-c1) */
+		     + z2 * FIX_1_451774981    /* sqrt(2) * (c3+c7) */
+		     + z3 * (-FIX_2_172734803) /* sqrt(2) * (-c1-c5) */
+		     + z4 * FIX_1_061594337;   /* sqrt(2) * (c5+c7) */
+
+		tmp2 = z1 * (-FIX_0_509795579) /* sqrt(2) * (c7-c5) */
+		     + z2 * (-FIX_0_601344887) /* sqrt(2) * (c5-c1) */
+		     + z3 * FIX_0_899976223    /* sqrt(2) * (c3-c7) */
+		     + z4 * FIX_2_562915447;   /* sqrt(2) * (c1+c3) */
+
+		/* Final output stage */
+
+		wsptr[DCTSIZE*0] = DESCALE(tmp10 + tmp2, CONST_BITS-PASS1_BITS+1);
+		wsptr[DCTSIZE*3] = DESCALE(tmp10 - tmp2, CONST_BITS-PASS1_BITS+1);
+		wsptr[DCTSIZE*1] = DESCALE(tmp12 + tmp0, CONST_BITS-PASS1_BITS+1);
+		wsptr[DCTSIZE*2] = DESCALE(tmp12 - tmp0, CONST_BITS-PASS1_BITS+1);
+	}
+
+	/* Pass 2: process 4 rows from work array, store into output array. */
+
+	wsptr = workspace;
+	outptr = output_buf;
+	for (ctr = 0; ctr < 4; ctr++) {
+		if (wsptr[1] == 0 && wsptr[2] == 0 && wsptr[3] == 0 &&
+				wsptr[5] == 0 && wsptr[6] == 0 && wsptr[7] == 0) {
+			/* AC terms all zero */
+			uint8_t dcval = range_limit(DESCALE(wsptr[0], PASS1_BITS+3));
+
+			outptr[0] = dcval;
+			outptr[1] = dcval;
+			outptr[2] = dcval;
+			outptr[3] = dcval;
+
+			wsptr += DCTSIZE;		/* advance pointer to next row */
+			outptr += stride;
+			continue;
+		}
+
+		/* Even part */
+
+		tmp0 = LEFT_SHIFT(wsptr[0], CONST_BITS+1);
+
+		tmp2 = wsptr[2] * FIX_1_847759065 + wsptr[6] * (-FIX_0_765366865);
+
+		tmp10 = tmp0 + tmp2;
+		tmp12 = tmp0 - tmp2;
+
+		/* Odd part */
+
+		z1 = wsptr[7];
+		z2 = wsptr[5];
+		z3 = wsptr[3];
+		z4 = wsptr[1];
+
+		tmp0 = z1 * (-FIX_0_211164243) /* sqrt(2) * (c3-c1) */
+		     + z2 * FIX_1_451774981    /* sqrt(2) * (c3+c7) */
+		     + z3 * (-FIX_2_172734803) /* sqrt(2) * (-c1-c5) */
+		     + z4 * FIX_1_061594337;   /* sqrt(2) * (c5+c7) */
+
+		tmp2 = z1 * (-FIX_0_509795579) /* sqrt(2) * (c7-c5) */
+		     + z2 * (-FIX_0_601344887) /* sqrt(2) * (c5-c1) */
+		     + z3 * FIX_0_899976223    /* sqrt(2) * (c3-c7) */
+		     + z4 * FIX_2_562915447;   /* sqrt(2) * (c1+c3) */
+
+		/* Final output stage */
+
+		outptr[0] = range_limit(DESCALE(tmp10 + tmp2, CONST_BITS+PASS1_BITS+3+1));
+		outptr[3] = range_limit(DESCALE(tmp10 - tmp2, CONST_BITS+PASS1_BITS+3+1));
+		outptr[1] = range_limit(DESCALE(tmp12 + tmp0, CONST_BITS+PASS1_BITS+3+1));
+		outptr[2] = range_limit(DESCALE(tmp12 - tmp0, CONST_BITS+PASS1_BITS+3+1));
+
+		wsptr += DCTSIZE;		/* advance pointer to next row */
+		outptr += stride;
+	}
+}
+
+/*
+ * Perform dequantization and inverse DCT on one block of coefficients,
+ * producing a reduced-size 2x2 output block.
+ */
+
+static void idct_2x2(struct component *compptr, uint8_t *output_buf,
+		int stride)
+{
+	int64_t tmp0, tmp10, z1;
+	int16_t *inptr;
+	int16_t *quantptr;
+	int64_t *wsptr;
+	uint8_t *outptr;
+	int ctr;
+	int64_t workspace[DCTSIZE*2]; /* buffers data between passes */
+
+	/* Pass 1: process columns from input, store into work array. */
+
+	inptr = compptr->DCT;
+	quantptr = compptr->Q_table;
+	wsptr = workspace;
+	for (ctr = DCTSIZE; ctr > 0; inptr++, quantptr++, wsptr++, ctr--) {
+		/* Don't bother to process columns 2,4,6 */
+		if (ctr == DCTSIZE-2 || ctr == DCTSIZE-4 || ctr == DCTSIZE-6)
+			continue;
+		if (inptr[DCTSIZE*1] == 0 && inptr[DCTSIZE*3] == 0 &&
+				inptr[DCTSIZE*5] == 0 && inptr[DCTSIZE*7] == 0) {
+			/* AC terms all zero; we need not examine terms 2,4,6 for 2x2 output */
+			int64_t dcval = LEFT_SHIFT(DEQUANTIZE(inptr[DCTSIZE*0], quantptr[DCTSIZE*0]), PASS1_BITS);
+
+			wsptr[DCTSIZE*0] = dcval;
+			wsptr[DCTSIZE*1] = dcval;
+			continue;
+		}
+
+		/* Even part */
+
+		z1 = DEQUANTIZE(inptr[DCTSIZE*0], quantptr[DCTSIZE*0]);
+		tmp10 = LEFT_SHIFT(z1, CONST_BITS+2);
+
+		/* Odd part */
+
+		z1 = DEQUANTIZE(inptr[DCTSIZE*7], quantptr[DCTSIZE*7]);
+		tmp0 = z1 * (-FIX_0_720959822); /* sqrt(2) * (c7-c5+c3-c1) */
+		z1 = DEQUANTIZE(inptr[DCTSIZE*5], quantptr[DCTSIZE*5]);
+		tmp0 += z1 * FIX_0_850430095; /* sqrt(2) * (-c1+c3+c5+c7) */
+		z1 = DEQUANTIZE(inptr[DCTSIZE*3], quantptr[DCTSIZE*3]);
+		tmp0 += z1 * (-FIX_1_272758580); /* sqrt(2) * (-c1+c3-c5-c7) */
+		z1 = DEQUANTIZE(inptr[DCTSIZE*1], quantptr[DCTSIZE*1]);
+		tmp0 += z1 * FIX_3_624509785; /* sqrt(2) * (c1+c3+c5+c7) */
+
+		/* Final output stage */
+
+		wsptr[DCTSIZE*0] = DESCALE(tmp10 + tmp0, CONST_BITS-PASS1_BITS+2);
+		wsptr[DCTSIZE*1] = DESCALE(tmp10 - tmp0, CONST_BITS-PASS1_BITS+2);
+	}
+
+	/* Pass 2: process 2 rows from work array, store into output array. */
+
+	wsptr = workspace;
+	outptr = output_buf;
+	for (ctr = 0; ctr < 2; ctr++) {
+		/* Even part */
+
+		tmp10 = LEFT_SHIFT(wsptr[0], CONST_BITS+2);
+
+		/* Odd part */
+
+		tmp0 = wsptr[7] * (-FIX_0_720959822) /* sqrt(2) * (c7-c5+c3-c1) */
+		     + wsptr[5] * FIX_0_850430095    /* sqrt(2) * (-c1+c3+c5+c7) */
+		     + wsptr[3] * (-FIX_1_272758580) /* sqrt(2) * (-c1+c3-c5-c7) */
+		     + wsptr[1] * FIX_3_624509785;   /* sqrt(2) * (c1+c3+c5+c7) */
+
+		/* Final output stage */
+
+		outptr[0] = range_limit(DESCALE(tmp10 + tmp0, CONST_BITS+PASS1_BITS+3+2));
+		outptr[1] = range_limit(DESCALE(tmp10 - tmp0, CONST_BITS+PASS1_BITS+3+2));
+
+		wsptr += DCTSIZE;		/* advance pointer to next row */
+		outptr += stride;
+	}
+}
+
+/*
+ * IDCT producing a (8 / scale) x (8 / scale) block, for decoding at 1/2,
+ * 1/4 or 1/8 of the image size. The 1x1 case is just the DC coefficient.
+ */
+void tinyjpeg_idct_int_scaled(struct component *compptr, uint8_t *output_buf,
+		int stride, int scale)
+{
+	int y, size = DCTSIZE / scale;
+
+	if (compptr->dc_only || scale == 8) {
+		uint8_t dcval = range_limit(DESCALE(DEQUANTIZE(compptr->DCT[0],
+						compptr->Q_table[0]), 3));
+
+		for (y = 0; y < size; y++) {
+			memset(output_buf, dcval, size);
+			output_buf += stride;
+		}
+		return;
+	}
+
+	if (scale == 4)
+		idct_2x2(compptr, output_buf, stride);
+	else
+		idct_4x4(compptr, output_buf, stride);
+}
@@ -37,14 +37,18 @@ int v4lconvert_decode_jpeg_tinyjpeg(struct v4lconvert_data *data,
 	unsigned int header_width, header_height;
 	unsigned int width  = fmt->fmt.pix.width;
 	unsigned int height = fmt->fmt.pix.height;
+	unsigned int scale = data->src_scale ? data->src_scale : 1;
 
 	if (!data->tinyjpeg) {
 		data->tinyjpeg = tinyjpeg_init();
 		if (!data->tinyjpeg)
 			return v4lconvert_oom_error(data);
+		tinyjpeg_set_threads(data->tinyjpeg, data->threads);
+		tinyjpeg_set_cpu_flags(data->tinyjpeg, data->cpu_flags);
 	}
 	flags |= TINYJPEG_FLAGS_MJPEG_TABLE;
 	tinyjpeg_set_flags(data->tinyjpeg, flags);
+	tinyjpeg_set_scale(data->tinyjpeg, scale);
 	if (tinyjpeg_parse_header(data->tinyjpeg, src, src_size)) {
 		V4LCONVERT_ERR("parsing JPEG header: %s",
 				tinyjpeg_get_errorstring(data->tinyjpeg));
@@ -59,15 +63,16 @@ int v4lconvert_decode_jpeg_tinyjpeg(struct v4lconvert_data *data,
 		height = tmp;
 	}
 
-	if (header_width != width || header_height != height) {
+	if (header_width != width * scale || header_height != height * scale) {
 		V4LCONVERT_ERR("unexpected width / height in JPEG header: "
 			       "expected: %ux%u, header: %ux%u\n",
-			       width, height, header_width, header_height);
+			       width * scale, height * scale,
+			       header_width, header_height);
 		errno = EIO;
 		return -1;
 	}
-	fmt->fmt.pix.width = header_width;
-	fmt->fmt.pix.height = header_height;
+	fmt->fmt.pix.width = header_width / scale;
+	fmt->fmt.pix.height = header_height / scale;
 
 	components[0] = dest;
 
@@ -133,7 +138,7 @@ static void jerr_emit_message(j_common_ptr cinfo, int msg_level)
 		return;
 
 	cinfo->err->format_message(cinfo, buffer);
-	snprintf(data->error_msg, V4LCONVERT_ERROR_MSG_SIZE,
+	snprintf(v4lconvert_error_buf(data), V4LCONVERT_ERROR_MSG_SIZE,
 		 "v4l-convert: libjpeg error: %s\n", buffer);
 }
 
@@ -188,7 +193,7 @@ static int decode_libjpeg_h_samp1(struct v4lconvert_data *data,
 	JSAMPROW y_rows[16], u_rows[8], v_rows[8];
 	JSAMPARRAY rows[3] = { y_rows, u_rows, v_rows };
 
-	uv_buf = v4lconvert_alloc_buffer(width * 16,
+	uv_buf = v4lconvert_alloc_buffer(data, width * 16,
 					 &data->convert_pixfmt_buf,
 					 &data->convert_pixfmt_buf_size);
 	if (!uv_buf)
@@ -278,12 +283,48 @@ static int decode_libjpeg_h_samp2(struct v4lconvert_data *data,
 	return 0;
 }
 
+/* Raw data output of an image decoded at a reduced size may have its chroma
+   at a different resolution than we expect, so for these we let libjpeg give
+   us YCbCr pixels and take the chroma of the first pixel of every 2x2 block */
+static int decode_libjpeg_ycbcr(struct v4lconvert_data *data,
+	unsigned char *ydest, unsigned char *udest, unsigned char *vdest)
+{
+	struct jpeg_decompress_struct *cinfo = &data->cinfo;
+	unsigned int x, y, width = cinfo->output_width;
+	unsigned char *buf;
+	JSAMPROW rows[2];
+
+	buf = v4lconvert_alloc_buffer(data, width * 6,
+				      &data->convert_pixfmt_buf,
+				      &data->convert_pixfmt_buf_size);
+	if (!buf)
+		return v4lconvert_oom_error(data);
+
+	rows[0] = buf;
+	rows[1] = buf + width * 3;
+
+	while (cinfo->output_scanline < cinfo->output_height) {
+		for (y = 0; y < 2; y++) {
+			if (jpeg_read_scanlines(cinfo, &rows[y], 1) != 1)
+				return -1;
+			for (x = 0; x < width; x++)
+				*ydest++ = rows[y][3 * x];
+		}
+		for (x = 0; x < width; x += 2) {
+			*udest++ = buf[3 * x + 1];
+			*vdest++ = buf[3 * x + 2];
+		}
+	}
+	return 0;
+}
+
 int v4lconvert_decode_jpeg_libjpeg(struct v4lconvert_data *data,
 	unsigned char *src, int src_size, unsigned char *dest,
 	struct v4l2_format *fmt, unsigned int dest_pix_fmt)
 {
 	unsigned int width  = fmt->fmt.pix.width;
 	unsigned int height = fmt->fmt.pix.height;
+	unsigned int scale = data->src_scale ? data->src_scale : 1;
 	int result = 0;
 
 	/* libjpeg errors before decoding the first line should signal EAGAIN */
@@ -301,11 +342,12 @@ int v4lconvert_decode_jpeg_libjpeg(struct v4lconvert_data *data,
 	jpeg_mem_src(&data->cinfo, src, src_size);
 	jpeg_read_header(&data->cinfo, TRUE);
 
-	if (data->cinfo.image_width  != width ||
-	    data->cinfo.image_height != height) {
+	if (data->cinfo.image_width  != width * scale ||
+	    data->cinfo.image_height != height * scale) {
 		V4LCONVERT_ERR("unexpected width / height in JPEG header: "
-			       "expected: %ux%u, header: %ux%u\n", width,
-			       height, data->cinfo.image_width,
+			       "expected: %ux%u, header: %ux%u\n",
+			       width * scale, height * scale,
+			       data->cinfo.image_width,
 			       data->cinfo.image_height);
 		errno = EIO;
 		return -1;
@@ -318,6 +360,10 @@ int v4lconvert_decode_jpeg_libjpeg(struct v4lconvert_data *data,
 		return -1;
 	}
 
+	/* Let libjpeg do the scaling with its reduced size IDCTs */
+	data->cinfo.scale_num = 1;
+	data->cinfo.scale_denom = scale;
+
 	if (dest_pix_fmt == V4L2_PIX_FMT_RGB24 ||
 	    dest_pix_fmt == V4L2_PIX_FMT_BGR24) {
 		JSAMPROW row_pointer[1];
@@ -339,6 +385,26 @@ int v4lconvert_decode_jpeg_libjpeg(struct v4lconvert_data *data,
 		if (dest_pix_fmt == V4L2_PIX_FMT_BGR24)
 			v4lconvert_swap_rgb(dest, dest, width, height);
 #endif
+	} else if (scale > 1) {
+		unsigned char *udest, *vdest;
+
+		if (dest_pix_fmt == V4L2_PIX_FMT_YVU420) {
+			vdest = dest + width * height;
+			udest = vdest + (width * height) / 4;
+		} else {
+			udest = dest + width * height;
+			vdest = udest + (width * height) / 4;
+		}
+
+		data->cinfo.out_color_space = JCS_YCbCr;
+		jpeg_start_decompress(&data->cinfo);
+		/* Make libjpeg errors report that we've got some data */
+		data->jerr_errno = EPIPE;
+		result = decode_libjpeg_ycbcr(data, dest, udest, vdest);
+		if (result)
+			jpeg_abort_decompress(&data->cinfo);
+		else
+			jpeg_finish_decompress(&data->cinfo);
 	} else {
 		int h_samp, v_samp;
 		unsigned char *udest, *vdest;
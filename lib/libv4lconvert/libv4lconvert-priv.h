@@ -26,6 +26,7 @@
 #endif
 #include <stdio.h>
 #include <stdint.h>
+#include <pthread.h>
 #include <sys/types.h>
 #ifdef HAVE_JPEG
 #include <jpeglib.h>
@@ -39,23 +40,149 @@
 
 #define ARRAY_SIZE(x) ((int)sizeof(x)/(int)sizeof((x)[0]))
 
-#define V4LCONVERT_ERROR_MSG_SIZE 256
 #define V4LCONVERT_MAX_FRAMESIZES 256
 
+/* Bitfields with a bit per entry of supported_src_pixfmts */
+#define V4LCONVERT_MAX_SRC_FORMATS 128
+#define V4LCONVERT_SRC_FORMATS_WORDS (V4LCONVERT_MAX_SRC_FORMATS / 64)
+#define V4LCONVERT_SRC_FORMAT_SET(bits, i) \
+	((bits)[(i) / 64] |= 1ULL << ((i) % 64))
+#define V4LCONVERT_SRC_FORMAT_ISSET(bits, i) \
+	(((bits)[(i) / 64] >> ((i) % 64)) & 1)
+
 #define V4LCONVERT_ERR(...) \
-	snprintf(data->error_msg, V4LCONVERT_ERROR_MSG_SIZE, \
+	snprintf(v4lconvert_error_buf(data), V4LCONVERT_ERROR_MSG_SIZE, \
 			"v4l-convert: error " __VA_ARGS__)
 
 /* Card flags */
 #define V4LCONVERT_IS_UVC                0x01
 #define V4LCONVERT_USE_TINYJPEG          0x02
+#define V4LCONVERT_IS_MPLANE             0x04
+
+/* Extra steps done while converting, see v4lconvert_fused_line() */
+#define V4LCONVERT_FUSED_HFLIP           0x01
+#define V4LCONVERT_FUSED_VFLIP           0x02
+#define V4LCONVERT_FUSED_RGB32           0x04
+#define V4LCONVERT_FUSED_LUT             0x08
+
+/* CPU flags, see cpu.c */
+#define V4LCONVERT_CPU_SSSE3             0x01
+#define V4LCONVERT_CPU_AVX2              0x02
+#define V4LCONVERT_CPU_NEON              0x04
+#define V4LCONVERT_CPU_SSE2              0x08
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define HAVE_V4LCONVERT_X86_SIMD
+#define V4LCONVERT_TARGET(isa) __attribute__((target(isa)))
+#endif
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#define HAVE_V4LCONVERT_NEON
+#endif
+
+/* Upper limit for v4lconvert_set_threads(), see threads.c */
+#define V4LCONVERT_MAX_THREADS           64
+
+/* Byte orders of the packed yuv 4:2:2 formats, for the simd kernels */
+enum v4lconvert_yuv422_order {
+	V4LCONVERT_ORDER_YUYV,
+	V4LCONVERT_ORDER_YVYU,
+	V4LCONVERT_ORDER_UYVY,
+};
+
+/* rgb to yuv, also used by the yuv420 processing, see libv4lprocessing.c */
+#define RGB2Y(r, g, b, y) \
+	(y) = ((8453 * (r) + 16594 * (g) + 3223 * (b) + 524288) >> 15)
+
+#define RGB2UV(r, g, b, u, v) 	\
+	do {			\
+		(u) = ((-4878 * (r) - 9578 * (g) + 14456 * (b) + 4210688) >> 15); \
+		(v) = ((14456 * (r) - 12105 * (g) - 2351 * (b) + 4210688) >> 15); \
+	} while (0)
+
+/* Fixed point yuv -> rgb conversion coefficients, in 1/64 units. With u and
+   v minus 128:
+     r = (ys * y + yoff + vr * v) >> 6
+     g = (ys * y + yoff + ug * u + vg * v) >> 6
+     b = (ys * y + yoff + ub * u) >> 6
+   clipped to 0 - 255. yoff subtracts the black level of limited range y and
+   rounds. The simd code does this in 16 bit lanes, with saturating adds,
+   which only saturate when the result gets clipped to 255 anyway. */
+struct v4lconvert_yuv_coefs {
+	int16_t ys;
+	int16_t yoff;
+	int16_t ub;
+	int16_t ug;
+	int16_t vg;
+	int16_t vr;
+};
+
+static inline unsigned char v4lconvert_yuv_clip(int x)
+{
+	x >>= 6;
+	return x < 0 ? 0 : x > 255 ? 255 : x;
+}
+
+/* Convert 2 pixels sharing their chroma, u and v already minus 128 */
+static inline void v4lconvert_yuv_to_rgb24_pair(
+		const struct v4lconvert_yuv_coefs *c, unsigned char *dest,
+		int y0, int y1, int u, int v, int bgr)
+{
+	int r = c->vr * v, g = c->ug * u + c->vg * v, b = c->ub * u;
+
+	y0 = c->ys * y0 + c->yoff;
+	y1 = c->ys * y1 + c->yoff;
+	dest[bgr ? 2 : 0] = v4lconvert_yuv_clip(y0 + r);
+	dest[1] = v4lconvert_yuv_clip(y0 + g);
+	dest[bgr ? 0 : 2] = v4lconvert_yuv_clip(y0 + b);
+	dest[bgr ? 5 : 3] = v4lconvert_yuv_clip(y1 + r);
+	dest[4] = v4lconvert_yuv_clip(y1 + g);
+	dest[bgr ? 3 : 5] = v4lconvert_yuv_clip(y1 + b);
+}
+
+static inline void v4lconvert_yuv_to_rgb24_pixel(
+		const struct v4lconvert_yuv_coefs *c, unsigned char *dest,
+		int y, int u, int v, int bgr)
+{
+	y = c->ys * y + c->yoff;
+	dest[bgr ? 2 : 0] = v4lconvert_yuv_clip(y + c->vr * v);
+	dest[1] = v4lconvert_yuv_clip(y + c->ug * u + c->vg * v);
+	dest[bgr ? 0 : 2] = v4lconvert_yuv_clip(y + c->ub * u);
+}
+
+/* The planes of a planar yuv src frame, U always comes before V, for the semi
+   planar formats plane[1] holds the interleaved chroma and plane[2] is unused */
+struct v4lconvert_planes {
+	const unsigned char *plane[3];
+	int stride[3];
+};
+
+/* Filter for scaling a line of src_size samples to dest_size samples, dest
+   sample i is the weighted sum of taps src samples starting at start[i],
+   with the weights at weights[i * taps], see scale.c */
+struct v4lconvert_scale_filter {
+	int src_size;
+	int dest_size;
+	int taps;
+	int *start;
+	int16_t *weights;
+};
 
 struct v4lconvert_data {
 	int fd;
 	int flags; /* bitfield */
 	int control_flags; /* bitfield */
+	int cpu_flags; /* bitfield */
+	/* For the ycbcr encoding and quantization of the src frame */
+	const struct v4lconvert_yuv_coefs *yuv_coefs;
+	int fused; /* bitfield, extra steps to do in convert_pixfmt */
+	/* decode JPEG / demosaic bayer at 1/src_scale size in convert_pixfmt */
+	int src_scale;
+	/* processing lookup tables in dest byte order, for V4LCONVERT_FUSED_LUT */
+	const unsigned char *lut[3];
+	/* planes of the multi-planar src frame, see v4lconvert_convert_mplane */
+	const struct v4lconvert_planes *src_planes;
 	unsigned int no_formats;
-	int64_t supported_src_formats; /* bitfield */
+	uint64_t supported_src_formats[V4LCONVERT_SRC_FORMATS_WORDS]; /* bitfield */
 	char error_msg[V4LCONVERT_ERROR_MSG_SIZE];
 	struct jdec_private *tinyjpeg;
 #ifdef HAVE_JPEG
@@ -67,22 +194,42 @@ struct v4lconvert_data {
 #endif // HAVE_JPEG
 	struct v4l2_frmsizeenum framesizes[V4LCONVERT_MAX_FRAMESIZES];
 	/* Bitmask of all supported src_formats which can do for a size */
-	int64_t framesize_supported_src_formats[V4LCONVERT_MAX_FRAMESIZES];
+	uint64_t framesize_supported_src_formats[V4LCONVERT_MAX_FRAMESIZES]
+						[V4LCONVERT_SRC_FORMATS_WORDS];
 	unsigned int no_framesizes;
 	int bandwidth;
 	int fps;
-	int convert1_buf_size;
+	/* Scratch buffers, borrowed from the buffer pool while converting a
+	   frame and returned to it afterwards, see v4lconvert_alloc_buffer() */
 	int convert2_buf_size;
 	int rotate90_buf_size;
 	int flip_buf_size;
 	int convert_pixfmt_buf_size;
-	unsigned char *convert1_buf;
+	int pack_buf_size;
+	int pack_pixfmt_buf_size;
+	int bayer_buf_size;
 	unsigned char *convert2_buf;
 	unsigned char *rotate90_buf;
 	unsigned char *flip_buf;
 	unsigned char *convert_pixfmt_buf;
+	unsigned char *pack_buf;
+	unsigned char *pack_pixfmt_buf;
+	unsigned char *bayer_buf;
+	/* Horizontal and vertical filters for the (luma) plane and for the
+	   chroma planes, kept as long as the sizes stay the same */
+	struct v4lconvert_scale_filter scale_filter[4];
 	struct v4lcontrol_data *control;
 	struct v4lprocessing_data *processing;
+	struct v4lconvert_threads *threads;
+	/* See v4lconvert_get_stats() */
+	struct v4lconvert_stats stats;
+	int stats_timing;
+	/* Cache of the enumeration ioctls, see capcache.c */
+	struct v4lconvert_capcache *capcache;
+	/* Held while converting a frame, the buffers above are shared with
+	   the worker thread of v4lconvert_submit(), see async.c */
+	pthread_mutex_t convert_lock;
+	struct v4lconvert_async *async;
 	void *dev_ops_priv;
 	const struct libv4l_dev_ops *dev_ops;
 
@@ -90,6 +237,14 @@ struct v4lconvert_data {
 	pid_t decompress_pid;
 	int decompress_in_pipe[2];  /* Data from helper to us */
 	int decompress_out_pipe[2]; /* Data from us to helper */
+	/* Shared memory ring, when the helper supports it (see helper-shm.h) */
+	struct v4lconvert_helper_shm *decompress_shm;
+	int decompress_shm_fd;
+	int decompress_req_fd;
+	int decompress_done_fd;
+	int decompress_shm_src_room;
+	int decompress_shm_dest_room;
+	int decompress_shm_slot;
 
 	/* For mr97310a decoder */
 	int frames_dropped;
@@ -108,24 +263,241 @@ struct v4lconvert_pixfmt {
 
 void v4lconvert_fixup_fmt(struct v4l2_format *fmt);
 
-unsigned char *v4lconvert_alloc_buffer(int needed,
-		unsigned char **buf, int *buf_size);
+/* Grow *buf to at least needed bytes. For the scratch buffers of a
+   v4lconvert instance these come from the buffer pool, until the end of the
+   conversion of the frame. data may be NULL for buffers which do not belong
+   to a v4lconvert instance, these are kept until freed by the caller. */
+unsigned char *v4lconvert_alloc_buffer(struct v4lconvert_data *data,
+		int needed, unsigned char **buf, int *buf_size);
 
 int v4lconvert_oom_error(struct v4lconvert_data *data);
 
+int v4lconvert_get_cpu_flags(void);
+
+/* Band parallel processing, func gets called for bands of rows covering
+   0 - height, with the band boundaries at multiples of align rows */
+typedef void (*v4lconvert_band_func)(void *arg, int first_row, int rows);
+
+struct v4lconvert_threads *v4lconvert_threads_create(void);
+int v4lconvert_threads_set_count(struct v4lconvert_threads *threads, int count);
+int v4lconvert_threads_get_count(struct v4lconvert_threads *threads);
+void v4lconvert_threads_destroy(struct v4lconvert_threads *threads);
+void v4lconvert_run_bands(struct v4lconvert_threads *threads,
+		v4lconvert_band_func func, void *arg, int height, int align);
+/* The rows of the bands v4lconvert_run_bands() uses, all bands but the last
+   one have this many rows, so band first_row is band first_row / rows */
+int v4lconvert_band_rows(struct v4lconvert_threads *threads, int height,
+		int align);
+
+/* Opt-in on disk cache of the VIDIOC_ENUM_FMT, VIDIOC_ENUM_FRAMESIZES and
+   VIDIOC_ENUM_FRAMEINTERVALS results, enabled by the LIBV4LCONVERT_CACHE_DIR
+   environment variable. v4lconvert_enum_ioctl() does any of these ioctls,
+   from the cache when it has the answer. */
+void v4lconvert_capcache_open(struct v4lconvert_data *data,
+		const struct v4l2_capability *cap);
+void v4lconvert_capcache_save(struct v4lconvert_data *data);
+void v4lconvert_capcache_close(struct v4lconvert_data *data);
+int v4lconvert_enum_ioctl(struct v4lconvert_data *data, unsigned long cmd,
+		void *arg);
+
+/* Process wide pool of scratch buffers, see pool.c. v4lconvert_pool_get()
+   rounds *size up to the usable size of its size class, and sets *allocated
+   when the pool had no free buffer of that class. */
+unsigned char *v4lconvert_pool_get(int *size, int *allocated);
+void v4lconvert_pool_put(unsigned char *buf);
+
+/* Stops the worker thread of v4lconvert_submit(), dropping pending jobs */
+void v4lconvert_async_destroy(struct v4lconvert_data *data);
+/* Where to put the error message, the one of the job being converted when
+   called from the worker thread, else data->error_msg */
+char *v4lconvert_error_buf(struct v4lconvert_data *data);
+
+/* The simd kernels convert as many pixels from the start of a line as they
+   can handle and return that number, the caller does the rest of the line */
+int v4lconvert_simd_yuv422_to_rgb24(int cpu_flags,
+		const struct v4lconvert_yuv_coefs *coefs, const unsigned char *src,
+		unsigned char *dest, int width, int order, int bgr);
+
+int v4lconvert_simd_yuv420_to_rgb24(int cpu_flags,
+		const struct v4lconvert_yuv_coefs *coefs, const unsigned char *ysrc,
+		const unsigned char *usrc, const unsigned char *vsrc,
+		unsigned char *dest, int width, int bgr);
+
+/* uvsrc points to the interleaved chroma of the line, for nv12 / nv21 a
+   pair per 2 pixels, for nv24 / nv42 a pair per pixel */
+int v4lconvert_simd_nv12_to_rgb24(int cpu_flags,
+		const struct v4lconvert_yuv_coefs *coefs, const unsigned char *ysrc,
+		const unsigned char *uvsrc, unsigned char *dest, int width,
+		int vu, int bgr);
+
+int v4lconvert_simd_nv24_to_rgb24(int cpu_flags,
+		const struct v4lconvert_yuv_coefs *coefs, const unsigned char *ysrc,
+		const unsigned char *uvsrc, unsigned char *dest, int width,
+		int vu, int bgr);
+
+/* Splits resp. merges count chroma pairs, return the number of pairs done */
+int v4lconvert_simd_split_uv(int cpu_flags, const unsigned char *uvsrc,
+		unsigned char *udest, unsigned char *vdest, int count);
+
+int v4lconvert_simd_merge_uv(int cpu_flags, const unsigned char *usrc,
+		const unsigned char *vsrc, unsigned char *uvdest, int count);
+
+int v4lconvert_simd_yuv422_to_y(int cpu_flags, const unsigned char *src,
+		unsigned char *ydest, int width, int order);
+
+/* Averages the chroma of 2 lines, storing it as nv12 U V pairs */
+int v4lconvert_simd_yuv422_to_uv(int cpu_flags, const unsigned char *src0,
+		const unsigned char *src1, unsigned char *uvdest, int width,
+		int order);
+
+int v4lconvert_simd_yuv420_to_yuyv(int cpu_flags, const unsigned char *ysrc,
+		const unsigned char *usrc, const unsigned char *vsrc,
+		unsigned char *dest, int width);
+
+int v4lconvert_simd_nv12_to_yuyv(int cpu_flags, const unsigned char *ysrc,
+		const unsigned char *uvsrc, unsigned char *dest, int width,
+		int vu);
+
+int v4lconvert_simd_rgb24_to_rgb32(int cpu_flags, const unsigned char *src,
+		unsigned char *dest, int width);
+
+/* bayer points to the top left of the 3x3 neighbourhood of the first pixel
+   to convert, len is the number of bayer bytes left on the line, these
+   return the number of bayer bytes (= pixels) handled */
+int v4lconvert_simd_bayer_line_to_rgb24(int cpu_flags,
+		const unsigned char *bayer, int stride, unsigned char *dest,
+		int len, int blue_line);
+
+int v4lconvert_simd_bayer_line_to_y(int cpu_flags, const unsigned char *bayer,
+		int stride, unsigned char *ydst, int len, int blue_line);
+
+int v4lconvert_simd_bayer_to_uv(int cpu_flags, const unsigned char *bayer,
+		int stride, unsigned char *udst, unsigned char *vdst, int width,
+		unsigned int pixfmt);
+
+/* Returns the number of samples converted, src_len is the number of bytes
+   of the packed line which may be read */
+int v4lconvert_simd_bayer_unpack_line(int cpu_flags, const unsigned char *src,
+		int src_len, unsigned char *dest, int width, int packing,
+		int shift);
+
+/* Writes the width pixels of bpp (1 or 3) bytes of src to dest in reverse
+   order, returns the number of dest pixels written */
+int v4lconvert_simd_reverse_line(int cpu_flags, const unsigned char *src,
+		unsigned char *dest, int width, int bpp);
+
+/* Transposes a 16x16 block of pixels of bpp (1 or 3) bytes, dest pixel
+   (x, y) becomes src pixel (y, x). The strides are in bytes and may be
+   negative. Only call this when v4lconvert_simd_can_transpose() returns 1
+   for the bpp */
+int v4lconvert_simd_can_transpose(int cpu_flags, int bpp);
+void v4lconvert_simd_transpose_block(int cpu_flags, const unsigned char *src,
+		int src_stride, unsigned char *dest, int dest_stride, int bpp);
+
+/* The weights of the scale filters add up to 1 << V4LCONVERT_SCALE_BITS,
+   the results of the vertical pass have V4LCONVERT_SCALE_LINE_BITS
+   fractional bits */
+#define V4LCONVERT_SCALE_BITS 14
+#define V4LCONVERT_SCALE_LINE_BITS 7
+
+/* Vertical pass of the scaler, line[x] becomes the weighted sum of
+   src[k * stride + x] for k < taps, returns the number of samples done */
+int v4lconvert_simd_scale_vertical(int cpu_flags, const unsigned char *src,
+		int stride, const int16_t *weights, int taps, int16_t *line,
+		int len);
+
+/* Dequantization and IDCT of a block of (dezigzagged) JPEG coefficients, the
+   same as tinyjpeg_idct_int() does, returns 1 when it did the block */
+int v4lconvert_simd_idct(int cpu_flags, const int16_t *coef,
+		const int16_t *qtable, uint8_t *dest, int stride);
+
 void v4lconvert_rgb24_to_yuv420(const unsigned char *src, unsigned char *dest,
 		const struct v4l2_format *src_fmt, int bgr, int yvu, int bpp);
 
-void v4lconvert_yuv420_to_rgb24(const unsigned char *src, unsigned char *dst,
+void v4lconvert_yuv420_planes(struct v4lconvert_planes *planes,
+		const unsigned char *src, int width, int height, int yvu);
+
+void v4lconvert_nv_planes(struct v4lconvert_planes *planes,
+		const unsigned char *src, int height, int stride,
+		int uvstride);
+
+/* The yuv -> rgb coefficients for the colorspace, ycbcr_enc and
+   quantization of a yuv src format */
+const struct v4lconvert_yuv_coefs *v4lconvert_get_yuv_coefs(
+		const struct v4l2_format *fmt);
+
+void v4lconvert_yuv420_planes_to_rgb24(struct v4lconvert_data *data,
+		const struct v4lconvert_planes *src, unsigned char *dest,
+		int width, int height, int bgr);
+
+void v4lconvert_yuv420_to_rgb24(struct v4lconvert_data *data,
+		const unsigned char *src, unsigned char *dst,
 		int width, int height, int yvu);
 
-void v4lconvert_yuv420_to_bgr24(const unsigned char *src, unsigned char *dst,
+void v4lconvert_yuv420_to_bgr24(struct v4lconvert_data *data,
+		const unsigned char *src, unsigned char *dst,
 		int width, int height, int yvu);
 
-void v4lconvert_yuyv_to_rgb24(const unsigned char *src, unsigned char *dst,
+void v4lconvert_yuv420_planes_to_yuv420(const struct v4lconvert_planes *src,
+		unsigned char *dest, int width, int height, int yvu);
+
+void v4lconvert_nv12_to_rgb24(struct v4lconvert_data *data,
+		const struct v4lconvert_planes *src, unsigned char *dest,
+		int width, int height, int vu, int bgr);
+
+void v4lconvert_nv24_to_rgb24(struct v4lconvert_data *data,
+		const struct v4lconvert_planes *src, unsigned char *dest,
+		int width, int height, int vu, int bgr);
+
+void v4lconvert_nv12_to_yuv420(struct v4lconvert_data *data,
+		const struct v4lconvert_planes *src, unsigned char *dest,
+		int width, int height, int vu, int yvu);
+
+void v4lconvert_nv24_to_yuv420(const struct v4lconvert_planes *src,
+		unsigned char *dest, int width, int height, int vu, int yvu);
+
+void v4lconvert_copy_plane(const unsigned char *src, unsigned char *dest,
 		int width, int height, int stride);
 
-void v4lconvert_yuyv_to_bgr24(const unsigned char *src, unsigned char *dst,
+void v4lconvert_nv12_to_nv12(const struct v4lconvert_planes *src,
+		unsigned char *dest, int width, int height, int vu);
+
+void v4lconvert_nv12_to_yuyv(struct v4lconvert_data *data,
+		const struct v4lconvert_planes *src, unsigned char *dest,
+		int width, int height, int vu);
+
+void v4lconvert_yuv420_to_nv12(struct v4lconvert_data *data,
+		const struct v4lconvert_planes *src, unsigned char *dest,
+		int width, int height);
+
+void v4lconvert_yuv420_to_yuyv(struct v4lconvert_data *data,
+		const struct v4lconvert_planes *src, unsigned char *dest,
+		int width, int height);
+
+void v4lconvert_yuv422_to_grey(struct v4lconvert_data *data,
+		const unsigned char *src, unsigned char *dest,
+		int width, int height, int stride, int order);
+
+void v4lconvert_yuv422_to_nv12(struct v4lconvert_data *data,
+		const unsigned char *src, unsigned char *dest,
+		int width, int height, int stride, int order);
+
+void v4lconvert_yuv422_to_yuyv(const unsigned char *src, unsigned char *dest,
+		int width, int height, int stride, int order);
+
+void v4lconvert_rgb24_to_rgb32_line(struct v4lconvert_data *data,
+		const unsigned char *src, unsigned char *dest, int width);
+
+void v4lconvert_rgb24_to_rgb32(struct v4lconvert_data *data,
+		const unsigned char *src, unsigned char *dest,
+		int width, int height);
+
+void v4lconvert_yuyv_to_rgb24(struct v4lconvert_data *data,
+		const unsigned char *src, unsigned char *dst,
+		int width, int height, int stride);
+
+void v4lconvert_yuyv_to_bgr24(struct v4lconvert_data *data,
+		const unsigned char *src, unsigned char *dst,
 		int width, int height, int stride);
 
 void v4lconvert_yuyv_to_yuv420(const unsigned char *src, unsigned char *dst,
@@ -134,16 +506,20 @@ void v4lconvert_yuyv_to_yuv420(const unsigned char *src, unsigned char *dst,
 void v4lconvert_nv16_to_yuyv(const unsigned char *src, unsigned char *dest,
 		int width, int height);
 
-void v4lconvert_yvyu_to_rgb24(const unsigned char *src, unsigned char *dst,
+void v4lconvert_yvyu_to_rgb24(struct v4lconvert_data *data,
+		const unsigned char *src, unsigned char *dst,
 		int width, int height, int stride);
 
-void v4lconvert_yvyu_to_bgr24(const unsigned char *src, unsigned char *dst,
+void v4lconvert_yvyu_to_bgr24(struct v4lconvert_data *data,
+		const unsigned char *src, unsigned char *dst,
 		int width, int height, int stride);
 
-void v4lconvert_uyvy_to_rgb24(const unsigned char *src, unsigned char *dst,
+void v4lconvert_uyvy_to_rgb24(struct v4lconvert_data *data,
+		const unsigned char *src, unsigned char *dst,
 		int width, int height, int stride);
 
-void v4lconvert_uyvy_to_bgr24(const unsigned char *src, unsigned char *dst,
+void v4lconvert_uyvy_to_bgr24(struct v4lconvert_data *data,
+		const unsigned char *src, unsigned char *dst,
 		int width, int height, int stride);
 
 void v4lconvert_uyvy_to_yuv420(const unsigned char *src, unsigned char *dst,
@@ -255,20 +631,51 @@ void v4lconvert_decode_sq905c(const unsigned char *src, unsigned char *dst,
 void v4lconvert_decode_stv0680(const unsigned char *src, unsigned char *dst,
 		int width, int height);
 
-void v4lconvert_bayer_to_rgb24(const unsigned char *bayer,
+/* Besides 8 bit bayer these take 10 / 12 / 16 bit bayer, packed or in 16 bit
+   words, and return -1 (with errno set) if they could not allocate memory.
+   They demosaic as the V4LCONTROL_DEMOSAIC control says, when data->src_scale
+   is 2 by 2x2 binning into a frame of half the width and height. */
+int v4lconvert_bayer_to_rgb24(struct v4lconvert_data *data,
+		const unsigned char *bayer,
 		unsigned char *rgb, int width, int height, const unsigned int stride, unsigned int pixfmt);
 
-void v4lconvert_bayer_to_bgr24(const unsigned char *bayer,
+int v4lconvert_bayer_to_bgr24(struct v4lconvert_data *data,
+		const unsigned char *bayer,
 		unsigned char *rgb, int width, int height, const unsigned int stride, unsigned int pixfmt);
 
-void v4lconvert_bayer_to_yuv420(const unsigned char *bayer, unsigned char *yuv,
+int v4lconvert_bayer_to_yuv420(struct v4lconvert_data *data,
+		const unsigned char *bayer, unsigned char *yuv,
 		int width, int height, const unsigned int stride, unsigned int src_pixfmt, int yvu);
 
-void v4lconvert_hm12_to_rgb24(const unsigned char *src,
-		unsigned char *dst, int width, int height);
+/* How the samples of a bayer format are stored */
+enum v4lconvert_bayer_packing {
+	V4LCONVERT_BAYER_8BIT,
+	V4LCONVERT_BAYER_16BIT,   /* in little endian 16 bit words */
+	V4LCONVERT_BAYER_PACKED10, /* 4 samples in 5 bytes, the 4 msb bytes first */
+	V4LCONVERT_BAYER_PACKED12, /* 2 samples in 3 bytes, the 2 msb bytes first */
+};
+
+/* Returns the 8 bit bayer format with the same pattern as pixfmt, and how
+   pixfmt is packed, for 16 bit words also how many lsb to drop to get 8 bits.
+   Returns 0 if pixfmt is not a bayer format. */
+unsigned int v4lconvert_bayer_unpacking(unsigned int pixfmt, int *packing,
+		int *shift);
+
+/* The number of bytes of a line of width samples of pixfmt */
+int v4lconvert_bayer_line_size(unsigned int pixfmt, int width);
+
+/* Converts a line of high bit depth bayer to 8 bit by dropping the lsb */
+void v4lconvert_bayer_unpack_line(struct v4lconvert_data *data,
+		const unsigned char *src, unsigned char *dest, int width,
+		int packing, int shift);
 
-void v4lconvert_hm12_to_bgr24(const unsigned char *src,
-		unsigned char *dst, int width, int height);
+void v4lconvert_hm12_to_rgb24(struct v4lconvert_data *data,
+		const unsigned char *src, unsigned char *dst, int width,
+		int height);
+
+void v4lconvert_hm12_to_bgr24(struct v4lconvert_data *data,
+		const unsigned char *src, unsigned char *dst, int width,
+		int height);
 
 void v4lconvert_hm12_to_yuv420(const unsigned char *src,
 		unsigned char *dst, int width, int height, int yvu);
@@ -276,18 +683,31 @@ void v4lconvert_hm12_to_yuv420(const unsigned char *src,
 void v4lconvert_hsv_to_rgb24(const unsigned char *src, unsigned char *dest,
 		int width, int height, int bgr, int Xin, unsigned char hsv_enc);
 
-void v4lconvert_rotate90(unsigned char *src, unsigned char *dest,
-		struct v4l2_format *fmt);
+void v4lconvert_rotate90(struct v4lconvert_data *data, unsigned char *src,
+		unsigned char *dest, struct v4l2_format *fmt);
+
+void v4lconvert_flip(struct v4lconvert_data *data, unsigned char *src,
+		unsigned char *dest, struct v4l2_format *fmt, int hflip, int vflip);
+
+unsigned char *v4lconvert_fused_line(struct v4lconvert_data *data,
+		unsigned char *dest, int y, int width, int height);
 
-void v4lconvert_flip(unsigned char *src, unsigned char *dest,
-		struct v4l2_format *fmt, int hflip, int vflip);
+void v4lconvert_fused_finish_line(struct v4lconvert_data *data,
+		unsigned char *line, int width);
 
 void v4lconvert_crop(unsigned char *src, unsigned char *dest,
 		const struct v4l2_format *src_fmt, const struct v4l2_format *dest_fmt);
 
+int v4lconvert_scale(struct v4lconvert_data *data, unsigned char *src,
+		unsigned char *dest, const struct v4l2_format *src_fmt,
+		const struct v4l2_format *dest_fmt);
+
+void v4lconvert_scale_free(struct v4lconvert_data *data);
+
 int v4lconvert_helper_decompress(struct v4lconvert_data *data,
 		const char *helper, const unsigned char *src, int src_size,
-		unsigned char *dest, int dest_size, int width, int height, int command);
+		unsigned char *dest, int dest_size, int width, int height, int command,
+		unsigned char **frame);
 
 void v4lconvert_helper_cleanup(struct v4lconvert_data *data);
 
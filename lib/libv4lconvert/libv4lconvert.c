@@ -24,6 +24,7 @@
 #include <errno.h>
 #include <string.h>
 #include <stdlib.h>
+#include <time.h>
 #include <unistd.h>
 #include <sys/stat.h>
 #include <sys/types.h>
@@ -89,7 +90,12 @@ static void v4lconvert_get_framesizes(struct v4lconvert_data *data,
 	{ V4L2_PIX_FMT_RGB24,		24,	 1,	 5,	0 }, \
 	{ V4L2_PIX_FMT_BGR24,		24,	 1,	 5,	0 }, \
 	{ V4L2_PIX_FMT_YUV420,		12,	 6,	 1,	0 }, \
-	{ V4L2_PIX_FMT_YVU420,		12,	 6,	 1,	0 }
+	{ V4L2_PIX_FMT_YVU420,		12,	 6,	 1,	0 }, \
+	{ V4L2_PIX_FMT_NV12,		12,	 5,	 2,	0 }, \
+	{ V4L2_PIX_FMT_YUYV,		16,	 5,	 4,	0 }, \
+	{ V4L2_PIX_FMT_XRGB32,		32,	 4,	 6,	0 }, \
+	{ V4L2_PIX_FMT_ARGB32,		32,	 4,	 6,	0 }, \
+	{ V4L2_PIX_FMT_GREY,		 8,	20,	20,	0 }
 
 static const struct v4lconvert_pixfmt supported_src_pixfmts[] = {
 	SUPPORTED_DST_PIXFMTS,
@@ -98,16 +104,14 @@ static const struct v4lconvert_pixfmt supported_src_pixfmts[] = {
 	{ V4L2_PIX_FMT_BGR32,		32,	 4,	 6,	0 },
 	{ V4L2_PIX_FMT_RGB32,		32,	 4,	 6,	0 },
 	{ V4L2_PIX_FMT_XBGR32,		32,	 4,	 6,	0 },
-	{ V4L2_PIX_FMT_XRGB32,		32,	 4,	 6,	0 },
 	{ V4L2_PIX_FMT_ABGR32,		32,	 4,	 6,	0 },
-	{ V4L2_PIX_FMT_ARGB32,		32,	 4,	 6,	0 },
 	/* yuv 4:2:2 formats */
-	{ V4L2_PIX_FMT_YUYV,		16,	 5,	 4,	0 },
 	{ V4L2_PIX_FMT_YVYU,		16,	 5,	 4,	0 },
 	{ V4L2_PIX_FMT_UYVY,		16,	 5,	 4,	0 },
 	{ V4L2_PIX_FMT_NV16,		16,	 5,	 4,	1 },
 	{ V4L2_PIX_FMT_NV61,		16,	 5,	 4,	1 },
 	/* yuv 4:2:0 formats */
+	{ V4L2_PIX_FMT_NV21,		12,	 5,	 2,	0 },
 	{ V4L2_PIX_FMT_SPCA501,		12,      6,	 3,	1 },
 	{ V4L2_PIX_FMT_SPCA505,		12,	 6,	 3,	1 },
 	{ V4L2_PIX_FMT_SPCA508,		12,	 6,	 3,	1 },
@@ -117,6 +121,14 @@ static const struct v4lconvert_pixfmt supported_src_pixfmts[] = {
 	{ V4L2_PIX_FMT_M420,		12,	 6,	 3,	1 },
 	{ V4L2_PIX_FMT_HM12,		12,	 6,	 3,	1 },
 	{ V4L2_PIX_FMT_CPIA1,		 0,	 6,	 3,	1 },
+	/* yuv 4:4:4 formats */
+	{ V4L2_PIX_FMT_NV24,		24,	 5,	 4,	0 },
+	{ V4L2_PIX_FMT_NV42,		24,	 5,	 4,	0 },
+	/* multi-planar yuv formats */
+	{ V4L2_PIX_FMT_NV12M,		12,	 5,	 2,	0 },
+	{ V4L2_PIX_FMT_NV21M,		12,	 5,	 2,	0 },
+	{ V4L2_PIX_FMT_YUV420M,		12,	 6,	 1,	0 },
+	{ V4L2_PIX_FMT_YVU420M,		12,	 6,	 1,	0 },
 	/* JPEG and variants */
 	{ V4L2_PIX_FMT_MJPEG,		 0,	 7,	 7,	0 },
 	{ V4L2_PIX_FMT_JPEG,		 0,	 7,	 7,	0 },
@@ -132,7 +144,26 @@ static const struct v4lconvert_pixfmt supported_src_pixfmts[] = {
 	{ V4L2_PIX_FMT_SGRBG8,		 8,	 8,	 8,	0 },
 	{ V4L2_PIX_FMT_SRGGB8,		 8,	 8,	 8,	0 },
 	{ V4L2_PIX_FMT_STV0680,		 8,	 8,	 8,	1 },
+	{ V4L2_PIX_FMT_SBGGR10,		16,	 8,	 8,	1 },
+	{ V4L2_PIX_FMT_SGBRG10,		16,	 8,	 8,	1 },
 	{ V4L2_PIX_FMT_SGRBG10,		16,	 8,	 8,	1 },
+	{ V4L2_PIX_FMT_SRGGB10,		16,	 8,	 8,	1 },
+	{ V4L2_PIX_FMT_SBGGR10P,	10,	 8,	 8,	1 },
+	{ V4L2_PIX_FMT_SGBRG10P,	10,	 8,	 8,	1 },
+	{ V4L2_PIX_FMT_SGRBG10P,	10,	 8,	 8,	1 },
+	{ V4L2_PIX_FMT_SRGGB10P,	10,	 8,	 8,	1 },
+	{ V4L2_PIX_FMT_SBGGR12,		16,	 8,	 8,	1 },
+	{ V4L2_PIX_FMT_SGBRG12,		16,	 8,	 8,	1 },
+	{ V4L2_PIX_FMT_SGRBG12,		16,	 8,	 8,	1 },
+	{ V4L2_PIX_FMT_SRGGB12,		16,	 8,	 8,	1 },
+	{ V4L2_PIX_FMT_SBGGR12P,	12,	 8,	 8,	1 },
+	{ V4L2_PIX_FMT_SGBRG12P,	12,	 8,	 8,	1 },
+	{ V4L2_PIX_FMT_SGRBG12P,	12,	 8,	 8,	1 },
+	{ V4L2_PIX_FMT_SRGGB12P,	12,	 8,	 8,	1 },
+	{ V4L2_PIX_FMT_SBGGR16,		16,	 8,	 8,	1 },
+	{ V4L2_PIX_FMT_SGBRG16,		16,	 8,	 8,	1 },
+	{ V4L2_PIX_FMT_SGRBG16,		16,	 8,	 8,	1 },
+	{ V4L2_PIX_FMT_SRGGB16,		16,	 8,	 8,	1 },
 	/* compressed bayer */
 	{ V4L2_PIX_FMT_SPCA561,		 0,	 9,	 9,	1 },
 	{ V4L2_PIX_FMT_SN9C10X,		 0,	 9,	 9,	1 },
@@ -146,7 +177,6 @@ static const struct v4lconvert_pixfmt supported_src_pixfmts[] = {
 	/* special */
 	{ V4L2_PIX_FMT_SE401,		 0,	 8,	 9,	1 },
 	/* grey formats */
-	{ V4L2_PIX_FMT_GREY,		 8,	20,	20,	0 },
 	{ V4L2_PIX_FMT_Y4,		 8,	20,	20,	0 },
 	{ V4L2_PIX_FMT_Y6,		 8,	20,	20,	0 },
 	{ V4L2_PIX_FMT_Y10BPACK,	10,	20,	20,	0 },
@@ -157,6 +187,10 @@ static const struct v4lconvert_pixfmt supported_src_pixfmts[] = {
 	{ V4L2_PIX_FMT_HSV24,		24,	 5,	 4,	0 },
 };
 
+/* Each supported src format has a bit in the supported_src_formats bitfields */
+typedef char v4lconvert_src_formats_fit[
+	ARRAY_SIZE(supported_src_pixfmts) <= V4LCONVERT_MAX_SRC_FORMATS ? 1 : -1];
+
 static const struct v4lconvert_pixfmt supported_dst_pixfmts[] = {
 	SUPPORTED_DST_PIXFMTS
 };
@@ -174,6 +208,84 @@ static const int v4lconvert_crop_res[][2] = {
 	{ 176, 144 },
 };
 
+/* try_format crops (or adds a small border) to get rid of the extra pixels
+   some sensors have, and to offer the well known resolutions above. Frames
+   of any other size than the src get scaled. */
+static int v4lconvert_crop_only(const struct v4l2_format *src_fmt,
+		const struct v4l2_format *dest_fmt)
+{
+	unsigned int width = dest_fmt->fmt.pix.width;
+	unsigned int height = dest_fmt->fmt.pix.height;
+	int i;
+
+	if (src_fmt->fmt.pix.width >= width &&
+	    src_fmt->fmt.pix.width <= width + 7 &&
+	    src_fmt->fmt.pix.height >= height &&
+	    src_fmt->fmt.pix.height <= height + 1)
+		return 1;
+
+	for (i = 0; i < ARRAY_SIZE(v4lconvert_crop_res); i++)
+		if (v4lconvert_crop_res[i][0] == width &&
+		    v4lconvert_crop_res[i][1] == height)
+			return 1;
+
+	return 0;
+}
+
+/* The buffer type to use when talking to the device */
+static enum v4l2_buf_type v4lconvert_buf_type(struct v4lconvert_data *data)
+{
+	return (data->flags & V4LCONVERT_IS_MPLANE) ?
+		V4L2_BUF_TYPE_VIDEO_CAPTURE_MPLANE : V4L2_BUF_TYPE_VIDEO_CAPTURE;
+}
+
+void v4lconvert_mplane_to_pix(const struct v4l2_format *mp_fmt,
+		struct v4l2_format *fmt)
+{
+	const struct v4l2_pix_format_mplane *pix_mp = &mp_fmt->fmt.pix_mp;
+	struct v4l2_format result = { .type = V4L2_BUF_TYPE_VIDEO_CAPTURE };
+	int i;
+
+	result.fmt.pix.width = pix_mp->width;
+	result.fmt.pix.height = pix_mp->height;
+	result.fmt.pix.pixelformat = pix_mp->pixelformat;
+	result.fmt.pix.field = pix_mp->field;
+	result.fmt.pix.bytesperline = pix_mp->plane_fmt[0].bytesperline;
+	for (i = 0; i < pix_mp->num_planes && i < VIDEO_MAX_PLANES; i++)
+		result.fmt.pix.sizeimage += pix_mp->plane_fmt[i].sizeimage;
+	result.fmt.pix.colorspace = pix_mp->colorspace;
+	result.fmt.pix.priv = V4L2_PIX_FMT_PRIV_MAGIC;
+	result.fmt.pix.flags = pix_mp->flags;
+	result.fmt.pix.ycbcr_enc = pix_mp->ycbcr_enc;
+	result.fmt.pix.quantization = pix_mp->quantization;
+	result.fmt.pix.xfer_func = pix_mp->xfer_func;
+	*fmt = result;
+}
+
+void v4lconvert_pix_to_mplane(const struct v4l2_format *fmt,
+		struct v4l2_format *mp_fmt)
+{
+	const struct v4l2_pix_format *pix = &fmt->fmt.pix;
+	struct v4l2_format result = { .type = V4L2_BUF_TYPE_VIDEO_CAPTURE_MPLANE };
+
+	result.fmt.pix_mp.width = pix->width;
+	result.fmt.pix_mp.height = pix->height;
+	result.fmt.pix_mp.pixelformat = pix->pixelformat;
+	result.fmt.pix_mp.field = pix->field;
+	result.fmt.pix_mp.colorspace = pix->colorspace;
+	result.fmt.pix_mp.num_planes = 1;
+	result.fmt.pix_mp.plane_fmt[0].bytesperline = pix->bytesperline;
+	result.fmt.pix_mp.plane_fmt[0].sizeimage = pix->sizeimage;
+	/* The extended fields are only valid with the magic priv value */
+	if (pix->priv == V4L2_PIX_FMT_PRIV_MAGIC) {
+		result.fmt.pix_mp.flags = pix->flags;
+		result.fmt.pix_mp.ycbcr_enc = pix->ycbcr_enc;
+		result.fmt.pix_mp.quantization = pix->quantization;
+		result.fmt.pix_mp.xfer_func = pix->xfer_func;
+	}
+	*mp_fmt = result;
+}
+
 struct v4lconvert_data *v4lconvert_create(int fd)
 {
 	return v4lconvert_create_with_dev_ops(fd, NULL, &default_dev_ops); 
@@ -183,6 +295,7 @@ struct v4lconvert_data *v4lconvert_create_with_dev_ops(int fd, void *dev_ops_pri
 		const struct libv4l_dev_ops *dev_ops)
 {
 	int i, j;
+	char *s;
 	struct v4lconvert_data *data = calloc(1, sizeof(struct v4lconvert_data));
 	struct v4l2_capability cap;
 	/*
@@ -193,6 +306,7 @@ struct v4lconvert_data *v4lconvert_create_with_dev_ops(int fd, void *dev_ops_pri
 	 * performance impact.
 	 */
 	int always_needs_conversion = 1;
+	int bayer_src = 0;
 
 	if (!data) {
 		fprintf(stderr, "libv4lconvert: error: out of memory!\n");
@@ -203,16 +317,53 @@ struct v4lconvert_data *v4lconvert_create_with_dev_ops(int fd, void *dev_ops_pri
 	data->dev_ops = dev_ops;
 	data->dev_ops_priv = dev_ops_priv;
 	data->decompress_pid = -1;
+	data->decompress_shm_fd = -1;
+	data->decompress_req_fd = -1;
+	data->decompress_done_fd = -1;
 	data->fps = 30;
+	data->cpu_flags = v4lconvert_get_cpu_flags();
+	data->threads = v4lconvert_threads_create();
+	if (!data->threads) {
+		free(data);
+		return NULL;
+	}
+
+	/* Allow overriding the number of conversion threads through the
+	   environment, 0 means 1 thread per cpu */
+	s = getenv("LIBV4LCONVERT_THREADS");
+	if (s)
+		v4lconvert_threads_set_count(data->threads, strtol(s, NULL, 0));
+
+	s = getenv("LIBV4LCONVERT_STATS");
+	if (s)
+		data->stats_timing = strtol(s, NULL, 0);
+
+	/* Check if this cam has any special flags */
+	if (data->dev_ops->ioctl(data->dev_ops_priv, data->fd,
+			VIDIOC_QUERYCAP, &cap) == 0) {
+		if (!strcmp((char *)cap.driver, "uvcvideo"))
+			data->flags |= V4LCONVERT_IS_UVC;
+
+		v4lconvert_capcache_open(data, &cap);
+
+		if (cap.capabilities & V4L2_CAP_DEVICE_CAPS)
+			cap.capabilities = cap.device_caps;
+		if ((cap.capabilities & 0xff) & ~V4L2_CAP_VIDEO_CAPTURE)
+			always_needs_conversion = 0;
+		/* Devices which only support the multi-planar api get talked to
+		   through it, see v4lconvert_dev_try_fmt() */
+		if (!(cap.capabilities & V4L2_CAP_VIDEO_CAPTURE) &&
+				(cap.capabilities & V4L2_CAP_VIDEO_CAPTURE_MPLANE))
+			data->flags |= V4LCONVERT_IS_MPLANE;
+	}
 
 	/* Check supported formats */
 	for (i = 0; ; i++) {
-		struct v4l2_fmtdesc fmt = { .type = V4L2_BUF_TYPE_VIDEO_CAPTURE };
+		struct v4l2_fmtdesc fmt = { .type = v4lconvert_buf_type(data) };
 
 		fmt.index = i;
 
-		if (data->dev_ops->ioctl(data->dev_ops_priv, data->fd,
-				VIDIOC_ENUM_FMT, &fmt))
+		if (v4lconvert_enum_ioctl(data, VIDIOC_ENUM_FMT, &fmt))
 			break;
 
 		for (j = 0; j < ARRAY_SIZE(supported_src_pixfmts); j++)
@@ -220,31 +371,27 @@ struct v4lconvert_data *v4lconvert_create_with_dev_ops(int fd, void *dev_ops_pri
 				break;
 
 		if (j < ARRAY_SIZE(supported_src_pixfmts)) {
-			data->supported_src_formats |= 1ULL << j;
+			V4LCONVERT_SRC_FORMAT_SET(data->supported_src_formats, j);
 			v4lconvert_get_framesizes(data, fmt.pixelformat, j);
 			if (!supported_src_pixfmts[j].needs_conversion)
 				always_needs_conversion = 0;
+			if (v4lconvert_bayer_unpacking(fmt.pixelformat, NULL, NULL))
+				bayer_src = 1;
 		} else
 			always_needs_conversion = 0;
 	}
 
 	data->no_formats = i;
 
-	/* Check if this cam has any special flags */
-	if (data->dev_ops->ioctl(data->dev_ops_priv, data->fd,
-			VIDIOC_QUERYCAP, &cap) == 0) {
-		if (!strcmp((char *)cap.driver, "uvcvideo"))
-			data->flags |= V4LCONVERT_IS_UVC;
-
-		if (cap.capabilities & V4L2_CAP_DEVICE_CAPS)
-			cap.capabilities = cap.device_caps;
-		if ((cap.capabilities & 0xff) & ~V4L2_CAP_VIDEO_CAPTURE)
-			always_needs_conversion = 0;
-	}
+	/* Write out the cache now, rather then only on destroy, so that the
+	   next open benefits from it even if this one never gets closed */
+	v4lconvert_capcache_save(data);
 
 	data->control = v4lcontrol_create(fd, dev_ops_priv, dev_ops,
-						always_needs_conversion);
+						always_needs_conversion, bayer_src);
 	if (!data->control) {
+		v4lconvert_capcache_close(data);
+		v4lconvert_threads_destroy(data->threads);
 		free(data);
 		return NULL;
 	}
@@ -253,13 +400,18 @@ struct v4lconvert_data *v4lconvert_create_with_dev_ops(int fd, void *dev_ops_pri
 	if (data->control_flags & V4LCONTROL_FORCE_TINYJPEG)
 		data->flags |= V4LCONVERT_USE_TINYJPEG;
 
-	data->processing = v4lprocessing_create(fd, data->control);
+	data->processing = v4lprocessing_create(fd, data->control,
+						data->threads);
 	if (!data->processing) {
 		v4lcontrol_destroy(data->control);
+		v4lconvert_capcache_close(data);
+		v4lconvert_threads_destroy(data->threads);
 		free(data);
 		return NULL;
 	}
 
+	pthread_mutex_init(&data->convert_lock, NULL);
+
 	return data;
 }
 
@@ -268,8 +420,12 @@ void v4lconvert_destroy(struct v4lconvert_data *data)
 	if (!data)
 		return;
 
+	/* Stop the worker thread first, it may still be converting */
+	v4lconvert_async_destroy(data);
 	v4lprocessing_destroy(data->processing);
 	v4lcontrol_destroy(data->control);
+	v4lconvert_capcache_close(data);
+	v4lconvert_threads_destroy(data->threads);
 	if (data->tinyjpeg) {
 		unsigned char *comps[3] = { NULL, NULL, NULL };
 
@@ -283,12 +439,9 @@ void v4lconvert_destroy(struct v4lconvert_data *data)
 #ifdef HAVE_LIBV4LCONVERT_HELPERS
 	v4lconvert_helper_cleanup(data);
 #endif
-	free(data->convert1_buf);
-	free(data->convert2_buf);
-	free(data->rotate90_buf);
-	free(data->flip_buf);
-	free(data->convert_pixfmt_buf);
+	v4lconvert_scale_free(data);
 	free(data->previous_frame);
+	pthread_mutex_destroy(&data->convert_lock);
 	free(data);
 }
 
@@ -305,8 +458,16 @@ int v4lconvert_supported_dst_format(unsigned int pixelformat)
 
 int v4lconvert_supported_dst_fmt_only(struct v4lconvert_data *data)
 {
-	return v4lcontrol_needs_conversion(data->control) &&
-		data->supported_src_formats;
+	int i;
+
+	if (!v4lcontrol_needs_conversion(data->control))
+		return 0;
+
+	for (i = 0; i < V4LCONVERT_SRC_FORMATS_WORDS; i++)
+		if (data->supported_src_formats[i])
+			return 1;
+
+	return 0;
 }
 
 /* See libv4lconvert.h for description of in / out parameters */
@@ -315,15 +476,24 @@ int v4lconvert_enum_fmt(struct v4lconvert_data *data, struct v4l2_fmtdesc *fmt)
 	int i, no_faked_fmts = 0;
 	unsigned int faked_fmts[ARRAY_SIZE(supported_dst_pixfmts)];
 
-	if (fmt->type != V4L2_BUF_TYPE_VIDEO_CAPTURE ||
+	if ((fmt->type != V4L2_BUF_TYPE_VIDEO_CAPTURE &&
+	     fmt->type != v4lconvert_buf_type(data)) ||
 			(!v4lconvert_supported_dst_fmt_only(data) &&
-			 fmt->index < data->no_formats))
-		return data->dev_ops->ioctl(data->dev_ops_priv, data->fd,
-				VIDIOC_ENUM_FMT, fmt);
+			 fmt->index < data->no_formats)) {
+		enum v4l2_buf_type type = fmt->type;
+		int result;
+
+		/* Multi-planar devices list the same formats for both types */
+		if (type == V4L2_BUF_TYPE_VIDEO_CAPTURE)
+			fmt->type = v4lconvert_buf_type(data);
+		result = v4lconvert_enum_ioctl(data, VIDIOC_ENUM_FMT, fmt);
+		fmt->type = type;
+		return result;
+	}
 
 	for (i = 0; i < ARRAY_SIZE(supported_dst_pixfmts); i++)
 		if (v4lconvert_supported_dst_fmt_only(data) ||
-				!(data->supported_src_formats & (1ULL << i))) {
+				!V4LCONVERT_SRC_FORMAT_ISSET(data->supported_src_formats, i)) {
 			faked_fmts[no_faked_fmts] = supported_dst_pixfmts[i].fmt;
 			no_faked_fmts++;
 		}
@@ -373,10 +543,15 @@ static int v4lconvert_get_rank(struct v4lconvert_data *data,
 	switch (dest_pixelformat) {
 	case V4L2_PIX_FMT_RGB24:
 	case V4L2_PIX_FMT_BGR24:
+	case V4L2_PIX_FMT_XRGB32:
+	case V4L2_PIX_FMT_ARGB32:
 		rank = supported_src_pixfmts[src_index].rgb_rank;
 		break;
 	case V4L2_PIX_FMT_YUV420:
 	case V4L2_PIX_FMT_YVU420:
+	case V4L2_PIX_FMT_NV12:
+	case V4L2_PIX_FMT_YUYV:
+	case V4L2_PIX_FMT_GREY:
 		rank = supported_src_pixfmts[src_index].yuv_rank;
 		break;
 	}
@@ -434,8 +609,8 @@ static int v4lconvert_do_try_format_uvc(struct v4lconvert_data *data,
 
 	for (i = 0; i < ARRAY_SIZE(supported_src_pixfmts); i++) {
 		/* is this format supported? */
-		if (!(data->framesize_supported_src_formats[best_framesize] &
-		      (1ULL << i)))
+		if (!V4LCONVERT_SRC_FORMAT_ISSET(
+				data->framesize_supported_src_formats[best_framesize], i))
 			continue;
 
 		/* Note the hardcoded use of discrete is based on this function
@@ -466,47 +641,69 @@ static int v4lconvert_do_try_format_uvc(struct v4lconvert_data *data,
 	return 0;
 }
 
+/* VIDIOC_TRY_FMT the single-planar fmt on the device. For multi-planar devices
+   fmt gets replaced by the multi-planar answer of the device, pix always gets
+   the single-planar version of the answer */
+static int v4lconvert_dev_try_fmt(struct v4lconvert_data *data,
+		struct v4l2_format *fmt, struct v4l2_format *pix)
+{
+	if (data->flags & V4LCONVERT_IS_MPLANE)
+		v4lconvert_pix_to_mplane(fmt, fmt);
+
+	if (data->dev_ops->ioctl(data->dev_ops_priv, data->fd,
+			VIDIOC_TRY_FMT, fmt))
+		return -1;
+
+	if (data->flags & V4LCONVERT_IS_MPLANE)
+		v4lconvert_mplane_to_pix(fmt, pix);
+	else
+		*pix = *fmt;
+
+	return 0;
+}
+
 static int v4lconvert_do_try_format(struct v4lconvert_data *data,
 		struct v4l2_format *dest_fmt, struct v4l2_format *src_fmt)
 {
 	int i, size_x_diff, size_y_diff, rank, best_rank = 0;
 	unsigned int size_diff, closest_fmt_size_diff = -1;
 	unsigned int desired_pixfmt = dest_fmt->fmt.pix.pixelformat;
-	struct v4l2_format try_fmt, closest_fmt = { .type = 0 };
+	struct v4l2_format try_fmt, try_pix, closest_pix;
+	struct v4l2_format closest_fmt = { .type = 0 };
 
 	if (data->flags & V4LCONVERT_IS_UVC)
 		return v4lconvert_do_try_format_uvc(data, dest_fmt, src_fmt);
 
 	for (i = 0; i < ARRAY_SIZE(supported_src_pixfmts); i++) {
 		/* is this format supported? */
-		if (!(data->supported_src_formats & (1ULL << i)))
+		if (!V4LCONVERT_SRC_FORMAT_ISSET(data->supported_src_formats, i))
 			continue;
 
 		try_fmt = *dest_fmt;
 		try_fmt.fmt.pix.pixelformat = supported_src_pixfmts[i].fmt;
-		if (data->dev_ops->ioctl(data->dev_ops_priv, data->fd,
-				VIDIOC_TRY_FMT, &try_fmt))
+		if (v4lconvert_dev_try_fmt(data, &try_fmt, &try_pix))
 			continue;
 
-		if (try_fmt.fmt.pix.pixelformat !=
+		if (try_pix.fmt.pix.pixelformat !=
 		    supported_src_pixfmts[i].fmt)
 			continue;
 
 		/* Did we get a better match than before? */
-		size_x_diff = (int)try_fmt.fmt.pix.width -
+		size_x_diff = (int)try_pix.fmt.pix.width -
 			      (int)dest_fmt->fmt.pix.width;
-		size_y_diff = (int)try_fmt.fmt.pix.height -
+		size_y_diff = (int)try_pix.fmt.pix.height -
 			      (int)dest_fmt->fmt.pix.height;
 		size_diff = size_x_diff * size_x_diff +
 			    size_y_diff * size_y_diff;
 
 		rank = v4lconvert_get_rank(data, i,
-					   try_fmt.fmt.pix.width,
-					   try_fmt.fmt.pix.height,
+					   try_pix.fmt.pix.width,
+					   try_pix.fmt.pix.height,
 					   desired_pixfmt);
 		if (size_diff < closest_fmt_size_diff ||
 		    (size_diff == closest_fmt_size_diff && rank < best_rank)) {
 			closest_fmt = try_fmt;
+			closest_pix = try_pix;
 			closest_fmt_size_diff = size_diff;
 			best_rank = rank;
 		}
@@ -515,8 +712,8 @@ static int v4lconvert_do_try_format(struct v4lconvert_data *data,
 	if (closest_fmt.type == 0)
 		return -1;
 
-	*dest_fmt = closest_fmt;
-	if (closest_fmt.fmt.pix.pixelformat != desired_pixfmt)
+	*dest_fmt = closest_pix;
+	if (closest_pix.fmt.pix.pixelformat != desired_pixfmt)
 		dest_fmt->fmt.pix.pixelformat = desired_pixfmt;
 	*src_fmt = closest_fmt;
 
@@ -533,12 +730,61 @@ void v4lconvert_fixup_fmt(struct v4l2_format *fmt)
 		break;
 	case V4L2_PIX_FMT_YUV420:
 	case V4L2_PIX_FMT_YVU420:
+	case V4L2_PIX_FMT_NV12:
 		fmt->fmt.pix.bytesperline = fmt->fmt.pix.width;
 		fmt->fmt.pix.sizeimage = fmt->fmt.pix.width * fmt->fmt.pix.height * 3 / 2;
 		break;
+	case V4L2_PIX_FMT_YUYV:
+		fmt->fmt.pix.bytesperline = fmt->fmt.pix.width * 2;
+		fmt->fmt.pix.sizeimage = fmt->fmt.pix.width * fmt->fmt.pix.height * 2;
+		break;
+	case V4L2_PIX_FMT_XRGB32:
+	case V4L2_PIX_FMT_ARGB32:
+		fmt->fmt.pix.bytesperline = fmt->fmt.pix.width * 4;
+		fmt->fmt.pix.sizeimage = fmt->fmt.pix.width * fmt->fmt.pix.height * 4;
+		break;
+	case V4L2_PIX_FMT_GREY:
+		fmt->fmt.pix.bytesperline = fmt->fmt.pix.width;
+		fmt->fmt.pix.sizeimage = fmt->fmt.pix.width * fmt->fmt.pix.height;
+		break;
 	}
 }
 
+/* When a frame gets made smaller anyways, we can decode a JPEG frame at 1/2,
+   1/4 or 1/8 of its size, or demosaic a raw bayer frame at 1/2 of its size
+   when 2x2 binning is asked for, and crop the rest. Returns the largest usable
+   scale factor for getting a width x height frame from src_fmt, 1 if none. */
+static int v4lconvert_src_scale(struct v4lconvert_data *data,
+		const struct v4l2_format *src_fmt,
+		unsigned int width, unsigned int height)
+{
+	unsigned int src_width = src_fmt->fmt.pix.width;
+	unsigned int src_height = src_fmt->fmt.pix.height;
+	int scale, max_scale;
+
+	if ((src_fmt->fmt.pix.pixelformat == V4L2_PIX_FMT_MJPEG ||
+	     src_fmt->fmt.pix.pixelformat == V4L2_PIX_FMT_JPEG) &&
+	    !(data->control_flags & V4LCONTROL_ROTATED_90_JPEG))
+		max_scale = 8;
+	else if (v4lconvert_bayer_unpacking(src_fmt->fmt.pix.pixelformat,
+					    NULL, NULL) &&
+		 v4lcontrol_get_ctrl(data->control, V4LCONTROL_DEMOSAIC) ==
+		 V4LCONTROL_DEMOSAIC_BIN)
+		max_scale = 2;
+	else
+		return 1;
+
+	/* The scaled size must be exact and even, for yuv420 */
+	for (scale = max_scale; scale > 1; scale /= 2)
+		if (src_width % (2 * scale) == 0 &&
+		    src_height % (2 * scale) == 0 &&
+		    src_width / scale >= width &&
+		    src_height / scale >= height)
+			return scale;
+
+	return 1;
+}
+
 /* See libv4lconvert.h for description of in / out parameters */
 int v4lconvert_try_format(struct v4lconvert_data *data,
 		struct v4l2_format *dest_fmt, struct v4l2_format *src_fmt)
@@ -548,6 +794,19 @@ int v4lconvert_try_format(struct v4lconvert_data *data,
 	unsigned int desired_height = dest_fmt->fmt.pix.height;
 	struct v4l2_format try_src, try_dest, try2_src, try2_dest;
 
+	/* Work on the single-planar version of a multi-planar dest_fmt */
+	if (dest_fmt->type == V4L2_BUF_TYPE_VIDEO_CAPTURE_MPLANE &&
+			(data->flags & V4LCONVERT_IS_MPLANE) &&
+			(v4lconvert_supported_dst_fmt_only(data) ||
+			 v4lconvert_supported_dst_format(
+				 dest_fmt->fmt.pix_mp.pixelformat))) {
+		v4lconvert_mplane_to_pix(dest_fmt, &try_dest);
+		result = v4lconvert_try_format(data, &try_dest, src_fmt);
+		if (result == 0)
+			v4lconvert_pix_to_mplane(&try_dest, dest_fmt);
+		return result;
+	}
+
 	if (dest_fmt->type == V4L2_BUF_TYPE_VIDEO_CAPTURE &&
 			v4lconvert_supported_dst_fmt_only(data) &&
 			!v4lconvert_supported_dst_format(dest_fmt->fmt.pix.pixelformat))
@@ -559,10 +818,17 @@ int v4lconvert_try_format(struct v4lconvert_data *data,
 	if (!v4lconvert_supported_dst_format(dest_fmt->fmt.pix.pixelformat) ||
 			dest_fmt->type != V4L2_BUF_TYPE_VIDEO_CAPTURE ||
 			v4lconvert_do_try_format(data, &try_dest, &try_src)) {
-		result = data->dev_ops->ioctl(data->dev_ops_priv, data->fd,
-				VIDIOC_TRY_FMT, dest_fmt);
+		if (dest_fmt->type == V4L2_BUF_TYPE_VIDEO_CAPTURE) {
+			try_src = *dest_fmt;
+			result = v4lconvert_dev_try_fmt(data, &try_src,
+							dest_fmt);
+		} else {
+			result = data->dev_ops->ioctl(data->dev_ops_priv,
+					data->fd, VIDIOC_TRY_FMT, dest_fmt);
+			try_src = *dest_fmt;
+		}
 		if (src_fmt)
-			*src_fmt = *dest_fmt;
+			*src_fmt = try_src;
 		return result;
 	}
 
@@ -632,6 +898,72 @@ int v4lconvert_try_format(struct v4lconvert_data *data,
 		}
 	}
 
+	/* In case of a non exact resolution match, see if we can get the resolution
+	   asked for by decoding a larger JPEG (or binning a larger bayer) frame at
+	   a reduced size, cropping max 20% of the decoded width / height */
+	if (try_dest.fmt.pix.width != desired_width ||
+			try_dest.fmt.pix.height != desired_height) {
+		for (i = 8; i > 1; i /= 2) {
+			int scale;
+
+			try2_dest = *dest_fmt;
+			try2_dest.fmt.pix.width = desired_width * i;
+			try2_dest.fmt.pix.height = desired_height * i;
+			result = v4lconvert_do_try_format(data, &try2_dest, &try2_src);
+			if (result)
+				continue;
+
+			scale = v4lconvert_src_scale(data, &try2_src,
+					desired_width, desired_height);
+			if (scale > 1 &&
+			    try2_src.fmt.pix.width / scale <= desired_width * 5 / 4 &&
+			    try2_src.fmt.pix.height / scale <= desired_height * 5 / 4) {
+				/* Success! */
+				try2_dest.fmt.pix.width = desired_width;
+				try2_dest.fmt.pix.height = desired_height;
+				try_dest = try2_dest;
+				try_src = try2_src;
+				break;
+			}
+		}
+	}
+
+	/* In case of a non exact resolution match, scale down the smallest
+	   resolution the device has which is larger than the one asked for.
+	   Differences which go away with the rounding below do not count. */
+	if ((try_dest.fmt.pix.width & ~7) != (desired_width & ~7) ||
+			(try_dest.fmt.pix.height & ~1) != (desired_height & ~1)) {
+		const struct v4l2_frmsize_discrete *size, *best = NULL;
+
+		for (i = 0; i < data->no_framesizes; i++) {
+			size = &data->framesizes[i].discrete;
+			if (data->framesizes[i].type != V4L2_FRMSIZE_TYPE_DISCRETE ||
+					size->width < desired_width ||
+					size->height < desired_height)
+				continue;
+
+			if (!best || size->width * size->height <
+					best->width * best->height)
+				best = size;
+		}
+
+		if (best) {
+			try2_dest = *dest_fmt;
+			try2_dest.fmt.pix.width = best->width;
+			try2_dest.fmt.pix.height = best->height;
+			result = v4lconvert_do_try_format(data, &try2_dest, &try2_src);
+			if (result == 0 &&
+					try2_dest.fmt.pix.width == best->width &&
+					try2_dest.fmt.pix.height == best->height) {
+				/* Success! */
+				try2_dest.fmt.pix.width = desired_width;
+				try2_dest.fmt.pix.height = desired_height;
+				try_dest = try2_dest;
+				try_src = try2_src;
+			}
+		}
+	}
+
 	/* Some applications / libs (*cough* gstreamer *cough*) will not work
 	   correctly with planar YUV formats when the width is not a multiple of 8
 	   or the height is not a multiple of 2. With RGB formats these apps require
@@ -668,12 +1000,162 @@ int v4lconvert_needs_conversion(struct v4lconvert_data *data,
 	return 0;
 }
 
-static int v4lconvert_processing_needs_double_conversion(
-		unsigned int src_pix_fmt, unsigned int dest_pix_fmt)
+unsigned char *v4lconvert_alloc_buffer(struct v4lconvert_data *data,
+		int needed, unsigned char **buf, int *buf_size)
+{
+	int allocated;
+
+	if (*buf_size >= needed)
+		return *buf;
+
+	if (!data) {
+		free(*buf);
+		*buf = malloc(needed);
+		*buf_size = *buf ? needed : 0;
+		return *buf;
+	}
+
+	v4lconvert_pool_put(*buf);
+	*buf_size = needed;
+	*buf = v4lconvert_pool_get(buf_size, &allocated);
+	if (!*buf)
+		*buf_size = 0;
+	if (allocated)
+		data->stats.buffer_reallocs++;
+	return *buf;
+}
+
+/* Return the scratch buffers to the pool, so that other instances can use
+   them while this one is not converting */
+static void v4lconvert_release_buffers(struct v4lconvert_data *data)
+{
+	unsigned char **bufs[] = {
+		&data->convert2_buf, &data->rotate90_buf, &data->flip_buf,
+		&data->convert_pixfmt_buf, &data->pack_buf,
+		&data->pack_pixfmt_buf, &data->bayer_buf,
+	};
+	int *sizes[] = {
+		&data->convert2_buf_size, &data->rotate90_buf_size,
+		&data->flip_buf_size, &data->convert_pixfmt_buf_size,
+		&data->pack_buf_size, &data->pack_pixfmt_buf_size,
+		&data->bayer_buf_size,
+	};
+	int i;
+
+	for (i = 0; i < ARRAY_SIZE(bufs); i++) {
+		v4lconvert_pool_put(*bufs[i]);
+		*bufs[i] = NULL;
+		*sizes[i] = 0;
+	}
+}
+
+int v4lconvert_oom_error(struct v4lconvert_data *data)
+{
+	V4LCONVERT_ERR("could not allocate memory\n");
+	errno = ENOMEM;
+	return -1;
+}
+
+/* Conversion of a packed src format to a packed dest format, the frame gets
+   converted in bands of rows in parallel when multiple threads are used */
+typedef void (*v4lconvert_packed_func)(struct v4lconvert_data *data,
+		const unsigned char *src, unsigned char *dest,
+		int width, int height, int stride);
+
+struct v4lconvert_packed_band_args {
+	struct v4lconvert_data *data;
+	v4lconvert_packed_func func;
+	const unsigned char *src;
+	unsigned char *dest;
+	int width;
+	int height;
+	int stride;
+	int dest_stride;
+};
+
+static void v4lconvert_packed_band(void *arg, int first_row, int rows)
+{
+	struct v4lconvert_packed_band_args *args = arg;
+	unsigned char *line;
+	int y;
+
+	if (!args->data->fused) {
+		args->func(args->data, args->src + first_row * args->stride,
+			   args->dest + first_row * args->dest_stride,
+			   args->width, rows, args->stride);
+		return;
+	}
+
+	/* Flipping / expanding to rgb32 while converting, only used with
+	   rgb24 / bgr24 dest */
+	for (y = first_row; y < first_row + rows; y++) {
+		line = v4lconvert_fused_line(args->data, args->dest, y,
+					     args->width, args->height);
+		args->func(args->data, args->src + y * args->stride, line,
+			   args->width, 1, args->stride);
+		v4lconvert_fused_finish_line(args->data, line, args->width);
+	}
+}
+
+static void v4lconvert_convert_packed(struct v4lconvert_data *data,
+		v4lconvert_packed_func func, const unsigned char *src,
+		unsigned char *dest, int width, int height, int stride,
+		int dest_stride)
+{
+	struct v4lconvert_packed_band_args args = {
+		data, func, src, dest, width, height, stride, dest_stride
+	};
+
+	v4lconvert_run_bands(data->threads, v4lconvert_packed_band, &args,
+			     height, 1);
+}
+
+/* Can convert_pixfmt flip the image and / or expand it to 32 bpp while
+   converting from src to dest? */
+static int v4lconvert_can_fuse(unsigned int src_pix_fmt,
+		unsigned int dest_pix_fmt)
+{
+	switch (dest_pix_fmt) {
+	case V4L2_PIX_FMT_RGB24:
+	case V4L2_PIX_FMT_BGR24:
+	case V4L2_PIX_FMT_XRGB32:
+	case V4L2_PIX_FMT_ARGB32:
+		break;
+	default:
+		return 0;
+	}
+
+	switch (src_pix_fmt) {
+	case V4L2_PIX_FMT_YUYV:
+	case V4L2_PIX_FMT_YVYU:
+	case V4L2_PIX_FMT_UYVY:
+	case V4L2_PIX_FMT_YUV420:
+	case V4L2_PIX_FMT_YVU420:
+	case V4L2_PIX_FMT_NV12:
+	case V4L2_PIX_FMT_NV21:
+	case V4L2_PIX_FMT_NV24:
+	case V4L2_PIX_FMT_NV42:
+	case V4L2_PIX_FMT_NV12M:
+	case V4L2_PIX_FMT_NV21M:
+	case V4L2_PIX_FMT_YUV420M:
+	case V4L2_PIX_FMT_YVU420M:
+		return 1;
+	}
+	/* And all raw bayer formats */
+	return v4lconvert_bayer_unpacking(src_pix_fmt, NULL, NULL) != 0;
+}
+
+/* Whitebalance, etc. processing gets done in place on bayer, rgb24 / bgr24 or
+   yuv420 / yvu420 data, see v4lprocessing_processing(). Can it be done on src
+   frames of this format before converting them? For the compressed formats
+   convert_pixfmt does the processing on the decompressed bayer data. */
+static int v4lconvert_processing_on_src(unsigned int src_pix_fmt)
 {
 	switch (src_pix_fmt) {
 	case V4L2_PIX_FMT_RGB24:
 	case V4L2_PIX_FMT_BGR24:
+	case V4L2_PIX_FMT_YUV420:
+	case V4L2_PIX_FMT_YVU420:
 	case V4L2_PIX_FMT_SPCA561:
 	case V4L2_PIX_FMT_SN9C10X:
 	case V4L2_PIX_FMT_PAC207:
@@ -688,47 +1170,324 @@ static int v4lconvert_processing_needs_double_conversion(
 	case V4L2_PIX_FMT_SGRBG8:
 	case V4L2_PIX_FMT_SRGGB8:
 	case V4L2_PIX_FMT_STV0680:
-		return 0;
+		return 1;
 	}
-	switch (dest_pix_fmt) {
+	return 0;
+}
+
+/* Can the processing lookup tables be applied while converting from src to
+   dest? See v4lprocessing_lookup_tables() for the src formats it can gather
+   its statistics from. */
+static int v4lconvert_processing_can_fuse(unsigned int src_pix_fmt,
+		unsigned int dest_pix_fmt)
+{
+	int packing;
+
+	switch (src_pix_fmt) {
+	case V4L2_PIX_FMT_YUYV:
+	case V4L2_PIX_FMT_YVYU:
+	case V4L2_PIX_FMT_UYVY:
+	case V4L2_PIX_FMT_YUV420:
+	case V4L2_PIX_FMT_YVU420:
+	case V4L2_PIX_FMT_NV12:
+	case V4L2_PIX_FMT_NV21:
+		return v4lconvert_can_fuse(src_pix_fmt, dest_pix_fmt);
+	}
+	/* 8 bit bayer gets processed in place, cheaper than rgb, the high bit
+	   depth formats can not be processed in place */
+	if (v4lconvert_bayer_unpacking(src_pix_fmt, &packing, NULL) &&
+	    packing != V4LCONVERT_BAYER_8BIT)
+		return v4lconvert_can_fuse(src_pix_fmt, dest_pix_fmt);
+	return 0;
+}
+
+/* The processing, rotate90, flip and crop steps, as well as most src format
+   conversions only handle rgb24 / bgr24 and yuv420 / yvu420. The other dest
+   formats get converted directly from a couple of common src formats, and
+   otherwise get packed from rgb24 resp. yuv420. This returns which of the 2
+   to use for a dest format, or 0 if it is one of the 4 base formats. */
+static unsigned int v4lconvert_base_fmt(unsigned int pixelformat)
+{
+	switch (pixelformat) {
+	case V4L2_PIX_FMT_XRGB32:
+	case V4L2_PIX_FMT_ARGB32:
+		return V4L2_PIX_FMT_RGB24;
+	case V4L2_PIX_FMT_NV12:
+	case V4L2_PIX_FMT_YUYV:
+	case V4L2_PIX_FMT_GREY:
+		return V4L2_PIX_FMT_YUV420;
+	}
+	return 0;
+}
+
+static int v4lconvert_frame_size(unsigned int pixelformat, int width,
+		int height)
+{
+	switch (pixelformat) {
+	case V4L2_PIX_FMT_XRGB32:
+	case V4L2_PIX_FMT_ARGB32:
+		return width * height * 4;
 	case V4L2_PIX_FMT_RGB24:
 	case V4L2_PIX_FMT_BGR24:
-		return 0;
+		return width * height * 3;
+	case V4L2_PIX_FMT_YUYV:
+		return width * height * 2;
+	case V4L2_PIX_FMT_YUV420:
+	case V4L2_PIX_FMT_YVU420:
+	case V4L2_PIX_FMT_NV12:
+		return width * height * 3 / 2;
+	case V4L2_PIX_FMT_GREY:
+		return width * height;
 	}
+	return -1;
+}
 
-	return 1;
+static int v4lconvert_yuv422_order(unsigned int pixelformat)
+{
+	switch (pixelformat) {
+	case V4L2_PIX_FMT_YVYU:
+		return V4LCONVERT_ORDER_YVYU;
+	case V4L2_PIX_FMT_UYVY:
+		return V4LCONVERT_ORDER_UYVY;
+	case V4L2_PIX_FMT_YUYV:
+		return V4LCONVERT_ORDER_YUYV;
+	}
+	return -1;
 }
 
-unsigned char *v4lconvert_alloc_buffer(int needed,
-		unsigned char **buf, int *buf_size)
+static int v4lconvert_convert_pixfmt(struct v4lconvert_data *data,
+	unsigned char *src, int src_size, unsigned char *dest, int dest_size,
+	struct v4l2_format *fmt, unsigned int dest_pix_fmt);
+
+/* Get the planes of a planar yuv src frame. The planes of multi-planar frames
+   come from v4lconvert_convert_mplane(), or are all in src one after the other
+   when called through v4lconvert_convert() */
+static const struct v4lconvert_planes *v4lconvert_get_planes(
+	struct v4lconvert_data *data, const struct v4l2_format *fmt,
+	const unsigned char *src, struct v4lconvert_planes *planes)
 {
-	if (*buf_size < needed) {
-		free(*buf);
-		*buf = malloc(needed);
-		if (*buf == NULL) {
-			*buf_size = 0;
-			return NULL;
+	unsigned int src_pix_fmt = fmt->fmt.pix.pixelformat;
+	unsigned int width  = fmt->fmt.pix.width;
+	unsigned int height = fmt->fmt.pix.height;
+	unsigned int bytesperline = fmt->fmt.pix.bytesperline;
+	int uv;
+
+	switch (src_pix_fmt) {
+	case V4L2_PIX_FMT_YUV420:
+	case V4L2_PIX_FMT_YVU420:
+		v4lconvert_yuv420_planes(planes, src, width, height,
+					 src_pix_fmt == V4L2_PIX_FMT_YVU420);
+		return planes;
+	case V4L2_PIX_FMT_NV24:
+	case V4L2_PIX_FMT_NV42:
+		v4lconvert_nv_planes(planes, src, height, bytesperline,
+				     2 * bytesperline);
+		return planes;
+	case V4L2_PIX_FMT_NV12M:
+	case V4L2_PIX_FMT_NV21M:
+		if (data->src_planes)
+			return data->src_planes;
+		/* fall through */
+	case V4L2_PIX_FMT_NV12:
+	case V4L2_PIX_FMT_NV21:
+		v4lconvert_nv_planes(planes, src, height, bytesperline,
+				     bytesperline);
+		return planes;
+	case V4L2_PIX_FMT_YUV420M:
+	case V4L2_PIX_FMT_YVU420M:
+		if (data->src_planes)
+			return data->src_planes;
+		uv = src_pix_fmt == V4L2_PIX_FMT_YVU420M ? 2 : 1;
+		planes->plane[0] = src;
+		planes->plane[uv] = src + bytesperline * height;
+		planes->plane[3 - uv] = planes->plane[uv] +
+					bytesperline / 2 * (height / 2);
+		planes->stride[0] = bytesperline;
+		planes->stride[1] = planes->stride[2] = bytesperline / 2;
+		return planes;
+	}
+	return NULL;
+}
+
+/* Conversion to one of the non base dest formats, see v4lconvert_base_fmt */
+static int v4lconvert_convert_pixfmt_ext(struct v4lconvert_data *data,
+	unsigned char *src, int src_size, unsigned char *dest, int dest_size,
+	struct v4l2_format *fmt, unsigned int dest_pix_fmt)
+{
+	unsigned int src_pix_fmt = fmt->fmt.pix.pixelformat;
+	unsigned int base_fmt = v4lconvert_base_fmt(dest_pix_fmt);
+	unsigned int width  = fmt->fmt.pix.width;
+	unsigned int height = fmt->fmt.pix.height;
+	unsigned int bytesperline = fmt->fmt.pix.bytesperline;
+	int order = v4lconvert_yuv422_order(src_pix_fmt);
+	int result, needed = 0, done = 1;
+	unsigned char *tmpbuf;
+	struct v4lconvert_planes planes_buf;
+	const struct v4lconvert_planes *planes;
+
+	/* Size of a whole frame for the src formats we convert directly */
+	switch (src_pix_fmt) {
+	case V4L2_PIX_FMT_YUYV:
+	case V4L2_PIX_FMT_YVYU:
+	case V4L2_PIX_FMT_UYVY:
+		needed = bytesperline * height;
+		break;
+	case V4L2_PIX_FMT_YUV420:
+	case V4L2_PIX_FMT_YVU420:
+		needed = width * height * 3 / 2;
+		break;
+	case V4L2_PIX_FMT_NV12:
+	case V4L2_PIX_FMT_NV21:
+		needed = bytesperline * height * 3 / 2;
+		break;
+	case V4L2_PIX_FMT_NV24:
+	case V4L2_PIX_FMT_NV42:
+		needed = bytesperline * height * 3;
+		break;
+	case V4L2_PIX_FMT_RGB24:
+		needed = width * height * 3;
+		break;
+	}
+	if (src_size < needed) {
+		V4LCONVERT_ERR("short %c%c%c%c data frame\n",
+			       src_pix_fmt & 0xff, (src_pix_fmt >> 8) & 0xff,
+			       (src_pix_fmt >> 16) & 0xff, src_pix_fmt >> 24);
+		errno = EPIPE;
+		return -1;
+	}
+
+	planes = v4lconvert_get_planes(data, fmt, src, &planes_buf);
+
+	switch (dest_pix_fmt) {
+	case V4L2_PIX_FMT_XRGB32:
+	case V4L2_PIX_FMT_ARGB32:
+		/* Convert to rgb24 in the second half of each dest line, expanding
+		   it in place */
+		if (v4lconvert_can_fuse(src_pix_fmt, dest_pix_fmt)) {
+			data->fused |= V4LCONVERT_FUSED_RGB32;
+			result = v4lconvert_convert_pixfmt(data, src, src_size,
+					dest, dest_size, fmt, V4L2_PIX_FMT_RGB24);
+			data->fused &= ~V4LCONVERT_FUSED_RGB32;
+			if (result)
+				return result;
+			fmt->fmt.pix.pixelformat = dest_pix_fmt;
+			v4lconvert_fixup_fmt(fmt);
+			return 0;
+		}
+		if (src_pix_fmt == V4L2_PIX_FMT_RGB24)
+			v4lconvert_rgb24_to_rgb32(data, src, dest, width, height);
+		else
+			done = 0;
+		break;
+
+	case V4L2_PIX_FMT_GREY:
+		switch (src_pix_fmt) {
+		case V4L2_PIX_FMT_YUYV:
+		case V4L2_PIX_FMT_YVYU:
+		case V4L2_PIX_FMT_UYVY:
+			v4lconvert_yuv422_to_grey(data, src, dest, width, height,
+						  bytesperline, order);
+			break;
+		case V4L2_PIX_FMT_YUV420:
+		case V4L2_PIX_FMT_YVU420:
+		case V4L2_PIX_FMT_YUV420M:
+		case V4L2_PIX_FMT_YVU420M:
+		case V4L2_PIX_FMT_NV12:
+		case V4L2_PIX_FMT_NV21:
+		case V4L2_PIX_FMT_NV12M:
+		case V4L2_PIX_FMT_NV21M:
+		case V4L2_PIX_FMT_NV24:
+		case V4L2_PIX_FMT_NV42:
+			v4lconvert_copy_plane(planes->plane[0], dest, width,
+					      height, planes->stride[0]);
+			break;
+		default:
+			done = 0;
+		}
+		break;
+
+	case V4L2_PIX_FMT_NV12:
+		switch (src_pix_fmt) {
+		case V4L2_PIX_FMT_YUYV:
+		case V4L2_PIX_FMT_YVYU:
+		case V4L2_PIX_FMT_UYVY:
+			v4lconvert_yuv422_to_nv12(data, src, dest, width, height,
+						  bytesperline, order);
+			break;
+		case V4L2_PIX_FMT_YUV420:
+		case V4L2_PIX_FMT_YVU420:
+		case V4L2_PIX_FMT_YUV420M:
+		case V4L2_PIX_FMT_YVU420M:
+			v4lconvert_yuv420_to_nv12(data, planes, dest, width,
+						  height);
+			break;
+		case V4L2_PIX_FMT_NV12:
+		case V4L2_PIX_FMT_NV21:
+		case V4L2_PIX_FMT_NV12M:
+		case V4L2_PIX_FMT_NV21M:
+			v4lconvert_nv12_to_nv12(planes, dest, width, height,
+					src_pix_fmt == V4L2_PIX_FMT_NV21 ||
+					src_pix_fmt == V4L2_PIX_FMT_NV21M);
+			break;
+		default:
+			done = 0;
+		}
+		break;
+
+	case V4L2_PIX_FMT_YUYV:
+		switch (src_pix_fmt) {
+		case V4L2_PIX_FMT_YUYV:
+		case V4L2_PIX_FMT_YVYU:
+		case V4L2_PIX_FMT_UYVY:
+			v4lconvert_yuv422_to_yuyv(src, dest, width, height,
+						  bytesperline, order);
+			break;
+		case V4L2_PIX_FMT_YUV420:
+		case V4L2_PIX_FMT_YVU420:
+		case V4L2_PIX_FMT_YUV420M:
+		case V4L2_PIX_FMT_YVU420M:
+			v4lconvert_yuv420_to_yuyv(data, planes, dest, width,
+						  height);
+			break;
+		case V4L2_PIX_FMT_NV12:
+		case V4L2_PIX_FMT_NV21:
+		case V4L2_PIX_FMT_NV12M:
+		case V4L2_PIX_FMT_NV21M:
+			v4lconvert_nv12_to_yuyv(data, planes, dest, width, height,
+					src_pix_fmt == V4L2_PIX_FMT_NV21 ||
+					src_pix_fmt == V4L2_PIX_FMT_NV21M);
+			break;
+		default:
+			done = 0;
 		}
-		*buf_size = needed;
+		break;
 	}
-	return *buf;
-}
 
-static void v4lconvert_10to8(void *_src, unsigned char *dst, int width, int height)
-{
-	int i;
-	uint16_t *src = _src;
-	
-	for (i = 0; i < width * height; i++) {
-		dst[i] = src[i] >> 2;
+	if (done) {
+		fmt->fmt.pix.pixelformat = dest_pix_fmt;
+		v4lconvert_fixup_fmt(fmt);
+		return 0;
 	}
-}
 
-int v4lconvert_oom_error(struct v4lconvert_data *data)
-{
-	V4LCONVERT_ERR("could not allocate memory\n");
-	errno = ENOMEM;
-	return -1;
+	/* No direct conversion, go through rgb24 resp. yuv420. The chroma
+	   planes of the latter get rounded up, for odd sizes */
+	if (base_fmt == V4L2_PIX_FMT_YUV420)
+		needed = width * height +
+			 2 * ((width + 1) / 2) * ((height + 1) / 2);
+	else
+		needed = v4lconvert_frame_size(base_fmt, width, height);
+	tmpbuf = v4lconvert_alloc_buffer(data, needed, &data->pack_pixfmt_buf,
+					 &data->pack_pixfmt_buf_size);
+	if (!tmpbuf)
+		return v4lconvert_oom_error(data);
+
+	result = v4lconvert_convert_pixfmt(data, src, src_size, tmpbuf, needed,
+					   fmt, base_fmt);
+	if (result)
+		return result;
+
+	return v4lconvert_convert_pixfmt_ext(data, tmpbuf, needed, dest,
+					     dest_size, fmt, dest_pix_fmt);
 }
 
 static int v4lconvert_convert_pixfmt(struct v4lconvert_data *data,
@@ -740,6 +1499,13 @@ static int v4lconvert_convert_pixfmt(struct v4lconvert_data *data,
 	unsigned int width  = fmt->fmt.pix.width;
 	unsigned int height = fmt->fmt.pix.height;
 	unsigned int bytesperline = fmt->fmt.pix.bytesperline;
+	struct v4lconvert_planes planes_buf;
+	const struct v4lconvert_planes *planes;
+	int vu;
+
+	if (v4lconvert_base_fmt(dest_pix_fmt))
+		return v4lconvert_convert_pixfmt_ext(data, src, src_size, dest,
+				dest_size, fmt, dest_pix_fmt);
 
 	switch (src_pix_fmt) {
 	/* JPG and variants */
@@ -795,7 +1561,8 @@ static int v4lconvert_convert_pixfmt(struct v4lconvert_data *data,
 
 		if (dest_pix_fmt != V4L2_PIX_FMT_YUV420 &&
 				dest_pix_fmt != V4L2_PIX_FMT_YVU420) {
-			d = v4lconvert_alloc_buffer(width * height * 3 / 2,
+			d = v4lconvert_alloc_buffer(data,
+					width * height * 3 / 2,
 					&data->convert_pixfmt_buf, &data->convert_pixfmt_buf_size);
 			if (!d)
 				return v4lconvert_oom_error(data);
@@ -841,7 +1608,8 @@ static int v4lconvert_convert_pixfmt(struct v4lconvert_data *data,
 #ifdef HAVE_LIBV4LCONVERT_HELPERS
 		case V4L2_PIX_FMT_OV511:
 			if (v4lconvert_helper_decompress(data, LIBV4LCONVERT_PRIV_DIR "/ov511-decomp",
-						src, src_size, d, d_size, width, height, yvu)) {
+						src, src_size, d, d_size, width, height, yvu,
+						d == dest ? NULL : &d)) {
 				/* Corrupt frame, better get another one */
 				errno = EAGAIN;
 				return -1;
@@ -849,7 +1617,8 @@ static int v4lconvert_convert_pixfmt(struct v4lconvert_data *data,
 			break;
 		case V4L2_PIX_FMT_OV518:
 			if (v4lconvert_helper_decompress(data, LIBV4LCONVERT_PRIV_DIR "/ov518-decomp",
-						src, src_size, d, d_size, width, height, yvu)) {
+						src, src_size, d, d_size, width, height, yvu,
+						d == dest ? NULL : &d)) {
 				/* Corrupt frame, better get another one */
 				errno = EAGAIN;
 				return -1;
@@ -858,14 +1627,14 @@ static int v4lconvert_convert_pixfmt(struct v4lconvert_data *data,
 #endif
 		}
 
+		/* Note the helpers may leave the frame in their shared memory,
+		   pointing d there */
 		switch (dest_pix_fmt) {
 		case V4L2_PIX_FMT_RGB24:
-			v4lconvert_yuv420_to_rgb24(data->convert_pixfmt_buf, dest, width,
-					height, yvu);
+			v4lconvert_yuv420_to_rgb24(data, d, dest, width, height, yvu);
 			break;
 		case V4L2_PIX_FMT_BGR24:
-			v4lconvert_yuv420_to_bgr24(data->convert_pixfmt_buf, dest, width,
-					height, yvu);
+			v4lconvert_yuv420_to_bgr24(data, d, dest, width, height, yvu);
 			break;
 		}
 		break;
@@ -875,10 +1644,10 @@ static int v4lconvert_convert_pixfmt(struct v4lconvert_data *data,
 	case V4L2_PIX_FMT_HM12:
 		switch (dest_pix_fmt) {
 		case V4L2_PIX_FMT_RGB24:
-			v4lconvert_hm12_to_rgb24(src, dest, width, height);
+			v4lconvert_hm12_to_rgb24(data, src, dest, width, height);
 			break;
 		case V4L2_PIX_FMT_BGR24:
-			v4lconvert_hm12_to_bgr24(src, dest, width, height);
+			v4lconvert_hm12_to_bgr24(data, src, dest, width, height);
 			break;
 		case V4L2_PIX_FMT_YUV420:
 			v4lconvert_hm12_to_yuv420(src, dest, width, height, 0);
@@ -899,22 +1668,16 @@ static int v4lconvert_convert_pixfmt(struct v4lconvert_data *data,
 #endif
 	case V4L2_PIX_FMT_SN9C2028:
 	case V4L2_PIX_FMT_SQ905C:
-	case V4L2_PIX_FMT_STV0680:
-	case V4L2_PIX_FMT_SGRBG10: { /* Not compressed but needs some shuffling */
+	case V4L2_PIX_FMT_STV0680: { /* Not compressed but needs some shuffling */
 		unsigned char *tmpbuf;
 		struct v4l2_format tmpfmt = *fmt;
 
-		tmpbuf = v4lconvert_alloc_buffer(width * height,
+		tmpbuf = v4lconvert_alloc_buffer(data, width * height,
 				&data->convert_pixfmt_buf, &data->convert_pixfmt_buf_size);
 		if (!tmpbuf)
 			return v4lconvert_oom_error(data);
 
 		switch (src_pix_fmt) {
-		case V4L2_PIX_FMT_SGRBG10:
-			v4lconvert_10to8(src, tmpbuf, width, height);
-			tmpfmt.fmt.pix.pixelformat = V4L2_PIX_FMT_SGRBG8;
-			bytesperline = width;
-			break;
 		case V4L2_PIX_FMT_SPCA561:
 			v4lconvert_decode_spca561(src, tmpbuf, width, height);
 			tmpfmt.fmt.pix.pixelformat = V4L2_PIX_FMT_SGBRG8;
@@ -975,34 +1738,73 @@ static int v4lconvert_convert_pixfmt(struct v4lconvert_data *data,
 		src_pix_fmt = tmpfmt.fmt.pix.pixelformat;
 		src = tmpbuf;
 		src_size = width * height;
+		bytesperline = width;
 		/* fall through */
 	}
 
-		/* Raw bayer formats */
+		/* Raw bayer formats, the high bit depth ones get converted to 8 bit
+		   on the fly */
 	case V4L2_PIX_FMT_SBGGR8:
 	case V4L2_PIX_FMT_SGBRG8:
 	case V4L2_PIX_FMT_SGRBG8:
 	case V4L2_PIX_FMT_SRGGB8:
-		if (src_size < (width * height)) {
+	case V4L2_PIX_FMT_SBGGR10:
+	case V4L2_PIX_FMT_SGBRG10:
+	case V4L2_PIX_FMT_SGRBG10:
+	case V4L2_PIX_FMT_SRGGB10:
+	case V4L2_PIX_FMT_SBGGR10P:
+	case V4L2_PIX_FMT_SGBRG10P:
+	case V4L2_PIX_FMT_SGRBG10P:
+	case V4L2_PIX_FMT_SRGGB10P:
+	case V4L2_PIX_FMT_SBGGR12:
+	case V4L2_PIX_FMT_SGBRG12:
+	case V4L2_PIX_FMT_SGRBG12:
+	case V4L2_PIX_FMT_SRGGB12:
+	case V4L2_PIX_FMT_SBGGR12P:
+	case V4L2_PIX_FMT_SGBRG12P:
+	case V4L2_PIX_FMT_SGRBG12P:
+	case V4L2_PIX_FMT_SRGGB12P:
+	case V4L2_PIX_FMT_SBGGR16:
+	case V4L2_PIX_FMT_SGBRG16:
+	case V4L2_PIX_FMT_SGRBG16:
+	case V4L2_PIX_FMT_SRGGB16: {
+		int line_size;
+
+		/* When binning width and height are those of the binned frame */
+		if (data->src_scale > 1) {
+			width *= data->src_scale;
+			height *= data->src_scale;
+		}
+
+		line_size = v4lconvert_bayer_line_size(src_pix_fmt, width);
+
+		if (bytesperline < line_size)
+			bytesperline = line_size;
+		if (src_size < (int)(bytesperline * (height - 1)) + line_size) {
 			V4LCONVERT_ERR("short raw bayer data frame\n");
 			errno = EPIPE;
 			result = -1;
 		}
 		switch (dest_pix_fmt) {
 		case V4L2_PIX_FMT_RGB24:
-			v4lconvert_bayer_to_rgb24(src, dest, width, height, bytesperline, src_pix_fmt);
+			if (v4lconvert_bayer_to_rgb24(data, src, dest, width, height, bytesperline, src_pix_fmt))
+				return v4lconvert_oom_error(data);
 			break;
 		case V4L2_PIX_FMT_BGR24:
-			v4lconvert_bayer_to_bgr24(src, dest, width, height, bytesperline, src_pix_fmt);
+			if (v4lconvert_bayer_to_bgr24(data, src, dest, width, height, bytesperline, src_pix_fmt))
+				return v4lconvert_oom_error(data);
 			break;
 		case V4L2_PIX_FMT_YUV420:
-			v4lconvert_bayer_to_yuv420(src, dest, width, height, bytesperline, src_pix_fmt, 0);
+			if (v4lconvert_bayer_to_yuv420(data, src, dest, width, height, bytesperline, src_pix_fmt, 0))
+				return v4lconvert_oom_error(data);
 			break;
 		case V4L2_PIX_FMT_YVU420:
-			v4lconvert_bayer_to_yuv420(src, dest, width, height, bytesperline, src_pix_fmt, 1);
+			if (v4lconvert_bayer_to_yuv420(data, src, dest, width, height, bytesperline, src_pix_fmt, 1))
+				return v4lconvert_oom_error(data);
 			break;
 		}
 		break;
+	}
 
 	case V4L2_PIX_FMT_SE401: {
 		unsigned char *d = NULL;
@@ -1014,7 +1816,7 @@ static int v4lconvert_convert_pixfmt(struct v4lconvert_data *data,
 		case V4L2_PIX_FMT_BGR24:
 		case V4L2_PIX_FMT_YUV420:
 		case V4L2_PIX_FMT_YVU420:
-			d = v4lconvert_alloc_buffer(width * height * 3,
+			d = v4lconvert_alloc_buffer(data, width * height * 3,
 					&data->convert_pixfmt_buf,
 					&data->convert_pixfmt_buf_size);
 			if (!d)
@@ -1229,11 +2031,11 @@ static int v4lconvert_convert_pixfmt(struct v4lconvert_data *data,
 		}
 		switch (dest_pix_fmt) {
 		case V4L2_PIX_FMT_RGB24:
-			v4lconvert_yuv420_to_rgb24(src, dest, width,
+			v4lconvert_yuv420_to_rgb24(data, src, dest, width,
 					height, 0);
 			break;
 		case V4L2_PIX_FMT_BGR24:
-			v4lconvert_yuv420_to_bgr24(src, dest, width,
+			v4lconvert_yuv420_to_bgr24(data, src, dest, width,
 					height, 0);
 			break;
 		case V4L2_PIX_FMT_YUV420:
@@ -1253,11 +2055,11 @@ static int v4lconvert_convert_pixfmt(struct v4lconvert_data *data,
 		}
 		switch (dest_pix_fmt) {
 		case V4L2_PIX_FMT_RGB24:
-			v4lconvert_yuv420_to_rgb24(src, dest, width,
+			v4lconvert_yuv420_to_rgb24(data, src, dest, width,
 					height, 1);
 			break;
 		case V4L2_PIX_FMT_BGR24:
-			v4lconvert_yuv420_to_bgr24(src, dest, width,
+			v4lconvert_yuv420_to_bgr24(data, src, dest, width,
 					height, 1);
 			break;
 		case V4L2_PIX_FMT_YUV420:
@@ -1269,10 +2071,97 @@ static int v4lconvert_convert_pixfmt(struct v4lconvert_data *data,
 		}
 		break;
 
+	/* multi-planar yuv 4:2:0, converted straight from the planes */
+	case V4L2_PIX_FMT_YUV420M:
+	case V4L2_PIX_FMT_YVU420M:
+		planes = v4lconvert_get_planes(data, fmt, src, &planes_buf);
+		switch (dest_pix_fmt) {
+		case V4L2_PIX_FMT_RGB24:
+			v4lconvert_yuv420_planes_to_rgb24(data, planes, dest,
+					width, height, 0);
+			break;
+		case V4L2_PIX_FMT_BGR24:
+			v4lconvert_yuv420_planes_to_rgb24(data, planes, dest,
+					width, height, 1);
+			break;
+		case V4L2_PIX_FMT_YUV420:
+			v4lconvert_yuv420_planes_to_yuv420(planes, dest,
+					width, height, 0);
+			break;
+		case V4L2_PIX_FMT_YVU420:
+			v4lconvert_yuv420_planes_to_yuv420(planes, dest,
+					width, height, 1);
+			break;
+		}
+		break;
+
+	/* yuv 4:2:0 and 4:4:4 semi planar formats */
+	case V4L2_PIX_FMT_NV12:
+	case V4L2_PIX_FMT_NV21:
+		if (src_size < (bytesperline * height * 3 / 2)) {
+			V4LCONVERT_ERR("short nv12 data frame\n");
+			errno = EPIPE;
+			result = -1;
+		}
+		/* fall through */
+	case V4L2_PIX_FMT_NV12M:
+	case V4L2_PIX_FMT_NV21M:
+		planes = v4lconvert_get_planes(data, fmt, src, &planes_buf);
+		vu = src_pix_fmt == V4L2_PIX_FMT_NV21 ||
+		     src_pix_fmt == V4L2_PIX_FMT_NV21M;
+		switch (dest_pix_fmt) {
+		case V4L2_PIX_FMT_RGB24:
+			v4lconvert_nv12_to_rgb24(data, planes, dest, width,
+						 height, vu, 0);
+			break;
+		case V4L2_PIX_FMT_BGR24:
+			v4lconvert_nv12_to_rgb24(data, planes, dest, width,
+						 height, vu, 1);
+			break;
+		case V4L2_PIX_FMT_YUV420:
+			v4lconvert_nv12_to_yuv420(data, planes, dest, width,
+						  height, vu, 0);
+			break;
+		case V4L2_PIX_FMT_YVU420:
+			v4lconvert_nv12_to_yuv420(data, planes, dest, width,
+						  height, vu, 1);
+			break;
+		}
+		break;
+
+	case V4L2_PIX_FMT_NV24:
+	case V4L2_PIX_FMT_NV42:
+		if (src_size < (bytesperline * height * 3)) {
+			V4LCONVERT_ERR("short nv24 data frame\n");
+			errno = EPIPE;
+			result = -1;
+		}
+		planes = v4lconvert_get_planes(data, fmt, src, &planes_buf);
+		vu = src_pix_fmt == V4L2_PIX_FMT_NV42;
+		switch (dest_pix_fmt) {
+		case V4L2_PIX_FMT_RGB24:
+			v4lconvert_nv24_to_rgb24(data, planes, dest, width,
+						 height, vu, 0);
+			break;
+		case V4L2_PIX_FMT_BGR24:
+			v4lconvert_nv24_to_rgb24(data, planes, dest, width,
+						 height, vu, 1);
+			break;
+		case V4L2_PIX_FMT_YUV420:
+			v4lconvert_nv24_to_yuv420(planes, dest, width, height,
+						  vu, 0);
+			break;
+		case V4L2_PIX_FMT_YVU420:
+			v4lconvert_nv24_to_yuv420(planes, dest, width, height,
+						  vu, 1);
+			break;
+		}
+		break;
+
 	case V4L2_PIX_FMT_NV16: {
 		unsigned char *tmpbuf;
 
-		tmpbuf = v4lconvert_alloc_buffer(width * height * 2,
+		tmpbuf = v4lconvert_alloc_buffer(data, width * height * 2,
 				&data->convert_pixfmt_buf, &data->convert_pixfmt_buf_size);
 		if (!tmpbuf)
 			return v4lconvert_oom_error(data);
@@ -1291,10 +2180,14 @@ static int v4lconvert_convert_pixfmt(struct v4lconvert_data *data,
 		}
 		switch (dest_pix_fmt) {
 		case V4L2_PIX_FMT_RGB24:
-			v4lconvert_yuyv_to_rgb24(src, dest, width, height, bytesperline);
+			v4lconvert_convert_packed(data, v4lconvert_yuyv_to_rgb24,
+					src, dest, width, height, bytesperline,
+					width * 3);
 			break;
 		case V4L2_PIX_FMT_BGR24:
-			v4lconvert_yuyv_to_bgr24(src, dest, width, height, bytesperline);
+			v4lconvert_convert_packed(data, v4lconvert_yuyv_to_bgr24,
+					src, dest, width, height, bytesperline,
+					width * 3);
 			break;
 		case V4L2_PIX_FMT_YUV420:
 			v4lconvert_yuyv_to_yuv420(src, dest, width, height, bytesperline, 0);
@@ -1308,7 +2201,7 @@ static int v4lconvert_convert_pixfmt(struct v4lconvert_data *data,
 	case V4L2_PIX_FMT_NV61: {
 		unsigned char *tmpbuf;
 
-		tmpbuf = v4lconvert_alloc_buffer(width * height * 2,
+		tmpbuf = v4lconvert_alloc_buffer(data, width * height * 2,
 				&data->convert_pixfmt_buf, &data->convert_pixfmt_buf_size);
 		if (!tmpbuf)
 			return v4lconvert_oom_error(data);
@@ -1328,10 +2221,14 @@ static int v4lconvert_convert_pixfmt(struct v4lconvert_data *data,
 		}
 		switch (dest_pix_fmt) {
 		case V4L2_PIX_FMT_RGB24:
-			v4lconvert_yvyu_to_rgb24(src, dest, width, height, bytesperline);
+			v4lconvert_convert_packed(data, v4lconvert_yvyu_to_rgb24,
+					src, dest, width, height, bytesperline,
+					width * 3);
 			break;
 		case V4L2_PIX_FMT_BGR24:
-			v4lconvert_yvyu_to_bgr24(src, dest, width, height, bytesperline);
+			v4lconvert_convert_packed(data, v4lconvert_yvyu_to_bgr24,
+					src, dest, width, height, bytesperline,
+					width * 3);
 			break;
 		case V4L2_PIX_FMT_YUV420:
 			/* Note we use yuyv_to_yuv420 not v4lconvert_yvyu_to_yuv420,
@@ -1352,10 +2249,14 @@ static int v4lconvert_convert_pixfmt(struct v4lconvert_data *data,
 		}
 		switch (dest_pix_fmt) {
 		case V4L2_PIX_FMT_RGB24:
-			v4lconvert_uyvy_to_rgb24(src, dest, width, height, bytesperline);
+			v4lconvert_convert_packed(data, v4lconvert_uyvy_to_rgb24,
+					src, dest, width, height, bytesperline,
+					width * 3);
 			break;
 		case V4L2_PIX_FMT_BGR24:
-			v4lconvert_uyvy_to_bgr24(src, dest, width, height, bytesperline);
+			v4lconvert_convert_packed(data, v4lconvert_uyvy_to_bgr24,
+					src, dest, width, height, bytesperline,
+					width * 3);
 			break;
 		case V4L2_PIX_FMT_YUV420:
 			v4lconvert_uyvy_to_yuv420(src, dest, width, height, bytesperline, 0);
@@ -1380,17 +2281,39 @@ static int v4lconvert_convert_pixfmt(struct v4lconvert_data *data,
 			v4lconvert_hsv_to_rgb24(src, dest, width, height, 1,
 						24, fmt->fmt.pix.hsv_enc);
 			break;
-		case V4L2_PIX_FMT_YUV420:
-			v4lconvert_hsv_to_rgb24(src, dest, width, height, 0,
+		case V4L2_PIX_FMT_YUV420: {
+			unsigned char *d = v4lconvert_alloc_buffer(data,
+					width * height * 3,
+					&data->convert_pixfmt_buf,
+					&data->convert_pixfmt_buf_size);
+
+			if (!d)
+				return v4lconvert_oom_error(data);
+
+			v4lconvert_hsv_to_rgb24(src, d, width, height, 0,
 						24, fmt->fmt.pix.hsv_enc);
-			v4lconvert_rgb24_to_yuv420(src, dest, fmt, 0, 0, 3);
+			fmt->fmt.pix.pixelformat = V4L2_PIX_FMT_RGB24;
+			v4lconvert_fixup_fmt(fmt);
+			v4lconvert_rgb24_to_yuv420(d, dest, fmt, 0, 0, 3);
 			break;
-		case V4L2_PIX_FMT_YVU420:
-			v4lconvert_hsv_to_rgb24(src, dest, width, height, 0,
+		}
+		case V4L2_PIX_FMT_YVU420: {
+			unsigned char *d = v4lconvert_alloc_buffer(data,
+					width * height * 3,
+					&data->convert_pixfmt_buf,
+					&data->convert_pixfmt_buf_size);
+
+			if (!d)
+				return v4lconvert_oom_error(data);
+
+			v4lconvert_hsv_to_rgb24(src, d, width, height, 0,
 						24, fmt->fmt.pix.hsv_enc);
-			v4lconvert_rgb24_to_yuv420(src, dest, fmt, 0, 1, 3);
+			fmt->fmt.pix.pixelformat = V4L2_PIX_FMT_RGB24;
+			v4lconvert_fixup_fmt(fmt);
+			v4lconvert_rgb24_to_yuv420(d, dest, fmt, 0, 1, 3);
 			break;
 		}
+		}
 
 		break;
 
@@ -1409,17 +2332,39 @@ static int v4lconvert_convert_pixfmt(struct v4lconvert_data *data,
 			v4lconvert_hsv_to_rgb24(src, dest, width, height, 1,
 						32, fmt->fmt.pix.hsv_enc);
 			break;
-		case V4L2_PIX_FMT_YUV420:
-			v4lconvert_hsv_to_rgb24(src, dest, width, height, 0,
+		case V4L2_PIX_FMT_YUV420: {
+			unsigned char *d = v4lconvert_alloc_buffer(data,
+					width * height * 3,
+					&data->convert_pixfmt_buf,
+					&data->convert_pixfmt_buf_size);
+
+			if (!d)
+				return v4lconvert_oom_error(data);
+
+			v4lconvert_hsv_to_rgb24(src, d, width, height, 0,
 						32, fmt->fmt.pix.hsv_enc);
-			v4lconvert_rgb24_to_yuv420(src, dest, fmt, 0, 0, 3);
+			fmt->fmt.pix.pixelformat = V4L2_PIX_FMT_RGB24;
+			v4lconvert_fixup_fmt(fmt);
+			v4lconvert_rgb24_to_yuv420(d, dest, fmt, 0, 0, 3);
 			break;
-		case V4L2_PIX_FMT_YVU420:
-			v4lconvert_hsv_to_rgb24(src, dest, width, height, 0,
+		}
+		case V4L2_PIX_FMT_YVU420: {
+			unsigned char *d = v4lconvert_alloc_buffer(data,
+					width * height * 3,
+					&data->convert_pixfmt_buf,
+					&data->convert_pixfmt_buf_size);
+
+			if (!d)
+				return v4lconvert_oom_error(data);
+
+			v4lconvert_hsv_to_rgb24(src, d, width, height, 0,
 						32, fmt->fmt.pix.hsv_enc);
-			v4lconvert_rgb24_to_yuv420(src, dest, fmt, 0, 1, 3);
+			fmt->fmt.pix.pixelformat = V4L2_PIX_FMT_RGB24;
+			v4lconvert_fixup_fmt(fmt);
+			v4lconvert_rgb24_to_yuv420(d, dest, fmt, 0, 1, 3);
 			break;
 		}
+		}
 
 		break;
 
@@ -1437,22 +2382,62 @@ static int v4lconvert_convert_pixfmt(struct v4lconvert_data *data,
 	return result;
 }
 
-int v4lconvert_convert(struct v4lconvert_data *data,
+/* Is pixelformat compressed, iow does it get decoded rather than converted */
+static int v4lconvert_compressed_fmt(unsigned int pixelformat)
+{
+	int i;
+
+	for (i = 0; i < ARRAY_SIZE(supported_src_pixfmts); i++)
+		if (supported_src_pixfmts[i].fmt == pixelformat)
+			return supported_src_pixfmts[i].bpp == 0;
+
+	return 0;
+}
+
+static uint64_t v4lconvert_stats_time(struct v4lconvert_data *data)
+{
+	struct timespec ts;
+
+	if (!data->stats_timing)
+		return 0;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/* Account the time since *t to stage, and restart *t. frame is 0 when this
+   is the second time the stage is done for the frame */
+static void v4lconvert_stats_stage(struct v4lconvert_data *data, int stage,
+		uint64_t *t, int frame)
+{
+	uint64_t now;
+
+	data->stats.stage_frames[stage] += frame;
+	if (!data->stats_timing)
+		return;
+
+	now = v4lconvert_stats_time(data);
+	data->stats.stage_ns[stage] += now - *t;
+	*t = now;
+}
+
+static int v4lconvert_convert_frame(struct v4lconvert_data *data,
 		const struct v4l2_format *src_fmt,  /* in */
 		const struct v4l2_format *dest_fmt, /* in */
 		unsigned char *src, int src_size, unsigned char *dest, int dest_size)
 {
-	int res, dest_needed, temp_needed, processing, convert = 0;
-	int rotate90, vflip, hflip, crop;
-	unsigned char *convert1_dest = dest;
-	int convert1_dest_size = dest_size;
+	int res, dest_needed, temp_needed, processing, convert = 0, fused = 0;
+	int rotate90, vflip, hflip, crop, src_scale, process_dest = 0;
 	unsigned char *convert2_src = src, *convert2_dest = dest;
 	int convert2_dest_size = dest_size;
 	unsigned char *rotate90_src = src, *rotate90_dest = dest;
 	unsigned char *flip_src = src, *flip_dest = dest;
 	unsigned char *crop_src = src;
+	unsigned char *pack_dest = NULL;
+	int pack_dest_size = 0;
 	struct v4l2_format my_src_fmt = *src_fmt;
 	struct v4l2_format my_dest_fmt = *dest_fmt;
+	uint64_t t;
 
 	processing = v4lprocessing_pre_processing(data->processing);
 	rotate90 = data->control_flags & V4LCONTROL_ROTATED_90_JPEG;
@@ -1472,21 +2457,26 @@ int v4lconvert_convert(struct v4lconvert_data *data,
 		return to_copy;
 	}
 
+	/* yuv gets converted to rgb with the coefficients for the ycbcr
+	   encoding and quantization of the src frame */
+	data->yuv_coefs = v4lconvert_get_yuv_coefs(src_fmt);
+
+	/* Decode JPEG / demosaic bayer at a reduced size when the frame gets
+	   cropped anyways. Note my_src_fmt then describes the converted frame,
+	   processing of the src frame itself is done using src_fmt. */
+	src_scale = v4lconvert_src_scale(data, &my_src_fmt,
+			my_dest_fmt.fmt.pix.width, my_dest_fmt.fmt.pix.height);
+	if (src_scale > 1) {
+		my_src_fmt.fmt.pix.width /= src_scale;
+		my_src_fmt.fmt.pix.height /= src_scale;
+		crop = my_dest_fmt.fmt.pix.width != my_src_fmt.fmt.pix.width ||
+			my_dest_fmt.fmt.pix.height != my_src_fmt.fmt.pix.height;
+	}
+
 	/* sanity check, is the dest buffer large enough? */
-	switch (my_dest_fmt.fmt.pix.pixelformat) {
-	case V4L2_PIX_FMT_RGB24:
-	case V4L2_PIX_FMT_BGR24:
-		dest_needed = my_dest_fmt.fmt.pix.width * my_dest_fmt.fmt.pix.height * 3;
-		temp_needed = my_src_fmt.fmt.pix.width * my_src_fmt.fmt.pix.height * 3;
-		break;
-	case V4L2_PIX_FMT_YUV420:
-	case V4L2_PIX_FMT_YVU420:
-		dest_needed =
-			my_dest_fmt.fmt.pix.width * my_dest_fmt.fmt.pix.height * 3 / 2;
-		temp_needed =
-			my_src_fmt.fmt.pix.width * my_src_fmt.fmt.pix.height * 3 / 2;
-		break;
-	default:
+	dest_needed = v4lconvert_frame_size(my_dest_fmt.fmt.pix.pixelformat,
+			my_dest_fmt.fmt.pix.width, my_dest_fmt.fmt.pix.height);
+	if (dest_needed < 0) {
 		V4LCONVERT_ERR("Unknown dest format in conversion\n");
 		errno = EINVAL;
 		return -1;
@@ -1500,13 +2490,18 @@ int v4lconvert_convert(struct v4lconvert_data *data,
 	}
 
 
-	/* Sometimes we need foo -> rgb -> bar as video processing (whitebalance,
-	   etc.) can only be done on rgb data */
-	if (processing && v4lconvert_processing_needs_double_conversion(
-				my_src_fmt.fmt.pix.pixelformat,
-				my_dest_fmt.fmt.pix.pixelformat))
-		convert = 2;
-	else if (my_dest_fmt.fmt.pix.pixelformat !=
+	/* Video processing (whitebalance, etc.) gets done while converting yuv to
+	   rgb, on the src frame, or otherwise on the converted frame */
+	if (processing) {
+		if (v4lconvert_processing_can_fuse(my_src_fmt.fmt.pix.pixelformat,
+					my_dest_fmt.fmt.pix.pixelformat))
+			fused = V4LCONVERT_FUSED_LUT;
+		else if (!v4lconvert_processing_on_src(
+					my_src_fmt.fmt.pix.pixelformat))
+			process_dest = 1;
+	}
+
+	if (my_dest_fmt.fmt.pix.pixelformat !=
 			my_src_fmt.fmt.pix.pixelformat ||
 		 /* Special case if we do not need to do conversion, but we
 		    are not doing any other step involving copying either,
@@ -1515,22 +2510,47 @@ int v4lconvert_convert(struct v4lconvert_data *data,
 		 (!rotate90 && !hflip && !vflip && !crop))
 		convert = 1;
 
-	/* convert_pixfmt (only if convert == 2) -> processing -> convert_pixfmt ->
-	   rotate -> flip -> crop, all steps are optional */
-	if (convert == 2) {
-		convert1_dest = v4lconvert_alloc_buffer(
-				my_src_fmt.fmt.pix.width * my_src_fmt.fmt.pix.height * 3,
-				&data->convert1_buf, &data->convert1_buf_size);
-		if (!convert1_dest)
+	/* For the most common case of an upside down cam with a format we can
+	   convert directly to rgb / bgr, flip while converting, saving a pass
+	   over the frame */
+	if (convert == 1 && (hflip || vflip) && !rotate90 &&
+			v4lconvert_can_fuse(my_src_fmt.fmt.pix.pixelformat,
+				my_dest_fmt.fmt.pix.pixelformat)) {
+		fused |= (hflip ? V4LCONVERT_FUSED_HFLIP : 0) |
+			(vflip ? V4LCONVERT_FUSED_VFLIP : 0);
+		hflip = vflip = 0;
+	}
+
+	/* rotate90, flip, crop and processing only handle the base formats, for
+	   other dest formats do all steps in the base format, and pack the result
+	   into dest at the end */
+	if ((rotate90 || hflip || vflip || crop || process_dest) &&
+			v4lconvert_base_fmt(my_dest_fmt.fmt.pix.pixelformat)) {
+		my_dest_fmt.fmt.pix.pixelformat =
+			v4lconvert_base_fmt(my_dest_fmt.fmt.pix.pixelformat);
+		v4lconvert_fixup_fmt(&my_dest_fmt);
+
+		pack_dest = dest;
+		pack_dest_size = dest_size;
+		dest_size = my_dest_fmt.fmt.pix.sizeimage;
+		dest = v4lconvert_alloc_buffer(data, dest_size, &data->pack_buf,
+					       &data->pack_buf_size);
+		if (!dest)
 			return v4lconvert_oom_error(data);
 
-		convert1_dest_size =
-			my_src_fmt.fmt.pix.width * my_src_fmt.fmt.pix.height * 3;
-		convert2_src = convert1_dest;
+		convert2_dest = rotate90_dest = flip_dest = dest;
+		convert2_dest_size = dest_size;
+		convert = my_dest_fmt.fmt.pix.pixelformat !=
+			  my_src_fmt.fmt.pix.pixelformat;
 	}
 
+	temp_needed = v4lconvert_frame_size(my_dest_fmt.fmt.pix.pixelformat,
+			my_src_fmt.fmt.pix.width, my_src_fmt.fmt.pix.height);
+
+	/* processing -> convert_pixfmt -> processing -> rotate -> flip -> crop,
+	   all steps are optional */
 	if (convert && (rotate90 || hflip || vflip || crop)) {
-		convert2_dest = v4lconvert_alloc_buffer(temp_needed,
+		convert2_dest = v4lconvert_alloc_buffer(data, temp_needed,
 				&data->convert2_buf, &data->convert2_buf_size);
 		if (!convert2_dest)
 			return v4lconvert_oom_error(data);
@@ -1540,7 +2560,7 @@ int v4lconvert_convert(struct v4lconvert_data *data,
 	}
 
 	if (rotate90 && (hflip || vflip || crop)) {
-		rotate90_dest = v4lconvert_alloc_buffer(temp_needed,
+		rotate90_dest = v4lconvert_alloc_buffer(data, temp_needed,
 				&data->rotate90_buf, &data->rotate90_buf_size);
 		if (!rotate90_dest)
 			return v4lconvert_oom_error(data);
@@ -1549,8 +2569,8 @@ int v4lconvert_convert(struct v4lconvert_data *data,
 	}
 
 	if ((vflip || hflip) && crop) {
-		flip_dest = v4lconvert_alloc_buffer(temp_needed, &data->flip_buf,
-				&data->flip_buf_size);
+		flip_dest = v4lconvert_alloc_buffer(data, temp_needed,
+				&data->flip_buf, &data->flip_buf_size);
 		if (!flip_dest)
 			return v4lconvert_oom_error(data);
 
@@ -1559,49 +2579,228 @@ int v4lconvert_convert(struct v4lconvert_data *data,
 
 	/* Done setting sources / dest and allocating intermediate buffers,
 	   real conversion / processing / ... starts here. */
-	if (convert == 2) {
-		res = v4lconvert_convert_pixfmt(data, src, src_size,
-				convert1_dest, convert1_dest_size,
-				&my_src_fmt,
-				V4L2_PIX_FMT_RGB24);
-		if (res)
-			return res;
-
-		src_size = my_src_fmt.fmt.pix.sizeimage;
-	}
-
+	t = v4lconvert_stats_time(data);
+	if (fused & V4LCONVERT_FUSED_LUT) {
+		const unsigned char *lut[3];
+
+		/* Update the lookup tables from the src frame, and apply them
+		   to each rgb line right after converting it, lut[] is in
+		   rgb order */
+		if (v4lprocessing_lookup_tables(data->processing, convert2_src,
+						src_fmt, lut)) {
+			int bgr = my_dest_fmt.fmt.pix.pixelformat ==
+				  V4L2_PIX_FMT_BGR24;
+
+			data->lut[0] = lut[bgr ? 2 : 0];
+			data->lut[1] = lut[1];
+			data->lut[2] = lut[bgr ? 0 : 2];
+		} else
+			fused &= ~V4LCONVERT_FUSED_LUT;
+	} else if (processing)
+		v4lprocessing_processing(data->processing, convert2_src, src_fmt);
 	if (processing)
-		v4lprocessing_processing(data->processing, convert2_src, &my_src_fmt);
+		v4lconvert_stats_stage(data, V4LCONVERT_STAGE_PROCESSING, &t, 1);
 
 	if (convert) {
+		int stage = v4lconvert_compressed_fmt(src_fmt->fmt.pix.pixelformat) ?
+			V4LCONVERT_STAGE_DECODE : V4LCONVERT_STAGE_CONVERT;
+
+		data->fused = fused;
+		data->src_scale = src_scale;
 		res = v4lconvert_convert_pixfmt(data, convert2_src, src_size,
 				convert2_dest, convert2_dest_size,
 				&my_src_fmt,
 				my_dest_fmt.fmt.pix.pixelformat);
-		if (res)
+		data->fused = 0;
+		data->src_scale = 0;
+		if (res) {
+			if (errno == EPIPE)
+				data->stats.short_frames++;
+			else
+				data->stats.decode_errors++;
 			return res;
+		}
+		v4lconvert_stats_stage(data, stage, &t, 1);
 
 		src_size = my_src_fmt.fmt.pix.sizeimage;
 
-		/* We call processing here again in case the source format was not
-		   rgb, but the dest is. v4lprocessing checks it self it only actually
+		/* We call processing here again in case it could not be done on
+		   the src format. v4lprocessing checks it self it only actually
 		   does the processing once per frame. */
-		if (processing)
+		if (processing) {
 			v4lprocessing_processing(data->processing, convert2_dest, &my_src_fmt);
+			v4lconvert_stats_stage(data, V4LCONVERT_STAGE_PROCESSING,
+					       &t, 0);
+		}
 	}
 
-	if (rotate90)
-		v4lconvert_rotate90(rotate90_src, rotate90_dest, &my_src_fmt);
+	if (rotate90) {
+		v4lconvert_rotate90(data, rotate90_src, rotate90_dest, &my_src_fmt);
+		v4lconvert_stats_stage(data, V4LCONVERT_STAGE_ROTATE, &t, 1);
+	}
 
-	if (hflip || vflip)
-		v4lconvert_flip(flip_src, flip_dest, &my_src_fmt, hflip, vflip);
+	if (hflip || vflip) {
+		v4lconvert_flip(data, flip_src, flip_dest, &my_src_fmt, hflip,
+				vflip);
+		v4lconvert_stats_stage(data, V4LCONVERT_STAGE_FLIP, &t, 1);
+	}
 
-	if (crop)
+	if (crop && v4lconvert_crop_only(&my_src_fmt, &my_dest_fmt))
 		v4lconvert_crop(crop_src, dest, &my_src_fmt, &my_dest_fmt);
+	else if (crop) {
+		res = v4lconvert_scale(data, crop_src, dest, &my_src_fmt,
+				&my_dest_fmt);
+		if (res)
+			return res;
+	}
+	if (crop)
+		v4lconvert_stats_stage(data, V4LCONVERT_STAGE_CROP, &t, 1);
+
+	if (pack_dest) {
+		res = v4lconvert_convert_pixfmt(data, dest, dest_size, pack_dest,
+				pack_dest_size, &my_dest_fmt,
+				dest_fmt->fmt.pix.pixelformat);
+		if (res)
+			return res;
+		v4lconvert_stats_stage(data, V4LCONVERT_STAGE_PACK, &t, 1);
+	}
 
 	return dest_needed;
 }
 
+/* Must be called with convert_lock held, the conversion buffers are shared
+   with the worker thread of v4lconvert_submit() */
+static int v4lconvert_convert_locked(struct v4lconvert_data *data,
+		const struct v4l2_format *src_fmt,  /* in */
+		const struct v4l2_format *dest_fmt, /* in */
+		unsigned char *src, int src_size, unsigned char *dest, int dest_size)
+{
+	uint64_t start = v4lconvert_stats_time(data);
+	int res;
+
+	res = v4lconvert_convert_frame(data, src_fmt, dest_fmt, src, src_size,
+				       dest, dest_size);
+	v4lconvert_release_buffers(data);
+	data->stats.frames++;
+	if (data->stats_timing)
+		data->stats.total_ns += v4lconvert_stats_time(data) - start;
+
+	return res;
+}
+
+int v4lconvert_convert(struct v4lconvert_data *data,
+		const struct v4l2_format *src_fmt,  /* in */
+		const struct v4l2_format *dest_fmt, /* in */
+		unsigned char *src, int src_size, unsigned char *dest, int dest_size)
+{
+	int res;
+
+	pthread_mutex_lock(&data->convert_lock);
+	res = v4lconvert_convert_locked(data, src_fmt, dest_fmt, src, src_size,
+					dest, dest_size);
+	pthread_mutex_unlock(&data->convert_lock);
+
+	return res;
+}
+
+int v4lconvert_convert_mplane(struct v4lconvert_data *data,
+		const struct v4l2_format *src_fmt,  /* in */
+		const struct v4l2_format *dest_fmt, /* in */
+		unsigned char *src[], const int src_size[],
+		unsigned char *dest, int dest_size)
+{
+	const struct v4l2_pix_format_mplane *pix_mp = &src_fmt->fmt.pix_mp;
+	struct v4l2_format my_src_fmt, my_dest_fmt;
+	struct v4lconvert_planes planes;
+	int i, res, lines, size = 0, no_planes = 0, uv = 1;
+
+	if (src_fmt->type != V4L2_BUF_TYPE_VIDEO_CAPTURE_MPLANE ||
+			pix_mp->num_planes < 1 ||
+			pix_mp->num_planes > VIDEO_MAX_PLANES) {
+		V4LCONVERT_ERR("invalid multi-planar src format\n");
+		errno = EINVAL;
+		return -1;
+	}
+
+	v4lconvert_mplane_to_pix(src_fmt, &my_src_fmt);
+	if (dest_fmt->type == V4L2_BUF_TYPE_VIDEO_CAPTURE_MPLANE)
+		v4lconvert_mplane_to_pix(dest_fmt, &my_dest_fmt);
+	else
+		my_dest_fmt = *dest_fmt;
+
+	/* Formats with a single plane are no different from single-planar */
+	if (pix_mp->num_planes == 1)
+		return v4lconvert_convert(data, &my_src_fmt, &my_dest_fmt,
+				src[0], src_size[0], dest, dest_size);
+
+	/* Just like v4lconvert_convert(), when the app asks for a format we
+	   cannot convert to return an unprocessed copy of the frame, with the
+	   planes one after the other */
+	if (!v4lconvert_supported_dst_format(my_dest_fmt.fmt.pix.pixelformat)) {
+		for (i = 0; i < pix_mp->num_planes && size < dest_size; i++) {
+			int to_copy = MIN(src_size[i], dest_size - size);
+
+			memcpy(dest + size, src[i], to_copy);
+			size += to_copy;
+		}
+		return size;
+	}
+
+	switch (pix_mp->pixelformat) {
+	case V4L2_PIX_FMT_NV12M:
+	case V4L2_PIX_FMT_NV21M:
+		no_planes = 2;
+		break;
+	case V4L2_PIX_FMT_YVU420M:
+		uv = 2;
+		/* fall through */
+	case V4L2_PIX_FMT_YUV420M:
+		no_planes = 3;
+		break;
+	}
+	if (pix_mp->num_planes != no_planes) {
+		V4LCONVERT_ERR("unsupported multi-planar src format\n");
+		errno = EINVAL;
+		return -1;
+	}
+
+	for (i = 0; i < pix_mp->num_planes; i++) {
+		lines = i ? pix_mp->height / 2 : pix_mp->height;
+		if (src_size[i] < (int)pix_mp->plane_fmt[i].bytesperline * lines) {
+			V4LCONVERT_ERR("short multi-planar data frame\n");
+			pthread_mutex_lock(&data->convert_lock);
+			data->stats.frames++;
+			data->stats.short_frames++;
+			pthread_mutex_unlock(&data->convert_lock);
+			errno = EPIPE;
+			return -1;
+		}
+		size += src_size[i];
+	}
+
+	/* The chroma plane(s) follow the luma plane, put U before V */
+	planes.plane[0] = src[0];
+	planes.stride[0] = pix_mp->plane_fmt[0].bytesperline;
+	planes.plane[uv] = src[1];
+	planes.stride[uv] = pix_mp->plane_fmt[1].bytesperline;
+	if (pix_mp->num_planes == 3) {
+		planes.plane[3 - uv] = src[2];
+		planes.stride[3 - uv] = pix_mp->plane_fmt[2].bytesperline;
+	} else {
+		planes.plane[2] = NULL;
+		planes.stride[2] = 0;
+	}
+
+	pthread_mutex_lock(&data->convert_lock);
+	data->src_planes = &planes;
+	res = v4lconvert_convert_locked(data, &my_src_fmt, &my_dest_fmt, src[0],
+					size, dest, dest_size);
+	data->src_planes = NULL;
+	pthread_mutex_unlock(&data->convert_lock);
+
+	return res;
+}
+
 const char *v4lconvert_get_error_message(struct v4lconvert_data *data)
 {
 	return data->error_msg;
@@ -1615,8 +2814,8 @@ static void v4lconvert_get_framesizes(struct v4lconvert_data *data,
 
 	for (i = 0; ; i++) {
 		frmsize.index = i;
-		if (data->dev_ops->ioctl(data->dev_ops_priv, data->fd,
-				VIDIOC_ENUM_FRAMESIZES, &frmsize))
+		if (v4lconvert_enum_ioctl(data, VIDIOC_ENUM_FRAMESIZES,
+				&frmsize))
 			break;
 
 		/* We got a framesize, check we don't have the same one already */
@@ -1648,7 +2847,9 @@ static void v4lconvert_get_framesizes(struct v4lconvert_data *data,
 				return;
 			}
 			data->framesizes[data->no_framesizes].type = frmsize.type;
-			data->framesize_supported_src_formats[data->no_framesizes] = 1ULL << index;
+			V4LCONVERT_SRC_FORMAT_SET(
+				data->framesize_supported_src_formats[data->no_framesizes],
+				index);
 
 			switch (frmsize.type) {
 			case V4L2_FRMSIZE_TYPE_DISCRETE:
@@ -1661,7 +2862,8 @@ static void v4lconvert_get_framesizes(struct v4lconvert_data *data,
 			}
 			data->no_framesizes++;
 		} else {
-			data->framesize_supported_src_formats[j] |= 1ULL << index;
+			V4LCONVERT_SRC_FORMAT_SET(
+				data->framesize_supported_src_formats[j], index);
 		}
 	}
 }
@@ -1674,8 +2876,8 @@ int v4lconvert_enum_framesizes(struct v4lconvert_data *data,
 			errno = EINVAL;
 			return -1;
 		}
-		return data->dev_ops->ioctl(data->dev_ops_priv, data->fd,
-				VIDIOC_ENUM_FRAMESIZES, frmsize);
+		return v4lconvert_enum_ioctl(data, VIDIOC_ENUM_FRAMESIZES,
+				frmsize);
 	}
 
 	if (frmsize->index >= data->no_framesizes) {
@@ -1712,8 +2914,8 @@ int v4lconvert_enum_frameintervals(struct v4lconvert_data *data,
 			errno = EINVAL;
 			return -1;
 		}
-		res = data->dev_ops->ioctl(data->dev_ops_priv, data->fd,
-				VIDIOC_ENUM_FRAMEINTERVALS, frmival);
+		res = v4lconvert_enum_ioctl(data, VIDIOC_ENUM_FRAMEINTERVALS,
+				frmival);
 		if (res)
 			V4LCONVERT_ERR("%s\n", strerror(errno));
 		return res;
@@ -1758,8 +2960,7 @@ int v4lconvert_enum_frameintervals(struct v4lconvert_data *data,
 	frmival->pixel_format = src_fmt.fmt.pix.pixelformat;
 	frmival->width = src_fmt.fmt.pix.width;
 	frmival->height = src_fmt.fmt.pix.height;
-	res = data->dev_ops->ioctl(data->dev_ops_priv, data->fd,
-			VIDIOC_ENUM_FRAMEINTERVALS, frmival);
+	res = v4lconvert_enum_ioctl(data, VIDIOC_ENUM_FRAMEINTERVALS, frmival);
 	if (res) {
 		int dest_pixfmt = dest_fmt.fmt.pix.pixelformat;
 		int src_pixfmt  = src_fmt.fmt.pix.pixelformat;
@@ -1826,3 +3027,35 @@ void v4lconvert_set_fps(struct v4lconvert_data *data, int fps)
 {
 	data->fps = fps;
 }
+
+void v4lconvert_get_stats(struct v4lconvert_data *data,
+		struct v4lconvert_stats *stats)
+{
+	*stats = data->stats;
+}
+
+void v4lconvert_reset_stats(struct v4lconvert_data *data)
+{
+	memset(&data->stats, 0, sizeof(data->stats));
+}
+
+void v4lconvert_set_stats_timing(struct v4lconvert_data *data, int enable)
+{
+	data->stats_timing = enable;
+}
+
+int v4lconvert_get_threads(struct v4lconvert_data *data)
+{
+	return v4lconvert_threads_get_count(data->threads);
+}
+
+int v4lconvert_set_threads(struct v4lconvert_data *data, int threads)
+{
+	if (v4lconvert_threads_set_count(data->threads, threads)) {
+		V4LCONVERT_ERR("starting conversion threads: %s\n",
+				strerror(errno));
+		return -1;
+	}
+
+	return 0;
+}
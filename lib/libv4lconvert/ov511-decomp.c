@@ -444,13 +444,11 @@ Decompress420HiNoMMX(unsigned char *pIn,
 	static inline void
 make_8x8(unsigned char *pIn, unsigned char *pOut, int w)
 {
-	unsigned char *pOut1 = pOut;
-	int x, y;
+	int y;
 
 	for (y = 0; y < 8; y++) {
-		pOut1 = pOut;
-		for (x = 0; x < 8; x++)
-			*pOut1++ = *pIn++;
+		memcpy(pOut, pIn, 8);
+		pIn += 8;
 		pOut += w;
 	}
 }
@@ -630,6 +628,12 @@ int main(int argc, char *argv[])
 		if (v4lconvert_helper_read(STDIN_FILENO, &src_size, sizeof(int), argv[0]))
 			return 1; /* Erm, no way to recover without loosing sync with libv4l */
 
+		/* libv4l asking us to switch to the shared memory protocol */
+		if (width == V4LCONVERT_HELPER_SHM_MAGIC) {
+			v4lconvert_helper_shm(v4lconvert_ov511_to_yuv420, argv[0]);
+			continue;
+		}
+
 		if (src_size > sizeof(src_buf)) {
 			fprintf(stderr, "%s: error: src_buf too small, need: %d\n",
 					argv[0], src_size);
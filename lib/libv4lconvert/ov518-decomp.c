@@ -1444,6 +1444,12 @@ int main(int argc, char *argv[])
 		if (v4lconvert_helper_read(STDIN_FILENO, &src_size, sizeof(int), argv[0]))
 			return 1; /* Erm, no way to recover without loosing sync with libv4l */
 
+		/* libv4l asking us to switch to the shared memory protocol */
+		if (width == V4LCONVERT_HELPER_SHM_MAGIC) {
+			v4lconvert_helper_shm(v4lconvert_ov518_to_yuv420, argv[0]);
+			continue;
+		}
+
 		if (src_size > sizeof(src_buf)) {
 			fprintf(stderr, "%s: error: src_buf too small, need: %d\n",
 					argv[0], src_size);
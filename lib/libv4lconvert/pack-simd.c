@@ -0,0 +1,550 @@
+/*
+
+# SIMD versions of the pixel (re)packing routines
+
+# These produce the exact same output as the plain C code in rgbyuv.c, which
+# stays the reference implementation and handles the left-over pixels at the
+# end of each line.
+
+# This program is free software; you can redistribute it and/or modify
+# it under the terms of the GNU Lesser General Public License as published by
+# the Free Software Foundation; either version 2.1 of the License, or
+# (at your option) any later version.
+#
+# This program is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU Lesser General Public License for more details.
+#
+# You should have received a copy of the GNU Lesser General Public License
+# along with this program; if not, write to the Free Software
+# Foundation, Inc., 51 Franklin Street, Suite 500, Boston, MA  02110-1335  USA
+
+ */
+
+#include "libv4lconvert-priv.h"
+#include "simd-priv.h"
+
+#ifdef HAVE_V4LCONVERT_X86_SIMD
+
+/* Shuffle masks gathering the Y values of 8 packed yuv 4:2:2 pixels in the
+   low half and their U V pairs in the high half, per byte order */
+static inline V4LCONVERT_TARGET("ssse3") __m128i yuv422_split_mask(int order)
+{
+	switch (order) {
+	case V4LCONVERT_ORDER_YVYU:
+		return _mm_setr_epi8(0, 2, 4, 6, 8, 10, 12, 14,
+				     3, 1, 7, 5, 11, 9, 15, 13);
+	case V4LCONVERT_ORDER_UYVY:
+		return _mm_setr_epi8(1, 3, 5, 7, 9, 11, 13, 15,
+				     0, 2, 4, 6, 8, 10, 12, 14);
+	default:
+		return _mm_setr_epi8(0, 2, 4, 6, 8, 10, 12, 14,
+				     1, 3, 5, 7, 9, 11, 13, 15);
+	}
+}
+
+static V4LCONVERT_TARGET("ssse3") int yuv422_to_y_ssse3(
+		const unsigned char *src, unsigned char *ydest, int width,
+		int order)
+{
+	const __m128i mask = yuv422_split_mask(order);
+	int x;
+
+	for (x = 0; x + 16 <= width; x += 16) {
+		__m128i a = _mm_shuffle_epi8(
+			_mm_loadu_si128((const __m128i *)src), mask);
+		__m128i b = _mm_shuffle_epi8(
+			_mm_loadu_si128((const __m128i *)(src + 16)), mask);
+
+		_mm_storeu_si128((__m128i *)ydest, _mm_unpacklo_epi64(a, b));
+		src += 32;
+		ydest += 16;
+	}
+
+	return x;
+}
+
+/* (a + b) / 2 rounded down, as done by the plain C code */
+static inline V4LCONVERT_TARGET("ssse3") __m128i avg_down_ssse3(__m128i a,
+		__m128i b)
+{
+	return _mm_sub_epi8(_mm_avg_epu8(a, b), _mm_and_si128(
+		_mm_xor_si128(a, b), _mm_set1_epi8(1)));
+}
+
+static V4LCONVERT_TARGET("ssse3") int yuv422_to_uv_ssse3(
+		const unsigned char *src0, const unsigned char *src1,
+		unsigned char *uvdest, int width, int order)
+{
+	const __m128i mask = yuv422_split_mask(order);
+	int x;
+
+	for (x = 0; x + 16 <= width; x += 16) {
+		__m128i a0 = _mm_shuffle_epi8(
+			_mm_loadu_si128((const __m128i *)src0), mask);
+		__m128i b0 = _mm_shuffle_epi8(
+			_mm_loadu_si128((const __m128i *)(src0 + 16)), mask);
+		__m128i a1 = _mm_shuffle_epi8(
+			_mm_loadu_si128((const __m128i *)src1), mask);
+		__m128i b1 = _mm_shuffle_epi8(
+			_mm_loadu_si128((const __m128i *)(src1 + 16)), mask);
+
+		_mm_storeu_si128((__m128i *)uvdest, avg_down_ssse3(
+			_mm_unpackhi_epi64(a0, b0), _mm_unpackhi_epi64(a1, b1)));
+		src0 += 32;
+		src1 += 32;
+		uvdest += 16;
+	}
+
+	return x;
+}
+
+static V4LCONVERT_TARGET("ssse3") int split_uv_ssse3(
+		const unsigned char *uvsrc, unsigned char *udest,
+		unsigned char *vdest, int count)
+{
+	const __m128i lo_mask = _mm_set1_epi16(0x00ff);
+	int x;
+
+	for (x = 0; x + 16 <= count; x += 16) {
+		__m128i a = _mm_loadu_si128((const __m128i *)uvsrc);
+		__m128i b = _mm_loadu_si128((const __m128i *)(uvsrc + 16));
+
+		_mm_storeu_si128((__m128i *)udest, _mm_packus_epi16(
+			_mm_and_si128(a, lo_mask), _mm_and_si128(b, lo_mask)));
+		_mm_storeu_si128((__m128i *)vdest, _mm_packus_epi16(
+			_mm_srli_epi16(a, 8), _mm_srli_epi16(b, 8)));
+		uvsrc += 32;
+		udest += 16;
+		vdest += 16;
+	}
+
+	return x;
+}
+
+static V4LCONVERT_TARGET("ssse3") int merge_uv_ssse3(
+		const unsigned char *usrc, const unsigned char *vsrc,
+		unsigned char *uvdest, int count)
+{
+	int x;
+
+	for (x = 0; x + 16 <= count; x += 16) {
+		__m128i u = _mm_loadu_si128((const __m128i *)usrc);
+		__m128i v = _mm_loadu_si128((const __m128i *)vsrc);
+
+		_mm_storeu_si128((__m128i *)uvdest, _mm_unpacklo_epi8(u, v));
+		_mm_storeu_si128((__m128i *)(uvdest + 16),
+				 _mm_unpackhi_epi8(u, v));
+		usrc += 16;
+		vsrc += 16;
+		uvdest += 32;
+	}
+
+	return x;
+}
+
+/* Interleave 16 Y values with 8 U V pairs as 16 yuyv pixels */
+static inline V4LCONVERT_TARGET("ssse3") void store_yuyv_ssse3(
+		unsigned char *dest, __m128i y, __m128i uv)
+{
+	_mm_storeu_si128((__m128i *)dest, _mm_unpacklo_epi8(y, uv));
+	_mm_storeu_si128((__m128i *)(dest + 16), _mm_unpackhi_epi8(y, uv));
+}
+
+static V4LCONVERT_TARGET("ssse3") int yuv420_to_yuyv_ssse3(
+		const unsigned char *ysrc, const unsigned char *usrc,
+		const unsigned char *vsrc, unsigned char *dest, int width)
+{
+	int x;
+
+	for (x = 0; x + 16 <= width; x += 16) {
+		store_yuyv_ssse3(dest, _mm_loadu_si128((const __m128i *)ysrc),
+			_mm_unpacklo_epi8(
+				_mm_loadl_epi64((const __m128i *)usrc),
+				_mm_loadl_epi64((const __m128i *)vsrc)));
+		ysrc += 16;
+		usrc += 8;
+		vsrc += 8;
+		dest += 32;
+	}
+
+	return x;
+}
+
+static V4LCONVERT_TARGET("ssse3") int nv12_to_yuyv_ssse3(
+		const unsigned char *ysrc, const unsigned char *uvsrc,
+		unsigned char *dest, int width, int vu)
+{
+	const __m128i swap = _mm_setr_epi8(1, 0, 3, 2, 5, 4, 7, 6,
+					   9, 8, 11, 10, 13, 12, 15, 14);
+	int x;
+
+	for (x = 0; x + 16 <= width; x += 16) {
+		__m128i uv = _mm_loadu_si128((const __m128i *)uvsrc);
+
+		if (vu)
+			uv = _mm_shuffle_epi8(uv, swap);
+		store_yuyv_ssse3(dest, _mm_loadu_si128((const __m128i *)ysrc),
+				 uv);
+		ysrc += 16;
+		uvsrc += 16;
+		dest += 32;
+	}
+
+	return x;
+}
+
+/* Note this may be used to expand a line in place, with src pointing width
+   bytes into dest, this works as the 48 src bytes get loaded before storing
+   64 bytes, which never reach src bytes which have not been loaded yet */
+static V4LCONVERT_TARGET("ssse3") int rgb24_to_rgb32_ssse3(
+		const unsigned char *src, unsigned char *dest, int width)
+{
+	const __m128i mask = _mm_setr_epi8(-1, 0, 1, 2, -1, 3, 4, 5,
+					   -1, 6, 7, 8, -1, 9, 10, 11);
+	const __m128i alpha = _mm_set1_epi32(0xff);
+	int x;
+
+	for (x = 0; x + 16 <= width; x += 16) {
+		__m128i a = _mm_loadu_si128((const __m128i *)src);
+		__m128i b = _mm_loadu_si128((const __m128i *)(src + 16));
+		__m128i c = _mm_loadu_si128((const __m128i *)(src + 32));
+
+		_mm_storeu_si128((__m128i *)dest, _mm_or_si128(alpha,
+			_mm_shuffle_epi8(a, mask)));
+		_mm_storeu_si128((__m128i *)(dest + 16), _mm_or_si128(alpha,
+			_mm_shuffle_epi8(_mm_alignr_epi8(b, a, 12), mask)));
+		_mm_storeu_si128((__m128i *)(dest + 32), _mm_or_si128(alpha,
+			_mm_shuffle_epi8(_mm_alignr_epi8(c, b, 8), mask)));
+		_mm_storeu_si128((__m128i *)(dest + 48), _mm_or_si128(alpha,
+			_mm_shuffle_epi8(_mm_srli_si128(c, 4), mask)));
+		src += 48;
+		dest += 64;
+	}
+
+	return x;
+}
+
+static V4LCONVERT_TARGET("avx2") int split_uv_avx2(
+		const unsigned char *uvsrc, unsigned char *udest,
+		unsigned char *vdest, int count)
+{
+	const __m256i lo_mask = _mm256_set1_epi16(0x00ff);
+	int x;
+
+	for (x = 0; x + 32 <= count; x += 32) {
+		__m256i a = _mm256_loadu_si256((const __m256i *)uvsrc);
+		__m256i b = _mm256_loadu_si256((const __m256i *)(uvsrc + 32));
+
+		/* packus works per lane, the permute puts the quadwords back
+		   in order */
+		_mm256_storeu_si256((__m256i *)udest, _mm256_permute4x64_epi64(
+			_mm256_packus_epi16(_mm256_and_si256(a, lo_mask),
+					    _mm256_and_si256(b, lo_mask)), 0xd8));
+		_mm256_storeu_si256((__m256i *)vdest, _mm256_permute4x64_epi64(
+			_mm256_packus_epi16(_mm256_srli_epi16(a, 8),
+					    _mm256_srli_epi16(b, 8)), 0xd8));
+		uvsrc += 64;
+		udest += 32;
+		vdest += 32;
+	}
+
+	return x;
+}
+
+#endif /* HAVE_V4LCONVERT_X86_SIMD */
+
+#ifdef HAVE_V4LCONVERT_NEON
+
+/* Get the even Y, U, odd Y and V values of 16 packed yuv 4:2:2 pixel pairs */
+static inline void yuv422_load_neon(const unsigned char *src, int order,
+		uint8x16_t *ye, uint8x16_t *u, uint8x16_t *yo, uint8x16_t *v)
+{
+	uint8x16x4_t in = vld4q_u8(src);
+
+	switch (order) {
+	case V4LCONVERT_ORDER_YVYU:
+		*ye = in.val[0]; *v = in.val[1]; *yo = in.val[2]; *u = in.val[3];
+		break;
+	case V4LCONVERT_ORDER_UYVY:
+		*u = in.val[0]; *ye = in.val[1]; *v = in.val[2]; *yo = in.val[3];
+		break;
+	default:
+		*ye = in.val[0]; *u = in.val[1]; *yo = in.val[2]; *v = in.val[3];
+		break;
+	}
+}
+
+static int yuv422_to_y_neon(const unsigned char *src, unsigned char *ydest,
+		int width, int order)
+{
+	uint8x16x2_t y;
+	uint8x16_t u, v;
+	int x;
+
+	for (x = 0; x + 32 <= width; x += 32) {
+		yuv422_load_neon(src, order, &y.val[0], &u, &y.val[1], &v);
+		vst2q_u8(ydest, y);
+		src += 64;
+		ydest += 32;
+	}
+
+	return x;
+}
+
+static int yuv422_to_uv_neon(const unsigned char *src0,
+		const unsigned char *src1, unsigned char *uvdest, int width,
+		int order)
+{
+	uint8x16_t ye, yo, u0, v0, u1, v1;
+	uint8x16x2_t uv;
+	int x;
+
+	for (x = 0; x + 32 <= width; x += 32) {
+		yuv422_load_neon(src0, order, &ye, &u0, &yo, &v0);
+		yuv422_load_neon(src1, order, &ye, &u1, &yo, &v1);
+		/* vhaddq rounds down, like the plain C code */
+		uv.val[0] = vhaddq_u8(u0, u1);
+		uv.val[1] = vhaddq_u8(v0, v1);
+		vst2q_u8(uvdest, uv);
+		src0 += 64;
+		src1 += 64;
+		uvdest += 32;
+	}
+
+	return x;
+}
+
+static int split_uv_neon(const unsigned char *uvsrc, unsigned char *udest,
+		unsigned char *vdest, int count)
+{
+	int x;
+
+	for (x = 0; x + 16 <= count; x += 16) {
+		uint8x16x2_t c = vld2q_u8(uvsrc);
+
+		vst1q_u8(udest, c.val[0]);
+		vst1q_u8(vdest, c.val[1]);
+		uvsrc += 32;
+		udest += 16;
+		vdest += 16;
+	}
+
+	return x;
+}
+
+static int merge_uv_neon(const unsigned char *usrc,
+		const unsigned char *vsrc, unsigned char *uvdest, int count)
+{
+	uint8x16x2_t c;
+	int x;
+
+	for (x = 0; x + 16 <= count; x += 16) {
+		c.val[0] = vld1q_u8(usrc);
+		c.val[1] = vld1q_u8(vsrc);
+		vst2q_u8(uvdest, c);
+		usrc += 16;
+		vsrc += 16;
+		uvdest += 32;
+	}
+
+	return x;
+}
+
+static int yuv420_to_yuyv_neon(const unsigned char *ysrc,
+		const unsigned char *usrc, const unsigned char *vsrc,
+		unsigned char *dest, int width)
+{
+	uint8x16x2_t y;
+	uint8x16x4_t out;
+	int x;
+
+	for (x = 0; x + 32 <= width; x += 32) {
+		y = vld2q_u8(ysrc);
+		out.val[0] = y.val[0];
+		out.val[1] = vld1q_u8(usrc);
+		out.val[2] = y.val[1];
+		out.val[3] = vld1q_u8(vsrc);
+		vst4q_u8(dest, out);
+		ysrc += 32;
+		usrc += 16;
+		vsrc += 16;
+		dest += 64;
+	}
+
+	return x;
+}
+
+static int nv12_to_yuyv_neon(const unsigned char *ysrc,
+		const unsigned char *uvsrc, unsigned char *dest, int width,
+		int vu)
+{
+	uint8x16x2_t y, uv;
+	uint8x16x4_t out;
+	int x;
+
+	for (x = 0; x + 32 <= width; x += 32) {
+		y = vld2q_u8(ysrc);
+		uv = vld2q_u8(uvsrc);
+		out.val[0] = y.val[0];
+		out.val[1] = uv.val[vu];
+		out.val[2] = y.val[1];
+		out.val[3] = uv.val[!vu];
+		vst4q_u8(dest, out);
+		ysrc += 32;
+		uvsrc += 32;
+		dest += 64;
+	}
+
+	return x;
+}
+
+/* In place use is fine, see rgb24_to_rgb32_ssse3 */
+static int rgb24_to_rgb32_neon(const unsigned char *src, unsigned char *dest,
+		int width)
+{
+	uint8x16x3_t in;
+	uint8x16x4_t out;
+	int x;
+
+	out.val[0] = vdupq_n_u8(0xff);
+	for (x = 0; x + 16 <= width; x += 16) {
+		in = vld3q_u8(src);
+		out.val[1] = in.val[0];
+		out.val[2] = in.val[1];
+		out.val[3] = in.val[2];
+		vst4q_u8(dest, out);
+		src += 48;
+		dest += 64;
+	}
+
+	return x;
+}
+
+#endif /* HAVE_V4LCONVERT_NEON */
+
+int v4lconvert_simd_yuv422_to_y(int cpu_flags, const unsigned char *src,
+		unsigned char *ydest, int width, int order)
+{
+	int x = 0;
+
+#ifdef HAVE_V4LCONVERT_X86_SIMD
+	if (cpu_flags & V4LCONVERT_CPU_SSSE3)
+		x = yuv422_to_y_ssse3(src, ydest, width, order);
+#endif
+#ifdef HAVE_V4LCONVERT_NEON
+	if (cpu_flags & V4LCONVERT_CPU_NEON)
+		x = yuv422_to_y_neon(src, ydest, width, order);
+#endif
+
+	return x;
+}
+
+int v4lconvert_simd_yuv422_to_uv(int cpu_flags, const unsigned char *src0,
+		const unsigned char *src1, unsigned char *uvdest, int width,
+		int order)
+{
+	int x = 0;
+
+#ifdef HAVE_V4LCONVERT_X86_SIMD
+	if (cpu_flags & V4LCONVERT_CPU_SSSE3)
+		x = yuv422_to_uv_ssse3(src0, src1, uvdest, width, order);
+#endif
+#ifdef HAVE_V4LCONVERT_NEON
+	if (cpu_flags & V4LCONVERT_CPU_NEON)
+		x = yuv422_to_uv_neon(src0, src1, uvdest, width, order);
+#endif
+
+	return x;
+}
+
+int v4lconvert_simd_split_uv(int cpu_flags, const unsigned char *uvsrc,
+		unsigned char *udest, unsigned char *vdest, int count)
+{
+	int x = 0;
+
+#ifdef HAVE_V4LCONVERT_X86_SIMD
+	if (cpu_flags & V4LCONVERT_CPU_AVX2)
+		x = split_uv_avx2(uvsrc, udest, vdest, count);
+	if (cpu_flags & V4LCONVERT_CPU_SSSE3)
+		x += split_uv_ssse3(uvsrc + x * 2, udest + x, vdest + x,
+				    count - x);
+#endif
+#ifdef HAVE_V4LCONVERT_NEON
+	if (cpu_flags & V4LCONVERT_CPU_NEON)
+		x = split_uv_neon(uvsrc, udest, vdest, count);
+#endif
+
+	return x;
+}
+
+int v4lconvert_simd_merge_uv(int cpu_flags, const unsigned char *usrc,
+		const unsigned char *vsrc, unsigned char *uvdest, int count)
+{
+	int x = 0;
+
+#ifdef HAVE_V4LCONVERT_X86_SIMD
+	if (cpu_flags & V4LCONVERT_CPU_SSSE3)
+		x = merge_uv_ssse3(usrc, vsrc, uvdest, count);
+#endif
+#ifdef HAVE_V4LCONVERT_NEON
+	if (cpu_flags & V4LCONVERT_CPU_NEON)
+		x = merge_uv_neon(usrc, vsrc, uvdest, count);
+#endif
+
+	return x;
+}
+
+int v4lconvert_simd_yuv420_to_yuyv(int cpu_flags, const unsigned char *ysrc,
+		const unsigned char *usrc, const unsigned char *vsrc,
+		unsigned char *dest, int width)
+{
+	int x = 0;
+
+#ifdef HAVE_V4LCONVERT_X86_SIMD
+	if (cpu_flags & V4LCONVERT_CPU_SSSE3)
+		x = yuv420_to_yuyv_ssse3(ysrc, usrc, vsrc, dest, width);
+#endif
+#ifdef HAVE_V4LCONVERT_NEON
+	if (cpu_flags & V4LCONVERT_CPU_NEON)
+		x = yuv420_to_yuyv_neon(ysrc, usrc, vsrc, dest, width);
+#endif
+
+	return x;
+}
+
+int v4lconvert_simd_nv12_to_yuyv(int cpu_flags, const unsigned char *ysrc,
+		const unsigned char *uvsrc, unsigned char *dest, int width,
+		int vu)
+{
+	int x = 0;
+
+#ifdef HAVE_V4LCONVERT_X86_SIMD
+	if (cpu_flags & V4LCONVERT_CPU_SSSE3)
+		x = nv12_to_yuyv_ssse3(ysrc, uvsrc, dest, width, vu);
+#endif
+#ifdef HAVE_V4LCONVERT_NEON
+	if (cpu_flags & V4LCONVERT_CPU_NEON)
+		x = nv12_to_yuyv_neon(ysrc, uvsrc, dest, width, vu);
+#endif
+
+	return x;
+}
+
+int v4lconvert_simd_rgb24_to_rgb32(int cpu_flags, const unsigned char *src,
+		unsigned char *dest, int width)
+{
+	int x = 0;
+
+#ifdef HAVE_V4LCONVERT_X86_SIMD
+	if (cpu_flags & V4LCONVERT_CPU_SSSE3)
+		x = rgb24_to_rgb32_ssse3(src, dest, width);
+#endif
+#ifdef HAVE_V4LCONVERT_NEON
+	if (cpu_flags & V4LCONVERT_CPU_NEON)
+		x = rgb24_to_rgb32_neon(src, dest, width);
+#endif
+
+	return x;
+}
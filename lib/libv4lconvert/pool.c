@@ -0,0 +1,242 @@
+/*
+
+# Process wide pool of scratch buffers, shared by all v4lconvert instances
+
+# This program is free software; you can redistribute it and/or modify
+# it under the terms of the GNU Lesser General Public License as published by
+# the Free Software Foundation; either version 2.1 of the License, or
+# (at your option) any later version.
+#
+# This program is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU Lesser General Public License for more details.
+#
+# You should have received a copy of the GNU Lesser General Public License
+# along with this program; if not, write to the Free Software
+# Foundation, Inc., 51 Franklin Street, Suite 500, Boston, MA  02110-1335  USA
+
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include "libv4lconvert-priv.h"
+
+/* There are 2 size classes per power of 2, 2^n and 1.5 * 2^n bytes, so at
+   most 1/3 of a buffer is unused. The smallest class is 4 KiB, the largest
+   1.5 GiB. Buffers below 64 KiB are not worth an mmap and get malloc-ed,
+   but are kept in the pool all the same, so that line buffers and the
+   scratch buffers of small frames do not cost a malloc per frame. */
+#define V4LCONVERT_POOL_MIN_SHIFT 12
+#define V4LCONVERT_POOL_CLASSES 38
+#define V4LCONVERT_POOL_MMAP_SIZE (64 * 1024)
+
+/* Free buffers kept per size class, more get freed resp. unmapped */
+#define V4LCONVERT_POOL_KEEP 16
+
+#define V4LCONVERT_POOL_THP_SIZE (2 * 1024 * 1024)
+
+enum v4lconvert_hugepages {
+	V4LCONVERT_HUGEPAGES_OFF,
+	V4LCONVERT_HUGEPAGES_TRANSPARENT,
+	V4LCONVERT_HUGEPAGES_EXPLICIT,
+};
+
+/* Each buffer starts with a header recording its size class, so that
+   v4lconvert_pool_put() does not need to be told the size. The header is
+   padded to a cache line, keeping the buffer itself aligned. Free buffers
+   are linked through it. */
+union v4lconvert_pool_hdr {
+	struct {
+		union v4lconvert_pool_hdr *next;
+		int class;
+	} h;
+	unsigned char pad[64];
+};
+
+static pthread_mutex_t v4lconvert_pool_lock = PTHREAD_MUTEX_INITIALIZER;
+static union v4lconvert_pool_hdr *v4lconvert_pool[V4LCONVERT_POOL_CLASSES];
+static int v4lconvert_pool_free_count[V4LCONVERT_POOL_CLASSES];
+static int v4lconvert_pool_hugepages = -1;
+static size_t v4lconvert_pool_hugepage_size;
+
+static size_t v4lconvert_pool_class_size(int class)
+{
+	int shift = V4LCONVERT_POOL_MIN_SHIFT + class / 2;
+
+	return (class & 1) ? (size_t)3 << (shift - 1) : (size_t)1 << shift;
+}
+
+/* The size of the mapping of a buffer of the given class, explicit huge
+   page mappings must be a multiple of the huge page size */
+static size_t v4lconvert_pool_map_size(int class)
+{
+	size_t size = v4lconvert_pool_class_size(class);
+	size_t align = v4lconvert_pool_hugepage_size;
+
+	if (v4lconvert_pool_hugepages == V4LCONVERT_HUGEPAGES_EXPLICIT &&
+			size >= align)
+		size = (size + align - 1) & ~(align - 1);
+
+	return size;
+}
+
+static size_t v4lconvert_pool_get_hugepage_size(void)
+{
+	size_t size = 0;
+	char buf[128];
+	FILE *f;
+
+	f = fopen("/proc/meminfo", "r");
+	if (!f)
+		return 0;
+
+	while (fgets(buf, sizeof(buf), f))
+		if (sscanf(buf, "Hugepagesize: %zu kB", &size) == 1)
+			break;
+	fclose(f);
+
+	return size * 1024;
+}
+
+/* Called with the pool lock held. The LIBV4LCONVERT_HUGEPAGES environment
+   variable selects if buffers of 2 MiB and up get backed by huge pages:
+   0 not, 1 transparent huge pages (the default), 2 explicitly reserved huge
+   pages (see /proc/sys/vm/nr_hugepages), falling back to normal pages when
+   there are not enough of them */
+static void v4lconvert_pool_init(void)
+{
+	char *s = getenv("LIBV4LCONVERT_HUGEPAGES");
+
+	v4lconvert_pool_hugepages = s ? strtol(s, NULL, 0) :
+				    V4LCONVERT_HUGEPAGES_TRANSPARENT;
+	v4lconvert_pool_hugepage_size = V4LCONVERT_POOL_THP_SIZE;
+
+#ifdef MAP_HUGETLB
+	if (v4lconvert_pool_hugepages == V4LCONVERT_HUGEPAGES_EXPLICIT) {
+		size_t size = v4lconvert_pool_get_hugepage_size();
+
+		if (size) {
+			v4lconvert_pool_hugepage_size = size;
+			return;
+		}
+	}
+#endif
+	if (v4lconvert_pool_hugepages != V4LCONVERT_HUGEPAGES_OFF)
+		v4lconvert_pool_hugepages = V4LCONVERT_HUGEPAGES_TRANSPARENT;
+}
+
+static void *v4lconvert_pool_map(int class)
+{
+	size_t size = v4lconvert_pool_map_size(class);
+	size_t align = v4lconvert_pool_hugepage_size;
+	int prot = PROT_READ | PROT_WRITE;
+	int flags = MAP_PRIVATE | MAP_ANONYMOUS;
+	unsigned char *buf;
+	uintptr_t start;
+
+	if (size < V4LCONVERT_POOL_MMAP_SIZE)
+		return malloc(size);
+
+	if (v4lconvert_pool_hugepages == V4LCONVERT_HUGEPAGES_OFF ||
+			size < align) {
+		buf = mmap(NULL, size, prot, flags, -1, 0);
+		return buf == MAP_FAILED ? NULL : buf;
+	}
+
+#ifdef MAP_HUGETLB
+	if (v4lconvert_pool_hugepages == V4LCONVERT_HUGEPAGES_EXPLICIT) {
+		buf = mmap(NULL, size, prot, flags | MAP_HUGETLB, -1, 0);
+		if (buf != MAP_FAILED)
+			return buf;
+	}
+#endif
+
+	/* Map a bit more, so that the buffer can start at a huge page
+	   boundary, and unmap the excess around it */
+	buf = mmap(NULL, size + align, prot, flags, -1, 0);
+	if (buf == MAP_FAILED)
+		return NULL;
+
+	start = ((uintptr_t)buf + align - 1) & ~(uintptr_t)(align - 1);
+	if (start != (uintptr_t)buf)
+		munmap(buf, start - (uintptr_t)buf);
+	munmap((unsigned char *)start + size,
+	       (uintptr_t)buf + align - start);
+	buf = (unsigned char *)start;
+
+#ifdef MADV_HUGEPAGE
+	madvise(buf, size, MADV_HUGEPAGE);
+#endif
+	return buf;
+}
+
+unsigned char *v4lconvert_pool_get(int *size, int *allocated)
+{
+	size_t needed = (size_t)*size + sizeof(union v4lconvert_pool_hdr);
+	union v4lconvert_pool_hdr *hdr;
+	int class;
+
+	*allocated = 0;
+	if (*size < 0)
+		return NULL;
+
+	for (class = 0; class < V4LCONVERT_POOL_CLASSES; class++)
+		if (v4lconvert_pool_class_size(class) >= needed)
+			break;
+	if (class == V4LCONVERT_POOL_CLASSES)
+		return NULL;
+
+	*size = v4lconvert_pool_class_size(class) - sizeof(*hdr);
+
+	pthread_mutex_lock(&v4lconvert_pool_lock);
+	if (v4lconvert_pool_hugepages == -1)
+		v4lconvert_pool_init();
+	hdr = v4lconvert_pool[class];
+	if (hdr) {
+		v4lconvert_pool[class] = hdr->h.next;
+		v4lconvert_pool_free_count[class]--;
+	}
+	pthread_mutex_unlock(&v4lconvert_pool_lock);
+
+	if (!hdr) {
+		hdr = v4lconvert_pool_map(class);
+		if (!hdr)
+			return NULL;
+		hdr->h.class = class;
+		*allocated = 1;
+	}
+
+	return (unsigned char *)(hdr + 1);
+}
+
+void v4lconvert_pool_put(unsigned char *buf)
+{
+	union v4lconvert_pool_hdr *hdr;
+	int class;
+
+	if (!buf)
+		return;
+
+	hdr = (union v4lconvert_pool_hdr *)buf - 1;
+	class = hdr->h.class;
+
+	pthread_mutex_lock(&v4lconvert_pool_lock);
+	if (v4lconvert_pool_free_count[class] < V4LCONVERT_POOL_KEEP) {
+		hdr->h.next = v4lconvert_pool[class];
+		v4lconvert_pool[class] = hdr;
+		v4lconvert_pool_free_count[class]++;
+		hdr = NULL;
+	}
+	pthread_mutex_unlock(&v4lconvert_pool_lock);
+
+	if (!hdr)
+		return;
+
+	if (v4lconvert_pool_class_size(class) < V4LCONVERT_POOL_MMAP_SIZE)
+		free(hdr);
+	else
+		munmap(hdr, v4lconvert_pool_map_size(class));
+}
@@ -26,8 +26,25 @@
 
 #define V4L2PROCESSING_UPDATE_RATE 10
 
+/* Range of y + the rgb offset of a chroma sample, see UV2RGB */
+#define V4LPROCESSING_CLIP_OFFSET 384
+#define V4LPROCESSING_CLIP_SIZE 1024
+
+/* Sums of the samples taken since the last lookup table update, green is
+   summed twice per sample, as a bayer sample (2x2 block) has 2 green pixels */
+struct v4lprocessing_stats {
+	unsigned long long comp1;
+	unsigned long long green;
+	unsigned long long comp2;
+	unsigned int count;
+	/* Sum of all components of the samples in the center of the frame */
+	unsigned long long lum;
+	unsigned int lum_count;
+};
+
 struct v4lprocessing_data {
 	struct v4lcontrol_data *control;
+	struct v4lconvert_threads *threads;
 	int fd;
 	int do_process;
 	int controls_changed;
@@ -37,10 +54,19 @@ struct v4lprocessing_data {
 	/* Counts the number of processed frames until a
 	   V4L2PROCESSING_UPDATE_RATE overflow happens */
 	int lookup_table_update_counter;
-	/* RGB/BGR lookup tables */
+	/* RGB/BGR lookup tables, RGB for yuv formats */
 	unsigned char comp1[256];
 	unsigned char green[256];
 	unsigned char comp2[256];
+	/* The lookup tables indexed by unclipped value + V4LPROCESSING_CLIP_OFFSET,
+	   for converting yuv to rgb and applying them in one go */
+	unsigned char clip_comp1[V4LPROCESSING_CLIP_SIZE];
+	unsigned char clip_green[V4LPROCESSING_CLIP_SIZE];
+	unsigned char clip_comp2[V4LPROCESSING_CLIP_SIZE];
+	/* Statistics for the filters, see v4lprocessing_gather_stats() */
+	struct v4lprocessing_stats stats;
+	/* Spread gathering the statistics over the frames until the next update */
+	int stats_incremental;
 	/* Filter private data for filters which need it */
 	/* whitebalance.c data */
 	int green_avg;
@@ -27,13 +27,25 @@
 #include "libv4lprocessing-priv.h"
 #include "../libv4lconvert-priv.h" /* for PIX_FMT defines */
 
+#define CLIP256(color) (((color) > 0xff) ? 0xff : (((color) < 0) ? 0 : (color)))
+
+/* The red, green and blue offsets of a chroma sample, these are the same
+   (multiplication free) approximations the yuv to rgb conversions use */
+#define UV2RGB(u, v, r, g, b) \
+	do { \
+		(r) = (((v) << 1) + (v)) >> 1; \
+		(g) = (((u) << 1) + (u) + ((v) << 2) + ((v) << 1)) >> 3; \
+		(b) = (((u) << 7) + (u)) >> 6; \
+	} while (0)
+
 static struct v4lprocessing_filter *filters[] = {
 	&whitebalance_filter,
 	&autogain_filter,
 	&gamma_filter,
 };
 
-struct v4lprocessing_data *v4lprocessing_create(int fd, struct v4lcontrol_data *control)
+struct v4lprocessing_data *v4lprocessing_create(int fd, struct v4lcontrol_data *control,
+		struct v4lconvert_threads *threads)
 {
 	struct v4lprocessing_data *data =
 		calloc(1, sizeof(struct v4lprocessing_data));
@@ -45,6 +57,7 @@ struct v4lprocessing_data *v4lprocessing_create(int fd, struct v4lcontrol_data *
 
 	data->fd = fd;
 	data->control = control;
+	data->threads = threads;
 
 	return data;
 }
@@ -69,6 +82,173 @@ int v4lprocessing_pre_processing(struct v4lprocessing_data *data)
 	return data->do_process;
 }
 
+/* The 8 msb of sample x of a line of (high bit depth) bayer, the same value
+   v4lconvert_bayer_unpack_line() gives */
+#define BAYER_SAMPLE(line, x) \
+	(packing == V4LCONVERT_BAYER_16BIT ? \
+		(unsigned char)(((line)[2 * (x)] | ((line)[2 * (x) + 1] << 8)) >> shift) : \
+	 packing == V4LCONVERT_BAYER_PACKED10 ? (line)[(x) / 4 * 5 + (x) % 4] : \
+	 packing == V4LCONVERT_BAYER_PACKED12 ? (line)[(x) / 2 * 3 + (x) % 2] : \
+	 (line)[x])
+
+/* Gather the statistics for the filters from a grid of every step-th sample
+   of every step-th line of samples, a sample being a 2x2 block for bayer and
+   yuv formats (so that each yuv sample has its own chroma) and a pixel for
+   rgb. Only grid lines with index % slices == slice are sampled, so that the
+   work can be spread over multiple frames. */
+static void v4lprocessing_gather_stats(struct v4lprocessing_data *data,
+		const unsigned char *buf, const struct v4l2_format *fmt,
+		int slice, int slices)
+{
+	struct v4lprocessing_stats *stats = &data->stats;
+	int x, y, u, v, r, g, b, ystep = 0, uvstep = 0, ystride = 0, uvstride = 0;
+	int step, width, height, bayer_green = -1, packing, shift;
+	int bytesperline = fmt->fmt.pix.bytesperline;
+	const unsigned char *ysrc = NULL, *usrc = NULL, *vsrc = NULL, *src;
+	unsigned int bayer_fmt;
+
+	/* Any bayer format, including high bit depth ones */
+	bayer_fmt = v4lconvert_bayer_unpacking(fmt->fmt.pix.pixelformat,
+					       &packing, &shift);
+	if (bayer_fmt)
+		bayer_green = bayer_fmt == V4L2_PIX_FMT_SGBRG8 ||
+			      bayer_fmt == V4L2_PIX_FMT_SGRBG8;
+
+	switch (bayer_fmt ? bayer_fmt : fmt->fmt.pix.pixelformat) {
+	case V4L2_PIX_FMT_SGBRG8:
+	case V4L2_PIX_FMT_SGRBG8:
+	case V4L2_PIX_FMT_SBGGR8:
+	case V4L2_PIX_FMT_SRGGB8:
+		if (bytesperline < v4lconvert_bayer_line_size(
+				fmt->fmt.pix.pixelformat, fmt->fmt.pix.width))
+			return;
+		break;
+	case V4L2_PIX_FMT_RGB24:
+	case V4L2_PIX_FMT_BGR24:
+		break;
+	case V4L2_PIX_FMT_YUYV:
+	case V4L2_PIX_FMT_YVYU:
+	case V4L2_PIX_FMT_UYVY:
+		ysrc = usrc = vsrc = buf;
+		if (fmt->fmt.pix.pixelformat == V4L2_PIX_FMT_UYVY) {
+			ysrc += 1;
+			vsrc += 2;
+		} else if (fmt->fmt.pix.pixelformat == V4L2_PIX_FMT_YVYU) {
+			usrc += 3;
+			vsrc += 1;
+		} else {
+			usrc += 1;
+			vsrc += 3;
+		}
+		ystep = uvstep = 4;
+		ystride = uvstride = 2 * bytesperline;
+		break;
+	case V4L2_PIX_FMT_YUV420:
+	case V4L2_PIX_FMT_YVU420:
+		/* Planar yuv420 is always packed without padding */
+		bytesperline = fmt->fmt.pix.width;
+		ysrc = buf;
+		usrc = buf + bytesperline * fmt->fmt.pix.height;
+		vsrc = usrc + bytesperline / 2 * (fmt->fmt.pix.height / 2);
+		if (fmt->fmt.pix.pixelformat == V4L2_PIX_FMT_YVU420) {
+			src = usrc;
+			usrc = vsrc;
+			vsrc = src;
+		}
+		ystep = 2;
+		uvstep = 1;
+		ystride = 2 * bytesperline;
+		uvstride = bytesperline / 2;
+		break;
+	case V4L2_PIX_FMT_NV12:
+	case V4L2_PIX_FMT_NV21:
+		ysrc = buf;
+		usrc = vsrc = buf + bytesperline * fmt->fmt.pix.height;
+		if (fmt->fmt.pix.pixelformat == V4L2_PIX_FMT_NV21)
+			usrc++;
+		else
+			vsrc++;
+		ystep = uvstep = 2;
+		ystride = 2 * bytesperline;
+		uvstride = bytesperline;
+		break;
+	default:
+		return;
+	}
+
+	/* Not enabled, or a shm segment from before this control existed */
+	step = v4lcontrol_get_ctrl(data->control, V4LCONTROL_STATS_STEP);
+	if (step < 1)
+		step = V4LCONTROL_DEFAULT_STATS_STEP;
+
+	/* Frame size in samples */
+	width = fmt->fmt.pix.width;
+	height = fmt->fmt.pix.height;
+	if (fmt->fmt.pix.pixelformat != V4L2_PIX_FMT_RGB24 &&
+	    fmt->fmt.pix.pixelformat != V4L2_PIX_FMT_BGR24) {
+		width /= 2;
+		height /= 2;
+	}
+
+	for (y = slice * step; y < height; y += slices * step) {
+		/* autogain only looks at the center of the frame */
+		int center = y >= height / 4 && y < height / 4 + height / 2;
+
+		for (x = 0; x < width; x += step) {
+			unsigned int c1, c2, green, lum, lum_count;
+
+			if (bayer_green != -1) {
+				const unsigned char *src1;
+
+				src = buf + 2 * y * bytesperline;
+				src1 = src + bytesperline;
+				if (bayer_green) {
+					green = BAYER_SAMPLE(src, 2 * x) +
+						BAYER_SAMPLE(src1, 2 * x + 1);
+					c1 = BAYER_SAMPLE(src, 2 * x + 1);
+					c2 = BAYER_SAMPLE(src1, 2 * x);
+				} else {
+					c1 = BAYER_SAMPLE(src, 2 * x);
+					green = BAYER_SAMPLE(src, 2 * x + 1) +
+						BAYER_SAMPLE(src1, 2 * x);
+					c2 = BAYER_SAMPLE(src1, 2 * x + 1);
+				}
+				lum = c1 + green + c2;
+				lum_count = 4;
+			} else if (ysrc) {
+				u = usrc[y * uvstride + x * uvstep] - 128;
+				v = vsrc[y * uvstride + x * uvstep] - 128;
+				UV2RGB(u, v, r, g, b);
+				src = ysrc + y * ystride + x * ystep;
+				c1 = CLIP256(*src + r);
+				green = CLIP256(*src - g);
+				c2 = CLIP256(*src + b);
+				lum = c1 + green + c2;
+				lum_count = 3;
+				green *= 2;
+			} else {
+				src = buf + y * bytesperline + 3 * x;
+				c1 = src[0];
+				green = src[1];
+				c2 = src[2];
+				lum = c1 + green + c2;
+				lum_count = 3;
+				green *= 2;
+			}
+
+			stats->comp1 += c1;
+			stats->green += green;
+			stats->comp2 += c2;
+			stats->count++;
+
+			if (center && x >= width / 4 && x < width / 4 + width / 2) {
+				stats->lum += lum;
+				stats->lum_count += lum_count;
+			}
+		}
+	}
+}
+
 static void v4lprocessing_update_lookup_tables(struct v4lprocessing_data *data,
 		unsigned char *buf, const struct v4l2_format *fmt)
 {
@@ -81,23 +261,96 @@ static void v4lprocessing_update_lookup_tables(struct v4lprocessing_data *data,
 	}
 
 	data->lookup_table_active = 0;
+
+	/* No statistics gathered while waiting for this update, use this frame */
+	if (data->stats.count == 0)
+		v4lprocessing_gather_stats(data, buf, fmt, 0, 1);
+
 	for (i = 0; i < ARRAY_SIZE(filters); i++) {
 		if (filters[i]->active(data)) {
 			if (filters[i]->calculate_lookup_tables(data, buf, fmt))
 				data->lookup_table_active = 1;
 		}
 	}
+
+	memset(&data->stats, 0, sizeof(data->stats));
 }
 
-static void v4lprocessing_do_processing(struct v4lprocessing_data *data,
-		unsigned char *buf, const struct v4l2_format *fmt)
+struct v4lprocessing_band_args {
+	struct v4lprocessing_data *data;
+	unsigned char *buf;
+	const struct v4l2_format *fmt;
+};
+
+/* There is no yuv equivalent of the rgb lookup tables, so convert each 2x2
+   block of yuv420 to rgb, apply the tables and convert it back, this gives
+   about the same result as doing the processing on a rgb24 version of the
+   frame, without the extra passes over the frame. The clip_* tables are the
+   lookup tables with the clipping of the yuv to rgb conversion folded in. */
+#define YUV420_PIXEL(ydest) \
+	do { \
+		r = clip_comp1[*(ydest) + dr]; \
+		g = clip_green[*(ydest) - dg]; \
+		b = clip_comp2[*(ydest) + db]; \
+		RGB2Y(r, g, b, *(ydest)); \
+		r_sum += r; \
+		g_sum += g; \
+		b_sum += b; \
+	} while (0)
+
+static void v4lprocessing_do_processing_yuv420(struct v4lprocessing_data *data,
+		unsigned char *buf, const struct v4l2_format *fmt,
+		int first_row, int rows)
 {
+	const unsigned char *clip_comp1 = data->clip_comp1 + V4LPROCESSING_CLIP_OFFSET;
+	const unsigned char *clip_green = data->clip_green + V4LPROCESSING_CLIP_OFFSET;
+	const unsigned char *clip_comp2 = data->clip_comp2 + V4LPROCESSING_CLIP_OFFSET;
+	int width = fmt->fmt.pix.width, height = fmt->fmt.pix.height;
+	unsigned char *ydest, *udest, *vdest;
+	int x, y, u, v, r, g, b, dr, dg, db, r_sum, g_sum, b_sum;
+
+	udest = buf + width * height + first_row / 2 * width / 2;
+	vdest = buf + width * height * 5 / 4 + first_row / 2 * width / 2;
+	if (fmt->fmt.pix.pixelformat == V4L2_PIX_FMT_YVU420) {
+		unsigned char *tmp = udest;
+
+		udest = vdest;
+		vdest = tmp;
+	}
+	ydest = buf + first_row * width;
+
+	for (y = 0; y < rows - 1; y += 2) {
+		for (x = 0; x < width / 2; x++) {
+			u = *udest - 128;
+			v = *vdest - 128;
+			UV2RGB(u, v, dr, dg, db);
+			r_sum = g_sum = b_sum = 0;
+			YUV420_PIXEL(ydest);
+			YUV420_PIXEL(ydest + 1);
+			YUV420_PIXEL(ydest + width);
+			YUV420_PIXEL(ydest + width + 1);
+			RGB2UV(r_sum >> 2, g_sum >> 2, b_sum >> 2, *udest, *vdest);
+			ydest += 2;
+			udest++;
+			vdest++;
+		}
+		ydest += width;
+	}
+}
+
+static void v4lprocessing_do_processing_band(void *arg, int first_row,
+		int rows)
+{
+	struct v4lprocessing_band_args *args = arg;
+	struct v4lprocessing_data *data = args->data;
+	const struct v4l2_format *fmt = args->fmt;
+	unsigned char *buf = args->buf + first_row * fmt->fmt.pix.bytesperline;
 	int x, y;
 
 	switch (fmt->fmt.pix.pixelformat) {
 	case V4L2_PIX_FMT_SGBRG8:
 	case V4L2_PIX_FMT_SGRBG8: /* Bayer patterns starting with green */
-		for (y = 0; y < fmt->fmt.pix.height / 2; y++) {
+		for (y = 0; y < rows / 2; y++) {
 			for (x = 0; x < fmt->fmt.pix.width / 2; x++) {
 				*buf = data->green[*buf];
 				buf++;
@@ -117,7 +370,7 @@ static void v4lprocessing_do_processing(struct v4lprocessing_data *data,
 
 	case V4L2_PIX_FMT_SBGGR8:
 	case V4L2_PIX_FMT_SRGGB8: /* Bayer patterns *NOT* starting with green */
-		for (y = 0; y < fmt->fmt.pix.height / 2; y++) {
+		for (y = 0; y < rows / 2; y++) {
 			for (x = 0; x < fmt->fmt.pix.width / 2; x++) {
 				*buf = data->comp1[*buf];
 				buf++;
@@ -135,9 +388,15 @@ static void v4lprocessing_do_processing(struct v4lprocessing_data *data,
 		}
 		break;
 
+	case V4L2_PIX_FMT_YUV420:
+	case V4L2_PIX_FMT_YVU420:
+		v4lprocessing_do_processing_yuv420(data, args->buf, fmt,
+						   first_row, rows);
+		break;
+
 	case V4L2_PIX_FMT_RGB24:
 	case V4L2_PIX_FMT_BGR24:
-		for (y = 0; y < fmt->fmt.pix.height; y++) {
+		for (y = 0; y < rows; y++) {
 			for (x = 0; x < fmt->fmt.pix.width; x++) {
 				*buf = data->comp1[*buf];
 				buf++;
@@ -152,6 +411,57 @@ static void v4lprocessing_do_processing(struct v4lprocessing_data *data,
 	}
 }
 
+static void v4lprocessing_do_processing(struct v4lprocessing_data *data,
+		unsigned char *buf, const struct v4l2_format *fmt)
+{
+	struct v4lprocessing_band_args args = { data, buf, fmt };
+	int i;
+
+	if (fmt->fmt.pix.pixelformat == V4L2_PIX_FMT_YUV420 ||
+	    fmt->fmt.pix.pixelformat == V4L2_PIX_FMT_YVU420) {
+		for (i = 0; i < V4LPROCESSING_CLIP_SIZE; i++) {
+			int c = CLIP256(i - V4LPROCESSING_CLIP_OFFSET);
+
+			data->clip_comp1[i] = data->comp1[c];
+			data->clip_green[i] = data->green[c];
+			data->clip_comp2[i] = data->comp2[c];
+		}
+	}
+
+	/* Bayer and yuv420 formats get processed 2 lines at a time */
+	v4lconvert_run_bands(data->threads, v4lprocessing_do_processing_band,
+			     &args, fmt->fmt.pix.height, 2);
+}
+
+static void v4lprocessing_update(struct v4lprocessing_data *data,
+		unsigned char *buf, const struct v4l2_format *fmt)
+{
+	if (data->controls_changed ||
+			data->lookup_table_update_counter == V4L2PROCESSING_UPDATE_RATE) {
+		/* Statistics gathered with the old settings are of no use */
+		if (data->controls_changed)
+			memset(&data->stats, 0, sizeof(data->stats));
+		data->controls_changed = 0;
+		data->lookup_table_update_counter = 0;
+		/* Do this after resetting lookup_table_update_counter so that filters can
+		   force the next update to be sooner when they changed camera settings */
+		v4lprocessing_update_lookup_tables(data, buf, fmt);
+		/* In that case the frames until the next update are not
+		   representative, and the next update uses only its own frame */
+		data->stats_incremental =
+			data->lookup_table_update_counter == 0;
+	} else {
+		data->lookup_table_update_counter++;
+		/* Gather a slice of the statistics each frame, rather than all
+		   of them in the update frame */
+		if (data->stats_incremental)
+			v4lprocessing_gather_stats(data, buf, fmt,
+				data->lookup_table_update_counter %
+					V4L2PROCESSING_UPDATE_RATE,
+				V4L2PROCESSING_UPDATE_RATE);
+	}
+}
+
 void v4lprocessing_processing(struct v4lprocessing_data *data,
 		unsigned char *buf, const struct v4l2_format *fmt)
 {
@@ -166,23 +476,46 @@ void v4lprocessing_processing(struct v4lprocessing_data *data,
 	case V4L2_PIX_FMT_SRGGB8:
 	case V4L2_PIX_FMT_RGB24:
 	case V4L2_PIX_FMT_BGR24:
+	case V4L2_PIX_FMT_YUV420:
+	case V4L2_PIX_FMT_YVU420:
 		break;
 	default:
 		return; /* Non supported pix format */
 	}
 
-	if (data->controls_changed ||
-			data->lookup_table_update_counter == V4L2PROCESSING_UPDATE_RATE) {
-		data->controls_changed = 0;
-		data->lookup_table_update_counter = 0;
-		/* Do this after resetting lookup_table_update_counter so that filters can
-		   force the next update to be sooner when they changed camera settings */
-		v4lprocessing_update_lookup_tables(data, buf, fmt);
-	} else
-		data->lookup_table_update_counter++;
+	v4lprocessing_update(data, buf, fmt);
 
 	if (data->lookup_table_active)
 		v4lprocessing_do_processing(data, buf, fmt);
 
 	data->do_process = 0;
 }
+
+int v4lprocessing_lookup_tables(struct v4lprocessing_data *data,
+		unsigned char *buf, const struct v4l2_format *fmt,
+		const unsigned char *lut[3])
+{
+	if (!data->do_process)
+		return 0;
+
+	v4lprocessing_update(data, buf, fmt);
+	data->do_process = 0;
+
+	if (!data->lookup_table_active)
+		return 0;
+
+	lut[0] = data->comp1;
+	lut[1] = data->green;
+	lut[2] = data->comp2;
+
+	/* For bayer comp1 is the first non green pixel, which may be blue */
+	switch (v4lconvert_bayer_unpacking(fmt->fmt.pix.pixelformat,
+					   NULL, NULL)) {
+	case V4L2_PIX_FMT_SBGGR8:
+	case V4L2_PIX_FMT_SGBRG8:
+		lut[0] = data->comp2;
+		lut[2] = data->comp1;
+		break;
+	}
+	return 1;
+}
@@ -30,8 +30,10 @@
 
 struct v4lprocessing_data;
 struct v4lcontrol_data;
+struct v4lconvert_threads;
 
-struct v4lprocessing_data *v4lprocessing_create(int fd, struct v4lcontrol_data *data);
+struct v4lprocessing_data *v4lprocessing_create(int fd, struct v4lcontrol_data *data,
+		struct v4lconvert_threads *threads);
 void v4lprocessing_destroy(struct v4lprocessing_data *data);
 
 /* Prepare to process 1 frame, returns 1 if processing is necesary,
@@ -44,4 +46,13 @@ int v4lprocessing_pre_processing(struct v4lprocessing_data *data);
 void v4lprocessing_processing(struct v4lprocessing_data *data,
   unsigned char *buf, const struct v4l2_format *fmt);
 
+/* Like v4lprocessing_processing(), but only update the lookup tables from the
+   yuv or (high bit depth) bayer frame in buf, leaving applying them to the
+   caller, who can do so while converting the frame to rgb. Returns 1 and the
+   red, green and blue lookup tables in lut[] if they need to be applied, 0 if
+   not. */
+int v4lprocessing_lookup_tables(struct v4lprocessing_data *data,
+  unsigned char *buf, const struct v4l2_format *fmt,
+  const unsigned char *lut[3]);
+
 #endif
@@ -0,0 +1,747 @@
+/*
+
+# SIMD versions of the YUV -> RGB conversion routines
+
+# These produce the exact same output as the plain C code in rgbyuv.c, which
+# stays the reference implementation and handles the left-over pixels at the
+# end of each line.
+
+# This program is free software; you can redistribute it and/or modify
+# it under the terms of the GNU Lesser General Public License as published by
+# the Free Software Foundation; either version 2.1 of the License, or
+# (at your option) any later version.
+#
+# This program is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU Lesser General Public License for more details.
+#
+# You should have received a copy of the GNU Lesser General Public License
+# along with this program; if not, write to the Free Software
+# Foundation, Inc., 51 Franklin Street, Suite 500, Boston, MA  02110-1335  USA
+
+ */
+
+#include "libv4lconvert-priv.h"
+#include "simd-priv.h"
+
+/*
+ * Like the plain C code, these calculate (ys * y + yoff + c) >> 6 for each
+ * of r, g and b, with c the chroma term and the coefficients from struct
+ * v4lconvert_yuv_coefs, see libv4lconvert-priv.h. The products and sums
+ * fit in 16 bit lanes, only adding the chroma term may overflow, for which
+ * saturating adds get used, this is bit exact for all possible y, u and v.
+ */
+
+#ifdef HAVE_V4LCONVERT_X86_SIMD
+
+/* The coefficients of struct v4lconvert_yuv_coefs in 16 bit lanes */
+struct yuv_coefs_ssse3 {
+	__m128i ys, yoff, ub, ug, vg, vr;
+};
+
+static inline V4LCONVERT_TARGET("ssse3") void load_coefs_ssse3(
+		struct yuv_coefs_ssse3 *c, const struct v4lconvert_yuv_coefs *coefs)
+{
+	c->ys = _mm_set1_epi16(coefs->ys);
+	c->yoff = _mm_set1_epi16(coefs->yoff);
+	c->ub = _mm_set1_epi16(coefs->ub);
+	c->ug = _mm_set1_epi16(coefs->ug);
+	c->vg = _mm_set1_epi16(coefs->vg);
+	c->vr = _mm_set1_epi16(coefs->vr);
+}
+
+/* ys * y + yoff for 8 luma words */
+static inline V4LCONVERT_TARGET("ssse3") __m128i luma_ssse3(
+		const struct yuv_coefs_ssse3 *c, __m128i y)
+{
+	return _mm_add_epi16(_mm_mullo_epi16(y, c->ys), c->yoff);
+}
+
+/* (y + chroma) >> 6 for 16 pixels, clipped to bytes */
+static inline V4LCONVERT_TARGET("ssse3") __m128i channel_ssse3(
+		__m128i ylo, __m128i yhi, __m128i clo, __m128i chi)
+{
+	return _mm_packus_epi16(_mm_srai_epi16(_mm_adds_epi16(ylo, clo), 6),
+				_mm_srai_epi16(_mm_adds_epi16(yhi, chi), 6));
+}
+
+/* Convert 16 pixels, y holds 16 luma bytes, u and v hold 8 chroma values
+   (already minus 128) as 16 bit words, each shared by 2 pixels */
+static V4LCONVERT_SIMD_INLINE V4LCONVERT_TARGET("ssse3")
+void yuv_to_rgb24_16_ssse3(
+		unsigned char *dest, const struct yuv_coefs_ssse3 *c,
+		__m128i y, __m128i u, __m128i v, int bgr)
+{
+	const __m128i zero = _mm_setzero_si128();
+	__m128i ylo, yhi, r, g, b;
+
+	ylo = luma_ssse3(c, _mm_unpacklo_epi8(y, zero));
+	yhi = luma_ssse3(c, _mm_unpackhi_epi8(y, zero));
+
+	r = _mm_mullo_epi16(v, c->vr);
+	g = _mm_add_epi16(_mm_mullo_epi16(u, c->ug), _mm_mullo_epi16(v, c->vg));
+	b = _mm_mullo_epi16(u, c->ub);
+
+	r = channel_ssse3(ylo, yhi, _mm_unpacklo_epi16(r, r),
+			  _mm_unpackhi_epi16(r, r));
+	g = channel_ssse3(ylo, yhi, _mm_unpacklo_epi16(g, g),
+			  _mm_unpackhi_epi16(g, g));
+	b = channel_ssse3(ylo, yhi, _mm_unpacklo_epi16(b, b),
+			  _mm_unpackhi_epi16(b, b));
+
+	if (bgr)
+		store_rgb24_ssse3(dest, b, g, r);
+	else
+		store_rgb24_ssse3(dest, r, g, b);
+}
+
+static V4LCONVERT_TARGET("ssse3") int yuv422_to_rgb24_ssse3(
+		const struct v4lconvert_yuv_coefs *coefs, const unsigned char *src,
+		unsigned char *dest, int width, int order, int bgr)
+{
+	const __m128i lo_mask = _mm_set1_epi16(0x00ff);
+	const __m128i c128 = _mm_set1_epi16(128);
+	struct yuv_coefs_ssse3 k;
+	int x;
+
+	load_coefs_ssse3(&k, coefs);
+	for (x = 0; x + 16 <= width; x += 16) {
+		__m128i a = _mm_loadu_si128((const __m128i *)src);
+		__m128i b = _mm_loadu_si128((const __m128i *)(src + 16));
+		__m128i y, c, u, v;
+
+		if (order == V4LCONVERT_ORDER_UYVY) {
+			y = _mm_packus_epi16(_mm_srli_epi16(a, 8), _mm_srli_epi16(b, 8));
+			c = _mm_packus_epi16(_mm_and_si128(a, lo_mask),
+					     _mm_and_si128(b, lo_mask));
+		} else {
+			y = _mm_packus_epi16(_mm_and_si128(a, lo_mask),
+					     _mm_and_si128(b, lo_mask));
+			c = _mm_packus_epi16(_mm_srli_epi16(a, 8), _mm_srli_epi16(b, 8));
+		}
+		if (order == V4LCONVERT_ORDER_YVYU) {
+			u = _mm_srli_epi16(c, 8);
+			v = _mm_and_si128(c, lo_mask);
+		} else {
+			u = _mm_and_si128(c, lo_mask);
+			v = _mm_srli_epi16(c, 8);
+		}
+
+		yuv_to_rgb24_16_ssse3(dest, &k, y, _mm_sub_epi16(u, c128),
+				      _mm_sub_epi16(v, c128), bgr);
+		src += 32;
+		dest += 48;
+	}
+
+	return x;
+}
+
+static V4LCONVERT_TARGET("ssse3") int yuv420_to_rgb24_ssse3(
+		const struct v4lconvert_yuv_coefs *coefs, const unsigned char *ysrc,
+		const unsigned char *usrc, const unsigned char *vsrc,
+		unsigned char *dest, int width, int bgr)
+{
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i c128 = _mm_set1_epi16(128);
+	struct yuv_coefs_ssse3 k;
+	int x;
+
+	load_coefs_ssse3(&k, coefs);
+	for (x = 0; x + 16 <= width; x += 16) {
+		__m128i y = _mm_loadu_si128((const __m128i *)ysrc);
+		__m128i u = _mm_unpacklo_epi8(
+			_mm_loadl_epi64((const __m128i *)usrc), zero);
+		__m128i v = _mm_unpacklo_epi8(
+			_mm_loadl_epi64((const __m128i *)vsrc), zero);
+
+		yuv_to_rgb24_16_ssse3(dest, &k, y, _mm_sub_epi16(u, c128),
+				      _mm_sub_epi16(v, c128), bgr);
+		ysrc += 16;
+		usrc += 8;
+		vsrc += 8;
+		dest += 48;
+	}
+
+	return x;
+}
+
+static V4LCONVERT_TARGET("ssse3") int nv12_to_rgb24_ssse3(
+		const struct v4lconvert_yuv_coefs *coefs, const unsigned char *ysrc,
+		const unsigned char *uvsrc, unsigned char *dest, int width,
+		int vu, int bgr)
+{
+	const __m128i lo_mask = _mm_set1_epi16(0x00ff);
+	const __m128i c128 = _mm_set1_epi16(128);
+	struct yuv_coefs_ssse3 k;
+	int x;
+
+	load_coefs_ssse3(&k, coefs);
+	for (x = 0; x + 16 <= width; x += 16) {
+		__m128i y = _mm_loadu_si128((const __m128i *)ysrc);
+		__m128i c = _mm_loadu_si128((const __m128i *)uvsrc);
+		__m128i u = _mm_sub_epi16(_mm_and_si128(c, lo_mask), c128);
+		__m128i v = _mm_sub_epi16(_mm_srli_epi16(c, 8), c128);
+
+		if (vu)
+			yuv_to_rgb24_16_ssse3(dest, &k, y, v, u, bgr);
+		else
+			yuv_to_rgb24_16_ssse3(dest, &k, y, u, v, bgr);
+		ysrc += 16;
+		uvsrc += 16;
+		dest += 48;
+	}
+
+	return x;
+}
+
+/* Like yuv_to_rgb24_16_ssse3, but with a chroma value per pixel, ulo / vlo
+   hold the chroma words of pixels 0 - 7 and uhi / vhi those of 8 - 15 */
+static V4LCONVERT_SIMD_INLINE V4LCONVERT_TARGET("ssse3")
+void yuv444_to_rgb24_16_ssse3(
+		unsigned char *dest, const struct yuv_coefs_ssse3 *c,
+		__m128i y, __m128i ulo, __m128i uhi, __m128i vlo, __m128i vhi,
+		int bgr)
+{
+	const __m128i zero = _mm_setzero_si128();
+	__m128i ylo, yhi, r, g, b;
+
+	ylo = luma_ssse3(c, _mm_unpacklo_epi8(y, zero));
+	yhi = luma_ssse3(c, _mm_unpackhi_epi8(y, zero));
+
+	r = channel_ssse3(ylo, yhi, _mm_mullo_epi16(vlo, c->vr),
+			  _mm_mullo_epi16(vhi, c->vr));
+	g = channel_ssse3(ylo, yhi,
+			  _mm_add_epi16(_mm_mullo_epi16(ulo, c->ug),
+					_mm_mullo_epi16(vlo, c->vg)),
+			  _mm_add_epi16(_mm_mullo_epi16(uhi, c->ug),
+					_mm_mullo_epi16(vhi, c->vg)));
+	b = channel_ssse3(ylo, yhi, _mm_mullo_epi16(ulo, c->ub),
+			  _mm_mullo_epi16(uhi, c->ub));
+
+	if (bgr)
+		store_rgb24_ssse3(dest, b, g, r);
+	else
+		store_rgb24_ssse3(dest, r, g, b);
+}
+
+static V4LCONVERT_TARGET("ssse3") int nv24_to_rgb24_ssse3(
+		const struct v4lconvert_yuv_coefs *coefs, const unsigned char *ysrc,
+		const unsigned char *uvsrc, unsigned char *dest, int width,
+		int vu, int bgr)
+{
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i lo_mask = _mm_set1_epi16(0x00ff);
+	const __m128i c128 = _mm_set1_epi16(128);
+	struct yuv_coefs_ssse3 k;
+	int x;
+
+	load_coefs_ssse3(&k, coefs);
+	for (x = 0; x + 16 <= width; x += 16) {
+		__m128i y = _mm_loadu_si128((const __m128i *)ysrc);
+		__m128i a = _mm_loadu_si128((const __m128i *)uvsrc);
+		__m128i b = _mm_loadu_si128((const __m128i *)(uvsrc + 16));
+		__m128i u = _mm_packus_epi16(_mm_and_si128(a, lo_mask),
+					     _mm_and_si128(b, lo_mask));
+		__m128i v = _mm_packus_epi16(_mm_srli_epi16(a, 8),
+					     _mm_srli_epi16(b, 8));
+
+		if (vu) {
+			__m128i tmp = u;
+
+			u = v;
+			v = tmp;
+		}
+		yuv444_to_rgb24_16_ssse3(dest, &k, y,
+			_mm_sub_epi16(_mm_unpacklo_epi8(u, zero), c128),
+			_mm_sub_epi16(_mm_unpackhi_epi8(u, zero), c128),
+			_mm_sub_epi16(_mm_unpacklo_epi8(v, zero), c128),
+			_mm_sub_epi16(_mm_unpackhi_epi8(v, zero), c128), bgr);
+		ysrc += 16;
+		uvsrc += 32;
+		dest += 48;
+	}
+
+	return x;
+}
+
+struct yuv_coefs_avx2 {
+	__m256i ys, yoff, ub, ug, vg, vr;
+};
+
+static inline V4LCONVERT_TARGET("avx2") void load_coefs_avx2(
+		struct yuv_coefs_avx2 *c, const struct v4lconvert_yuv_coefs *coefs)
+{
+	c->ys = _mm256_set1_epi16(coefs->ys);
+	c->yoff = _mm256_set1_epi16(coefs->yoff);
+	c->ub = _mm256_set1_epi16(coefs->ub);
+	c->ug = _mm256_set1_epi16(coefs->ug);
+	c->vg = _mm256_set1_epi16(coefs->vg);
+	c->vr = _mm256_set1_epi16(coefs->vr);
+}
+
+static inline V4LCONVERT_TARGET("avx2") __m256i luma_avx2(
+		const struct yuv_coefs_avx2 *c, __m256i y)
+{
+	return _mm256_add_epi16(_mm256_mullo_epi16(y, c->ys), c->yoff);
+}
+
+static inline V4LCONVERT_TARGET("avx2") __m256i channel_avx2(
+		__m256i ylo, __m256i yhi, __m256i clo, __m256i chi)
+{
+	return _mm256_packus_epi16(
+		_mm256_srai_epi16(_mm256_adds_epi16(ylo, clo), 6),
+		_mm256_srai_epi16(_mm256_adds_epi16(yhi, chi), 6));
+}
+
+static inline V4LCONVERT_TARGET("avx2") void store_rgb24_32_avx2(
+		unsigned char *dest, __m256i r, __m256i g, __m256i b, int bgr)
+{
+	if (bgr) {
+		__m256i tmp = r;
+
+		r = b;
+		b = tmp;
+	}
+	store_rgb24_ssse3(dest, _mm256_castsi256_si128(r),
+			  _mm256_castsi256_si128(g), _mm256_castsi256_si128(b));
+	store_rgb24_ssse3(dest + 48, _mm256_extracti128_si256(r, 1),
+			  _mm256_extracti128_si256(g, 1),
+			  _mm256_extracti128_si256(b, 1));
+}
+
+/* 32 pixel version of yuv_to_rgb24_16_ssse3, u and v hold 16 chroma words */
+static V4LCONVERT_SIMD_INLINE V4LCONVERT_TARGET("avx2")
+void yuv_to_rgb24_32_avx2(
+		unsigned char *dest, const struct yuv_coefs_avx2 *c,
+		__m256i y, __m256i u, __m256i v, int bgr)
+{
+	const __m256i zero = _mm256_setzero_si256();
+	__m256i ylo, yhi, r, g, b;
+
+	/* The avx2 unpack instructions work per 128 bit lane, so ylo gets
+	   pixels 0-7 + 16-23 and yhi 8-15 + 24-31, which matches the chroma
+	   words duplicated by unpack, packus then restores the pixel order */
+	ylo = luma_avx2(c, _mm256_unpacklo_epi8(y, zero));
+	yhi = luma_avx2(c, _mm256_unpackhi_epi8(y, zero));
+
+	r = _mm256_mullo_epi16(v, c->vr);
+	g = _mm256_add_epi16(_mm256_mullo_epi16(u, c->ug),
+			     _mm256_mullo_epi16(v, c->vg));
+	b = _mm256_mullo_epi16(u, c->ub);
+
+	r = channel_avx2(ylo, yhi, _mm256_unpacklo_epi16(r, r),
+			 _mm256_unpackhi_epi16(r, r));
+	g = channel_avx2(ylo, yhi, _mm256_unpacklo_epi16(g, g),
+			 _mm256_unpackhi_epi16(g, g));
+	b = channel_avx2(ylo, yhi, _mm256_unpacklo_epi16(b, b),
+			 _mm256_unpackhi_epi16(b, b));
+
+	store_rgb24_32_avx2(dest, r, g, b, bgr);
+}
+
+static V4LCONVERT_TARGET("avx2") int yuv422_to_rgb24_avx2(
+		const struct v4lconvert_yuv_coefs *coefs, const unsigned char *src,
+		unsigned char *dest, int width, int order, int bgr)
+{
+	const __m256i lo_mask = _mm256_set1_epi16(0x00ff);
+	const __m256i c128 = _mm256_set1_epi16(128);
+	struct yuv_coefs_avx2 k;
+	int x;
+
+	load_coefs_avx2(&k, coefs);
+	for (x = 0; x + 32 <= width; x += 32) {
+		__m256i a = _mm256_loadu_si256((const __m256i *)src);
+		__m256i b = _mm256_loadu_si256((const __m256i *)(src + 32));
+		__m256i y, c, u, v;
+
+		/* packus works per lane, the permute puts the quadwords back
+		   in pixel order */
+		if (order == V4LCONVERT_ORDER_UYVY) {
+			y = _mm256_packus_epi16(_mm256_srli_epi16(a, 8),
+						_mm256_srli_epi16(b, 8));
+			c = _mm256_packus_epi16(_mm256_and_si256(a, lo_mask),
+						_mm256_and_si256(b, lo_mask));
+		} else {
+			y = _mm256_packus_epi16(_mm256_and_si256(a, lo_mask),
+						_mm256_and_si256(b, lo_mask));
+			c = _mm256_packus_epi16(_mm256_srli_epi16(a, 8),
+						_mm256_srli_epi16(b, 8));
+		}
+		y = _mm256_permute4x64_epi64(y, 0xd8);
+		c = _mm256_permute4x64_epi64(c, 0xd8);
+		if (order == V4LCONVERT_ORDER_YVYU) {
+			u = _mm256_srli_epi16(c, 8);
+			v = _mm256_and_si256(c, lo_mask);
+		} else {
+			u = _mm256_and_si256(c, lo_mask);
+			v = _mm256_srli_epi16(c, 8);
+		}
+
+		yuv_to_rgb24_32_avx2(dest, &k, y, _mm256_sub_epi16(u, c128),
+				     _mm256_sub_epi16(v, c128), bgr);
+		src += 64;
+		dest += 96;
+	}
+
+	return x;
+}
+
+static V4LCONVERT_TARGET("avx2") int yuv420_to_rgb24_avx2(
+		const struct v4lconvert_yuv_coefs *coefs, const unsigned char *ysrc,
+		const unsigned char *usrc, const unsigned char *vsrc,
+		unsigned char *dest, int width, int bgr)
+{
+	const __m256i c128 = _mm256_set1_epi16(128);
+	struct yuv_coefs_avx2 k;
+	int x;
+
+	load_coefs_avx2(&k, coefs);
+	for (x = 0; x + 32 <= width; x += 32) {
+		__m256i y = _mm256_loadu_si256((const __m256i *)ysrc);
+		__m256i u = _mm256_cvtepu8_epi16(
+			_mm_loadu_si128((const __m128i *)usrc));
+		__m256i v = _mm256_cvtepu8_epi16(
+			_mm_loadu_si128((const __m128i *)vsrc));
+
+		yuv_to_rgb24_32_avx2(dest, &k, y, _mm256_sub_epi16(u, c128),
+				     _mm256_sub_epi16(v, c128), bgr);
+		ysrc += 32;
+		usrc += 16;
+		vsrc += 16;
+		dest += 96;
+	}
+
+	return x;
+}
+
+static V4LCONVERT_TARGET("avx2") int nv12_to_rgb24_avx2(
+		const struct v4lconvert_yuv_coefs *coefs, const unsigned char *ysrc,
+		const unsigned char *uvsrc, unsigned char *dest, int width,
+		int vu, int bgr)
+{
+	const __m256i lo_mask = _mm256_set1_epi16(0x00ff);
+	const __m256i c128 = _mm256_set1_epi16(128);
+	struct yuv_coefs_avx2 k;
+	int x;
+
+	load_coefs_avx2(&k, coefs);
+	for (x = 0; x + 32 <= width; x += 32) {
+		__m256i y = _mm256_loadu_si256((const __m256i *)ysrc);
+		__m256i c = _mm256_loadu_si256((const __m256i *)uvsrc);
+		__m256i u = _mm256_sub_epi16(_mm256_and_si256(c, lo_mask), c128);
+		__m256i v = _mm256_sub_epi16(_mm256_srli_epi16(c, 8), c128);
+
+		if (vu)
+			yuv_to_rgb24_32_avx2(dest, &k, y, v, u, bgr);
+		else
+			yuv_to_rgb24_32_avx2(dest, &k, y, u, v, bgr);
+		ysrc += 32;
+		uvsrc += 32;
+		dest += 96;
+	}
+
+	return x;
+}
+
+/* 32 pixel version of yuv444_to_rgb24_16_ssse3, the chroma words follow the
+   per 128 bit lane order of unpacking y, see yuv_to_rgb24_32_avx2 */
+static V4LCONVERT_SIMD_INLINE V4LCONVERT_TARGET("avx2")
+void yuv444_to_rgb24_32_avx2(
+		unsigned char *dest, const struct yuv_coefs_avx2 *c,
+		__m256i y, __m256i ulo, __m256i uhi, __m256i vlo, __m256i vhi,
+		int bgr)
+{
+	const __m256i zero = _mm256_setzero_si256();
+	__m256i ylo, yhi, r, g, b;
+
+	ylo = luma_avx2(c, _mm256_unpacklo_epi8(y, zero));
+	yhi = luma_avx2(c, _mm256_unpackhi_epi8(y, zero));
+
+	r = channel_avx2(ylo, yhi, _mm256_mullo_epi16(vlo, c->vr),
+			 _mm256_mullo_epi16(vhi, c->vr));
+	g = channel_avx2(ylo, yhi,
+			 _mm256_add_epi16(_mm256_mullo_epi16(ulo, c->ug),
+					  _mm256_mullo_epi16(vlo, c->vg)),
+			 _mm256_add_epi16(_mm256_mullo_epi16(uhi, c->ug),
+					  _mm256_mullo_epi16(vhi, c->vg)));
+	b = channel_avx2(ylo, yhi, _mm256_mullo_epi16(ulo, c->ub),
+			 _mm256_mullo_epi16(uhi, c->ub));
+
+	store_rgb24_32_avx2(dest, r, g, b, bgr);
+}
+
+static V4LCONVERT_TARGET("avx2") int nv24_to_rgb24_avx2(
+		const struct v4lconvert_yuv_coefs *coefs, const unsigned char *ysrc,
+		const unsigned char *uvsrc, unsigned char *dest, int width,
+		int vu, int bgr)
+{
+	const __m256i zero = _mm256_setzero_si256();
+	const __m256i lo_mask = _mm256_set1_epi16(0x00ff);
+	const __m256i c128 = _mm256_set1_epi16(128);
+	struct yuv_coefs_avx2 k;
+	int x;
+
+	load_coefs_avx2(&k, coefs);
+	for (x = 0; x + 32 <= width; x += 32) {
+		__m256i y = _mm256_loadu_si256((const __m256i *)ysrc);
+		__m256i a = _mm256_loadu_si256((const __m256i *)uvsrc);
+		__m256i b = _mm256_loadu_si256((const __m256i *)(uvsrc + 32));
+		__m256i u = _mm256_permute4x64_epi64(_mm256_packus_epi16(
+				_mm256_and_si256(a, lo_mask),
+				_mm256_and_si256(b, lo_mask)), 0xd8);
+		__m256i v = _mm256_permute4x64_epi64(_mm256_packus_epi16(
+				_mm256_srli_epi16(a, 8),
+				_mm256_srli_epi16(b, 8)), 0xd8);
+
+		if (vu) {
+			__m256i tmp = u;
+
+			u = v;
+			v = tmp;
+		}
+		yuv444_to_rgb24_32_avx2(dest, &k, y,
+			_mm256_sub_epi16(_mm256_unpacklo_epi8(u, zero), c128),
+			_mm256_sub_epi16(_mm256_unpackhi_epi8(u, zero), c128),
+			_mm256_sub_epi16(_mm256_unpacklo_epi8(v, zero), c128),
+			_mm256_sub_epi16(_mm256_unpackhi_epi8(v, zero), c128), bgr);
+		ysrc += 32;
+		uvsrc += 64;
+		dest += 96;
+	}
+
+	return x;
+}
+
+#endif /* HAVE_V4LCONVERT_X86_SIMD */
+
+#ifdef HAVE_V4LCONVERT_NEON
+
+/* Convert 8 pixel pairs, ye and yo hold the luma of the even and odd pixels,
+   u and v the chroma (already minus 128) shared by each pair */
+static inline void yuv_to_rgb24_pairs_neon(
+		const struct v4lconvert_yuv_coefs *c, int16x8_t ye, int16x8_t yo,
+		int16x8_t u, int16x8_t v, uint8x8_t *re, uint8x8_t *ro,
+		uint8x8_t *ge, uint8x8_t *go, uint8x8_t *be, uint8x8_t *bo)
+{
+	int16x8_t r = vmulq_n_s16(v, c->vr);
+	int16x8_t g = vmlaq_n_s16(vmulq_n_s16(u, c->ug), v, c->vg);
+	int16x8_t b = vmulq_n_s16(u, c->ub);
+
+	ye = vmlaq_n_s16(vdupq_n_s16(c->yoff), ye, c->ys);
+	yo = vmlaq_n_s16(vdupq_n_s16(c->yoff), yo, c->ys);
+
+	*re = vqshrun_n_s16(vqaddq_s16(ye, r), 6);
+	*ro = vqshrun_n_s16(vqaddq_s16(yo, r), 6);
+	*ge = vqshrun_n_s16(vqaddq_s16(ye, g), 6);
+	*go = vqshrun_n_s16(vqaddq_s16(yo, g), 6);
+	*be = vqshrun_n_s16(vqaddq_s16(ye, b), 6);
+	*bo = vqshrun_n_s16(vqaddq_s16(yo, b), 6);
+}
+
+static inline int16x8_t widen_neon(uint8x8_t x)
+{
+	return vreinterpretq_s16_u16(vmovl_u8(x));
+}
+
+/* Convert 16 pixel pairs and store them as 96 bytes rgb24 */
+static V4LCONVERT_SIMD_INLINE void yuv_to_rgb24_32_neon(unsigned char *dest,
+		const struct v4lconvert_yuv_coefs *c, uint8x16_t ye,
+		uint8x16_t yo, uint8x16_t u, uint8x16_t v, int bgr)
+{
+	const int16x8_t c128 = vdupq_n_s16(128);
+	uint8x8_t re[2], ro[2], ge[2], go[2], be[2], bo[2];
+	uint8x16x2_t r, g, b;
+	uint8x16x3_t out;
+
+	yuv_to_rgb24_pairs_neon(c, widen_neon(vget_low_u8(ye)),
+		widen_neon(vget_low_u8(yo)),
+		vsubq_s16(widen_neon(vget_low_u8(u)), c128),
+		vsubq_s16(widen_neon(vget_low_u8(v)), c128),
+		&re[0], &ro[0], &ge[0], &go[0], &be[0], &bo[0]);
+	yuv_to_rgb24_pairs_neon(c, widen_neon(vget_high_u8(ye)),
+		widen_neon(vget_high_u8(yo)),
+		vsubq_s16(widen_neon(vget_high_u8(u)), c128),
+		vsubq_s16(widen_neon(vget_high_u8(v)), c128),
+		&re[1], &ro[1], &ge[1], &go[1], &be[1], &bo[1]);
+
+	/* Interleave even and odd pixels */
+	r = vzipq_u8(vcombine_u8(re[0], re[1]), vcombine_u8(ro[0], ro[1]));
+	g = vzipq_u8(vcombine_u8(ge[0], ge[1]), vcombine_u8(go[0], go[1]));
+	b = vzipq_u8(vcombine_u8(be[0], be[1]), vcombine_u8(bo[0], bo[1]));
+
+	out.val[0] = bgr ? b.val[0] : r.val[0];
+	out.val[1] = g.val[0];
+	out.val[2] = bgr ? r.val[0] : b.val[0];
+	vst3q_u8(dest, out);
+	out.val[0] = bgr ? b.val[1] : r.val[1];
+	out.val[1] = g.val[1];
+	out.val[2] = bgr ? r.val[1] : b.val[1];
+	vst3q_u8(dest + 48, out);
+}
+
+static int yuv422_to_rgb24_neon(
+		const struct v4lconvert_yuv_coefs *coefs, const unsigned char *src,
+		unsigned char *dest, int width, int order, int bgr)
+{
+	const struct v4lconvert_yuv_coefs k = *coefs;
+	int x;
+
+	for (x = 0; x + 32 <= width; x += 32) {
+		uint8x16x4_t in = vld4q_u8(src);
+
+		switch (order) {
+		case V4LCONVERT_ORDER_YUYV:
+			yuv_to_rgb24_32_neon(dest, &k, in.val[0], in.val[2],
+					     in.val[1], in.val[3], bgr);
+			break;
+		case V4LCONVERT_ORDER_YVYU:
+			yuv_to_rgb24_32_neon(dest, &k, in.val[0], in.val[2],
+					     in.val[3], in.val[1], bgr);
+			break;
+		case V4LCONVERT_ORDER_UYVY:
+			yuv_to_rgb24_32_neon(dest, &k, in.val[1], in.val[3],
+					     in.val[0], in.val[2], bgr);
+			break;
+		}
+		src += 64;
+		dest += 96;
+	}
+
+	return x;
+}
+
+static int yuv420_to_rgb24_neon(
+		const struct v4lconvert_yuv_coefs *coefs, const unsigned char *ysrc,
+		const unsigned char *usrc, const unsigned char *vsrc,
+		unsigned char *dest, int width, int bgr)
+{
+	const struct v4lconvert_yuv_coefs k = *coefs;
+	int x;
+
+	for (x = 0; x + 32 <= width; x += 32) {
+		uint8x16x2_t y = vld2q_u8(ysrc);
+
+		yuv_to_rgb24_32_neon(dest, &k, y.val[0], y.val[1],
+				     vld1q_u8(usrc), vld1q_u8(vsrc), bgr);
+		ysrc += 32;
+		usrc += 16;
+		vsrc += 16;
+		dest += 96;
+	}
+
+	return x;
+}
+
+static int nv12_to_rgb24_neon(
+		const struct v4lconvert_yuv_coefs *coefs, const unsigned char *ysrc,
+		const unsigned char *uvsrc, unsigned char *dest, int width,
+		int vu, int bgr)
+{
+	const struct v4lconvert_yuv_coefs k = *coefs;
+	int x;
+
+	for (x = 0; x + 32 <= width; x += 32) {
+		uint8x16x2_t y = vld2q_u8(ysrc);
+		uint8x16x2_t c = vld2q_u8(uvsrc);
+
+		yuv_to_rgb24_32_neon(dest, &k, y.val[0], y.val[1], c.val[vu],
+				     c.val[!vu], bgr);
+		ysrc += 32;
+		uvsrc += 32;
+		dest += 96;
+	}
+
+	return x;
+}
+
+#endif /* HAVE_V4LCONVERT_NEON */
+
+int v4lconvert_simd_yuv422_to_rgb24(int cpu_flags,
+		const struct v4lconvert_yuv_coefs *coefs, const unsigned char *src,
+		unsigned char *dest, int width, int order, int bgr)
+{
+	int x = 0;
+
+#ifdef HAVE_V4LCONVERT_X86_SIMD
+	if (cpu_flags & V4LCONVERT_CPU_AVX2)
+		x = yuv422_to_rgb24_avx2(coefs, src, dest, width, order, bgr);
+	if (cpu_flags & V4LCONVERT_CPU_SSSE3)
+		x += yuv422_to_rgb24_ssse3(coefs, src + x * 2, dest + x * 3,
+					   width - x, order, bgr);
+#endif
+#ifdef HAVE_V4LCONVERT_NEON
+	if (cpu_flags & V4LCONVERT_CPU_NEON)
+		x = yuv422_to_rgb24_neon(coefs, src, dest, width, order, bgr);
+#endif
+
+	return x;
+}
+
+int v4lconvert_simd_yuv420_to_rgb24(int cpu_flags,
+		const struct v4lconvert_yuv_coefs *coefs, const unsigned char *ysrc,
+		const unsigned char *usrc, const unsigned char *vsrc,
+		unsigned char *dest, int width, int bgr)
+{
+	int x = 0;
+
+#ifdef HAVE_V4LCONVERT_X86_SIMD
+	if (cpu_flags & V4LCONVERT_CPU_AVX2)
+		x = yuv420_to_rgb24_avx2(coefs, ysrc, usrc, vsrc, dest, width,
+					 bgr);
+	if (cpu_flags & V4LCONVERT_CPU_SSSE3)
+		x += yuv420_to_rgb24_ssse3(coefs, ysrc + x, usrc + x / 2,
+					   vsrc + x / 2, dest + x * 3,
+					   width - x, bgr);
+#endif
+#ifdef HAVE_V4LCONVERT_NEON
+	if (cpu_flags & V4LCONVERT_CPU_NEON)
+		x = yuv420_to_rgb24_neon(coefs, ysrc, usrc, vsrc, dest, width,
+					 bgr);
+#endif
+
+	return x;
+}
+
+int v4lconvert_simd_nv12_to_rgb24(int cpu_flags,
+		const struct v4lconvert_yuv_coefs *coefs, const unsigned char *ysrc,
+		const unsigned char *uvsrc, unsigned char *dest, int width,
+		int vu, int bgr)
+{
+	int x = 0;
+
+#ifdef HAVE_V4LCONVERT_X86_SIMD
+	if (cpu_flags & V4LCONVERT_CPU_AVX2)
+		x = nv12_to_rgb24_avx2(coefs, ysrc, uvsrc, dest, width, vu,
+				       bgr);
+	if (cpu_flags & V4LCONVERT_CPU_SSSE3)
+		x += nv12_to_rgb24_ssse3(coefs, ysrc + x, uvsrc + x,
+					 dest + x * 3, width - x, vu, bgr);
+#endif
+#ifdef HAVE_V4LCONVERT_NEON
+	if (cpu_flags & V4LCONVERT_CPU_NEON)
+		x = nv12_to_rgb24_neon(coefs, ysrc, uvsrc, dest, width, vu,
+				       bgr);
+#endif
+
+	return x;
+}
+
+int v4lconvert_simd_nv24_to_rgb24(int cpu_flags,
+		const struct v4lconvert_yuv_coefs *coefs, const unsigned char *ysrc,
+		const unsigned char *uvsrc, unsigned char *dest, int width,
+		int vu, int bgr)
+{
+	int x = 0;
+
+#ifdef HAVE_V4LCONVERT_X86_SIMD
+	if (cpu_flags & V4LCONVERT_CPU_AVX2)
+		x = nv24_to_rgb24_avx2(coefs, ysrc, uvsrc, dest, width, vu,
+				       bgr);
+	if (cpu_flags & V4LCONVERT_CPU_SSSE3)
+		x += nv24_to_rgb24_ssse3(coefs, ysrc + x, uvsrc + x * 2,
+					 dest + x * 3, width - x, vu, bgr);
+#endif
+
+	return x;
+}
@@ -25,15 +25,6 @@
 #include <string.h>
 #include "libv4lconvert-priv.h"
 
-#define RGB2Y(r, g, b, y) \
-	(y) = ((8453 * (r) + 16594 * (g) + 3223 * (b) + 524288) >> 15)
-
-#define RGB2UV(r, g, b, u, v) 	\
-	do {			\
-		(u) = ((-4878 * (r) - 9578 * (g) + 14456 * (b) + 4210688) >> 15); \
-		(v) = ((14456 * (r) - 12105 * (g) - 2351 * (b) + 4210688) >> 15); \
-	} while (0)
-
 void v4lconvert_rgb24_to_yuv420(const unsigned char *src, unsigned char *dest,
 		const struct v4l2_format *src_fmt, int bgr, int yvu, int bpp)
 {
@@ -83,172 +74,640 @@ void v4lconvert_rgb24_to_yuv420(const unsigned char *src, unsigned char *dest,
 	}
 }
 
-#define YUV2R(y, u, v) ({ \
-		int r = (y) + ((((v) - 128) * 1436) >> 10); r > 255 ? 255 : r < 0 ? 0 : r; })
-#define YUV2G(y, u, v) ({ \
-		int g = (y) - ((((u) - 128) * 352 + ((v) - 128) * 731) >> 10); g > 255 ? 255 : g < 0 ? 0 : g; })
-#define YUV2B(y, u, v) ({ \
-		int b = (y) + ((((u) - 128) * 1814) >> 10); b > 255 ? 255 : b < 0 ? 0 : b; })
-
-#define CLIP(color) (unsigned char)(((color) > 0xFF) ? 0xff : (((color) < 0) ? 0 : (color)))
-
-void v4lconvert_yuv420_to_bgr24(const unsigned char *src, unsigned char *dest,
-		int width, int height, int yvu)
+/* Generated from the Kr and Kb of each encoding, for limited range the y
+   term is exact at mid gray. The largest difference from floating point
+   math is 2, the average 0.3. */
+static const struct v4lconvert_yuv_coefs v4lconvert_yuv_coefs_table[][2] = {
+	/*   limited range                       full range */
+	{ { 75, -1221, 129, -25, -52, 102 }, { 64, 32, 113, -22, -46,  90 } },
+	{ { 75, -1221, 135, -14, -34, 115 }, { 64, 32, 119, -12, -30, 101 } },
+	{ { 75, -1221, 137, -12, -42, 107 }, { 64, 32, 120, -11, -37,  94 } },
+	{ { 75, -1221, 133, -17, -35, 115 }, { 64, 32, 117, -15, -31, 101 } },
+};
+
+enum {
+	V4LCONVERT_YUV_COEFS_601,
+	V4LCONVERT_YUV_COEFS_709,
+	V4LCONVERT_YUV_COEFS_BT2020,
+	V4LCONVERT_YUV_COEFS_SMPTE240M,
+};
+
+const struct v4lconvert_yuv_coefs *v4lconvert_get_yuv_coefs(
+		const struct v4l2_format *fmt)
 {
-	int i, j;
+	const struct v4l2_pix_format *pix = &fmt->fmt.pix;
+	unsigned int enc = V4L2_YCBCR_ENC_DEFAULT;
+	unsigned int quant = V4L2_QUANTIZATION_DEFAULT;
+	int table;
+
+	/* The ycbcr_enc and quantization fields are only valid when priv is
+	   set to the magic value */
+	if (pix->priv == V4L2_PIX_FMT_PRIV_MAGIC) {
+		enc = pix->ycbcr_enc;
+		quant = pix->quantization;
+	}
+	if (enc == V4L2_YCBCR_ENC_DEFAULT)
+		enc = V4L2_MAP_YCBCR_ENC_DEFAULT(pix->colorspace);
+	if (quant == V4L2_QUANTIZATION_DEFAULT)
+		quant = V4L2_MAP_QUANTIZATION_DEFAULT(0, pix->colorspace, enc);
+
+	switch (enc) {
+	case V4L2_YCBCR_ENC_709:
+	case V4L2_YCBCR_ENC_XV709:
+		table = V4LCONVERT_YUV_COEFS_709;
+		break;
+	case V4L2_YCBCR_ENC_BT2020:
+	case V4L2_YCBCR_ENC_BT2020_CONST_LUM:
+		/* constant luminance is not linear in y'cbcr, the non
+		   constant luminance matrix comes closest */
+		table = V4LCONVERT_YUV_COEFS_BT2020;
+		break;
+	case V4L2_YCBCR_ENC_SMPTE240M:
+		table = V4LCONVERT_YUV_COEFS_SMPTE240M;
+		break;
+	default:
+		table = V4LCONVERT_YUV_COEFS_601;
+		break;
+	}
+
+	return &v4lconvert_yuv_coefs_table[table]
+			[quant == V4L2_QUANTIZATION_FULL_RANGE];
+}
 
-	const unsigned char *ysrc = src;
-	const unsigned char *usrc, *vsrc;
+struct yuv420_band_args {
+	struct v4lconvert_data *data;
+	const struct v4lconvert_planes *src;
+	unsigned char *dest;
+	int width;
+	int height;
+};
 
+void v4lconvert_yuv420_planes(struct v4lconvert_planes *planes,
+		const unsigned char *src, int width, int height, int yvu)
+{
+	planes->plane[0] = src;
 	if (yvu) {
-		vsrc = src + width * height;
-		usrc = vsrc + (width * height) / 4;
+		planes->plane[2] = src + width * height;
+		planes->plane[1] = planes->plane[2] + (width * height) / 4;
 	} else {
-		usrc = src + width * height;
-		vsrc = usrc + (width * height) / 4;
+		planes->plane[1] = src + width * height;
+		planes->plane[2] = planes->plane[1] + (width * height) / 4;
 	}
+	planes->stride[0] = width;
+	planes->stride[1] = planes->stride[2] = width / 2;
+}
 
-	for (i = 0; i < height; i++) {
-		for (j = 0; j < width; j += 2) {
-#if 1 /* fast slightly less accurate multiplication free code */
-			int u1 = (((*usrc - 128) << 7) +  (*usrc - 128)) >> 6;
-			int rg = (((*usrc - 128) << 1) +  (*usrc - 128) +
-					((*vsrc - 128) << 2) + ((*vsrc - 128) << 1)) >> 3;
-			int v1 = (((*vsrc - 128) << 1) +  (*vsrc - 128)) >> 1;
-
-			*dest++ = CLIP(*ysrc + u1);
-			*dest++ = CLIP(*ysrc - rg);
-			*dest++ = CLIP(*ysrc + v1);
-			ysrc++;
-
-			*dest++ = CLIP(*ysrc + u1);
-			*dest++ = CLIP(*ysrc - rg);
-			*dest++ = CLIP(*ysrc + v1);
-#else
-			*dest++ = YUV2B(*ysrc, *usrc, *vsrc);
-			*dest++ = YUV2G(*ysrc, *usrc, *vsrc);
-			*dest++ = YUV2R(*ysrc, *usrc, *vsrc);
-			ysrc++;
-
-			*dest++ = YUV2B(*ysrc, *usrc, *vsrc);
-			*dest++ = YUV2G(*ysrc, *usrc, *vsrc);
-			*dest++ = YUV2R(*ysrc, *usrc, *vsrc);
-#endif
-			ysrc++;
+void v4lconvert_nv_planes(struct v4lconvert_planes *planes,
+		const unsigned char *src, int height, int stride,
+		int uvstride)
+{
+	planes->plane[0] = src;
+	planes->plane[1] = src + stride * height;
+	planes->plane[2] = NULL;
+	planes->stride[0] = stride;
+	planes->stride[1] = uvstride;
+	planes->stride[2] = 0;
+}
+
+/* The chroma line of luma line y. Our yuv 4:2:0 frames have height / 2
+   chroma lines, so the last line of an odd height frame shares the chroma
+   of the line above it */
+static int yuv420_uv_line(int y, int height)
+{
+	y /= 2;
+	if (y && y == height / 2)
+		y--;
+	return y;
+}
+
+static void yuv420_to_bgr24_band(void *arg, int first_row, int height)
+{
+	struct yuv420_band_args *args = arg;
+	const struct v4lconvert_yuv_coefs coefs = *args->data->yuv_coefs;
+	int i, j, width = args->width;
+
+	const struct v4lconvert_planes *src = args->src;
+	const unsigned char *ysrc, *usrc, *vsrc;
+	unsigned char *dest, *line;
+
+	for (i = first_row; i < first_row + height; i++) {
+		ysrc = src->plane[0] + i * src->stride[0];
+		usrc = src->plane[1] + yuv420_uv_line(i, args->height) *
+			src->stride[1];
+		vsrc = src->plane[2] + yuv420_uv_line(i, args->height) *
+			src->stride[2];
+		line = dest = v4lconvert_fused_line(args->data, args->dest,
+				i, width, args->height);
+		j = v4lconvert_simd_yuv420_to_rgb24(args->data->cpu_flags,
+				&coefs, ysrc, usrc, vsrc, dest, width, 1);
+		ysrc += j;
+		usrc += j / 2;
+		vsrc += j / 2;
+		dest += j * 3;
+		for (; j < width; j += 2) {
+			v4lconvert_yuv_to_rgb24_pair(&coefs, dest, ysrc[0],
+					ysrc[1], *usrc - 128, *vsrc - 128, 1);
+			ysrc += 2;
 			usrc++;
 			vsrc++;
+			dest += 6;
 		}
-		/* Rewind u and v for next line */
-		if (!(i & 1)) {
-			usrc -= width / 2;
-			vsrc -= width / 2;
+		v4lconvert_fused_finish_line(args->data, line, width);
+	}
+}
+
+
+static void yuv420_to_rgb24_band(void *arg, int first_row, int height)
+{
+	struct yuv420_band_args *args = arg;
+	const struct v4lconvert_yuv_coefs coefs = *args->data->yuv_coefs;
+	int i, j, width = args->width;
+
+	const struct v4lconvert_planes *src = args->src;
+	const unsigned char *ysrc, *usrc, *vsrc;
+	unsigned char *dest, *line;
+
+	for (i = first_row; i < first_row + height; i++) {
+		ysrc = src->plane[0] + i * src->stride[0];
+		usrc = src->plane[1] + yuv420_uv_line(i, args->height) *
+			src->stride[1];
+		vsrc = src->plane[2] + yuv420_uv_line(i, args->height) *
+			src->stride[2];
+		line = dest = v4lconvert_fused_line(args->data, args->dest,
+				i, width, args->height);
+		j = v4lconvert_simd_yuv420_to_rgb24(args->data->cpu_flags,
+				&coefs, ysrc, usrc, vsrc, dest, width, 0);
+		ysrc += j;
+		usrc += j / 2;
+		vsrc += j / 2;
+		dest += j * 3;
+		for (; j < width; j += 2) {
+			v4lconvert_yuv_to_rgb24_pair(&coefs, dest, ysrc[0],
+					ysrc[1], *usrc - 128, *vsrc - 128, 0);
+			ysrc += 2;
+			usrc++;
+			vsrc++;
+			dest += 6;
 		}
+		v4lconvert_fused_finish_line(args->data, line, width);
 	}
 }
 
-void v4lconvert_yuv420_to_rgb24(const unsigned char *src, unsigned char *dest,
+void v4lconvert_yuv420_planes_to_rgb24(struct v4lconvert_data *data,
+		const struct v4lconvert_planes *src, unsigned char *dest,
+		int width, int height, int bgr)
+{
+	struct yuv420_band_args args = { data, src, dest, width, height };
+
+	v4lconvert_run_bands(data->threads, bgr ? yuv420_to_bgr24_band :
+			     yuv420_to_rgb24_band, &args, height, 2);
+}
+
+void v4lconvert_yuv420_to_rgb24(struct v4lconvert_data *data,
+		const unsigned char *src, unsigned char *dest,
 		int width, int height, int yvu)
 {
-	int i, j;
+	struct v4lconvert_planes planes;
 
-	const unsigned char *ysrc = src;
-	const unsigned char *usrc, *vsrc;
+	v4lconvert_yuv420_planes(&planes, src, width, height, yvu);
+	v4lconvert_yuv420_planes_to_rgb24(data, &planes, dest, width, height,
+					  0);
+}
 
+void v4lconvert_yuv420_to_bgr24(struct v4lconvert_data *data,
+		const unsigned char *src, unsigned char *dest,
+		int width, int height, int yvu)
+{
+	struct v4lconvert_planes planes;
+
+	v4lconvert_yuv420_planes(&planes, src, width, height, yvu);
+	v4lconvert_yuv420_planes_to_rgb24(data, &planes, dest, width, height,
+					  1);
+}
+
+/* For the semi planar nv12 / nv21 and nv24 / nv42 formats, these have a Y
+   plane and a plane of interleaved U and V (V and U for nv21 / nv42) values,
+   which for the multi-planar nv12m / nv21m are in separate buffers */
+struct nv_band_args {
+	struct v4lconvert_data *data;
+	const struct v4lconvert_planes *src;
+	unsigned char *dest;
+	int width;
+	int height;
+	int vu;
+	int bgr;
+};
+
+static void nv12_to_rgbbgr24_band(void *arg, int first_row, int rows)
+{
+	struct nv_band_args *args = arg;
+	const struct v4lconvert_planes *src = args->src;
+	const struct v4lconvert_yuv_coefs coefs = *args->data->yuv_coefs;
+	const unsigned char *ysrc, *uvsrc;
+	unsigned char *dest;
+	int i, j, c, width = args->width;
+
+	for (i = first_row; i < first_row + rows; i++) {
+		ysrc = src->plane[0] + i * src->stride[0];
+		uvsrc = src->plane[1] + yuv420_uv_line(i, args->height) *
+			src->stride[1];
+		dest = v4lconvert_fused_line(args->data, args->dest, i,
+					     width, args->height);
+		j = v4lconvert_simd_nv12_to_rgb24(args->data->cpu_flags,
+				&coefs, ysrc, uvsrc, dest, width, args->vu,
+				args->bgr);
+		for (; j < width; j++) {
+			c = j & ~1;
+			v4lconvert_yuv_to_rgb24_pixel(&coefs, dest + j * 3,
+					ysrc[j], uvsrc[c + args->vu] - 128,
+					uvsrc[c + !args->vu] - 128, args->bgr);
+		}
+		v4lconvert_fused_finish_line(args->data, dest, width);
+	}
+}
+
+static void nv24_to_rgbbgr24_band(void *arg, int first_row, int rows)
+{
+	struct nv_band_args *args = arg;
+	const struct v4lconvert_planes *src = args->src;
+	const struct v4lconvert_yuv_coefs coefs = *args->data->yuv_coefs;
+	const unsigned char *ysrc, *uvsrc;
+	unsigned char *dest;
+	int i, j, width = args->width;
+
+	for (i = first_row; i < first_row + rows; i++) {
+		ysrc = src->plane[0] + i * src->stride[0];
+		uvsrc = src->plane[1] + i * src->stride[1];
+		dest = v4lconvert_fused_line(args->data, args->dest, i,
+					     width, args->height);
+		j = v4lconvert_simd_nv24_to_rgb24(args->data->cpu_flags,
+				&coefs, ysrc, uvsrc, dest, width, args->vu,
+				args->bgr);
+		for (; j < width; j++)
+			v4lconvert_yuv_to_rgb24_pixel(&coefs, dest + j * 3,
+					ysrc[j], uvsrc[2 * j + args->vu] - 128,
+					uvsrc[2 * j + !args->vu] - 128,
+					args->bgr);
+		v4lconvert_fused_finish_line(args->data, dest, width);
+	}
+}
+
+void v4lconvert_nv12_to_rgb24(struct v4lconvert_data *data,
+		const struct v4lconvert_planes *src, unsigned char *dest,
+		int width, int height, int vu, int bgr)
+{
+	struct nv_band_args args = {
+		data, src, dest, width, height, vu, bgr
+	};
+
+	v4lconvert_run_bands(data->threads, nv12_to_rgbbgr24_band, &args,
+			     height, 2);
+}
+
+void v4lconvert_nv24_to_rgb24(struct v4lconvert_data *data,
+		const struct v4lconvert_planes *src, unsigned char *dest,
+		int width, int height, int vu, int bgr)
+{
+	struct nv_band_args args = {
+		data, src, dest, width, height, vu, bgr
+	};
+
+	v4lconvert_run_bands(data->threads, nv24_to_rgbbgr24_band, &args,
+			     height, 1);
+}
+
+void v4lconvert_copy_plane(const unsigned char *src, unsigned char *dest,
+		int width, int height, int stride)
+{
+	int i;
+
+	for (i = 0; i < height; i++) {
+		memcpy(dest, src, width);
+		src += stride;
+		dest += width;
+	}
+}
+
+void v4lconvert_yuv420_planes_to_yuv420(const struct v4lconvert_planes *src,
+		unsigned char *dest, int width, int height, int yvu)
+{
+	unsigned char *udest, *vdest;
+
+	udest = dest + width * height;
+	vdest = udest + width * height / 4;
 	if (yvu) {
-		vsrc = src + width * height;
-		usrc = vsrc + (width * height) / 4;
-	} else {
-		usrc = src + width * height;
-		vsrc = usrc + (width * height) / 4;
+		udest = vdest;
+		vdest = dest + width * height;
+	}
+	v4lconvert_copy_plane(src->plane[0], dest, width, height,
+			      src->stride[0]);
+	v4lconvert_copy_plane(src->plane[1], udest, width / 2, height / 2,
+			      src->stride[1]);
+	v4lconvert_copy_plane(src->plane[2], vdest, width / 2, height / 2,
+			      src->stride[2]);
+}
+
+void v4lconvert_nv12_to_yuv420(struct v4lconvert_data *data,
+		const struct v4lconvert_planes *src, unsigned char *dest,
+		int width, int height, int vu, int yvu)
+{
+	const unsigned char *uvsrc = src->plane[1];
+	unsigned char *udest, *vdest;
+	int i, j;
+
+	v4lconvert_copy_plane(src->plane[0], dest, width, height,
+			      src->stride[0]);
+
+	/* Splitting the interleaved chroma into 2 planes, swapping the planes
+	   takes care of both nv21 and yvu420 */
+	udest = dest + width * height;
+	vdest = udest + width * height / 4;
+	if (vu ^ yvu) {
+		udest = vdest;
+		vdest = dest + width * height;
+	}
+	for (i = 0; i < height / 2; i++) {
+		j = v4lconvert_simd_split_uv(data->cpu_flags, uvsrc, udest,
+					     vdest, width / 2);
+		for (; j < width / 2; j++) {
+			udest[j] = uvsrc[2 * j];
+			vdest[j] = uvsrc[2 * j + 1];
+		}
+		uvsrc += src->stride[1];
+		udest += width / 2;
+		vdest += width / 2;
+	}
+}
+
+void v4lconvert_nv24_to_yuv420(const struct v4lconvert_planes *src,
+		unsigned char *dest, int width, int height, int vu, int yvu)
+{
+	const unsigned char *uvsrc = src->plane[1];
+	const unsigned char *uvsrc1 = uvsrc + src->stride[1];
+	unsigned char *udest, *vdest;
+	int i, j;
+
+	v4lconvert_copy_plane(src->plane[0], dest, width, height,
+			      src->stride[0]);
+
+	/* Average each 2x2 block of chroma values */
+	udest = dest + width * height;
+	vdest = udest + width * height / 4;
+	if (vu ^ yvu) {
+		udest = vdest;
+		vdest = dest + width * height;
+	}
+	for (i = 0; i < height / 2; i++) {
+		for (j = 0; j < width / 2; j++) {
+			*udest++ = (uvsrc[4 * j] + uvsrc[4 * j + 2] +
+				    uvsrc1[4 * j] + uvsrc1[4 * j + 2] + 2) >> 2;
+			*vdest++ = (uvsrc[4 * j + 1] + uvsrc[4 * j + 3] +
+				    uvsrc1[4 * j + 1] + uvsrc1[4 * j + 3] + 2) >> 2;
+		}
+		uvsrc += 2 * src->stride[1];
+		uvsrc1 += 2 * src->stride[1];
+	}
+}
+
+void v4lconvert_nv12_to_nv12(const struct v4lconvert_planes *src,
+		unsigned char *dest, int width, int height, int vu)
+{
+	const unsigned char *uvsrc = src->plane[1];
+	int i, j;
+
+	v4lconvert_copy_plane(src->plane[0], dest, width, height,
+			      src->stride[0]);
+	dest += width * height;
+
+	if (!vu) {
+		v4lconvert_copy_plane(uvsrc, dest, width, height / 2,
+				      src->stride[1]);
+		return;
 	}
 
+	for (i = 0; i < height / 2; i++) {
+		for (j = 0; j + 1 < width; j += 2) {
+			dest[j] = uvsrc[j + 1];
+			dest[j + 1] = uvsrc[j];
+		}
+		uvsrc += src->stride[1];
+		dest += width;
+	}
+}
+
+void v4lconvert_nv12_to_yuyv(struct v4lconvert_data *data,
+		const struct v4lconvert_planes *src, unsigned char *dest,
+		int width, int height, int vu)
+{
+	const unsigned char *ysrc, *uvsrc;
+	int i, j;
+
 	for (i = 0; i < height; i++) {
-		for (j = 0; j < width; j += 2) {
-#if 1 /* fast slightly less accurate multiplication free code */
-			int u1 = (((*usrc - 128) << 7) +  (*usrc - 128)) >> 6;
-			int rg = (((*usrc - 128) << 1) +  (*usrc - 128) +
-					((*vsrc - 128) << 2) + ((*vsrc - 128) << 1)) >> 3;
-			int v1 = (((*vsrc - 128) << 1) +  (*vsrc - 128)) >> 1;
-
-			*dest++ = CLIP(*ysrc + v1);
-			*dest++ = CLIP(*ysrc - rg);
-			*dest++ = CLIP(*ysrc + u1);
-			ysrc++;
-
-			*dest++ = CLIP(*ysrc + v1);
-			*dest++ = CLIP(*ysrc - rg);
-			*dest++ = CLIP(*ysrc + u1);
-#else
-			*dest++ = YUV2R(*ysrc, *usrc, *vsrc);
-			*dest++ = YUV2G(*ysrc, *usrc, *vsrc);
-			*dest++ = YUV2B(*ysrc, *usrc, *vsrc);
-			ysrc++;
-
-			*dest++ = YUV2R(*ysrc, *usrc, *vsrc);
-			*dest++ = YUV2G(*ysrc, *usrc, *vsrc);
-			*dest++ = YUV2B(*ysrc, *usrc, *vsrc);
-#endif
-			ysrc++;
-			usrc++;
-			vsrc++;
+		ysrc = src->plane[0] + i * src->stride[0];
+		uvsrc = src->plane[1] + yuv420_uv_line(i, height) *
+			src->stride[1];
+		j = v4lconvert_simd_nv12_to_yuyv(data->cpu_flags, ysrc, uvsrc,
+						 dest, width, vu);
+		for (; j + 1 < width; j += 2) {
+			dest[2 * j] = ysrc[j];
+			dest[2 * j + 1] = uvsrc[j + vu];
+			dest[2 * j + 2] = ysrc[j + 1];
+			dest[2 * j + 3] = uvsrc[j + !vu];
 		}
-		/* Rewind u and v for next line */
-		if (!(i&1)) {
-			usrc -= width / 2;
-			vsrc -= width / 2;
+		dest += width * 2;
+	}
+}
+
+void v4lconvert_yuv420_to_nv12(struct v4lconvert_data *data,
+		const struct v4lconvert_planes *src, unsigned char *dest,
+		int width, int height)
+{
+	const unsigned char *usrc = src->plane[1], *vsrc = src->plane[2];
+	int i, j;
+
+	v4lconvert_copy_plane(src->plane[0], dest, width, height,
+			      src->stride[0]);
+	dest += width * height;
+
+	for (i = 0; i < height / 2; i++) {
+		j = v4lconvert_simd_merge_uv(data->cpu_flags, usrc, vsrc, dest,
+					     width / 2);
+		for (; j < width / 2; j++) {
+			dest[2 * j] = usrc[j];
+			dest[2 * j + 1] = vsrc[j];
+		}
+		usrc += src->stride[1];
+		vsrc += src->stride[2];
+		dest += width;
+	}
+}
+
+void v4lconvert_yuv420_to_yuyv(struct v4lconvert_data *data,
+		const struct v4lconvert_planes *src, unsigned char *dest,
+		int width, int height)
+{
+	const unsigned char *ysrc, *usrc, *vsrc;
+	int i, j;
+
+	for (i = 0; i < height; i++) {
+		ysrc = src->plane[0] + i * src->stride[0];
+		usrc = src->plane[1] + yuv420_uv_line(i, height) *
+			src->stride[1];
+		vsrc = src->plane[2] + yuv420_uv_line(i, height) *
+			src->stride[2];
+		j = v4lconvert_simd_yuv420_to_yuyv(data->cpu_flags, ysrc, usrc,
+						   vsrc, dest, width);
+		for (; j + 1 < width; j += 2) {
+			dest[2 * j] = ysrc[j];
+			dest[2 * j + 1] = usrc[j / 2];
+			dest[2 * j + 2] = ysrc[j + 1];
+			dest[2 * j + 3] = vsrc[j / 2];
 		}
+		dest += width * 2;
 	}
 }
 
-void v4lconvert_yuyv_to_bgr24(const unsigned char *src, unsigned char *dest,
+/* Offsets of the first Y, U, second Y and V value in a packed yuv 4:2:2 pixel
+   pair, per byte order */
+static const unsigned char yuv422_offsets[3][4] = {
+	[V4LCONVERT_ORDER_YUYV] = { 0, 1, 2, 3 },
+	[V4LCONVERT_ORDER_YVYU] = { 0, 3, 2, 1 },
+	[V4LCONVERT_ORDER_UYVY] = { 1, 0, 3, 2 },
+};
+
+void v4lconvert_yuv422_to_grey(struct v4lconvert_data *data,
+		const unsigned char *src, unsigned char *dest,
+		int width, int height, int stride, int order)
+{
+	int i, j, y = yuv422_offsets[order][0];
+
+	for (i = 0; i < height; i++) {
+		j = v4lconvert_simd_yuv422_to_y(data->cpu_flags, src, dest,
+						width, order);
+		for (; j < width; j++)
+			dest[j] = src[2 * j + y];
+		src += stride;
+		dest += width;
+	}
+}
+
+void v4lconvert_yuv422_to_nv12(struct v4lconvert_data *data,
+		const unsigned char *src, unsigned char *dest,
+		int width, int height, int stride, int order)
+{
+	const unsigned char *src1;
+	int i, j, u = yuv422_offsets[order][1], v = yuv422_offsets[order][3];
+
+	v4lconvert_yuv422_to_grey(data, src, dest, width, height, stride,
+				  order);
+	dest += width * height;
+
+	/* Average the chroma of each 2 lines, like yuyv_to_yuv420 does */
+	for (i = 0; i < height / 2; i++) {
+		src1 = src + stride;
+		j = v4lconvert_simd_yuv422_to_uv(data->cpu_flags, src, src1,
+						 dest, width, order);
+		for (; j + 1 < width; j += 2) {
+			dest[j] = (src[2 * j + u] + src1[2 * j + u]) / 2;
+			dest[j + 1] = (src[2 * j + v] + src1[2 * j + v]) / 2;
+		}
+		src += 2 * stride;
+		dest += width;
+	}
+}
+
+void v4lconvert_yuv422_to_yuyv(const unsigned char *src, unsigned char *dest,
+		int width, int height, int stride, int order)
+{
+	const unsigned char *o = yuv422_offsets[order];
+	int i, j;
+
+	for (i = 0; i < height; i++) {
+		for (j = 0; j + 1 < width; j += 2) {
+			dest[2 * j] = src[2 * j + o[0]];
+			dest[2 * j + 1] = src[2 * j + o[1]];
+			dest[2 * j + 2] = src[2 * j + o[2]];
+			dest[2 * j + 3] = src[2 * j + o[3]];
+		}
+		src += stride;
+		dest += width * 2;
+	}
+}
+
+/* Note this is also used to expand a line in place, with src pointing width
+   bytes into dest, see v4lconvert_fused_finish_line() */
+void v4lconvert_rgb24_to_rgb32_line(struct v4lconvert_data *data,
+		const unsigned char *src, unsigned char *dest, int width)
+{
+	unsigned char r, g, b;
+	int j;
+
+	j = v4lconvert_simd_rgb24_to_rgb32(data->cpu_flags, src, dest, width);
+	src += j * 3;
+	dest += j * 4;
+	for (; j < width; j++) {
+		r = src[0];
+		g = src[1];
+		b = src[2];
+		dest[0] = 0xff;
+		dest[1] = r;
+		dest[2] = g;
+		dest[3] = b;
+		src += 3;
+		dest += 4;
+	}
+}
+
+void v4lconvert_rgb24_to_rgb32(struct v4lconvert_data *data,
+		const unsigned char *src, unsigned char *dest,
+		int width, int height)
+{
+	while (--height >= 0) {
+		v4lconvert_rgb24_to_rgb32_line(data, src, dest, width);
+		src += width * 3;
+		dest += width * 4;
+	}
+}
+
+void v4lconvert_yuyv_to_bgr24(struct v4lconvert_data *data,
+		const unsigned char *src, unsigned char *dest,
 		int width, int height, int stride)
 {
+	const struct v4lconvert_yuv_coefs coefs = *data->yuv_coefs;
 	int j;
 
 	while (--height >= 0) {
-		for (j = 0; j + 1 < width; j += 2) {
-			int u = src[1];
-			int v = src[3];
-			int u1 = (((u - 128) << 7) +  (u - 128)) >> 6;
-			int rg = (((u - 128) << 1) +  (u - 128) +
-					((v - 128) << 2) + ((v - 128) << 1)) >> 3;
-			int v1 = (((v - 128) << 1) +  (v - 128)) >> 1;
-
-			*dest++ = CLIP(src[0] + u1);
-			*dest++ = CLIP(src[0] - rg);
-			*dest++ = CLIP(src[0] + v1);
-
-			*dest++ = CLIP(src[2] + u1);
-			*dest++ = CLIP(src[2] - rg);
-			*dest++ = CLIP(src[2] + v1);
+		j = v4lconvert_simd_yuv422_to_rgb24(data->cpu_flags, &coefs,
+				src, dest, width, V4LCONVERT_ORDER_YUYV, 1);
+		src += j * 2;
+		dest += j * 3;
+		for (; j + 1 < width; j += 2) {
+			v4lconvert_yuv_to_rgb24_pair(&coefs, dest, src[0],
+					src[2], src[1] - 128, src[3] - 128, 1);
 			src += 4;
+			dest += 6;
 		}
 		src += stride - width * 2;
 	}
 }
 
-void v4lconvert_yuyv_to_rgb24(const unsigned char *src, unsigned char *dest,
+void v4lconvert_yuyv_to_rgb24(struct v4lconvert_data *data,
+		const unsigned char *src, unsigned char *dest,
 		int width, int height, int stride)
 {
+	const struct v4lconvert_yuv_coefs coefs = *data->yuv_coefs;
 	int j;
 
 	while (--height >= 0) {
-		for (j = 0; j + 1 < width; j += 2) {
-			int u = src[1];
-			int v = src[3];
-			int u1 = (((u - 128) << 7) +  (u - 128)) >> 6;
-			int rg = (((u - 128) << 1) +  (u - 128) +
-					((v - 128) << 2) + ((v - 128) << 1)) >> 3;
-			int v1 = (((v - 128) << 1) +  (v - 128)) >> 1;
-
-			*dest++ = CLIP(src[0] + v1);
-			*dest++ = CLIP(src[0] - rg);
-			*dest++ = CLIP(src[0] + u1);
-
-			*dest++ = CLIP(src[2] + v1);
-			*dest++ = CLIP(src[2] - rg);
-			*dest++ = CLIP(src[2] + u1);
+		j = v4lconvert_simd_yuv422_to_rgb24(data->cpu_flags, &coefs,
+				src, dest, width, V4LCONVERT_ORDER_YUYV, 0);
+		src += j * 2;
+		dest += j * 3;
+		for (; j + 1 < width; j += 2) {
+			v4lconvert_yuv_to_rgb24_pair(&coefs, dest, src[0],
+					src[2], src[1] - 128, src[3] - 128, 0);
 			src += 4;
+			dest += 6;
 		}
 		src += stride - (width * 2);
 	}
@@ -282,7 +741,8 @@ void v4lconvert_yuyv_to_yuv420(const unsigned char *src, unsigned char *dest,
 		udest = dest;
 		vdest = dest + width * height / 4;
 	}
-	for (i = 0; i < height; i += 2) {
+	/* Only full line pairs, an odd last line has no chroma line of its own */
+	for (i = 0; i + 1 < height; i += 2) {
 		for (j = 0; j + 1 < width; j += 2) {
 			*udest++ = ((int) src[0] + src1[0]) / 2;	/* U */
 			*vdest++ = ((int) src[2] + src1[2]) / 2;	/* V */
@@ -310,109 +770,89 @@ void v4lconvert_nv16_to_yuyv(const unsigned char *src, unsigned char *dest,
 	}
 }
 
-void v4lconvert_yvyu_to_bgr24(const unsigned char *src, unsigned char *dest,
+void v4lconvert_yvyu_to_bgr24(struct v4lconvert_data *data,
+		const unsigned char *src, unsigned char *dest,
 		int width, int height, int stride)
 {
+	const struct v4lconvert_yuv_coefs coefs = *data->yuv_coefs;
 	int j;
 
 	while (--height >= 0) {
-		for (j = 0; j + 1 < width; j += 2) {
-			int u = src[3];
-			int v = src[1];
-			int u1 = (((u - 128) << 7) +  (u - 128)) >> 6;
-			int rg = (((u - 128) << 1) +  (u - 128) +
-					((v - 128) << 2) + ((v - 128) << 1)) >> 3;
-			int v1 = (((v - 128) << 1) +  (v - 128)) >> 1;
-
-			*dest++ = CLIP(src[0] + u1);
-			*dest++ = CLIP(src[0] - rg);
-			*dest++ = CLIP(src[0] + v1);
-
-			*dest++ = CLIP(src[2] + u1);
-			*dest++ = CLIP(src[2] - rg);
-			*dest++ = CLIP(src[2] + v1);
+		j = v4lconvert_simd_yuv422_to_rgb24(data->cpu_flags, &coefs,
+				src, dest, width, V4LCONVERT_ORDER_YVYU, 1);
+		src += j * 2;
+		dest += j * 3;
+		for (; j + 1 < width; j += 2) {
+			v4lconvert_yuv_to_rgb24_pair(&coefs, dest, src[0],
+					src[2], src[3] - 128, src[1] - 128, 1);
 			src += 4;
+			dest += 6;
 		}
 		src += stride - (width * 2);
 	}
 }
 
-void v4lconvert_yvyu_to_rgb24(const unsigned char *src, unsigned char *dest,
+void v4lconvert_yvyu_to_rgb24(struct v4lconvert_data *data,
+		const unsigned char *src, unsigned char *dest,
 		int width, int height, int stride)
 {
+	const struct v4lconvert_yuv_coefs coefs = *data->yuv_coefs;
 	int j;
 
 	while (--height >= 0) {
-		for (j = 0; j + 1 < width; j += 2) {
-			int u = src[3];
-			int v = src[1];
-			int u1 = (((u - 128) << 7) +  (u - 128)) >> 6;
-			int rg = (((u - 128) << 1) +  (u - 128) +
-					((v - 128) << 2) + ((v - 128) << 1)) >> 3;
-			int v1 = (((v - 128) << 1) +  (v - 128)) >> 1;
-
-			*dest++ = CLIP(src[0] + v1);
-			*dest++ = CLIP(src[0] - rg);
-			*dest++ = CLIP(src[0] + u1);
-
-			*dest++ = CLIP(src[2] + v1);
-			*dest++ = CLIP(src[2] - rg);
-			*dest++ = CLIP(src[2] + u1);
+		j = v4lconvert_simd_yuv422_to_rgb24(data->cpu_flags, &coefs,
+				src, dest, width, V4LCONVERT_ORDER_YVYU, 0);
+		src += j * 2;
+		dest += j * 3;
+		for (; j + 1 < width; j += 2) {
+			v4lconvert_yuv_to_rgb24_pair(&coefs, dest, src[0],
+					src[2], src[3] - 128, src[1] - 128, 0);
 			src += 4;
+			dest += 6;
 		}
 		src += stride - (width * 2);
 	}
 }
 
-void v4lconvert_uyvy_to_bgr24(const unsigned char *src, unsigned char *dest,
+void v4lconvert_uyvy_to_bgr24(struct v4lconvert_data *data,
+		const unsigned char *src, unsigned char *dest,
 		int width, int height, int stride)
 {
+	const struct v4lconvert_yuv_coefs coefs = *data->yuv_coefs;
 	int j;
 
 	while (--height >= 0) {
-		for (j = 0; j + 1 < width; j += 2) {
-			int u = src[0];
-			int v = src[2];
-			int u1 = (((u - 128) << 7) +  (u - 128)) >> 6;
-			int rg = (((u - 128) << 1) +  (u - 128) +
-					((v - 128) << 2) + ((v - 128) << 1)) >> 3;
-			int v1 = (((v - 128) << 1) +  (v - 128)) >> 1;
-
-			*dest++ = CLIP(src[1] + u1);
-			*dest++ = CLIP(src[1] - rg);
-			*dest++ = CLIP(src[1] + v1);
-
-			*dest++ = CLIP(src[3] + u1);
-			*dest++ = CLIP(src[3] - rg);
-			*dest++ = CLIP(src[3] + v1);
+		j = v4lconvert_simd_yuv422_to_rgb24(data->cpu_flags, &coefs,
+				src, dest, width, V4LCONVERT_ORDER_UYVY, 1);
+		src += j * 2;
+		dest += j * 3;
+		for (; j + 1 < width; j += 2) {
+			v4lconvert_yuv_to_rgb24_pair(&coefs, dest, src[1],
+					src[3], src[0] - 128, src[2] - 128, 1);
 			src += 4;
+			dest += 6;
 		}
 		src += stride - width * 2;
 	}
 }
 
-void v4lconvert_uyvy_to_rgb24(const unsigned char *src, unsigned char *dest,
+void v4lconvert_uyvy_to_rgb24(struct v4lconvert_data *data,
+		const unsigned char *src, unsigned char *dest,
 		int width, int height, int stride)
 {
+	const struct v4lconvert_yuv_coefs coefs = *data->yuv_coefs;
 	int j;
 
 	while (--height >= 0) {
-		for (j = 0; j + 1 < width; j += 2) {
-			int u = src[0];
-			int v = src[2];
-			int u1 = (((u - 128) << 7) +  (u - 128)) >> 6;
-			int rg = (((u - 128) << 1) +  (u - 128) +
-					((v - 128) << 2) + ((v - 128) << 1)) >> 3;
-			int v1 = (((v - 128) << 1) +  (v - 128)) >> 1;
-
-			*dest++ = CLIP(src[1] + v1);
-			*dest++ = CLIP(src[1] - rg);
-			*dest++ = CLIP(src[1] + u1);
-
-			*dest++ = CLIP(src[3] + v1);
-			*dest++ = CLIP(src[3] - rg);
-			*dest++ = CLIP(src[3] + u1);
+		j = v4lconvert_simd_yuv422_to_rgb24(data->cpu_flags, &coefs,
+				src, dest, width, V4LCONVERT_ORDER_UYVY, 0);
+		src += j * 2;
+		dest += j * 3;
+		for (; j + 1 < width; j += 2) {
+			v4lconvert_yuv_to_rgb24_pair(&coefs, dest, src[1],
+					src[3], src[0] - 128, src[2] - 128, 0);
 			src += 4;
+			dest += 6;
 		}
 		src += stride - width * 2;
 	}
@@ -445,7 +885,8 @@ void v4lconvert_uyvy_to_yuv420(const unsigned char *src, unsigned char *dest,
 		udest = dest;
 		vdest = dest + width * height / 4;
 	}
-	for (i = 0; i < height; i += 2) {
+	/* Only full line pairs, an odd last line has no chroma line of its own */
+	for (i = 0; i + 1 < height; i += 2) {
 		for (j = 0; j + 1 < width; j += 2) {
 			*udest++ = ((int) src[0] + src1[0]) / 2;	/* U */
 			*vdest++ = ((int) src[2] + src1[2]) / 2;	/* V */
@@ -476,30 +917,21 @@ void v4lconvert_swap_rgb(const unsigned char *src, unsigned char *dst,
 void v4lconvert_swap_uv(const unsigned char *src, unsigned char *dest,
 		const struct v4l2_format *src_fmt)
 {
-	int y;
+	int width = src_fmt->fmt.pix.width;
+	int height = src_fmt->fmt.pix.height;
+	int stride = src_fmt->fmt.pix.bytesperline;
+	const unsigned char *src1 = src + height * stride;
+	const unsigned char *src2 = src1 + height * stride / 4;
 
 	/* Copy Y */
-	for (y = 0; y < src_fmt->fmt.pix.height; y++) {
-		memcpy(dest, src, src_fmt->fmt.pix.width);
-		dest += src_fmt->fmt.pix.width;
-		src += src_fmt->fmt.pix.bytesperline;
-	}
-
-	/* Copy component 2 */
-	src += src_fmt->fmt.pix.height * src_fmt->fmt.pix.bytesperline / 4;
-	for (y = 0; y < src_fmt->fmt.pix.height / 2; y++) {
-		memcpy(dest, src, src_fmt->fmt.pix.width / 2);
-		dest += src_fmt->fmt.pix.width / 2;
-		src += src_fmt->fmt.pix.bytesperline / 2;
-	}
-
-	/* Copy component 1 */
-	src -= src_fmt->fmt.pix.height * src_fmt->fmt.pix.bytesperline / 2;
-	for (y = 0; y < src_fmt->fmt.pix.height / 2; y++) {
-		memcpy(dest, src, src_fmt->fmt.pix.width / 2);
-		dest += src_fmt->fmt.pix.width / 2;
-		src += src_fmt->fmt.pix.bytesperline / 2;
-	}
+	v4lconvert_copy_plane(src, dest, width, height, stride);
+	dest += width * height;
+
+	/* Copy component 2, then component 1. For an odd height the planes
+	   are width * height / 4 apart, not the height / 2 lines they hold */
+	v4lconvert_copy_plane(src2, dest, width / 2, height / 2, stride / 2);
+	dest += width * height / 4;
+	v4lconvert_copy_plane(src1, dest, width / 2, height / 2, stride / 2);
 }
 
 void v4lconvert_rgb565_to_rgb24(const unsigned char *src, unsigned char *dest,
@@ -582,12 +1014,12 @@ void v4lconvert_rgb565_to_yuv420(const unsigned char *src, unsigned char *dest,
 			g[1] = 0xfc & (tmp >> 3);
 			b[1] = 0xf8 & (tmp >> 8);
 
-			tmp = *(((unsigned short *)src) + src_fmt->fmt.pix.bytesperline);
+			tmp = *(unsigned short *)(src + src_fmt->fmt.pix.bytesperline);
 			r[2] = 0xf8 & (tmp << 3);
 			g[2] = 0xfc & (tmp >> 3);
 			b[2] = 0xf8 & (tmp >> 8);
 
-			tmp = *(((unsigned short *)src) + src_fmt->fmt.pix.bytesperline + 1);
+			tmp = *(unsigned short *)(src + src_fmt->fmt.pix.bytesperline + 2);
 			r[3] = 0xf8 & (tmp << 3);
 			g[3] = 0xfc & (tmp >> 3);
 			b[3] = 0xf8 & (tmp >> 8);
@@ -689,7 +1121,7 @@ int v4lconvert_y10b_to_rgb24(struct v4lconvert_data *data,
 {
 	unsigned char *unpacked_buffer;
 
-	unpacked_buffer = v4lconvert_alloc_buffer(width * height * 2,
+	unpacked_buffer = v4lconvert_alloc_buffer(data, width * height * 2,
 					&data->convert_pixfmt_buf,
 					&data->convert_pixfmt_buf_size);
 	if (!unpacked_buffer)
@@ -720,7 +1152,7 @@ int v4lconvert_y10b_to_yuv420(struct v4lconvert_data *data,
 {
 	unsigned char *unpacked_buffer;
 
-	unpacked_buffer = v4lconvert_alloc_buffer(width * height * 2,
+	unpacked_buffer = v4lconvert_alloc_buffer(data, width * height * 2,
 					&data->convert_pixfmt_buf,
 					&data->convert_pixfmt_buf_size);
 	if (!unpacked_buffer)
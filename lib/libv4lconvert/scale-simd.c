@@ -0,0 +1,138 @@
+/*
+
+# SIMD versions of the vertical pass of the scaler
+
+# These produce the exact same output as the plain C code in scale.c, which
+# stays the reference implementation and handles the left-over samples at
+# the end of each line.
+
+# This program is free software; you can redistribute it and/or modify
+# it under the terms of the GNU Lesser General Public License as published by
+# the Free Software Foundation; either version 2.1 of the License, or
+# (at your option) any later version.
+#
+# This program is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU Lesser General Public License for more details.
+#
+# You should have received a copy of the GNU Lesser General Public License
+# along with this program; if not, write to the Free Software
+# Foundation, Inc., 51 Franklin Street, Suite 500, Boston, MA  02110-1335  USA
+
+ */
+
+#include "libv4lconvert-priv.h"
+#include "simd-priv.h"
+
+#define SCALE_SHIFT (V4LCONVERT_SCALE_BITS - V4LCONVERT_SCALE_LINE_BITS)
+
+#ifdef HAVE_V4LCONVERT_X86_SIMD
+
+/* Interleaves the samples of 2 src lines, so that pmaddwd can weigh and add
+   them in one go */
+static V4LCONVERT_TARGET("sse2") int scale_vertical_sse2(
+		const unsigned char *src, int stride, const int16_t *weights,
+		int taps, int16_t *line, int len)
+{
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i round = _mm_set1_epi32(1 << (SCALE_SHIFT - 1));
+	int x, k;
+
+	for (x = 0; x + 16 <= len; x += 16) {
+		__m128i sum0 = round, sum1 = round, sum2 = round, sum3 = round;
+
+		for (k = 0; k < taps; k += 2) {
+			const unsigned char *s = src + k * stride + x;
+			__m128i a = _mm_loadu_si128((const __m128i *)s);
+			__m128i b = zero, w, lo, hi;
+
+			if (k + 1 < taps) {
+				b = _mm_loadu_si128((const __m128i *)(s + stride));
+				w = _mm_set1_epi32(V4LCONVERT_COEF_PAIR(
+						weights[k], weights[k + 1]));
+			} else {
+				w = _mm_set1_epi32(V4LCONVERT_COEF_PAIR(
+						weights[k], 0));
+			}
+
+			lo = _mm_unpacklo_epi8(a, zero);
+			hi = _mm_unpacklo_epi8(b, zero);
+			sum0 = _mm_add_epi32(sum0, _mm_madd_epi16(
+					_mm_unpacklo_epi16(lo, hi), w));
+			sum1 = _mm_add_epi32(sum1, _mm_madd_epi16(
+					_mm_unpackhi_epi16(lo, hi), w));
+			lo = _mm_unpackhi_epi8(a, zero);
+			hi = _mm_unpackhi_epi8(b, zero);
+			sum2 = _mm_add_epi32(sum2, _mm_madd_epi16(
+					_mm_unpacklo_epi16(lo, hi), w));
+			sum3 = _mm_add_epi32(sum3, _mm_madd_epi16(
+					_mm_unpackhi_epi16(lo, hi), w));
+		}
+
+		_mm_storeu_si128((__m128i *)(line + x), _mm_packs_epi32(
+				_mm_srai_epi32(sum0, SCALE_SHIFT),
+				_mm_srai_epi32(sum1, SCALE_SHIFT)));
+		_mm_storeu_si128((__m128i *)(line + x + 8), _mm_packs_epi32(
+				_mm_srai_epi32(sum2, SCALE_SHIFT),
+				_mm_srai_epi32(sum3, SCALE_SHIFT)));
+	}
+
+	return x;
+}
+
+#endif /* HAVE_V4LCONVERT_X86_SIMD */
+
+#ifdef HAVE_V4LCONVERT_NEON
+
+static int scale_vertical_neon(const unsigned char *src, int stride,
+		const int16_t *weights, int taps, int16_t *line, int len)
+{
+	const int32x4_t round = vdupq_n_s32(1 << (SCALE_SHIFT - 1));
+	int x, k;
+
+	for (x = 0; x + 16 <= len; x += 16) {
+		int32x4_t sum0 = round, sum1 = round, sum2 = round, sum3 = round;
+
+		for (k = 0; k < taps; k++) {
+			uint8x16_t a = vld1q_u8(src + k * stride + x);
+			int16x8_t lo = vreinterpretq_s16_u16(
+					vmovl_u8(vget_low_u8(a)));
+			int16x8_t hi = vreinterpretq_s16_u16(
+					vmovl_u8(vget_high_u8(a)));
+
+			sum0 = vmlal_n_s16(sum0, vget_low_s16(lo), weights[k]);
+			sum1 = vmlal_n_s16(sum1, vget_high_s16(lo), weights[k]);
+			sum2 = vmlal_n_s16(sum2, vget_low_s16(hi), weights[k]);
+			sum3 = vmlal_n_s16(sum3, vget_high_s16(hi), weights[k]);
+		}
+
+		vst1q_s16(line + x, vcombine_s16(vshrn_n_s32(sum0, SCALE_SHIFT),
+						 vshrn_n_s32(sum1, SCALE_SHIFT)));
+		vst1q_s16(line + x + 8,
+			  vcombine_s16(vshrn_n_s32(sum2, SCALE_SHIFT),
+				       vshrn_n_s32(sum3, SCALE_SHIFT)));
+	}
+
+	return x;
+}
+
+#endif /* HAVE_V4LCONVERT_NEON */
+
+int v4lconvert_simd_scale_vertical(int cpu_flags, const unsigned char *src,
+		int stride, const int16_t *weights, int taps, int16_t *line,
+		int len)
+{
+#ifdef HAVE_V4LCONVERT_X86_SIMD
+	if (cpu_flags & V4LCONVERT_CPU_SSE2)
+		return scale_vertical_sse2(src, stride, weights, taps, line,
+					   len);
+#endif
+#ifdef HAVE_V4LCONVERT_NEON
+	if (cpu_flags & V4LCONVERT_CPU_NEON)
+		return scale_vertical_neon(src, stride, weights, taps, line,
+					   len);
+#endif
+
+	return 0;
+}
@@ -0,0 +1,368 @@
+/*
+
+# Arbitrary ratio scaling, an area average (box) filter for making frames
+# smaller and a bilinear filter for making them larger
+
+# This program is free software; you can redistribute it and/or modify
+# it under the terms of the GNU Lesser General Public License as published by
+# the Free Software Foundation; either version 2.1 of the License, or
+# (at your option) any later version.
+#
+# This program is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU Lesser General Public License for more details.
+#
+# You should have received a copy of the GNU Lesser General Public License
+# along with this program; if not, write to the Free Software
+# Foundation, Inc., 51 Franklin Street, Suite 500, Boston, MA  02110-1335  USA
+
+ */
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include "libv4lconvert-priv.h"
+
+#define MIN(a, b) (((a) < (b)) ? (a) : (b))
+#define MAX(a, b) (((a) > (b)) ? (a) : (b))
+
+/* The max number of src samples of a line which get filtered vertically at
+   a time, this limits the scale down ratio to about 1 / 1000 */
+#define V4LCONVERT_SCALE_CHUNK 1024
+
+struct v4lconvert_scale_args {
+	struct v4lconvert_data *data;
+	const unsigned char *src;
+	int src_stride;
+	unsigned char *dest;
+	int dest_stride;
+	int bpp;
+	const struct v4lconvert_scale_filter *hfilter;
+	const struct v4lconvert_scale_filter *vfilter;
+};
+
+static void v4lconvert_scale_filter_free(struct v4lconvert_scale_filter *f)
+{
+	free(f->start);
+	free(f->weights);
+	memset(f, 0, sizeof(*f));
+}
+
+/* Get the first src sample dest sample i gets made from and the weights of
+   the src samples, returns the number of src samples (taps) */
+static int v4lconvert_scale_filter_taps(int i, int src_size, int dest_size,
+		int *first, int16_t *w)
+{
+	int j, taps, sum, max;
+
+	if (src_size > dest_size) {
+		/* Box filter, in units of 1 / dest_size src sample dest sample
+		   i covers src_size units starting at i * src_size, and src
+		   sample j covers dest_size units starting at j * dest_size */
+		int begin = i * src_size;
+		int end = begin + src_size;
+
+		*first = begin / dest_size;
+		taps = (end - 1) / dest_size - *first + 1;
+		if (!w)
+			return taps;
+
+		for (j = 0; j < taps; j++) {
+			int overlap = MIN(end, (*first + j + 1) * dest_size) -
+				      MAX(begin, (*first + j) * dest_size);
+
+			w[j] = ((overlap << V4LCONVERT_SCALE_BITS) +
+				src_size / 2) / src_size;
+		}
+	} else {
+		/* Bilinear, the center of dest sample i is at src position
+		   (i + 0.5) * src_size / dest_size - 0.5, pos is this in units
+		   of 1 / (2 * dest_size) src sample */
+		int pos = MAX((2 * i + 1) * src_size - dest_size, 0);
+		int frac = ((pos % (2 * dest_size)) << V4LCONVERT_SCALE_BITS) /
+			   (2 * dest_size);
+
+		*first = pos / (2 * dest_size);
+		if (*first >= src_size - 1 || frac == 0) {
+			*first = MIN(*first, src_size - 1);
+			taps = 1;
+			if (w)
+				w[0] = 1 << V4LCONVERT_SCALE_BITS;
+		} else {
+			taps = 2;
+			if (w) {
+				w[0] = (1 << V4LCONVERT_SCALE_BITS) - frac;
+				w[1] = frac;
+			}
+		}
+		if (!w)
+			return taps;
+	}
+
+	/* Rounding may make the weights not add up to exactly 1, fix this up
+	   in the largest weight */
+	sum = 0;
+	max = 0;
+	for (j = 0; j < taps; j++) {
+		sum += w[j];
+		if (w[j] > w[max])
+			max = j;
+	}
+	w[max] += (1 << V4LCONVERT_SCALE_BITS) - sum;
+
+	return taps;
+}
+
+/* (Re)calculate the filter for scaling src_size samples to dest_size
+   samples, unless f already is that filter. All dest samples get made from
+   the same number of src samples (padding the weights with zeros), which
+   makes the filter loops a lot more predictable for the cpu. */
+static int v4lconvert_scale_filter_init(struct v4lconvert_scale_filter *f,
+		int src_size, int dest_size)
+{
+	int i, first, taps;
+
+	if (f->src_size == src_size && f->dest_size == dest_size)
+		return 0;
+
+	v4lconvert_scale_filter_free(f);
+	for (i = 0; i < dest_size; i++)
+		f->taps = MAX(f->taps, v4lconvert_scale_filter_taps(i,
+				src_size, dest_size, &first, NULL));
+
+	f->start = malloc(dest_size * sizeof(*f->start));
+	f->weights = calloc(dest_size * f->taps, sizeof(*f->weights));
+	if (!f->start || !f->weights) {
+		v4lconvert_scale_filter_free(f);
+		return -1;
+	}
+
+	for (i = 0; i < dest_size; i++) {
+		int16_t *w = f->weights + i * f->taps;
+
+		taps = v4lconvert_scale_filter_taps(i, src_size, dest_size,
+						    &first, w);
+		/* Move the padding to the front when there are not enough
+		   src samples after first */
+		if (first + f->taps > src_size) {
+			int shift = first + f->taps - src_size;
+
+			memmove(w + shift, w, taps * sizeof(*w));
+			memset(w, 0, shift * sizeof(*w));
+			first -= shift;
+		}
+		f->start[i] = first;
+	}
+
+	f->src_size = src_size;
+	f->dest_size = dest_size;
+
+	return 0;
+}
+
+void v4lconvert_scale_free(struct v4lconvert_data *data)
+{
+	int i;
+
+	for (i = 0; i < ARRAY_SIZE(data->scale_filter); i++)
+		v4lconvert_scale_filter_free(&data->scale_filter[i]);
+}
+
+static void v4lconvert_scale_vertical(struct v4lconvert_data *data,
+		const unsigned char *src, int stride, const int16_t *weights,
+		int taps, int16_t *line, int len)
+{
+	int x, k, sum;
+
+	x = v4lconvert_simd_scale_vertical(data->cpu_flags, src, stride,
+					   weights, taps, line, len);
+	for (; x < len; x++) {
+		sum = 1 << (V4LCONVERT_SCALE_BITS - V4LCONVERT_SCALE_LINE_BITS - 1);
+		for (k = 0; k < taps; k++)
+			sum += weights[k] * src[k * stride + x];
+		line[x] = sum >> (V4LCONVERT_SCALE_BITS -
+				  V4LCONVERT_SCALE_LINE_BITS);
+	}
+}
+
+/* Filter dest samples first - last - 1 from line, which starts with src
+   sample offset */
+static void v4lconvert_scale_horizontal(const int16_t *line,
+		unsigned char *dest, const struct v4lconvert_scale_filter *f,
+		int first, int last, int offset, int bpp)
+{
+	const int round = 1 << (V4LCONVERT_SCALE_BITS +
+				V4LCONVERT_SCALE_LINE_BITS - 1);
+	const int shift = V4LCONVERT_SCALE_BITS + V4LCONVERT_SCALE_LINE_BITS;
+	int i, j, taps = f->taps;
+
+	if (bpp == 3) {
+		for (i = first; i < last; i++) {
+			const int16_t *w = f->weights + i * taps;
+			const int16_t *s = line + (f->start[i] - offset) * 3;
+			int r = round, g = round, b = round;
+
+			for (j = 0; j < taps; j++) {
+				r += w[j] * s[3 * j];
+				g += w[j] * s[3 * j + 1];
+				b += w[j] * s[3 * j + 2];
+			}
+			dest[3 * i] = r >> shift;
+			dest[3 * i + 1] = g >> shift;
+			dest[3 * i + 2] = b >> shift;
+		}
+	} else {
+		for (i = first; i < last; i++) {
+			const int16_t *w = f->weights + i * taps;
+			const int16_t *s = line + f->start[i] - offset;
+			int sum = round;
+
+			for (j = 0; j < taps; j++)
+				sum += w[j] * s[j];
+			dest[i] = sum >> shift;
+		}
+	}
+}
+
+/* Scaling is done a dest line at a time, first filtering the src lines it
+   gets made from vertically into line, and then filtering line horizontally.
+   For wide frames line holds only a part of a dest line at a time. */
+static void v4lconvert_scale_band(void *arg, int first_row, int rows)
+{
+	const struct v4lconvert_scale_args *args = arg;
+	const struct v4lconvert_scale_filter *hf = args->hfilter;
+	const struct v4lconvert_scale_filter *vf = args->vfilter;
+	int16_t line[V4LCONVERT_SCALE_CHUNK * 3];
+	int x, x_end, y, first, last, bpp = args->bpp;
+
+	for (y = first_row; y < first_row + rows; y++) {
+		const unsigned char *src = args->src +
+			vf->start[y] * args->src_stride;
+		unsigned char *dest = args->dest + y * args->dest_stride;
+
+		for (x = 0; x < hf->dest_size; x = x_end) {
+			first = hf->start[x];
+			for (x_end = x + 1; x_end < hf->dest_size; x_end++)
+				if (hf->start[x_end] + hf->taps - first >
+						V4LCONVERT_SCALE_CHUNK)
+					break;
+			last = hf->start[x_end - 1] + hf->taps;
+
+			v4lconvert_scale_vertical(args->data, src + first * bpp,
+					args->src_stride,
+					vf->weights + y * vf->taps, vf->taps,
+					line, (last - first) * bpp);
+			v4lconvert_scale_horizontal(line, dest, hf, x, x_end,
+					first, bpp);
+		}
+	}
+}
+
+static void v4lconvert_scale_plane(struct v4lconvert_data *data,
+		const unsigned char *src, int src_stride, unsigned char *dest,
+		int dest_stride, int bpp,
+		const struct v4lconvert_scale_filter *hfilter,
+		const struct v4lconvert_scale_filter *vfilter)
+{
+	struct v4lconvert_scale_args args = { data, src, src_stride, dest,
+		dest_stride, bpp, hfilter, vfilter };
+
+	v4lconvert_run_bands(data->threads, v4lconvert_scale_band, &args,
+			     vfilter->dest_size, 1);
+}
+
+int v4lconvert_scale(struct v4lconvert_data *data, unsigned char *src,
+		unsigned char *dest, const struct v4l2_format *src_fmt,
+		const struct v4l2_format *dest_fmt)
+{
+	struct v4lconvert_scale_filter *f = data->scale_filter;
+	int src_width = src_fmt->fmt.pix.width;
+	int src_height = src_fmt->fmt.pix.height;
+	int src_stride = src_fmt->fmt.pix.bytesperline;
+	int dest_width = dest_fmt->fmt.pix.width;
+	int dest_height = dest_fmt->fmt.pix.height;
+	int dest_stride = dest_fmt->fmt.pix.bytesperline;
+	int width = src_width, height = src_height, x, y, i, no_filters;
+
+	/* Scale the largest centered part of src which has the aspect ratio
+	   of dest, rather then stretching the picture */
+	if (src_width * dest_height > src_height * dest_width)
+		width = src_height * dest_width / dest_height;
+	else
+		height = src_width * dest_height / dest_width;
+
+	if (width < 2 || height < 2 || dest_width < 2 || dest_height < 2) {
+		V4LCONVERT_ERR("cannot scale %dx%d to %dx%d\n", src_width,
+			       src_height, dest_width, dest_height);
+		errno = EINVAL;
+		return -1;
+	}
+
+	switch (dest_fmt->fmt.pix.pixelformat) {
+	case V4L2_PIX_FMT_RGB24:
+	case V4L2_PIX_FMT_BGR24:
+		if (v4lconvert_scale_filter_init(&f[0], width, dest_width) ||
+		    v4lconvert_scale_filter_init(&f[1], height, dest_height))
+			return v4lconvert_oom_error(data);
+		no_filters = 2;
+		break;
+	case V4L2_PIX_FMT_YUV420:
+	case V4L2_PIX_FMT_YVU420:
+		width &= ~1;
+		height &= ~1;
+		if (v4lconvert_scale_filter_init(&f[0], width, dest_width) ||
+		    v4lconvert_scale_filter_init(&f[1], height, dest_height) ||
+		    v4lconvert_scale_filter_init(&f[2], width / 2,
+						 dest_width / 2) ||
+		    v4lconvert_scale_filter_init(&f[3], height / 2,
+						 dest_height / 2))
+			return v4lconvert_oom_error(data);
+		no_filters = 4;
+		break;
+	default:
+		V4LCONVERT_ERR("cannot scale this format\n");
+		errno = EINVAL;
+		return -1;
+	}
+
+	for (i = 0; i < no_filters; i++) {
+		if (f[i].taps > V4LCONVERT_SCALE_CHUNK) {
+			V4LCONVERT_ERR("cannot scale %dx%d to %dx%d\n",
+				       src_width, src_height, dest_width,
+				       dest_height);
+			errno = EINVAL;
+			return -1;
+		}
+	}
+
+	if (dest_fmt->fmt.pix.pixelformat == V4L2_PIX_FMT_RGB24 ||
+	    dest_fmt->fmt.pix.pixelformat == V4L2_PIX_FMT_BGR24) {
+		x = (src_width - width) / 2;
+		y = (src_height - height) / 2;
+		v4lconvert_scale_plane(data, src + y * src_stride + x * 3,
+				src_stride, dest, dest_stride, 3, &f[0], &f[1]);
+		return 0;
+	}
+
+	x = ((src_width - width) / 2) & ~1;
+	y = ((src_height - height) / 2) & ~1;
+
+	/* Y */
+	v4lconvert_scale_plane(data, src + y * src_stride + x, src_stride,
+			dest, dest_stride, 1, &f[0], &f[1]);
+	src += src_height * src_stride;
+	dest += dest_height * dest_stride;
+
+	/* U */
+	v4lconvert_scale_plane(data, src + y / 2 * src_stride / 2 + x / 2,
+			src_stride / 2, dest, dest_stride / 2, 1, &f[2], &f[3]);
+	src += src_height * src_stride / 4;
+	dest += dest_height * dest_stride / 4;
+
+	/* V */
+	v4lconvert_scale_plane(data, src + y / 2 * src_stride / 2 + x / 2,
+			src_stride / 2, dest, dest_stride / 2, 1, &f[2], &f[3]);
+
+	return 0;
+}
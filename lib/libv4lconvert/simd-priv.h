@@ -0,0 +1,71 @@
+/*
+
+# Helpers shared by the SIMD conversion routines
+
+# This program is free software; you can redistribute it and/or modify
+# it under the terms of the GNU Lesser General Public License as published by
+# the Free Software Foundation; either version 2.1 of the License, or
+# (at your option) any later version.
+#
+# This program is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU Lesser General Public License for more details.
+#
+# You should have received a copy of the GNU Lesser General Public License
+# along with this program; if not, write to the Free Software
+# Foundation, Inc., 51 Franklin Street, Suite 500, Boston, MA  02110-1335  USA
+
+ */
+
+#ifndef __LIBV4LCONVERT_SIMD_PRIV_H
+#define __LIBV4LCONVERT_SIMD_PRIV_H
+
+#include "libv4lconvert-priv.h"
+
+#ifdef HAVE_V4LCONVERT_X86_SIMD
+#include <immintrin.h>
+#endif
+#ifdef HAVE_V4LCONVERT_NEON
+#include <arm_neon.h>
+#endif
+
+/* For the per block conversion helpers, which get used by several loops and
+   are too big for gcc to inline them by itself, a call per block is slow */
+#define V4LCONVERT_SIMD_INLINE inline __attribute__((always_inline))
+
+/* Pack 2 16 bit coefficients into a 32 bit value for pmaddwd, lo is
+   applied to the even and hi to the odd 16 bit elements */
+#define V4LCONVERT_COEF_PAIR(lo, hi) \
+	((int)(((unsigned int)(hi) << 16) | ((lo) & 0xffff)))
+
+#ifdef HAVE_V4LCONVERT_X86_SIMD
+
+/* Store 16 pixels worth of separate r, g and b bytes as 48 bytes rgb24 */
+static inline V4LCONVERT_TARGET("ssse3") void store_rgb24_ssse3(
+		unsigned char *dest, __m128i r, __m128i g, __m128i b)
+{
+	const __m128i r0 = _mm_setr_epi8(0, -1, -1, 1, -1, -1, 2, -1, -1, 3, -1, -1, 4, -1, -1, 5);
+	const __m128i g0 = _mm_setr_epi8(-1, 0, -1, -1, 1, -1, -1, 2, -1, -1, 3, -1, -1, 4, -1, -1);
+	const __m128i b0 = _mm_setr_epi8(-1, -1, 0, -1, -1, 1, -1, -1, 2, -1, -1, 3, -1, -1, 4, -1);
+	const __m128i r1 = _mm_setr_epi8(-1, -1, 6, -1, -1, 7, -1, -1, 8, -1, -1, 9, -1, -1, 10, -1);
+	const __m128i g1 = _mm_setr_epi8(5, -1, -1, 6, -1, -1, 7, -1, -1, 8, -1, -1, 9, -1, -1, 10);
+	const __m128i b1 = _mm_setr_epi8(-1, 5, -1, -1, 6, -1, -1, 7, -1, -1, 8, -1, -1, 9, -1, -1);
+	const __m128i r2 = _mm_setr_epi8(-1, 11, -1, -1, 12, -1, -1, 13, -1, -1, 14, -1, -1, 15, -1, -1);
+	const __m128i g2 = _mm_setr_epi8(-1, -1, 11, -1, -1, 12, -1, -1, 13, -1, -1, 14, -1, -1, 15, -1);
+	const __m128i b2 = _mm_setr_epi8(10, -1, -1, 11, -1, -1, 12, -1, -1, 13, -1, -1, 14, -1, -1, 15);
+
+	_mm_storeu_si128((__m128i *)dest, _mm_or_si128(_mm_or_si128(
+		_mm_shuffle_epi8(r, r0), _mm_shuffle_epi8(g, g0)),
+		_mm_shuffle_epi8(b, b0)));
+	_mm_storeu_si128((__m128i *)(dest + 16), _mm_or_si128(_mm_or_si128(
+		_mm_shuffle_epi8(r, r1), _mm_shuffle_epi8(g, g1)),
+		_mm_shuffle_epi8(b, b1)));
+	_mm_storeu_si128((__m128i *)(dest + 32), _mm_or_si128(_mm_or_si128(
+		_mm_shuffle_epi8(r, r2), _mm_shuffle_epi8(g, g2)),
+		_mm_shuffle_epi8(b, b2)));
+}
+
+#endif /* HAVE_V4LCONVERT_X86_SIMD */
+
+#endif
@@ -0,0 +1,214 @@
+/*
+
+# Worker threads for converting a frame in bands of rows in parallel
+
+# This program is free software; you can redistribute it and/or modify
+# it under the terms of the GNU Lesser General Public License as published by
+# the Free Software Foundation; either version 2.1 of the License, or
+# (at your option) any later version.
+#
+# This program is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU Lesser General Public License for more details.
+#
+# You should have received a copy of the GNU Lesser General Public License
+# along with this program; if not, write to the Free Software
+# Foundation, Inc., 51 Franklin Street, Suite 500, Boston, MA  02110-1335  USA
+
+ */
+
+#include <errno.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <pthread.h>
+#include "libv4lconvert-priv.h"
+
+/* Don't bother splitting up frames in bands smaller then this */
+#define V4LCONVERT_MIN_BAND_ROWS 16
+
+struct v4lconvert_threads {
+	pthread_mutex_t lock;
+	pthread_cond_t start_cond;
+	pthread_cond_t done_cond;
+	pthread_t *workers;
+	int no_workers;
+	int exit;
+	/* The job currently being run */
+	v4lconvert_band_func func;
+	void *arg;
+	int height;
+	int band_rows;
+	int no_bands;
+	int next_band;
+	int bands_done;
+};
+
+struct v4lconvert_threads *v4lconvert_threads_create(void)
+{
+	struct v4lconvert_threads *threads =
+		calloc(1, sizeof(struct v4lconvert_threads));
+
+	if (!threads)
+		return NULL;
+
+	pthread_mutex_init(&threads->lock, NULL);
+	pthread_cond_init(&threads->start_cond, NULL);
+	pthread_cond_init(&threads->done_cond, NULL);
+
+	return threads;
+}
+
+/* Must be called with the lock held, returns with the lock held */
+static void v4lconvert_threads_run_band(struct v4lconvert_threads *threads)
+{
+	int band = threads->next_band++;
+	int first_row = band * threads->band_rows;
+	int rows = threads->band_rows;
+
+	if (first_row + rows > threads->height)
+		rows = threads->height - first_row;
+
+	pthread_mutex_unlock(&threads->lock);
+	threads->func(threads->arg, first_row, rows);
+	pthread_mutex_lock(&threads->lock);
+
+	if (++threads->bands_done == threads->no_bands)
+		pthread_cond_signal(&threads->done_cond);
+}
+
+static void *v4lconvert_threads_worker(void *arg)
+{
+	struct v4lconvert_threads *threads = arg;
+
+	pthread_mutex_lock(&threads->lock);
+	while (1) {
+		while (!threads->exit && threads->next_band >= threads->no_bands)
+			pthread_cond_wait(&threads->start_cond, &threads->lock);
+		if (threads->exit)
+			break;
+		v4lconvert_threads_run_band(threads);
+	}
+	pthread_mutex_unlock(&threads->lock);
+
+	return NULL;
+}
+
+static void v4lconvert_threads_stop(struct v4lconvert_threads *threads)
+{
+	int i;
+
+	pthread_mutex_lock(&threads->lock);
+	threads->exit = 1;
+	pthread_cond_broadcast(&threads->start_cond);
+	pthread_mutex_unlock(&threads->lock);
+
+	for (i = 0; i < threads->no_workers; i++)
+		pthread_join(threads->workers[i], NULL);
+
+	free(threads->workers);
+	threads->workers = NULL;
+	threads->no_workers = 0;
+	threads->exit = 0;
+}
+
+int v4lconvert_threads_set_count(struct v4lconvert_threads *threads, int count)
+{
+	int i;
+
+	if (count <= 0)
+		count = sysconf(_SC_NPROCESSORS_ONLN);
+	if (count > V4LCONVERT_MAX_THREADS)
+		count = V4LCONVERT_MAX_THREADS;
+
+	/* The calling thread does 1 band itself */
+	if (count - 1 == threads->no_workers)
+		return 0;
+
+	v4lconvert_threads_stop(threads);
+	if (count == 1)
+		return 0;
+
+	threads->workers = calloc(count - 1, sizeof(pthread_t));
+	if (!threads->workers) {
+		errno = ENOMEM;
+		return -1;
+	}
+
+	for (i = 0; i < count - 1; i++) {
+		if (pthread_create(&threads->workers[i], NULL,
+				   v4lconvert_threads_worker, threads)) {
+			threads->no_workers = i;
+			v4lconvert_threads_stop(threads);
+			errno = EAGAIN;
+			return -1;
+		}
+	}
+	threads->no_workers = count - 1;
+
+	return 0;
+}
+
+int v4lconvert_threads_get_count(struct v4lconvert_threads *threads)
+{
+	return threads->no_workers + 1;
+}
+
+void v4lconvert_threads_destroy(struct v4lconvert_threads *threads)
+{
+	if (!threads)
+		return;
+
+	v4lconvert_threads_stop(threads);
+	pthread_cond_destroy(&threads->done_cond);
+	pthread_cond_destroy(&threads->start_cond);
+	pthread_mutex_destroy(&threads->lock);
+	free(threads);
+}
+
+int v4lconvert_band_rows(struct v4lconvert_threads *threads, int height,
+		int align)
+{
+	int no_bands, band_rows;
+
+	if (!threads || !threads->no_workers ||
+			height < 2 * V4LCONVERT_MIN_BAND_ROWS)
+		return height;
+
+	no_bands = threads->no_workers + 1;
+	band_rows = (height + no_bands - 1) / no_bands;
+	if (band_rows < V4LCONVERT_MIN_BAND_ROWS)
+		band_rows = V4LCONVERT_MIN_BAND_ROWS;
+	return (band_rows + align - 1) / align * align;
+}
+
+void v4lconvert_run_bands(struct v4lconvert_threads *threads,
+		v4lconvert_band_func func, void *arg, int height, int align)
+{
+	int no_bands, band_rows;
+
+	band_rows = v4lconvert_band_rows(threads, height, align);
+	if (band_rows >= height) {
+		func(arg, 0, height);
+		return;
+	}
+
+	no_bands = (height + band_rows - 1) / band_rows;
+
+	pthread_mutex_lock(&threads->lock);
+	threads->func = func;
+	threads->arg = arg;
+	threads->height = height;
+	threads->band_rows = band_rows;
+	threads->no_bands = no_bands;
+	threads->next_band = 0;
+	threads->bands_done = 0;
+	pthread_cond_broadcast(&threads->start_cond);
+
+	/* Lend a hand ourselves, and then wait for the workers to finish */
+	while (threads->next_band < threads->no_bands)
+		v4lconvert_threads_run_band(threads);
+	while (threads->bands_done < threads->no_bands)
+		pthread_cond_wait(&threads->done_cond, &threads->lock);
+	pthread_mutex_unlock(&threads->lock);
+}
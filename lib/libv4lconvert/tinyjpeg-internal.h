@@ -45,10 +45,14 @@ struct jdec_private;
 #define HUFFMAN_HASH_SIZE  (1UL<<HUFFMAN_HASH_NBITS)
 #define HUFFMAN_HASH_MASK  (HUFFMAN_HASH_SIZE-1)
 
+/* Number of bits looked at once to decode an AC symbol and its coefficient */
+#define HUFFMAN_AC_NBITS   10
+#define HUFFMAN_AC_SIZE    (1UL<<HUFFMAN_AC_NBITS)
+
 #define HUFFMAN_TABLES	   4
 #define COMPONENTS	   3
-#define JPEG_MAX_WIDTH	   2048
-#define JPEG_MAX_HEIGHT	   2048
+#define JPEG_MAX_WIDTH	   4096
+#define JPEG_MAX_HEIGHT	   4096
 
 struct huffman_table {
 	/* Fast look up table, using HUFFMAN_HASH_NBITS bits we can have directly the symbol,
@@ -56,20 +60,29 @@ struct huffman_table {
 	short int lookup[HUFFMAN_HASH_SIZE];
 	/* code size: give the number of bits of a symbol is encoded */
 	unsigned char code_size[HUFFMAN_HASH_SIZE];
-	/* some place to store value that is not encoded in the lookup table
-	 * IMPROVEME: Calculate if 256 value is enough to store all values
-	 */
-	uint16_t slowtable[16 - HUFFMAN_HASH_NBITS][256];
+	/* For AC tables: using HUFFMAN_AC_NBITS bits we get the run length and
+	 * the coefficient directly, when both the code and the coefficient bits
+	 * fit and the coefficient fits in 8 bits. Packed as:
+	 * coefficient << 8 | run << 4 | code + coefficient size,
+	 * 0 if the symbol needs to be decoded the normal way. */
+	int16_t ac_lookup[HUFFMAN_AC_SIZE];
+	/* For codes longer then HUFFMAN_HASH_NBITS: the highest code of each
+	 * length (-1 if there are none), and the value to add to a code of that
+	 * length to get the index of its symbol in values */
+	int32_t maxcode[17];
+	int valoffset[17];
+	unsigned char values[256];
 };
 
 struct component {
 	unsigned int Hfactor;
 	unsigned int Vfactor;
-	float *Q_table;		/* Pointer to the quantisation table to use */
+	int16_t *Q_table;	/* Pointer to the quantisation table to use */
 	struct huffman_table *AC_table;
 	struct huffman_table *DC_table;
 	short int previous_DC;	/* Previous DC coefficient */
 	short int DCT[64];		/* DCT coef */
+	int dc_only;			/* All AC coefs are 0, only DCT[0] is valid */
 #if SANITY_CHECK
 	unsigned int cid;
 #endif
@@ -84,16 +97,19 @@ struct jdec_private {
 	uint8_t *components[COMPONENTS];
 	unsigned int width, height;	/* Size of the image */
 	unsigned int flags;
+	int cpu_flags;
+	unsigned int scale;	/* Decode at 1/scale of the image size */
 
 	/* Private variables */
 	const unsigned char *stream_end;
 	const unsigned char *stream;	/* Pointer to the current stream */
 	unsigned char *stream_filtered;
 	int stream_filtered_bufsize;
-	unsigned int reservoir, nbits_in_reservoir;
+	uint64_t reservoir;
+	unsigned int nbits_in_reservoir;
 
 	struct component component_infos[COMPONENTS];
-	float Q_tables[COMPONENTS][64];		/* quantization tables */
+	int16_t Q_tables[COMPONENTS][64];	/* quantization tables */
 	struct huffman_table HTDC[HUFFMAN_TABLES];	/* DC huffman tables   */
 	struct huffman_table HTAC[HUFFMAN_TABLES];	/* AC huffman tables   */
 	int default_huffman_table_initialized;
@@ -118,10 +134,29 @@ struct jdec_private {
 	/* Temp buffers for multipass planar JPG -> RGB decoding */
 	int tmp_buf_y_size;
 	uint8_t *tmp_buf[COMPONENTS];
+
+	/* Planes for decoding at a reduced size */
+	uint8_t *scaled_buf;
+	int scaled_buf_size;
+
+	/* For decoding restart intervals in parallel */
+	struct v4lconvert_threads *threads;
+	const unsigned char **rst_segments;	/* Start of each interval */
+	int rst_segments_bufsize;
 };
 
-#define IDCT tinyjpeg_idct_float
-void tinyjpeg_idct_float (struct component *compptr, uint8_t *output_buf, int stride);
+#define IDCT(compptr, output_buf, stride) \
+	tinyjpeg_idct_int(compptr, output_buf, stride, priv->cpu_flags)
+void tinyjpeg_idct_int(struct component *compptr, uint8_t *output_buf,
+		int stride, int cpu_flags);
+void tinyjpeg_idct_int_scaled(struct component *compptr, uint8_t *output_buf,
+		int stride, int scale);
+
+/* The floating point IDCT tinyjpeg used to use, now only used as reference
+   by contrib/test/idct-test.c */
+void tinyjpeg_idct_float_qtable(float *qtable, const int16_t *Q_table);
+void tinyjpeg_idct_float(const int16_t *DCT, const float *qtable,
+		uint8_t *output_buf, int stride);
 
 #endif
 
@@ -243,50 +243,98 @@ const unsigned char standard_quantization[][64] = { {
  *  look_nbits: read nbits from the stream without marking as read.
  *  skip_nbits: read nbits from the stream but do not return the result.
  *
- * stream: current pointer in the jpeg data (read bytes per bytes)
+ * stream: current pointer in the jpeg data (read 4 bytes at a time when
+ *         possible)
  * nbits_in_reservoir: number of bits filled into the reservoir
- * reservoir: register that contains bits information. Only nbits_in_reservoir
- *            is valid.
+ * reservoir: 64 bit register that contains bits information. Only the lower
+ *            nbits_in_reservoir bits are valid, the bits above that are
+ *            garbage and must be masked off.
  *                          nbits_in_reservoir
  *                        <--    17 bits    -->
- *            Ex: 0000 0000 1010 0000 1111 0000   <== reservoir
+ *            Ex: xxxx xxxx 1010 0000 1111 0000   <== reservoir
  *                        ^
  *                        bit 1
  *            To get two bits from this example
  *                 result = (reservoir >> 15) & 3
  *
+ * When the reservoir runs low it gets topped up as far as possible, but never
+ * past a marker, so that after a restart interval the unused whole bytes in
+ * the reservoir are only those of the marker (see find_next_rst_marker). If
+ * the bits are really needed the marker is read as data, as it has always
+ * been done.
  */
+static void fill_reservoir(struct jdec_private *priv, uint64_t *reservoir,
+		unsigned int *nbits_in_reservoir, const unsigned char **stream,
+		unsigned int nbits_wanted)
+{
+	const unsigned char *s = *stream;
+	uint64_t r = *reservoir;
+	unsigned int nbits = *nbits_in_reservoir;
+	unsigned char c;
+
+	/* Add 4 bytes at once if there is no 0xff among them */
+	if (nbits <= 32 && priv->stream_end - s >= 4) {
+		uint32_t word = ((uint32_t)s[0] << 24) | (s[1] << 16) |
+				(s[2] << 8) | s[3];
+		uint32_t inv = ~word;
+
+		if (!((inv - 0x01010101U) & ~inv & 0x80808080U)) {
+			r = (r << 32) | word;
+			nbits += 32;
+			s += 4;
+		}
+	}
+
+	while (nbits <= 56 && s < priv->stream_end) {
+		c = *s;
+		if (c == 0xff) {
+			if (s + 1 >= priv->stream_end || s[1] != 0x00)
+				break; /* Marker */
+			s++;
+		}
+		s++;
+		r = (r << 8) | c;
+		nbits += 8;
+	}
+
+	while (nbits < nbits_wanted) {
+		if (s >= priv->stream_end) {
+			snprintf(priv->error_string, sizeof(priv->error_string),
+					"fill_nbits error: need %u more bits\n",
+					nbits_wanted - nbits);
+			longjmp(priv->jump_state, -EIO);
+		}
+		c = *s++;
+		r = (r << 8) | c;
+		if (c == 0xff && *s == 0x00)
+			s++;
+		nbits += 8;
+	}
+
+	*stream = s;
+	*reservoir = r;
+	*nbits_in_reservoir = nbits;
+}
+
 #define fill_nbits(reservoir, nbits_in_reservoir, stream, nbits_wanted) do { \
-	while (nbits_in_reservoir < nbits_wanted) { \
-		unsigned char c; \
-		if (stream >= priv->stream_end) { \
-			snprintf(priv->error_string, sizeof(priv->error_string), \
-					"fill_nbits error: need %u more bits\n", \
-					nbits_wanted - nbits_in_reservoir); \
-			longjmp(priv->jump_state, -EIO); \
-		} \
-		c = *stream++; \
-		reservoir <<= 8; \
-		if (c == 0xff && *stream == 0x00) \
-			stream++; \
-		reservoir |= c; \
-		nbits_in_reservoir += 8; \
-	} \
+	if (nbits_in_reservoir < (nbits_wanted)) \
+		fill_reservoir(priv, &(reservoir), &(nbits_in_reservoir), \
+			       &(stream), (nbits_wanted)); \
 }  while (0);
 
 /* Signed version !!!! */
 #define get_nbits(reservoir, nbits_in_reservoir, stream, nbits_wanted, result) do { \
 	fill_nbits(reservoir, nbits_in_reservoir, stream, (nbits_wanted)); \
-	result = ((reservoir) >> (nbits_in_reservoir - (nbits_wanted))); \
 	nbits_in_reservoir -= (nbits_wanted);  \
-	reservoir &= ((1U << nbits_in_reservoir) - 1); \
+	result = ((reservoir) >> nbits_in_reservoir) & ((1U << (nbits_wanted)) - 1); \
 	if ((unsigned int)result < (1UL << ((nbits_wanted) - 1))) \
 		result += (0xFFFFFFFFUL << (nbits_wanted)) + 1; \
 }  while (0);
 
 #define look_nbits(reservoir, nbits_in_reservoir, stream, nbits_wanted, result) do { \
 	fill_nbits(reservoir, nbits_in_reservoir, stream, (nbits_wanted)); \
-	result = ((reservoir) >> (nbits_in_reservoir - (nbits_wanted))); \
+	result = ((reservoir) >> (nbits_in_reservoir - (nbits_wanted))) & \
+		 ((1U << (nbits_wanted)) - 1); \
 }  while (0);
 
 /* To speed up the decoding, we assume that the reservoir have enough bit
@@ -294,12 +342,10 @@ const unsigned char standard_quantization[][64] = { {
  * #define skip_nbits(reservoir, nbits_in_reservoir, stream, nbits_wanted) do { \
  *   fill_nbits(reservoir, nbits_in_reservoir, stream, (nbits_wanted)); \
  *   nbits_in_reservoir -= (nbits_wanted); \
- *   reservoir &= ((1U << nbits_in_reservoir) - 1); \
  * }  while(0);
  */
 #define skip_nbits(reservoir, nbits_in_reservoir, stream, nbits_wanted) do { \
 	nbits_in_reservoir -= (nbits_wanted); \
-	reservoir &= ((1U << nbits_in_reservoir) - 1); \
 }  while (0);
 
 #define be16_to_cpu(x) (((x)[0] << 8) | (x)[1])
@@ -312,16 +358,15 @@ static void resync(struct jdec_private *priv);
  * To speedup the procedure, we look HUFFMAN_HASH_NBITS bits and the code is
  * lower than HUFFMAN_HASH_NBITS we have automaticaly the length of the code
  * and the value by using two lookup table.
- * Else if the value is not found, just search (linear) into an array for each
- * bits is the code is present.
+ * Else we look at 16 bits and find the length of the code by comparing
+ * it with the highest code of each length.
  *
  * If the code is not present for any reason, -1 is return.
  */
 static int get_next_huffman_code(struct jdec_private *priv, struct huffman_table *huffman_table)
 {
 	int value, hcode;
-	unsigned int extra_nbits, nbits;
-	uint16_t *slowtable;
+	unsigned int nbits;
 
 	look_nbits(priv->reservoir, priv->nbits_in_reservoir, priv->stream, HUFFMAN_HASH_NBITS, hcode);
 	value = huffman_table->lookup[hcode];
@@ -332,19 +377,13 @@ static int get_next_huffman_code(struct jdec_private *priv, struct huffman_table
 		return value;
 	}
 
-	/* Decode more bits each time ... */
-	for (extra_nbits = 0; extra_nbits < 16 - HUFFMAN_HASH_NBITS; extra_nbits++) {
-		nbits = HUFFMAN_HASH_NBITS + 1 + extra_nbits;
+	look_nbits(priv->reservoir, priv->nbits_in_reservoir, priv->stream, 16, hcode);
+	for (nbits = HUFFMAN_HASH_NBITS + 1; nbits <= 16; nbits++) {
+		int code = hcode >> (16 - nbits);
 
-		look_nbits(priv->reservoir, priv->nbits_in_reservoir, priv->stream, nbits, hcode);
-		slowtable = huffman_table->slowtable[extra_nbits];
-		/* Search if the code is in this array */
-		while (slowtable[0]) {
-			if (slowtable[0] == hcode) {
-				skip_nbits(priv->reservoir, priv->nbits_in_reservoir, priv->stream, nbits);
-				return slowtable[1];
-			}
-			slowtable += 2;
+		if (code <= huffman_table->maxcode[nbits]) {
+			skip_nbits(priv->reservoir, priv->nbits_in_reservoir, priv->stream, nbits);
+			return huffman_table->values[code + huffman_table->valoffset[nbits]];
 		}
 	}
 	snprintf(priv->error_string, sizeof(priv->error_string),
@@ -364,6 +403,7 @@ static void process_Huffman_data_unit(struct jdec_private *priv, int component)
 	unsigned char j;
 	unsigned int huff_code;
 	unsigned char size_val, count_0;
+	int hcode, fast, dc_only = 1;
 
 	struct component *c = &priv->component_infos[component];
 	short int DCT[64];
@@ -373,6 +413,11 @@ static void process_Huffman_data_unit(struct jdec_private *priv, int component)
 
 	/* DC coefficient decoding */
 	huff_code = get_next_huffman_code(priv, c->DC_table);
+	if (huff_code > 16) {
+		snprintf(priv->error_string, sizeof(priv->error_string),
+				"error: invalid DC coefficient size (%u)\n", huff_code);
+		longjmp(priv->jump_state, -EIO);
+	}
 	if (huff_code) {
 		get_nbits(priv->reservoir, priv->nbits_in_reservoir, priv->stream, huff_code, DCT[0]);
 		DCT[0] += c->previous_DC;
@@ -385,6 +430,17 @@ static void process_Huffman_data_unit(struct jdec_private *priv, int component)
 	/* AC coefficient decoding */
 	j = 1;
 	while (j < 64) {
+		/* Try to decode the run length and coefficient in one go */
+		look_nbits(priv->reservoir, priv->nbits_in_reservoir, priv->stream, HUFFMAN_AC_NBITS, hcode);
+		fast = c->AC_table->ac_lookup[hcode];
+		if (fast && j + ((fast >> 4) & 0xf) < 64) {
+			skip_nbits(priv->reservoir, priv->nbits_in_reservoir, priv->stream, fast & 0xf);
+			j += (fast >> 4) & 0xf;
+			DCT[j++] = fast >> 8;
+			dc_only = 0;
+			continue;
+		}
+
 		huff_code = get_next_huffman_code(priv, c->AC_table);
 
 		size_val = huff_code & 0xF;
@@ -400,6 +456,7 @@ static void process_Huffman_data_unit(struct jdec_private *priv, int component)
 			if (j < 64) {
 				get_nbits(priv->reservoir, priv->nbits_in_reservoir, priv->stream, size_val, DCT[j]);
 				j++;
+				dc_only = 0;
 			}
 		}
 	}
@@ -410,6 +467,12 @@ static void process_Huffman_data_unit(struct jdec_private *priv, int component)
 		longjmp(priv->jump_state, -EIO);
 	}
 
+	c->dc_only = dc_only;
+	if (dc_only) {
+		c->DCT[0] = DCT[0];
+		return;
+	}
+
 	for (j = 0; j < 64; j++)
 		c->DCT[j] = DCT[zigzag[j]];
 }
@@ -419,14 +482,14 @@ static void process_Huffman_data_unit(struct jdec_private *priv, int component)
  *
  * lookup will return the symbol if the code is less or equal than HUFFMAN_HASH_NBITS.
  * code_size will be used to known how many bits this symbol is encoded.
- * slowtable will be used when the first lookup didn't give the result.
+ * maxcode, valoffset and values will be used when the first lookup didn't give the result.
+ * ac_lookup gives the run length and coefficient for short AC codes.
  */
 static int build_huffman_table(struct jdec_private *priv, const unsigned char *bits, const unsigned char *vals, struct huffman_table *table)
 {
-	unsigned int i, j, code, code_size, val, nbits;
+	unsigned int i, j, code, code_size, val, nbits, size;
 	unsigned char huffsize[257], *hz;
 	unsigned int huffcode[257], *hc;
-	int slowtable_used[16 - HUFFMAN_HASH_NBITS];
 
 	/*
 	 * Build a temp array
@@ -434,14 +497,18 @@ static int build_huffman_table(struct jdec_private *priv, const unsigned char *b
 	 */
 	hz = huffsize;
 	for (i = 1; i <= 16; i++) {
-		for (j = 1; j <= bits[i]; j++)
+		for (j = 1; j <= bits[i]; j++) {
+			if (hz == huffsize + 256)
+				error("Too many Huffman codes\n");
 			*hz++ = i;
+		}
 	}
 	*hz = 0;
 
 	memset(table->lookup, 0xff, sizeof(table->lookup));
-	for (i = 0; i < (16 - HUFFMAN_HASH_NBITS); i++)
-		slowtable_used[i] = 0;
+	memset(table->ac_lookup, 0, sizeof(table->ac_lookup));
+	for (i = 0; i <= 16; i++)
+		table->maxcode[i] = -1;
 
 	/* Build a temp array
 	 *   huffcode[X] => code used to write vals[X]
@@ -452,6 +519,8 @@ static int build_huffman_table(struct jdec_private *priv, const unsigned char *b
 	nbits = *hz;
 	while (*hz) {
 		while (*hz == nbits) {
+			if (code >= (1U << nbits))
+				error("Invalid Huffman table\n");
 			*hc++ = code++;
 			hz++;
 		}
@@ -460,7 +529,7 @@ static int build_huffman_table(struct jdec_private *priv, const unsigned char *b
 	}
 
 	/*
-	 * Build the lookup table, and the slowtable if needed.
+	 * Build the lookup tables, and the maxcode table if needed.
 	 */
 	for (i = 0; huffsize[i]; i++) {
 		val = vals[i];
@@ -469,6 +538,7 @@ static int build_huffman_table(struct jdec_private *priv, const unsigned char *b
 
 		trace("val=%2.2x code=%8.8x codesize=%2.2d\n", i, code, code_size);
 
+		table->values[i] = val;
 		table->code_size[val] = code_size;
 		if (code_size <= HUFFMAN_HASH_NBITS) {
 			/*
@@ -480,25 +550,34 @@ static int build_huffman_table(struct jdec_private *priv, const unsigned char *b
 			code <<= HUFFMAN_HASH_NBITS - code_size;
 			while (repeat--)
 				table->lookup[code++] = val;
-
+			code = huffcode[i];
 		} else {
-			/* Perhaps sorting the array will be an optimization */
-			int slowtable_index = code_size - HUFFMAN_HASH_NBITS - 1;
-
-			if (slowtable_used[slowtable_index] == 254)
-				error("slow Huffman table overflow\n");
+			if (table->maxcode[code_size] == -1)
+				table->valoffset[code_size] = i - code;
+			table->maxcode[code_size] = code;
+		}
 
-			table->slowtable[slowtable_index][slowtable_used[slowtable_index]]
-				= code;
-			table->slowtable[slowtable_index][slowtable_used[slowtable_index] + 1]
-				= val;
-			slowtable_used[slowtable_index] += 2;
+		/*
+		 * If the code and the coefficient bits fit in HUFFMAN_AC_NBITS, put
+		 * the decoded coefficient in ac_lookup for all values of the
+		 * remaining bits
+		 */
+		size = val & 0xf;
+		if (size && size <= 7 && code_size + size <= HUFFMAN_AC_NBITS) {
+			unsigned int free_bits = HUFFMAN_AC_NBITS - code_size - size;
+
+			for (j = 0; j < (1U << (HUFFMAN_AC_NBITS - code_size)); j++) {
+				unsigned int index = (code << (HUFFMAN_AC_NBITS - code_size)) | j;
+				int coef = j >> free_bits;
+
+				if (coef < (1 << (size - 1)))
+					coef -= (1 << size) - 1;
+				table->ac_lookup[index] = coef * 256 +
+					((val >> 4) << 4) + code_size + size;
+			}
 		}
 	}
 
-	for (i = 0; i < (16 - HUFFMAN_HASH_NBITS); i++)
-		table->slowtable[i][slowtable_used[i]] = 0;
-
 	return 0;
 }
 
@@ -1380,7 +1459,7 @@ static void decode_MCU_2x1_3planes(struct jdec_private *priv)
 	IDCT(&priv->component_infos[cCr], priv->Cr, 8);
 }
 
-static void build_quantization_table(float *qtable, const unsigned char *ref_table);
+static void build_quantization_table(int16_t *qtable, const unsigned char *ref_table);
 
 static void pixart_decode_MCU_2x1_3planes(struct jdec_private *priv)
 {
@@ -1657,34 +1736,21 @@ static void print_SOF(const unsigned char *stream)
  *
  ******************************************************************************/
 
-static void build_quantization_table(float *qtable, const unsigned char *ref_table)
+static void build_quantization_table(int16_t *qtable, const unsigned char *ref_table)
 {
-	/* Taken from libjpeg. Copyright Independent JPEG Group's LLM idct.
-	 * For float AA&N IDCT method, divisors are equal to quantization
-	 * coefficients scaled by scalefactor[row]*scalefactor[col], where
-	 *   scalefactor[0] = 1
-	 *   scalefactor[k] = cos(k*PI/16) * sqrt(2)    for k=1..7
-	 * We apply a further scale factor of 8.
-	 * What's actually stored is 1/divisor so that the inner loop can
-	 * use a multiplication rather than a division.
-	 */
-	int i, j;
-	static const double aanscalefactor[8] = {
-		1.0, 1.387039845, 1.306562965, 1.175875602,
-		1.0, 0.785694958, 0.541196100, 0.275899379
-	};
+	/* The quantization table is stored in zigzag order, while the
+	 * coefficients get dezigzagged while decoding them. */
+	int i;
 	const unsigned char *zz = zigzag;
 
-	for (i = 0; i < 8; i++)
-		for (j = 0; j < 8; j++)
-			*qtable++ = ref_table[*zz++] * aanscalefactor[i] * aanscalefactor[j];
-
+	for (i = 0; i < 64; i++)
+		*qtable++ = ref_table[*zz++];
 }
 
 static int parse_DQT(struct jdec_private *priv, const unsigned char *stream)
 {
 	int qi;
-	float *table;
+	int16_t *table;
 	const unsigned char *dqt_block_end;
 
 	trace("> DQT marker\n");
@@ -2101,6 +2167,8 @@ void tinyjpeg_free(struct jdec_private *priv)
 	}
 	priv->tmp_buf_y_size = 0;
 	free(priv->stream_filtered);
+	free(priv->scaled_buf);
+	free(priv->rst_segments);
 	free(priv);
 }
 
@@ -2171,6 +2239,7 @@ static const convert_colorspace_fct convert_colorspace_grey[4] = {
 };
 
 int tinyjpeg_decode_planar(struct jdec_private *priv, int pixfmt);
+static int tinyjpeg_decode_scaled(struct jdec_private *priv, int pixfmt);
 
 /* This function parses and removes the special Pixart JPEG chunk headers */
 static int pixart_filter(struct jdec_private *priv, unsigned char *dest,
@@ -2231,6 +2300,142 @@ kernel: 0xff 0xff 0x00 0xff 0x96, and we skip one unknown byte */
 	error("Short Pixart JPEG frame\n");
 }
 
+/*
+ * Decoding of restart intervals in parallel
+ *
+ * Each restart interval starts with the DC predictions and the bit reservoir
+ * reset, so once we know where in the stream each interval starts they can
+ * all be decoded independently. The intervals get divided over the
+ * libv4lconvert threads, each thread decoding its intervals with its own copy
+ * of the decoder state.
+ */
+struct rst_decode_args {
+	struct jdec_private *priv;
+	decode_MCU_fct decode_MCU;
+	convert_colorspace_fct convert_to_pixfmt;
+	unsigned int mcus_per_row;
+	unsigned int *bytes_per_blocklines;
+	unsigned int *bytes_per_mcu;
+	int failed;
+};
+
+/**
+ * Find the start of the first @segments@ restart intervals of the scan,
+ * returns 0 when they are all there and the RST markers are in order.
+ */
+static int find_rst_segments(struct jdec_private *priv, int segments)
+{
+	const unsigned char *stream = priv->stream;
+	int found = 1, expected = priv->last_rst_marker_seen;
+
+	priv->rst_segments = (const unsigned char **)
+		v4lconvert_alloc_buffer(NULL,
+				segments * sizeof(*priv->rst_segments),
+				(unsigned char **)&priv->rst_segments,
+				&priv->rst_segments_bufsize);
+	if (!priv->rst_segments)
+		return -1;
+
+	priv->rst_segments[0] = stream;
+	while (found < segments) {
+		stream = memchr(stream, 0xff, priv->stream_end - stream);
+		if (!stream)
+			return -1;
+		/* Skip any padding ff byte (this is normal) */
+		while (stream < priv->stream_end && *stream == 0xff)
+			stream++;
+		if (stream >= priv->stream_end)
+			return -1;
+
+		if (*stream == 0x00) {
+			/* Stuffed 0xff in the entropy coded data */
+		} else if (*stream == RST + expected) {
+			priv->rst_segments[found++] = stream + 1;
+			expected = (expected + 1) & 7;
+		} else
+			return -1;
+		stream++;
+	}
+
+	return 0;
+}
+
+static void decode_rst_band(void *arg, int first_mcu, int mcus)
+{
+	struct rst_decode_args *args = arg;
+	struct jdec_private *priv;
+	unsigned int x, y;
+	int c, i, mcu;
+
+	priv = malloc(sizeof(*priv));
+	if (!priv) {
+		args->failed = 1;
+		return;
+	}
+	memcpy(priv, args->priv, sizeof(*priv));
+
+	if (setjmp(priv->jump_state)) {
+		args->failed = 1;
+		free(priv);
+		return;
+	}
+
+	for (i = 0; i < mcus; i++) {
+		mcu = first_mcu + i;
+		x = mcu % args->mcus_per_row;
+		y = mcu / args->mcus_per_row;
+
+		if (mcu % priv->restart_interval == 0) {
+			priv->stream = priv->rst_segments[mcu / priv->restart_interval];
+			resync(priv);
+		}
+		if (i == 0 || x == 0)
+			for (c = 0; c < COMPONENTS; c++)
+				priv->plane[c] = priv->components[c] +
+					y * args->bytes_per_blocklines[c] +
+					x * args->bytes_per_mcu[c];
+
+		args->decode_MCU(priv);
+		args->convert_to_pixfmt(priv);
+		for (c = 0; c < COMPONENTS; c++)
+			priv->plane[c] += args->bytes_per_mcu[c];
+	}
+
+	free(priv);
+}
+
+/**
+ * Decode the scan one restart interval at a time using multiple threads,
+ * returns 0 on success, -1 when this is not possible, or the data is
+ * corrupt, in which case the caller should decode the scan the normal way.
+ */
+static int decode_rst_segments(struct jdec_private *priv,
+		decode_MCU_fct decode_MCU, convert_colorspace_fct convert_to_pixfmt,
+		unsigned int xstride_by_mcu, unsigned int ystride_by_mcu,
+		unsigned int *bytes_per_blocklines, unsigned int *bytes_per_mcu)
+{
+	struct rst_decode_args args = {
+		priv, decode_MCU, convert_to_pixfmt,
+		(priv->width + xstride_by_mcu - 1) / xstride_by_mcu,
+		bytes_per_blocklines, bytes_per_mcu, 0
+	};
+	int mcus = args.mcus_per_row * (priv->height / ystride_by_mcu);
+
+	if (!priv->threads || v4lconvert_threads_get_count(priv->threads) < 2 ||
+	    priv->restart_interval <= 0 ||
+	    (priv->flags & TINYJPEG_FLAGS_PIXART_JPEG))
+		return -1;
+
+	if (find_rst_segments(priv, (mcus + priv->restart_interval - 1) /
+				    priv->restart_interval))
+		return -1;
+
+	v4lconvert_run_bands(priv->threads, decode_rst_band, &args, mcus,
+			     priv->restart_interval);
+
+	return args.failed ? -1 : 0;
+}
+
 /**
  * Decode and convert the jpeg image into @pixfmt@ image
  *
@@ -2248,6 +2453,9 @@ int tinyjpeg_decode(struct jdec_private *priv, int pixfmt)
 	if (setjmp(priv->jump_state))
 		return -1;
 
+	if (priv->scale > 1)
+		return tinyjpeg_decode_scaled(priv, pixfmt);
+
 	if (priv->flags & TINYJPEG_FLAGS_PLANAR_JPEG)
 		return tinyjpeg_decode_planar(priv, pixfmt);
 
@@ -2262,7 +2470,8 @@ int tinyjpeg_decode(struct jdec_private *priv, int pixfmt)
 		int length;
 
 		priv->stream_filtered =
-			v4lconvert_alloc_buffer(priv->stream_end - priv->stream,
+			v4lconvert_alloc_buffer(NULL,
+					priv->stream_end - priv->stream,
 					&priv->stream_filtered,
 					&priv->stream_filtered_bufsize);
 		if (!priv->stream_filtered)
@@ -2364,6 +2573,11 @@ int tinyjpeg_decode(struct jdec_private *priv, int pixfmt)
 	bytes_per_mcu[1] *= xstride_by_mcu / 8;
 	bytes_per_mcu[2] *= xstride_by_mcu / 8;
 
+	if (decode_rst_segments(priv, decode_MCU, convert_to_pixfmt,
+				xstride_by_mcu, ystride_by_mcu,
+				bytes_per_blocklines, bytes_per_mcu) == 0)
+		return 0;
+
 	/* Just the decode the image by macroblock (size is 8x8, 8x16, or 16x16) */
 	for (y = 0; y < priv->height / ystride_by_mcu; y++) {
 		//trace("Decoding row %d\n", y);
@@ -2629,6 +2843,218 @@ int tinyjpeg_decode_planar(struct jdec_private *priv, int pixfmt)
 	return 0;
 }
 
+/**
+ * IDCT of a block of component @c@ into a (8 / scale) x (8 / scale) block.
+ */
+static void idct_scaled(struct jdec_private *priv, int c, uint8_t *output_buf,
+		int stride, unsigned int scale)
+{
+	if (scale == 1)
+		IDCT(&priv->component_infos[c], output_buf, stride);
+	else
+		tinyjpeg_idct_int_scaled(&priv->component_infos[c], output_buf,
+					 stride, scale);
+}
+
+/**
+ * Decode the image at 1/scale of its size, using reduced size IDCTs.
+ *
+ * Each component gets decoded into a plane at its own (scaled) resolution,
+ * these are then converted into @pixfmt@. Where possible the planes are the
+ * destination buffers themselves.
+ */
+static int tinyjpeg_decode_scaled(struct jdec_private *priv, int pixfmt)
+{
+	unsigned int scale = priv->scale, cscale, bs, cbs;
+	unsigned int width = priv->width / scale;
+	unsigned int height = priv->height / scale;
+	unsigned int hfactor, vfactor, hsub, vsub, cwidth, cheight;
+	unsigned int c, x, y, h, v, xstep, ystep;
+	uint8_t *plane[COMPONENTS], *p;
+	const uint8_t *s, *Y, *Cb, *Cr;
+
+	if (scale != 2 && scale != 4 && scale != 8)
+		error("Unsupported scale 1/%u\n", scale);
+	if (priv->flags & TINYJPEG_FLAGS_PIXART_JPEG)
+		error("Scaled decoding not supported for PIXART JPEG's\n");
+
+	if (priv->flags & TINYJPEG_FLAGS_PLANAR_JPEG) {
+		hfactor = 2;
+		vfactor = 2;
+	} else {
+		hfactor = priv->component_infos[cY].Hfactor;
+		vfactor = priv->component_infos[cY].Vfactor;
+	}
+	if (hfactor < 1 || hfactor > 2 || vfactor < 1 || vfactor > 2)
+		error("Unsupported sampling factors %ux%u\n", hfactor, vfactor);
+
+	/* For RGB output decode 2x2 subsampled chroma at twice the scale of Y,
+	   which gives us chroma at the resolution of Y without upsampling */
+	cscale = scale;
+	hsub = hfactor;
+	vsub = vfactor;
+	if ((pixfmt == TINYJPEG_FMT_RGB24 || pixfmt == TINYJPEG_FMT_BGR24) &&
+	    hfactor == 2 && vfactor == 2) {
+		cscale = scale / 2;
+		hsub = 1;
+		vsub = 1;
+	}
+	bs = 8 / scale;
+	cbs = 8 / cscale;
+	cwidth = width / hsub;
+	cheight = height / vsub;
+
+	priv->scaled_buf = v4lconvert_alloc_buffer(NULL, width * height +
+					2 * cwidth * cheight,
+					&priv->scaled_buf,
+					&priv->scaled_buf_size);
+	if (!priv->scaled_buf)
+		error("Out of memory!\n");
+	plane[cY] = priv->scaled_buf;
+	plane[cCb] = plane[cY] + width * height;
+	plane[cCr] = plane[cCb] + cwidth * cheight;
+
+	switch (pixfmt) {
+	case TINYJPEG_FMT_YUV420P:
+		plane[cY] = priv->components[0];
+		if (hfactor == 2 && vfactor == 2) {
+			plane[cCb] = priv->components[1];
+			plane[cCr] = priv->components[2];
+		}
+		break;
+	case TINYJPEG_FMT_GREY:
+		plane[cY] = priv->components[0];
+		break;
+	case TINYJPEG_FMT_RGB24:
+	case TINYJPEG_FMT_BGR24:
+		break;
+	default:
+		error("Bad pixel format\n");
+	}
+
+	resync(priv);
+
+	if (priv->flags & TINYJPEG_FLAGS_PLANAR_JPEG) {
+		/* Each component is in a scan of its own */
+		for (y = 0; y < height / bs; y++) {
+			for (x = 0; x < width / bs; x++) {
+				process_Huffman_data_unit(priv, cY);
+				idct_scaled(priv, cY,
+					    plane[cY] + (y * width + x) * bs,
+					    width, scale);
+			}
+		}
+		for (c = cCb; c <= cCr; c++) {
+			priv->stream -= (priv->nbits_in_reservoir / 8);
+			resync(priv);
+			if (find_next_sos_marker(priv) < 0)
+				return -1;
+			if (parse_SOS(priv, priv->stream) < 0)
+				return -1;
+
+			for (y = 0; y < cheight / cbs; y++) {
+				for (x = 0; x < cwidth / cbs; x++) {
+					process_Huffman_data_unit(priv, c);
+					idct_scaled(priv, c,
+						    plane[c] + (y * cwidth + x) * cbs,
+						    cwidth, cscale);
+				}
+			}
+		}
+	} else {
+		for (y = 0; y < priv->height / (8 * vfactor); y++) {
+			for (x = 0; x < priv->width / (8 * hfactor); x++) {
+				p = plane[cY] + (y * vfactor * width + x * hfactor) * bs;
+				for (v = 0; v < vfactor; v++) {
+					for (h = 0; h < hfactor; h++) {
+						process_Huffman_data_unit(priv, cY);
+						idct_scaled(priv, cY,
+							    p + (v * width + h) * bs,
+							    width, scale);
+					}
+				}
+				for (c = cCb; c <= cCr; c++) {
+					process_Huffman_data_unit(priv, c);
+					if (pixfmt == TINYJPEG_FMT_GREY)
+						continue;
+					idct_scaled(priv, c,
+						    plane[c] + (y * cwidth + x) * cbs,
+						    cwidth, cscale);
+				}
+				if (priv->restarts_to_go > 0) {
+					priv->restarts_to_go--;
+					if (priv->restarts_to_go == 0) {
+						priv->stream -= (priv->nbits_in_reservoir / 8);
+						resync(priv);
+						if (find_next_rst_marker(priv) < 0)
+							return -1;
+					}
+				}
+			}
+		}
+	}
+
+#define SCALEBITS       10
+#define ONE_HALF        (1UL << (SCALEBITS - 1))
+#define FIX(x)          ((int)((x) * (1UL << SCALEBITS) + 0.5))
+
+	switch (pixfmt) {
+	case TINYJPEG_FMT_YUV420P:
+		if (plane[cCb] == priv->components[1])
+			break;
+
+		/* Take every other chroma sample where not subsampled */
+		xstep = 2 / hfactor;
+		ystep = 2 / vfactor;
+		for (c = cCb; c <= cCr; c++) {
+			p = priv->components[c];
+			for (y = 0; y < height / 2; y++) {
+				s = plane[c] + y * ystep * cwidth;
+				for (x = 0; x < width / 2; x++)
+					*p++ = s[x * xstep];
+			}
+		}
+		break;
+
+	case TINYJPEG_FMT_RGB24:
+	case TINYJPEG_FMT_BGR24:
+		p = priv->components[0];
+		for (y = 0; y < height; y++) {
+			Y = plane[cY] + y * width;
+			Cb = plane[cCb] + (y / vsub) * cwidth;
+			Cr = plane[cCr] + (y / vsub) * cwidth;
+			for (x = 0; x < width; x++) {
+				int l, cb, cr;
+				int r, g, b;
+
+				cb = Cb[x / hsub] - 128;
+				cr = Cr[x / hsub] - 128;
+				l = Y[x] << SCALEBITS;
+				r = (l + FIX(1.40200) * cr + ONE_HALF) >> SCALEBITS;
+				g = (l - FIX(0.34414) * cb - FIX(0.71414) * cr +
+				     ONE_HALF) >> SCALEBITS;
+				b = (l + FIX(1.77200) * cb + ONE_HALF) >> SCALEBITS;
+				if (pixfmt == TINYJPEG_FMT_RGB24) {
+					*p++ = clamp(r);
+					*p++ = clamp(g);
+					*p++ = clamp(b);
+				} else {
+					*p++ = clamp(b);
+					*p++ = clamp(g);
+					*p++ = clamp(r);
+				}
+			}
+		}
+		break;
+	}
+
+#undef SCALEBITS
+#undef ONE_HALF
+#undef FIX
+
+	return 0;
+}
+
 const char *tinyjpeg_get_errorstring(struct jdec_private *priv)
 {
 	return priv->error_string;
@@ -2668,3 +3094,17 @@ int tinyjpeg_set_flags(struct jdec_private *priv, int flags)
 	return oldflags;
 }
 
+void tinyjpeg_set_threads(struct jdec_private *priv, struct v4lconvert_threads *threads)
+{
+	priv->threads = threads;
+}
+
+void tinyjpeg_set_cpu_flags(struct jdec_private *priv, int cpu_flags)
+{
+	priv->cpu_flags = cpu_flags;
+}
+
+void tinyjpeg_set_scale(struct jdec_private *priv, unsigned int scale)
+{
+	priv->scale = scale;
+}